@@ -128,6 +128,7 @@ void ConnectionsService::PrintConnections(
             "<th>Out/s</th>"
             "<th>OutBytes/m</th>"
             "<th>Out/m</th>"
+            "<th>HeldBytes</th>"
             "<th>Rtt/Var(ms)</th>"
             "<th>SocketId</th>"
             "</tr>\n";
@@ -138,7 +139,7 @@ void ConnectionsService::PrintConnections(
         }
         os << "SSL|Protocol |fd   |"
             "InBytes/s|In/s  |InBytes/m |In/m    |"
-            "OutBytes/s|Out/s |OutBytes/m|Out/m   |"
+            "OutBytes/s|Out/s |OutBytes/m|Out/m   |HeldBytes|"
             "Rtt/Var(ms)|SocketId\n";
     }
 
@@ -183,6 +184,7 @@ void ConnectionsService::PrintConnections(
                << min_width("-", 6) << bar
                << min_width("-", 10) << bar
                << min_width("-", 8) << bar
+               << min_width("-", 9) << bar
                << min_width("-", 11) << bar;
         } else {
             // Get name of the protocol. In principle we can dynamic_cast the
@@ -258,6 +260,7 @@ void ConnectionsService::PrintConnections(
                << min_width(stat.out_num_messages_s, 6) << bar
                << min_width(stat.out_size_m, 10) << bar
                << min_width(stat.out_num_messages_m, 8) << bar
+               << min_width(ptr->held_bytes(), 9) << bar
                << min_width(rtt_display, 11) << bar;
         }
 
@@ -18,6 +18,7 @@
 #include <gflags/gflags.h>
 #include "butil/files/file_enumerator.h"
 #include "butil/file_util.h"                     // butil::FilePath
+#include "butil/iobuf_profiler.h"
 #include "brpc/log.h"
 #include "brpc/controller.h"
 #include "brpc/server.h"
@@ -45,7 +46,7 @@ DEFINE_int32(max_profiling_seconds, 300, "upper limit of running time of profile
 BRPC_VALIDATE_GFLAG(max_profiling_seconds, NonNegativeInteger);
 
 DEFINE_int32(max_profiles_kept, 32,
-             "max profiles kept for cpu/heap/growth/contention respectively");
+             "max profiles kept for cpu/heap/growth/contention/iobuf respectively");
 BRPC_VALIDATE_GFLAG(max_profiles_kept, PassValidate);
 
 static const char* const PPROF_FILENAME = "pprof.pl";
@@ -77,6 +78,12 @@ struct ProfilingResult {
 
 static bool g_written_pprof_perl = false;
 
+// Blocks sampled before can still be viewed after sampling is turned off.
+static bool IsIOBufProfilerEnabled() {
+    return butil::iobuf::block_sampling_rate() != 0 ||
+        butil::iobuf::sampled_block_count() != 0;
+}
+
 struct ProfilingEnvironment {
     pthread_mutex_t mutex;
     int64_t cur_id;
@@ -86,7 +93,8 @@ struct ProfilingEnvironment {
 };
 
 // Different ProfilingType have different env.
-static ProfilingEnvironment g_env[4] = {
+static ProfilingEnvironment g_env[5] = {
+    { PTHREAD_MUTEX_INITIALIZER, 0, NULL, NULL, NULL },
     { PTHREAD_MUTEX_INITIALIZER, 0, NULL, NULL, NULL },
     { PTHREAD_MUTEX_INITIALIZER, 0, NULL, NULL, NULL },
     { PTHREAD_MUTEX_INITIALIZER, 0, NULL, NULL, NULL },
@@ -699,6 +707,24 @@ static void DoProfiling(ProfilingType type,
                 HTTP_STATUS_INTERNAL_SERVER_ERROR);
             return NotifyWaiters(type, cntl, view);
         }
+    } else if (type == PROFILING_IOBUF) {
+        if (!IsIOBufProfilerEnabled()) {
+            os << "IOBuf profiler is not enabled (-iobuf_sampling_rate is 0)."
+               << (use_html ? "</body></html>" : "\n");
+            os.move_to(resp);
+            cntl->http_response().set_status_code(HTTP_STATUS_FORBIDDEN);
+            return NotifyWaiters(type, cntl, view);
+        }
+        std::string obj;
+        butil::iobuf::dump_block_profile(&obj);
+        if (!WriteSmallFile(prof_name, obj)) {
+            os << "Fail to write " << prof_name
+               << (use_html ? "</body></html>" : "\n");
+            os.move_to(resp);
+            cntl->http_response().set_status_code(
+                HTTP_STATUS_INTERNAL_SERVER_ERROR);
+            return NotifyWaiters(type, cntl, view);
+        }
     } else {
         os << "Unknown ProfilingType=" << type
            << (use_html ? "</body></html>" : "\n");
@@ -741,6 +767,11 @@ static void StartProfiling(ProfilingType type,
         }
     } else if (type == PROFILING_GROWTH) {
         enabled = IsHeapProfilerEnabled();
+    } else if (type == PROFILING_IOBUF) {
+        enabled = IsIOBufProfilerEnabled();
+        if (!enabled) {
+            extra_desc = " (-iobuf_sampling_rate is 0)";
+        }
     }
     const char* const type_str = ProfilingType2String(type);
     
@@ -1077,6 +1108,14 @@ void HotspotsService::contention(
     return StartProfiling(PROFILING_CONTENTION, cntl_base, done);
 }
 
+void HotspotsService::iobuf(
+    ::google::protobuf::RpcController* cntl_base,
+    const ::brpc::HotspotsRequest*,
+    ::brpc::HotspotsResponse*,
+    ::google::protobuf::Closure* done) {
+    return StartProfiling(PROFILING_IOBUF, cntl_base, done);
+}
+
 void HotspotsService::cpu_non_responsive(
     ::google::protobuf::RpcController* cntl_base,
     const ::brpc::HotspotsRequest*,
@@ -1109,6 +1148,14 @@ void HotspotsService::contention_non_responsive(
     return DoProfiling(PROFILING_CONTENTION, cntl_base, done);
 }
 
+void HotspotsService::iobuf_non_responsive(
+    ::google::protobuf::RpcController* cntl_base,
+    const ::brpc::HotspotsRequest*,
+    ::brpc::HotspotsResponse*,
+    ::google::protobuf::Closure* done) {
+    return DoProfiling(PROFILING_IOBUF, cntl_base, done);
+}
+
 void HotspotsService::GetTabInfo(TabInfoList* info_list) const {
     TabInfo* info = info_list->add();
     info->path = "/hotspots/cpu";
@@ -1122,6 +1169,9 @@ void HotspotsService::GetTabInfo(TabInfoList* info_list) const {
     info = info_list->add();
     info->path = "/hotspots/contention";
     info->tab_name = "contention";
+    info = info_list->add();
+    info->path = "/hotspots/iobuf";
+    info->tab_name = "iobuf";
 }
 
 } // namespace brpc
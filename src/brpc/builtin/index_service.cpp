@@ -17,6 +17,7 @@
 #include <gflags/gflags.h>                  // DECLARE_xxx
 #include <google/protobuf/descriptor.h>
 #include "butil/time.h"                      // gettimeofday_us
+#include "butil/iobuf_profiler.h"            // block_sampling_rate
 #include "brpc/server.h"                    // Server
 #include "brpc/builtin/index_service.h"
 #include "brpc/builtin/status_service.h"
@@ -109,6 +110,8 @@ void IndexService::default_method(::google::protobuf::RpcController* controller,
            << SP << Path("/vars/rpc_server*_count;iobuf_blo$k_*", html_addr)
            <<  " : List multiple bvars with glob patterns"
             " (Use $ instead of ? to match single character)" << NL
+           << Path("/brpc_metrics", html_addr)
+           << " : Numeric bvars in the text format of prometheus" << NL
             
            << Path("/rpcz", html_addr) << " : Recent RPC calls"
            << (!FLAGS_enable_rpcz ? "(disabled)" : "") << NL
@@ -140,7 +143,11 @@ void IndexService::default_method(::google::protobuf::RpcController* controller,
            << (!IsHeapProfilerEnabled() ? " (disabled)" : "") << NL
            << Path("/hotspots/growth", html_addr)
            << " : Profiling growth of heap"
-           << (!IsHeapProfilerEnabled() ? " (disabled)" : "") << NL;
+           << (!IsHeapProfilerEnabled() ? " (disabled)" : "") << NL
+           << Path("/hotspots/iobuf", html_addr)
+           << " : Profiling memory held by IOBuf"
+           << (butil::iobuf::block_sampling_rate() == 0 ? " (disabled)" : "")
+           << NL;
     }
     os << "curl -H 'Content-Type: application/json' -d 'JSON' " << my_addr
        << "/ServiceName/MethodName : Call method by http+json" << NL
@@ -0,0 +1,389 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>                         // strlen
+#include <sstream>
+#include <string>
+#include "butil/macros.h"                   // arraysize
+#include "bvar/bvar.h"
+#include "brpc/controller.h"                // Controller
+#include "brpc/closure_guard.h"             // ClosureGuard
+#include "brpc/builtin/prometheus_metrics_service.h"
+
+
+namespace brpc {
+
+// Suffixes of variables exposed by LatencyRecorder which are combined into
+// a summary. Indexes of the quantiles are [0, NQUANTILE).
+static const struct {
+    const char* suffix;
+    const char* quantile;
+} s_latency_suffixes[] = {
+    { "_latency_50", "0.5" },
+    { "_latency_90", "0.9" },
+    { "_latency_99", "0.99" },
+    { "_latency_999", "0.999" },
+    { "_latency_9999", "0.9999" },
+    { "_latency", NULL },
+    { "_count", NULL },
+};
+static const size_t NQUANTILE = 5;
+static const size_t LATENCY_INDEX = 5;
+static const size_t COUNT_INDEX = 6;
+static const size_t NSUFFIX = arraysize(s_latency_suffixes);
+
+// Prometheus requires names to match [a-zA-Z_:][a-zA-Z0-9_:]*
+static bool IsValidMetricName(const butil::StringPiece& name) {
+    if (name.empty() || (name[0] >= '0' && name[0] <= '9')) {
+        return false;
+    }
+    for (size_t i = 0; i < name.size(); ++i) {
+        const char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == ':')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Non-numeric bvars (strings, vectors, cdf ...) are not exported.
+static bool IsNumber(const butil::StringPiece& s) {
+    bool has_digit = false;
+    for (size_t i = 0; i < s.size(); ++i) {
+        const char c = s[i];
+        if (c >= '0' && c <= '9') {
+            has_digit = true;
+        } else if (c == '-' || c == '+') {
+            if (i != 0 && s[i - 1] != 'e' && s[i - 1] != 'E') {
+                return false;
+            }
+        } else if (c != '.' && c != 'e' && c != 'E') {
+            return false;
+        }
+    }
+    return has_digit;
+}
+
+// Labels parsed from names are label1="value1",label2="value2". Values of
+// multi-dimensional bvars are escaped already while names of other bvars
+// are arbitrary, so unescape the values and escape them again into `out'
+// with the helper shared with bvar. Returns false if `labels' is malformed.
+static bool NormalizeLabels(const butil::StringPiece& labels,
+                            std::string* out) {
+    out->clear();
+    std::string value;
+    size_t i = 0;
+    while (i < labels.size()) {
+        const size_t eq_pos = labels.find('=', i);
+        if (eq_pos == butil::StringPiece::npos ||
+            eq_pos + 1 >= labels.size() || labels[eq_pos + 1] != '"') {
+            return false;
+        }
+        const butil::StringPiece label = labels.substr(i, eq_pos - i);
+        if (!IsValidMetricName(label)) {
+            return false;
+        }
+        value.clear();
+        size_t j = eq_pos + 2;
+        for (; j < labels.size(); ++j) {
+            const char c = labels[j];
+            if (c == '\\' && j + 1 < labels.size()) {
+                const char next = labels[j + 1];
+                if (next == '\\' || next == '"' || next == 'n') {
+                    value.push_back(next == 'n' ? '\n' : next);
+                    ++j;
+                    continue;
+                }
+            } else if (c == '"' &&
+                       (j + 1 == labels.size() || labels[j + 1] == ',')) {
+                break;
+            }
+            value.push_back(c);
+        }
+        if (j == labels.size()) {
+            // Not closed.
+            return false;
+        }
+        if (!out->empty()) {
+            out->push_back(',');
+        }
+        out->append(label.data(), label.size());
+        out->append("=\"");
+        bvar::append_escaped_label_value(out, value);
+        out->push_back('"');
+        i = j + 2;
+    }
+    return true;
+}
+
+// Write dumped bvars into the appender right away. Variables exposed by a
+// LatencyRecorder are written as a summary when its quantiles are dumped:
+// the count dumped before them (names are sorted) is looked up by name for
+// Variables, and is dumped right after them by MultiDimension<LatencyRecorder>.
+class PrometheusMetricsDumper : public bvar::Dumper {
+public:
+    explicit PrometheusMetricsDumper(butil::IOBufAppender* app)
+        : _app(app)
+        , _dumping_mvariables(false)
+        , _skip_last_metric(false)
+        , _is_recorder(false) {}
+
+    bool dump(const std::string& name, const butil::StringPiece& desc);
+
+    // Call this before dumping MVariables. Metrics of MVariables with the
+    // same names as Variables are skipped, because samples of one metric
+    // must be contiguous and preceded by exactly one TYPE line.
+    void BeginMVariables();
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(PrometheusMetricsDumper);
+
+    // Returns true if the variable is written or skipped as a part of the
+    // summary of a LatencyRecorder.
+    bool DumpLatencyRecorderSuffix(const butil::StringPiece& metric,
+                                   const butil::StringPiece& labels,
+                                   const butil::StringPiece& desc);
+    bool IsLatencyRecorder(const butil::StringPiece& prefix, size_t index);
+    // Describe the Variable named `name' into _os, returns 0 on success.
+    int DescribeVariable(const std::string& name);
+    // Write the TYPE line if `metric' is different from the last one.
+    // Returns false if samples of the metric should be skipped.
+    bool BeginMetric(const butil::StringPiece& metric, const char* type);
+    void WriteHeader(const butil::StringPiece& metric, const char* type);
+    void WriteValue(const butil::StringPiece& metric,
+                    const butil::StringPiece& labels,
+                    const char* quantile,
+                    const butil::StringPiece& value);
+
+    butil::IOBufAppender* _app;
+    bool _dumping_mvariables;
+    std::string _last_metric;
+    bool _skip_last_metric;
+    // Prefix of the LatencyRecorder checked last time.
+    std::string _recorder_prefix;
+    bool _is_recorder;
+    // Buffers reused for names, labels and values.
+    std::string _name;
+    std::string _labels;
+    std::string _escaped;
+    std::ostringstream _os;
+};
+
+void PrometheusMetricsDumper::BeginMVariables() {
+    _dumping_mvariables = true;
+    _last_metric.clear();
+    _skip_last_metric = false;
+    _recorder_prefix.clear();
+    _is_recorder = false;
+}
+
+int PrometheusMetricsDumper::DescribeVariable(const std::string& name) {
+    _os.str("");
+    return bvar::Variable::describe_exposed(name, _os);
+}
+
+bool PrometheusMetricsDumper::BeginMetric(const butil::StringPiece& metric,
+                                          const char* type) {
+    if (metric == _last_metric) {
+        return !_skip_last_metric;
+    }
+    metric.CopyToString(&_last_metric);
+    // Variables are dumped before MVariables.
+    _skip_last_metric =
+        (_dumping_mvariables && DescribeVariable(_last_metric) == 0);
+    if (_skip_last_metric) {
+        return false;
+    }
+    WriteHeader(metric, type);
+    return true;
+}
+
+void PrometheusMetricsDumper::WriteHeader(const butil::StringPiece& metric,
+                                          const char* type) {
+    _app->append("# HELP ");
+    _app->append(metric);
+    _app->append("\n# TYPE ");
+    _app->append(metric);
+    _app->push_back(' ');
+    _app->append(type);
+    _app->push_back('\n');
+}
+
+void PrometheusMetricsDumper::WriteValue(const butil::StringPiece& metric,
+                                         const butil::StringPiece& labels,
+                                         const char* quantile,
+                                         const butil::StringPiece& value) {
+    _app->append(metric);
+    if (!labels.empty() || quantile) {
+        _app->push_back('{');
+        _app->append(labels);
+        if (quantile) {
+            if (!labels.empty()) {
+                _app->push_back(',');
+            }
+            _app->append("quantile=\"");
+            _escaped.clear();
+            bvar::append_escaped_label_value(&_escaped, quantile);
+            _app->append(_escaped);
+            _app->push_back('"');
+        }
+        _app->push_back('}');
+    }
+    _app->push_back(' ');
+    _app->append(value);
+    _app->push_back('\n');
+}
+
+bool PrometheusMetricsDumper::IsLatencyRecorder(
+    const butil::StringPiece& prefix, size_t index) {
+    if (_dumping_mvariables) {
+        // MultiDimension<LatencyRecorder> dumps quantiles of all labels
+        // first, followed by the counts and the average latencies.
+        if (index < NQUANTILE) {
+            prefix.CopyToString(&_recorder_prefix);
+            _is_recorder = true;
+        }
+        return _is_recorder && prefix == _recorder_prefix;
+    }
+    if (prefix != _recorder_prefix) {
+        prefix.CopyToString(&_recorder_prefix);
+        _name = _recorder_prefix;
+        _name.append("_latency");
+        _is_recorder = (DescribeVariable(_name) == 0);
+        if (_is_recorder) {
+            _name.append("_99");
+            _is_recorder = (DescribeVariable(_name) == 0);
+        }
+    }
+    return _is_recorder;
+}
+
+bool PrometheusMetricsDumper::DumpLatencyRecorderSuffix(
+    const butil::StringPiece& metric, const butil::StringPiece& labels,
+    const butil::StringPiece& desc) {
+    size_t index = 0;
+    for (; index < NSUFFIX; ++index) {
+        if (metric.ends_with(s_latency_suffixes[index].suffix)) {
+            break;
+        }
+    }
+    if (index == NSUFFIX) {
+        return false;
+    }
+    butil::StringPiece prefix = metric;
+    prefix.remove_suffix(strlen(s_latency_suffixes[index].suffix));
+    if (!IsLatencyRecorder(prefix, index)) {
+        return false;
+    }
+    if (index == LATENCY_INDEX) {
+        // Average latencies of recent seconds can't be converted into the
+        // accumulated _sum, which is omitted. The name is taken by the
+        // summary as well.
+        return true;
+    }
+    if (index == COUNT_INDEX && !_dumping_mvariables) {
+        // Written along with the quantiles.
+        return true;
+    }
+    // prefix_latency{quantile="0.99"} and prefix_latency_count.
+    prefix.CopyToString(&_name);
+    _name.append("_latency");
+    const bool first = (_name != _last_metric);
+    if (!BeginMetric(_name, "summary")) {
+        return true;
+    }
+    if (index == COUNT_INDEX) {
+        _name.append("_count");
+        WriteValue(_name, labels, NULL, desc);
+        return true;
+    }
+    if (first && !_dumping_mvariables) {
+        _name.erase(prefix.size());
+        _name.append("_count");
+        if (DescribeVariable(_name) == 0) {
+            const std::string count = _os.str();
+            if (IsNumber(count)) {
+                _name.insert(prefix.size(), "_latency");
+                WriteValue(_name, labels, NULL, count);
+            }
+        }
+        _name.assign(_last_metric);
+    }
+    WriteValue(_name, labels, s_latency_suffixes[index].quantile, desc);
+    return true;
+}
+
+bool PrometheusMetricsDumper::dump(const std::string& name,
+                                   const butil::StringPiece& desc) {
+    if (!IsNumber(desc)) {
+        return true;
+    }
+    // Names of multi-dimensional bvars are metric{labels}
+    butil::StringPiece metric(name);
+    butil::StringPiece labels;
+    const size_t brace_pos = metric.find('{');
+    if (brace_pos != butil::StringPiece::npos) {
+        if (metric[metric.size() - 1] != '}' ||
+            !NormalizeLabels(metric.substr(brace_pos + 1,
+                                           metric.size() - brace_pos - 2),
+                             &_labels)) {
+            return true;
+        }
+        labels = _labels;
+        metric.remove_suffix(metric.size() - brace_pos);
+    }
+    if (!IsValidMetricName(metric)) {
+        return true;
+    }
+    if (DumpLatencyRecorderSuffix(metric, labels, desc)) {
+        return true;
+    }
+    if (BeginMetric(metric, "gauge")) {
+        WriteValue(metric, labels, NULL, desc);
+    }
+    return true;
+}
+
+int DumpPrometheusMetricsToIOBuf(butil::IOBuf* out) {
+    butil::IOBufAppender appender;
+    PrometheusMetricsDumper dumper(&appender);
+    bvar::DumpOptions opt;
+    opt.quote_string = false;
+    if (bvar::Variable::dump_exposed(&dumper, &opt) < 0) {
+        return -1;
+    }
+    dumper.BeginMVariables();
+    if (bvar::MVariable::dump_exposed(&dumper, &opt) < 0) {
+        return -1;
+    }
+    out->append(butil::IOBuf::Movable(appender.buf()));
+    return 0;
+}
+
+void PrometheusMetricsService::default_method(
+    ::google::protobuf::RpcController* cntl_base,
+    const ::brpc::MetricsRequest*,
+    ::brpc::MetricsResponse*,
+    ::google::protobuf::Closure* done) {
+    ClosureGuard done_guard(done);
+    Controller *cntl = static_cast<Controller*>(cntl_base);
+    cntl->http_response().set_content_type("text/plain; version=0.0.4");
+    if (DumpPrometheusMetricsToIOBuf(&cntl->response_attachment()) != 0) {
+        cntl->SetFailed("Fail to dump metrics");
+        return;
+    }
+}
+
+} // namespace brpc
@@ -0,0 +1,42 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BRPC_PROMETHEUS_METRICS_SERVICE_H
+#define BRPC_PROMETHEUS_METRICS_SERVICE_H
+
+#include "butil/iobuf.h"
+#include "brpc/builtin_service.pb.h"
+
+
+namespace brpc {
+
+// Export bvars in the text format of prometheus at /brpc_metrics
+class PrometheusMetricsService : public brpc_metrics {
+public:
+    void default_method(::google::protobuf::RpcController* cntl_base,
+                        const ::brpc::MetricsRequest* request,
+                        ::brpc::MetricsResponse* response,
+                        ::google::protobuf::Closure* done);
+};
+
+// Append numeric bvars and multi-dimensional bvars to `out' in the text
+// format of prometheus. Variables of LatencyRecorders are exported as
+// summaries.
+// Returns 0 on success, -1 otherwise.
+int DumpPrometheusMetricsToIOBuf(butil::IOBuf* out);
+
+} // namespace brpc
+
+
+#endif // BRPC_PROMETHEUS_METRICS_SERVICE_H
@@ -90,7 +90,10 @@ int Channel::InitChannelOptions(const ChannelOptions* options) {
         // connection_type.
         const bool has_error = _options.connection_type.has_error();
         
-        if (protocol->supported_connection_type & CONNECTION_TYPE_SINGLE) {
+        if ((protocol->supported_connection_type & CONNECTION_TYPE_SINGLE) &&
+            // http pipelines requests on single connection only when the
+            // connection_type is set explicitly.
+            _options.protocol != PROTOCOL_HTTP) {
             _options.connection_type = CONNECTION_TYPE_SINGLE;
         } else if (protocol->supported_connection_type & CONNECTION_TYPE_POOLED) {
             _options.connection_type = CONNECTION_TYPE_POOLED;
@@ -363,6 +366,16 @@ void Channel::CallMethod(const google::protobuf::MethodDescriptor* method,
         cntl->set_max_retry(0);
         cntl->set_backup_request_ms(-1);
     }
+    if (cntl->is_request_written_progressively()) {
+        if (cntl->_request_protocol != PROTOCOL_HTTP) {
+            cntl->SetFailed(EREQUEST, "Only http supports writing request "
+                            "progressively");
+            return cntl->HandleSendFailed();
+        }
+        // Chunks written into the ProgressiveAttachment can't be resent.
+        cntl->set_max_retry(0);
+        cntl->set_backup_request_ms(-1);
+    }
 
     if (cntl->backup_request_ms() >= 0 &&
         (cntl->backup_request_ms() < cntl->timeout_ms() ||
@@ -40,6 +40,7 @@
 #include "brpc/retry_policy.h"
 #include "brpc/stream_impl.h"
 #include "brpc/policy/streaming_rpc_protocol.h" // FIXME
+#include "brpc/policy/thrift_protocol.h"   // OnThriftFramedCallEnded
 #include "brpc/rpc_dump.pb.h"
 #include "brpc/details/usercode_backup_pool.h"  // RunUserCode
 #include "brpc/mongo_service_adaptor.h"
@@ -256,6 +257,7 @@ Controller::Call::Call(Controller::Call* rhs)
     : nretry(rhs->nretry)
     , need_feedback(rhs->need_feedback)
     , touched_by_stream_creator(rhs->touched_by_stream_creator)
+    , pipelined(rhs->pipelined)
     , peer_id(rhs->peer_id)
     , begin_time_us(rhs->begin_time_us)
     , sending_sock(rhs->sending_sock.release()) {
@@ -264,6 +266,7 @@ Controller::Call::Call(Controller::Call* rhs)
     // will behave incorrectly.
     rhs->need_feedback = false;
     rhs->touched_by_stream_creator = false;
+    rhs->pipelined = false;
     rhs->peer_id = (SocketId)-1;
 }
 
@@ -275,6 +278,7 @@ void Controller::Call::Reset() {
     nretry = 0;
     need_feedback = false;
     touched_by_stream_creator = false;
+    pipelined = false;
     peer_id = (SocketId)-1;
     begin_time_us = 0;
     sending_sock.reset(NULL);
@@ -661,14 +665,20 @@ inline bool does_error_affect_main_socket(int error_code) {
 //      entire RPC (specified by c->FailedInline()).
 void Controller::Call::OnComplete(Controller* c, int error_code/*note*/,
                                   bool responded) {
-    switch (c->connection_type()) {
+    ConnectionType connection_type = c->connection_type();
+    if (pipelined) {
+        // The RPC may fall back to pooled connections after this call was
+        // issued on the pipelined socket, check IssueRPC().
+        connection_type = CONNECTION_TYPE_SINGLE;
+    }
+    switch (connection_type) {
     case CONNECTION_TYPE_UNKNOWN:
         break;
     case CONNECTION_TYPE_SINGLE:
         // Set main socket to be failed for connection refusal of streams.
         // "single" streams are often maintained in a separate SocketMap and
-        // different from the main socket as well.
-        if (c->_stream_creator != NULL &&
+        // different from the main socket as well, so are pipelined sockets.
+        if ((c->_stream_creator != NULL || pipelined) &&
             does_error_affect_main_socket(error_code) &&
             (sending_sock == NULL || sending_sock->id() != peer_id)) {
             Socket::SetFailed(peer_id);
@@ -716,6 +726,13 @@ void Controller::Call::OnComplete(Controller* c, int error_code/*note*/,
         }
         break;
     }
+    if (!responded && sending_sock != NULL &&
+        c->_request_protocol == PROTOCOL_THRIFT) {
+        // The connection correlates responses with calls by itself, forget
+        // the call whose response never comes back.
+        policy::OnThriftFramedCallEnded(
+            sending_sock.get(), c->_correlation_id.value + nretry + 1);
+    }
     if (ELOGOFF == error_code) {
         SocketUniquePtr sock;
         if (Socket::Address(peer_id, &sock) == 0) {
@@ -749,6 +766,11 @@ void Controller::EndRPC(const CompletionInfo& info) {
         bthread_timer_del(_timeout_id);
         _timeout_id = 0;
     }
+    if (_wpa != NULL) {
+        // The request was not sent, stop writes to the ProgressiveAttachment.
+        _wpa->MarkRPCAsDone(true);
+        _wpa.reset(NULL);
+    }
 
     // End _current_call and _unfinished_call.
     if (info.id == current_id() || info.id == _correlation_id) {
@@ -933,6 +955,7 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
 
     // Pick a target server for sending RPC
     _current_call.need_feedback = false;
+    _current_call.pipelined = false;
     SocketUniquePtr tmp_sock;
     if (SingleServer()) {
         // Don't use _current_call.peer_id which is set to -1 after construction
@@ -986,7 +1009,27 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
         }
     }
     // Handle connection type
-    if (_connection_type == CONNECTION_TYPE_SINGLE ||
+    if (is_request_written_progressively()) {
+        // The body may still be being written when the RPC ends, the
+        // connection can't be shared with or reused by other RPCs.
+        _connection_type = CONNECTION_TYPE_SHORT;
+    } else if (_connection_type == CONNECTION_TYPE_SINGLE &&
+               _stream_creator == NULL &&
+               _request_protocol == PROTOCOL_HTTP) {
+        if (tmp_sock->is_fallen_back_to_pooled() ||
+            is_response_read_progressively()) {
+            // Pipelined requests are not handled correctly by the server,
+            // or the progressively-read response would block responses
+            // after it.
+            _connection_type = CONNECTION_TYPE_POOLED;
+        } else {
+            // Pipeline the request on a socket other than the main socket,
+            // which may be closed by the server after any response.
+            _current_call.pipelined = true;
+        }
+    }
+    if ((_connection_type == CONNECTION_TYPE_SINGLE &&
+         !_current_call.pipelined) ||
         _stream_creator != NULL) { // let user decides the sending_socket
         // in the callback(according to connection_type) directly
         _current_call.sending_sock.reset(tmp_sock.release());
@@ -999,7 +1042,9 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
         _current_call.sending_sock->set_preferred_index(_preferred_index);
     } else {
         int rc = 0;
-        if (_connection_type == CONNECTION_TYPE_POOLED) {
+        if (_current_call.pipelined) {
+            rc = Socket::GetPipelinedSocket(tmp_sock.get(), &_current_call.sending_sock);
+        } else if (_connection_type == CONNECTION_TYPE_POOLED) {
             rc = Socket::GetPooledSocket(tmp_sock.get(), &_current_call.sending_sock);
         } else if (_connection_type == CONNECTION_TYPE_SHORT) {
             rc = Socket::GetShortSocket(tmp_sock.get(), &_current_call.sending_sock);
@@ -1104,6 +1149,17 @@ void Controller::IssueRPC(int64_t start_realtime_us) {
         // to confirm the credential data
         _current_call.sending_sock->SetAuthentication(rc);
     }
+    if (_wpa != NULL) {
+        // Chunks written into the ProgressiveAttachment follow the request.
+        if (rc == 0) {
+            SocketUniquePtr httpsock;
+            _current_call.sending_sock->ReAddress(&httpsock);
+            _wpa->MarkRequestAsSent(httpsock);
+        } else {
+            _wpa->MarkRPCAsDone(true);
+        }
+        _wpa.reset(NULL);
+    }
     CHECK_EQ(0, bthread_id_unlock(cid));
 }
 
@@ -1296,12 +1352,30 @@ Controller::CreateProgressiveAttachment(StopStyle stop_style) {
     return pb;
 }
 
+ProgressiveAttachment* Controller::CreateProgressiveRequestAttachment() {
+    if (has_progressive_writer()) {
+        LOG(ERROR) << "One controller can only have one ProgressiveAttachment";
+        return NULL;
+    }
+    if (_current_call.sending_sock != NULL) {
+        LOG(ERROR) << "The request is already sent";
+        return NULL;
+    }
+    // Bound to the connection after the request is sent, check IssueRPC().
+    SocketUniquePtr httpsock;
+    ProgressiveAttachment* pb = new ProgressiveAttachment(httpsock, false);
+    _wpa.reset(pb);
+    add_flag(FLAGS_REQUEST_WRITE_PROGRESSIVELY);
+    return pb;
+}
+
 void Controller::ReadProgressiveAttachmentBy(ProgressiveReader* r) {
     if (r == NULL) {
         LOG(FATAL) << "Param[r] is NULL";
         return;
     }
-    if (!is_response_read_progressively()) {
+    if (!is_response_read_progressively() &&
+        !is_request_read_progressively()) {
         return r->OnEndOfMessage(
             butil::Status(EINVAL, "Can't read progressive attachment from a "
                          "controller without calling "
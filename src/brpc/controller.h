@@ -90,6 +90,8 @@ class Controller : public google::protobuf::RpcController/*non-copyable*/ {
 friend class Channel;
 friend class ParallelChannel;
 friend class ParallelChannelDone;
+friend class RedisClusterChannel;
+friend class RedisClusterDone;
 friend class ControllerPrivateAccessor;
 friend class ServerPrivateAccessor;
 friend class SelectiveChannel;
@@ -116,6 +118,10 @@ friend void policy::ProcessMongoRequest(InputMessageBase*);
     static const uint32_t FLAGS_LOG_ID = (1 << 9); // log_id is set
     static const uint32_t FLAGS_REQUEST_CODE = (1 << 10);
     static const uint32_t FLAGS_PB_BYTES_TO_BASE64 = (1 << 11);
+    // The request carries a payload checksum, reply with one as well.
+    static const uint32_t FLAGS_PAYLOAD_CHECKSUM = (1 << 12);
+    static const uint32_t FLAGS_REQUEST_READ_PROGRESSIVELY = (1 << 13);
+    static const uint32_t FLAGS_REQUEST_WRITE_PROGRESSIVELY = (1 << 14);
     
 public:
     Controller();
@@ -239,7 +245,15 @@ public:
     // True if response_will_be_read_progressively() was called.
     bool is_response_read_progressively() const { return has_flag(FLAGS_READ_PROGRESSIVELY); }
 
-    // Read the remaining body after RPC:
+    // [Server-side] True if the http request is read progressively, namely
+    // the service was added with ServiceOptions.enable_progressive_read. The
+    // method is called after receiving headers, request_attachment() is
+    // empty and the body should be read by ReadProgressiveAttachmentBy().
+    bool is_request_read_progressively() const
+    { return has_flag(FLAGS_REQUEST_READ_PROGRESSIVELY); }
+
+    // Read the remaining body after RPC (or of the request being processed
+    // if is_request_read_progressively() is true at server-side):
     // - This function can only be called once.
     // - If user called response_will_be_read_progressively() but
     //   ReadProgressiveAttachmentBy(), controller will set a reader ignoring
@@ -252,6 +266,21 @@ public:
     
     // True if ReadProgressiveAttachmentBy() was ever called successfully.
     bool has_progressive_reader() const { return has_flag(FLAGS_PROGRESSIVE_READER); }
+
+    // Create a ProgressiveAttachment to write body of the http request in
+    // chunked encoding after the request is sent, so that large bodies are
+    // uploaded with bounded memory. Must be called before RPC and the http
+    // request must be HTTP/1.1 and not GET. request_attachment(), if not
+    // empty, is sent as the first chunk. Data written before the request is
+    // sent are buffered and Write() fails with EOVERCROWDED when too much
+    // data is buffered, write again later in that case. The body ends when
+    // all references to the returned object are released.
+    // Notice that the RPC is not retried, uses a short connection and its
+    // timeout includes time of writing the body.
+    ProgressiveAttachment* CreateProgressiveRequestAttachment();
+    // True if CreateProgressiveRequestAttachment() was called.
+    bool is_request_written_progressively() const
+    { return has_flag(FLAGS_REQUEST_WRITE_PROGRESSIVELY); }
     
     // RPC may fail with EOVERCROWDED if the socket to write is too full
     // (limited by -socket_max_unwritten_bytes). In some scenarios, user
@@ -523,6 +552,7 @@ private:
         int nretry;                // sent in nretry-th retry.
         bool need_feedback;        // The LB needs feedback.
         bool touched_by_stream_creator;
+        bool pipelined;            // sent on the pipelined socket of peer_id
         SocketId peer_id;          // main server id
         int64_t begin_time_us;     // sent real time.
         // The actual `Socket' for sending RPC. It's socket id will be
@@ -72,6 +72,20 @@ public:
         return *this;
     }
 
+    ControllerPrivateAccessor &set_request_read_progressively(bool on) {
+        _cntl->set_flag(Controller::FLAGS_REQUEST_READ_PROGRESSIVELY, on);
+        return *this;
+    }
+
+    ControllerPrivateAccessor &set_payload_checksum(bool payload_checksum) {
+        _cntl->set_flag(Controller::FLAGS_PAYLOAD_CHECKSUM, payload_checksum);
+        return *this;
+    }
+
+    bool payload_checksum() const {
+        return _cntl->has_flag(Controller::FLAGS_PAYLOAD_CHECKSUM);
+    }
+
     ControllerPrivateAccessor &set_remote_side(const butil::EndPoint& pt) {
         _cntl->_remote_side = pt;
         return *this;
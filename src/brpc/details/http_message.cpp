@@ -16,6 +16,7 @@
 //          Ge,Jun (gejun@baidu.com)
 
 #include <cstdlib>
+#include <strings.h>                            // strcasecmp
 
 #include <string>                               // std::string
 #include <iostream>
@@ -175,7 +176,7 @@ int HttpMessage::on_headers_complete(http_parser *parser) {
             uri.SetHostAndPort(*host_header);
         }
     }
-    return 0;
+    return http_message->OnHeadersComplete();
 }
 
 int HttpMessage::UnlockAndFlushToBodyReader(std::unique_lock<butil::Mutex>& mu) {
@@ -511,6 +512,37 @@ std::ostream& operator<<(std::ostream& os, const http_parser& parser) {
 
 #define BRPC_CRLF "\r\n"
 
+static const char s_hex_map[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8',
+                                  '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+inline void AppendHttpChunkHead(butil::IOBuf* buf, size_t size) {
+    char tmp[32];
+    int i = (int)sizeof(tmp);
+    tmp[--i] = '\n';
+    tmp[--i] = '\r';
+    do {
+        tmp[--i] = s_hex_map[size & 0xF];
+        size >>= 4;
+    } while (size != 0);
+    buf->append(tmp + i, sizeof(tmp) - i);
+}
+
+void AppendHttpChunk(butil::IOBuf* buf, const butil::IOBuf& data) {
+    AppendHttpChunkHead(buf, data.size());
+    buf->append(data);
+    buf->append(BRPC_CRLF, 2);
+}
+
+void AppendHttpChunk(butil::IOBuf* buf, const void* data, size_t n) {
+    AppendHttpChunkHead(buf, n);
+    buf->append(data, n);
+    buf->append(BRPC_CRLF, 2);
+}
+
+void AppendLastHttpChunk(butil::IOBuf* buf) {
+    buf->append("0" BRPC_CRLF BRPC_CRLF, 5);
+}
+
 // Request format
 // Request       = Request-Line              ; Section 5.1
 //                 *(( general-header        ; Section 4.5
@@ -539,11 +571,16 @@ void SerializeHttpRequest(butil::IOBuf* request,
     uri.PrintWithoutHost(os); // host is sent by "Host" header.
     os << " HTTP/" << h->major_version() << '.'
        << h->minor_version() << BRPC_CRLF;
+    const std::string* transfer_encoding = h->GetHeader("Transfer-Encoding");
+    const bool chunked = (transfer_encoding != NULL &&
+                          strcasecmp(transfer_encoding->c_str(), "chunked") == 0);
     if (h->method() != HTTP_METHOD_GET) {
         h->RemoveHeader("Content-Length");
         // Never use "Content-Length" set by user.
-        os << "Content-Length: " << (content ? content->length() : 0)
-           << BRPC_CRLF;
+        if (!chunked) {
+            os << "Content-Length: " << (content ? content->length() : 0)
+               << BRPC_CRLF;
+        }
     }
     //rfc 7230#section-5.4:
     //A client MUST send a Host header field in all HTTP/1.1 request
@@ -594,7 +631,14 @@ void SerializeHttpRequest(butil::IOBuf* request,
     os << BRPC_CRLF;  // CRLF before content
     os.move_to(*request);
     if (h->method() != HTTP_METHOD_GET && content) {
-        request->append(*content);
+        if (!chunked) {
+            request->append(*content);
+        } else {
+            if (!content->empty()) {
+                AppendHttpChunk(request, *content);
+            }
+            AppendLastHttpChunk(request);
+        }
     }
 }
 
@@ -45,7 +45,7 @@ public:
     // If read_body_progressively is true, the body will be read progressively
     // by using SetBodyReader().
     explicit HttpMessage(bool read_body_progressively = false);
-    ~HttpMessage();
+    virtual ~HttpMessage();
 
     const butil::IOBuf &body() const { return _body; }
     butil::IOBuf &body() { return _body; }
@@ -86,6 +86,14 @@ public:
     void SetBodyReader(ProgressiveReader* r);
 
 protected:
+    // Called when the header part is parsed and before any part of the body.
+    // Derived classes may call set_read_body_progressively() here to decide
+    // how to read the body according to the headers.
+    // Returns -1 to fail the parsing.
+    virtual int OnHeadersComplete() { return 0; }
+    void set_read_body_progressively(bool read_body_progressively)
+    { _read_body_progressively = read_body_progressively; }
+
     int OnBody(const char* data, size_t size);
     int OnMessageComplete();
     size_t _parsed_length;
@@ -120,12 +128,24 @@ std::ostream& operator<<(std::ostream& os, const http_parser& parser);
 // Serialize a http request.
 // header: may be modified in some cases
 // remote_side: used when "Host" is absent
-// content: could be NULL.
+// content: could be NULL. If header has "Transfer-Encoding: chunked", content
+//          is sent as one chunk followed by the last chunk, or nothing is
+//          appended after headers when content is NULL so that the caller
+//          can write chunks of the body later.
 void SerializeHttpRequest(butil::IOBuf* request,
                           HttpHeader* header,
                           const butil::EndPoint& remote_side,
                           const butil::IOBuf* content);
 
+// Append `data' as one chunk of chunked transfer-encoding. The chunk head
+// and the trailing CRLF are small blocks referenced around blocks of `data',
+// which are shared rather than copied.
+void AppendHttpChunk(butil::IOBuf* buf, const butil::IOBuf& data);
+void AppendHttpChunk(butil::IOBuf* buf, const void* data, size_t n);
+
+// Append the last chunk which ends a body in chunked transfer-encoding.
+void AppendLastHttpChunk(butil::IOBuf* buf);
+
 // Serialize a http response.
 // header: may be modified in some cases
 // content: cleared after usage. could be NULL. 
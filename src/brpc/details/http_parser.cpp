@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include "butil/fast_memchr.h"
 
 #ifndef ULLONG_MAX
 # define ULLONG_MAX ((uint64_t) -1) /* 2^64-1 */
@@ -1595,7 +1596,17 @@ size_t http_parser_execute (http_parser *parser,
 
         switch (parser->header_state) {
           case h_general:
+          {
+            /* Jump to the next CR/LF, which are scanned with SIMD. */
+            const char* p_end = butil::fast_memchr2(p, data + len - p, CR, LF);
+            if (p_end == NULL) {
+              p_end = data + len;
+            }
+            /* Bytes before p_end are counted at once. */
+            parser->nread += p_end - p - 1;
+            p = p_end - 1;
             break;
+          }
 
           case h_connection:
           case h_transfer_encoding:
@@ -103,6 +103,9 @@ public:
 
     RestfulMap* global_restful_map() const
     { return _server->_global_restful_map; }
+
+    bool has_progressive_read_service() const
+    { return _server->_has_progressive_read_service; }
     
 private:
     const Server* _server;
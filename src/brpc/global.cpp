@@ -57,6 +57,7 @@
 #include "brpc/policy/nshead_mcpack_protocol.h"
 #include "brpc/policy/rtmp_protocol.h"
 #include "brpc/policy/esp_protocol.h"
+#include "brpc/policy/thrift_protocol.h"
 
 #include "brpc/input_messenger.h"     // get_or_new_client_side_messenger
 #include "brpc/socket_map.h"          // SocketMapList
@@ -66,11 +67,52 @@
 #include "brpc/details/usercode_backup_pool.h"
 #include "butil/fd_guard.h"
 #include "butil/files/file_watcher.h"
+#include "butil/unique_ptr.h"
+#include "butil/iobuf_slab_allocator.h"
+#include "butil/iobuf_profiler.h"
+#include "brpc/reloadable_flags.h"
 
 namespace brpc {
 
 DECLARE_bool(usercode_in_pthread);
 
+DEFINE_int32(iobuf_slab_max_memory_mb, 16384,
+             "Max memory of slabs used by IOBuf, only read when "
+             "-iobuf_use_slab_allocator is turned on for the first time");
+
+static bool SetIOBufSlabAllocator(const char*, bool value) {
+    if (value) {
+        return butil::iobuf::install_slab_allocator(
+            (size_t)FLAGS_iobuf_slab_max_memory_mb * 1024 * 1024) == 0;
+    }
+    butil::iobuf::uninstall_slab_allocator();
+    return true;
+}
+DEFINE_bool(iobuf_use_slab_allocator, false,
+            "Allocate blocks of IOBuf from 2MB slabs backed by hugepages and "
+            "cached in per-thread magazines rather than malloc");
+BRPC_VALIDATE_GFLAG(iobuf_use_slab_allocator, SetIOBufSlabAllocator);
+
+static bool SetIOBufSamplingRate(const char*, int32_t value) {
+    if (value < 0) {
+        return false;
+    }
+    butil::iobuf::set_block_sampling_rate(value);
+    return true;
+}
+DEFINE_int32(iobuf_sampling_rate, 0,
+             "Record call stacks of one in every so many blocks created by "
+             "IOBuf, viewed in /hotspots/iobuf. 0 to disable");
+BRPC_VALIDATE_GFLAG(iobuf_sampling_rate, SetIOBufSamplingRate);
+
+static bool SetIOBufBlockSize(const char*, int32_t value) {
+    return value > 0 && butil::iobuf::set_default_block_size(value) == 0;
+}
+DEFINE_int32(iobuf_block_size, butil::IOBuf::DEFAULT_BLOCK_SIZE,
+             "Size of blocks created by IOBuf, 8192 or 65536 are suggested "
+             "since the slab allocator has classes of these sizes");
+BRPC_VALIDATE_GFLAG(iobuf_block_size, SetIOBufBlockSize);
+
 namespace policy {
 // Defined in http_rpc_protocol.cpp
 void InitCommonStrings();
@@ -142,6 +184,12 @@ static int64_t GetIOBufNewBigViewCount(void*) {
 static int64_t GetIOBufBlockMemory(void*) {
     return butil::IOBuf::block_memory();
 }
+static int64_t GetIOBufSlabBlockCount(void* arg) {
+    return butil::iobuf::slab_block_count((size_t)arg);
+}
+static int64_t GetIOBufSlabMemory(void*) {
+    return butil::iobuf::slab_memory();
+}
 
 // Defined in server.cpp
 extern butil::static_atomic<int> g_running_server_count;
@@ -165,6 +213,17 @@ static void* GlobalUpdate(void*) {
         "iobuf_block_memory", GetIOBufBlockMemory, NULL);
     bvar::PassiveStatus<int> var_running_server_count(
         "rpc_server_count", GetRunningServerCount, NULL);
+    bvar::PassiveStatus<int64_t> var_iobuf_slab_memory(
+        "iobuf_slab_memory", GetIOBufSlabMemory, NULL);
+    std::unique_ptr<bvar::PassiveStatus<int64_t> >
+        var_iobuf_slab_block_counts[butil::iobuf::SLAB_SIZE_CLASS_NUM];
+    for (size_t i = 0; i < butil::iobuf::SLAB_SIZE_CLASS_NUM; ++i) {
+        char name[64];
+        snprintf(name, sizeof(name), "iobuf_slab_block_count_%lu",
+                 (unsigned long)butil::iobuf::SLAB_BLOCK_SIZES[i]);
+        var_iobuf_slab_block_counts[i].reset(new bvar::PassiveStatus<int64_t>(
+            name, GetIOBufSlabBlockCount, (void*)i));
+    }
     
     butil::FileWatcher fw;
     if (fw.init_from_not_exist(DUMMY_SERVER_PORT_FILE) < 0) {
@@ -338,7 +397,7 @@ static void GlobalInitializeOrDieImpl() {
                                ProcessHttpRequest, ProcessHttpResponse,
                                VerifyHttpRequest, ParseHttpServerAddress,
                                GetHttpMethodName,
-                               CONNECTION_TYPE_POOLED_AND_SHORT,
+                               CONNECTION_TYPE_ALL,
                                "http" };
     if (RegisterProtocol(PROTOCOL_HTTP, http_protocol) != 0) {
         exit(1);
@@ -411,7 +470,7 @@ static void GlobalInitializeOrDieImpl() {
     Protocol redis_protocol = { ParseRedisMessage,
                                 SerializeRedisRequest,
                                 PackRedisRequest,
-                                NULL, ProcessRedisResponse,
+                                ProcessRedisRequest, ProcessRedisResponse,
                                 NULL, NULL, GetRedisMethodName,
                                 CONNECTION_TYPE_ALL, "redis" };
     if (RegisterProtocol(PROTOCOL_REDIS, redis_protocol) != 0) {
@@ -419,14 +478,29 @@ static void GlobalInitializeOrDieImpl() {
     }
 
     Protocol mongo_protocol = { ParseMongoMessage,
-                                NULL, NULL,
-                                ProcessMongoRequest, NULL,
-                                NULL, NULL, NULL,
-                                CONNECTION_TYPE_POOLED, "mongo" };
+                                SerializeMongoRequest, PackMongoRequest,
+                                ProcessMongoRequest, ProcessMongoResponse,
+                                NULL, NULL, GetMongoMethodName,
+                                CONNECTION_TYPE_ALL, "mongo" };
     if (RegisterProtocol(PROTOCOL_MONGO, mongo_protocol) != 0) {
         exit(1);
     }
 
+    // Not pooled since sockets returned to the pool can't keep the context
+    // of seqids set by PackThriftFramedRequest.
+    Protocol thrift_protocol = { ParseThriftFramedMessage,
+                                 SerializeThriftFramedRequest,
+                                 PackThriftFramedRequest,
+                                 ProcessThriftFramedRequest,
+                                 ProcessThriftFramedResponse,
+                                 NULL, NULL, GetThriftFramedMethodName,
+                                 (ConnectionType)(CONNECTION_TYPE_SINGLE |
+                                                  CONNECTION_TYPE_SHORT),
+                                 "thrift" };
+    if (RegisterProtocol(PROTOCOL_THRIFT, thrift_protocol) != 0) {
+        exit(1);
+    }
+
     // Only valid at client side
     Protocol ubrpc_compack_protocol = {
         ParseNsheadMessage,
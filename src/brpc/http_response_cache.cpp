@@ -0,0 +1,151 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "butil/logging.h"
+#include "butil/time.h"
+#include "butil/crc32c.h"
+#include "butil/string_printf.h"
+#include "brpc/http_response_cache.h"
+
+
+namespace brpc {
+
+HttpResponseCacheOptions::HttpResponseCacheOptions()
+    : ttl_ms(1000)
+    , max_bytes(64 * 1024 * 1024)
+    , enable_etag(true)
+    , max_wait_ms(1000) {
+}
+
+HttpResponseCache::HttpResponseCache()
+    : _entries(EntryMap::NO_AUTO_EVICT)
+    , _nbytes(0) {
+    CHECK_EQ(0, _flights.init(64));
+}
+
+HttpResponseCache::~HttpResponseCache() {
+    Clear();
+}
+
+int HttpResponseCache::Init(const HttpResponseCacheOptions* options) {
+    HttpResponseCacheOptions opt;
+    if (options) {
+        opt = *options;
+    }
+    if (opt.ttl_ms <= 0) {
+        LOG(ERROR) << "Invalid ttl_ms=" << opt.ttl_ms;
+        return -1;
+    }
+    std::unique_lock<bthread::Mutex> mu(_mutex);
+    _options = opt;
+    EvictIfNeeded();
+    return 0;
+}
+
+void HttpResponseCache::Clear() {
+    std::unique_lock<bthread::Mutex> mu(_mutex);
+    _entries.Clear();
+    _nbytes = 0;
+}
+
+size_t HttpResponseCache::count() const {
+    std::unique_lock<bthread::Mutex> mu(_mutex);
+    return _entries.size();
+}
+
+size_t HttpResponseCache::size_in_bytes() const {
+    std::unique_lock<bthread::Mutex> mu(_mutex);
+    return _nbytes;
+}
+
+void HttpResponseCache::EvictIfNeeded() {
+    while (_nbytes > _options.max_bytes && !_entries.empty()) {
+        EntryMap::reverse_iterator it = _entries.rbegin();
+        _nbytes -= it->second->nbytes;
+        _entries.Erase(it);
+    }
+}
+
+HttpResponseCache::EntryPtr
+HttpResponseCache::Lookup(const std::string& key, bool* is_leader) {
+    *is_leader = false;
+    std::unique_lock<bthread::Mutex> mu(_mutex);
+    EntryMap::iterator it = _entries.Get(key);
+    if (it != _entries.end()) {
+        if (it->second->expire_us > butil::gettimeofday_us()) {
+            return it->second;
+        }
+        _nbytes -= it->second->nbytes;
+        _entries.Erase(it);
+    }
+    FlightPtr* pflight = _flights.seek(key);
+    if (pflight == NULL) {
+        _flights[key].reset(new Flight);
+        *is_leader = true;
+        return NULL;
+    }
+    // Hold the flight which is removed from _flights when done.
+    FlightPtr flight = *pflight;
+    const timespec abstime = butil::milliseconds_from_now(_options.max_wait_ms);
+    while (!flight->done) {
+        if (flight->cond.wait_until(mu, abstime) == ETIMEDOUT) {
+            break;
+        }
+    }
+    return flight->entry;
+}
+
+void HttpResponseCache::EndGenerating(const std::string& key, Entry* entry) {
+    EntryPtr entry_ptr(entry);
+    if (entry != NULL) {
+        entry->expire_us = butil::gettimeofday_us() + _options.ttl_ms * 1000L;
+        entry->nbytes = key.size() + entry->body.size() +
+            entry->content_type.size() + sizeof(Entry);
+        for (size_t i = 0; i < entry->headers.size(); ++i) {
+            entry->nbytes += entry->headers[i].first.size() +
+                entry->headers[i].second.size();
+        }
+        if (_options.enable_etag && entry->etag.empty()) {
+            // CRC32C of the body does not guarantee byte-for-byte
+            // equivalence, so it's a weak validator.
+            entry->etag = butil::string_printf(
+                "W/\"%08x-%lx\"", butil::crc32c::Value(entry->body),
+                (unsigned long)entry->body.size());
+        }
+    }
+    std::unique_lock<bthread::Mutex> mu(_mutex);
+    FlightPtr flight;
+    FlightPtr* pflight = _flights.seek(key);
+    if (pflight != NULL) {
+        flight.swap(*pflight);
+        _flights.erase(key);
+        flight->done = true;
+        flight->entry = entry_ptr;
+    }
+    if (entry != NULL && entry->nbytes <= _options.max_bytes) {
+        EntryMap::iterator it = _entries.Peek(key);
+        if (it != _entries.end()) {
+            _nbytes -= it->second->nbytes;
+        }
+        _entries.Put(key, entry_ptr);
+        _nbytes += entry->nbytes;
+        EvictIfNeeded();
+    }
+    mu.unlock();
+    if (flight != NULL) {
+        flight->cond.notify_all();
+    }
+}
+
+} // namespace brpc
@@ -0,0 +1,155 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BRPC_HTTP_RESPONSE_CACHE_H
+#define BRPC_HTTP_RESPONSE_CACHE_H
+
+#include <string>
+#include <vector>
+#include "butil/iobuf.h"                         // butil::IOBuf
+#include "butil/intrusive_ptr.hpp"               // butil::intrusive_ptr
+#include "butil/containers/mru_cache.h"          // butil::MRUCache
+#include "butil/containers/flat_map.h"           // butil::FlatMap
+#include "bthread/bthread.h"
+#include "bthread/mutex.h"                       // bthread::Mutex
+#include "bthread/condition_variable.h"          // bthread::ConditionVariable
+#include "brpc/shared_object.h"                  // SharedObject
+
+
+namespace brpc {
+
+struct HttpResponseCacheOptions {
+    // Constructed with default options.
+    HttpResponseCacheOptions();
+
+    // Cached responses are stale after so many milliseconds.
+    // Default: 1000
+    int64_t ttl_ms;
+
+    // Max total bytes of cached responses, least recently used responses
+    // are evicted when the limit is exceeded.
+    // Default: 64MB
+    size_t max_bytes;
+
+    // Names of request headers that differentiate responses to requests
+    // with a same URI, e.g. "Accept-Language". Values of the headers are
+    // part of the cache key. Accept-Encoding is always taken into account
+    // since responses may be compressed according to it.
+    // Default: empty
+    std::vector<std::string> vary_headers;
+
+    // Attach ETag to responses (if user did not) and respond 304 to
+    // requests whose If-None-Match matches. Generated ETags are weak
+    // validators derived from CRC32C of the bodies.
+    // Default: true
+    bool enable_etag;
+
+    // Max milliseconds for a request to wait for the response being
+    // generated by another request with a same cache key. The request calls
+    // the method by itself after the waiting times out.
+    // Default: 1000
+    int64_t max_wait_ms;
+};
+
+// Cache responses to GET requests of http services, so that identical
+// requests are answered without calling the methods. Only successful
+// responses (status 200) without Cache-Control "no-store" or "private" and
+// Set-Cookie are cached. Concurrent misses of a same key are coalesced:
+// only one of them calls the method and others wait for its response.
+// Bodies are shared by cached and sent responses without copying.
+// Example:
+//   brpc::HttpResponseCache cache;
+//   brpc::HttpResponseCacheOptions cache_opt;
+//   cache_opt.ttl_ms = 500;
+//   cache.Init(&cache_opt);
+//   brpc::ServiceOptions svc_opt;
+//   svc_opt.http_response_cache = &cache;
+//   server.AddService(&my_service, svc_opt);
+// The cache can be shared by services and must be valid during lifetime of
+// the server.
+class HttpResponseCache {
+public:
+    // A cached response.
+    struct Entry : public SharedObject {
+        int status_code;
+        std::string content_type;
+        std::vector<std::pair<std::string, std::string> > headers;
+        std::string etag;
+        butil::IOBuf body;
+        int64_t expire_us;
+        size_t nbytes;
+    };
+    typedef butil::intrusive_ptr<Entry> EntryPtr;
+
+    HttpResponseCache();
+    ~HttpResponseCache();
+
+    // Set options of the cache, NULL means default options.
+    // Returns 0 on success, -1 otherwise.
+    int Init(const HttpResponseCacheOptions* options);
+
+    const HttpResponseCacheOptions& options() const { return _options; }
+
+    // Remove all cached responses.
+    void Clear();
+
+    // Number of cached responses.
+    size_t count() const;
+
+    // Total bytes of cached responses.
+    size_t size_in_bytes() const;
+
+    // [Internal] Get the fresh response of `key'. If the response is missing
+    // and no other request is generating it, NULL is returned and
+    // *is_leader is set to true, in which case the caller must generate the
+    // response and call EndGenerating() with the key. Otherwise the call
+    // waits for the generating request and returns its response, or NULL
+    // with *is_leader set to false if the response is not cacheable or the
+    // waiting times out.
+    EntryPtr Lookup(const std::string& key, bool* is_leader);
+
+    // [Internal] Finish generating the response of `key' started in Lookup().
+    // `entry' is put into the cache and returned to waiting requests, NULL
+    // means that the response is not cacheable. expire_us, nbytes and etag
+    // (if it's empty) of `entry' are filled by this function.
+    void EndGenerating(const std::string& key, Entry* entry);
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(HttpResponseCache);
+
+    // Requests waiting for a same key share a flight and are woken up by
+    // its own condition only, so that EndGenerating() of other keys don't
+    // wake them up.
+    struct Flight : public SharedObject {
+        Flight() : done(false) {}
+        bool done;
+        EntryPtr entry;
+        bthread::ConditionVariable cond;
+    };
+    typedef butil::intrusive_ptr<Flight> FlightPtr;
+    typedef butil::MRUCache<std::string, EntryPtr> EntryMap;
+
+    void EvictIfNeeded();
+
+    HttpResponseCacheOptions _options;
+    mutable bthread::Mutex _mutex;
+    EntryMap _entries;
+    size_t _nbytes;
+    butil::FlatMap<std::string, FlightPtr> _flights;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_HTTP_RESPONSE_CACHE_H
@@ -46,6 +46,11 @@ public:
     int64_t received_us() const { return _received_us; }
     int64_t base_real_us() const { return _base_real_us; }
 
+    // True if the message is cut before being complete and the remaining
+    // part is parsed after processing of the message begins, in which case
+    // the message is always processed in a separate bthread.
+    virtual bool is_partial() const { return false; }
+
 protected:
     virtual ~InputMessageBase();
 
@@ -14,6 +14,7 @@
 
 // Authors: Ge,Jun (gejun@baidu.com)
 
+#include <sys/ioctl.h>                           // FIONREAD
 #include <gflags/gflags.h>
 #include "butil/fd_guard.h"                      // fd_guard
 #include "butil/logging.h"                       // CHECK
@@ -49,6 +50,13 @@ DEFINE_bool(log_connection_close, false,
             "Print log when remote side closes the connection");
 BRPC_VALIDATE_GFLAG(log_connection_close, PassValidate);
 
+DEFINE_int32(read_buffer_compact_bytes, 1024,
+             "When a connection has no more data to read, residual bytes in "
+             "its read buffer no more than this value are copied into shared "
+             "blocks so that the mostly-unused blocks of reads are released. "
+             "0 disables the compaction");
+BRPC_VALIDATE_GFLAG(read_buffer_compact_bytes, NonNegativeInteger);
+
 DECLARE_bool(usercode_in_pthread);
 DECLARE_uint64(max_body_size);
 
@@ -189,6 +197,16 @@ void InputMessenger::OnNewMessages(Socket* m) {
 
         // Calculate bytes to be read.
         size_t once_read = m->_avg_msg_size * 16;
+        if (m->_last_read_full) {
+            // Last read was limited by the size, more bytes are probably
+            // pending in the kernel. Read them all at once rather than
+            // looping with small sizes.
+            int npending = 0;
+            if (ioctl(m->fd(), FIONREAD, &npending) == 0 &&
+                (size_t)npending > once_read) {
+                once_read = npending;
+            }
+        }
         if (once_read < MIN_ONCE_READ) {
             once_read = MIN_ONCE_READ;
         } else if (once_read > MAX_ONCE_READ) {
@@ -197,6 +215,7 @@ void InputMessenger::OnNewMessages(Socket* m) {
 
         // Read.
         const ssize_t nr = m->DoRead(once_read);
+        m->_last_read_full = (nr == (ssize_t)once_read);
         if (nr <= 0) {
             if (0 == nr) {
                 // Set `read_eof' flag and proceed to feed EOF into `Protocol'
@@ -214,9 +233,16 @@ void InputMessenger::OnNewMessages(Socket* m) {
                 m->SetFailed(saved_errno, "Fail to read from %s: %s",
                              m->description().c_str(), berror(saved_errno));
                 return;
-            } else if (!m->MoreReadEvents(&progress)) {
-                return;
-            } else { // new events during processing
+            } else {
+                // No more data for now. A small incomplete message should
+                // not pin blocks of reads while the connection is idle.
+                if (FLAGS_read_buffer_compact_bytes > 0) {
+                    m->_read_buf.compact(FLAGS_read_buffer_compact_bytes);
+                }
+                if (!m->MoreReadEvents(&progress)) {
+                    return;
+                }
+                // new events during processing
                 continue;
             }
         }
@@ -313,7 +339,7 @@ void InputMessenger::OnNewMessages(Socket* m) {
                       "destroyed when authentication failed";
                 }
             }
-            if (!m->is_read_progressive()) {
+            if (!m->is_read_progressive() && !msg->is_partial()) {
                 // Transfer ownership to last_msg
                 last_msg.reset(msg.release());
             } else {
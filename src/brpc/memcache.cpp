@@ -22,12 +22,15 @@
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/reflection_ops.h>
 #include <google/protobuf/wire_format.h>
+#include <gflags/gflags.h>
 #include "butil/string_printf.h"
 #include "butil/macros.h"
 #include "butil/sys_byteorder.h"
 #include "brpc/controller.h"
 #include "brpc/memcache.h"
 #include "brpc/policy/memcache_binary_header.h"
+#include "brpc/policy/hasher.h"
+#include "brpc/policy/consistent_hashing_load_balancer.h"
 
 
 namespace brpc {
@@ -466,7 +469,8 @@ const char* MemcacheResponse::status_str(Status st) {
 // MUST NOT have extras.
 // MUST have key.
 // MUST NOT have value.
-bool MemcacheRequest::GetOrDelete(uint8_t command, const butil::StringPiece& key) {
+bool MemcacheRequest::AppendKeyCommand(uint8_t command,
+                                       const butil::StringPiece& key) {
     const policy::MemcacheRequestHeader header = {
         policy::MC_MAGIC_REQUEST,
         command,
@@ -481,7 +485,14 @@ bool MemcacheRequest::GetOrDelete(uint8_t command, const butil::StringPiece& key
     if (_buf.append(&header, sizeof(header))) {
         return false;
     }
-    if (_buf.append(key.data(), key.size())) {
+    if (!key.empty() && _buf.append(key.data(), key.size())) {
+        return false;
+    }
+    return true;
+}
+
+bool MemcacheRequest::GetOrDelete(uint8_t command, const butil::StringPiece& key) {
+    if (!AppendKeyCommand(command, key)) {
         return false;
     }
     ++_pipelined_count;
@@ -492,6 +503,24 @@ bool MemcacheRequest::Get(const butil::StringPiece& key) {
     return GetOrDelete(policy::MC_BINARY_GET, key);
 }
 
+// Quiet GETs are not responded when keys are missing, the trailing NOOP
+// which is always responded marks the end of the batch.
+bool MemcacheRequest::MultiGet(const std::vector<std::string>& keys) {
+    const size_t old_size = _buf.size();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!AppendKeyCommand(policy::MC_BINARY_GETKQ, keys[i])) {
+            _buf.pop_back(_buf.size() - old_size);
+            return false;
+        }
+    }
+    if (!AppendKeyCommand(policy::MC_BINARY_NOOP, butil::StringPiece())) {
+        _buf.pop_back(_buf.size() - old_size);
+        return false;
+    }
+    ++_pipelined_count;
+    return true;
+}
+
 bool MemcacheRequest::Delete(const butil::StringPiece& key) {
     return GetOrDelete(policy::MC_BINARY_DELETE, key);
 }
@@ -626,6 +655,67 @@ bool MemcacheResponse::PopGet(
     return false;
 }
 
+// Responses of a MultiGet() are GETKQ responses of hits (and of keys failed
+// with errors other than "not found") followed by a NOOP response.
+bool MemcacheResponse::PopMultiGet(MemcacheHitMap* hits) {
+    if (!hits->initialized() && hits->init(64) != 0) {
+        butil::string_printf(&_err, "Fail to init hits");
+        return false;
+    }
+    std::string last_error;
+    while (true) {
+        const size_t n = _buf.size();
+        policy::MemcacheResponseHeader header;
+        if (n < sizeof(header)) {
+            butil::string_printf(&_err, "buffer is too small to contain a header");
+            return false;
+        }
+        _buf.copy_to(&header, sizeof(header));
+        if (n < sizeof(header) + header.total_body_length) {
+            butil::string_printf(&_err, "response=%u < header=%u + body=%u",
+                      (unsigned)n, (unsigned)sizeof(header), header.total_body_length);
+            return false;
+        }
+        if (header.command == (uint8_t)policy::MC_BINARY_NOOP) {
+            _buf.pop_front(sizeof(header) + header.total_body_length);
+            _err.swap(last_error);
+            return true;
+        }
+        if (header.command != (uint8_t)policy::MC_BINARY_GETKQ) {
+            butil::string_printf(&_err, "not a MultiGet response");
+            return false;
+        }
+        const int value_size = (int)header.total_body_length
+            - (int)header.extras_length - (int)header.key_length;
+        if (value_size < 0) {
+            butil::string_printf(&_err, "value_size=%d is non-negative", value_size);
+            return false;
+        }
+        if (header.status != (uint16_t)STATUS_SUCCESS) {
+            _buf.pop_front(sizeof(header) + header.extras_length +
+                           header.key_length);
+            last_error.clear();
+            _buf.cutn(&last_error, value_size);
+            continue;
+        }
+        if (header.extras_length != 4u) {
+            butil::string_printf(&_err, "GETKQ response must have flags as extras, actual length=%u",
+                      header.extras_length);
+            return false;
+        }
+        _buf.pop_front(sizeof(header));
+        uint32_t raw_flags = 0;
+        _buf.cutn(&raw_flags, sizeof(raw_flags));
+        std::string key;
+        _buf.cutn(&key, header.key_length);
+        MemcacheHit& hit = (*hits)[key];
+        hit.flags = butil::NetToHost32(raw_flags);
+        hit.cas_value = header.cas_value;
+        hit.value.clear();
+        _buf.cutn(&hit.value, value_size);
+    }
+}
+
 // MUST NOT have extras
 // MUST NOT have key
 // MUST NOT have value
@@ -1010,5 +1100,126 @@ bool MemcacheResponse::PopVersion(std::string* version) {
     _err.clear();
     return true;
 }
- 
+
+namespace policy {
+DECLARE_int32(chash_num_replicas);
+}
+
+MemcacheConsistentHashSharding::MemcacheConsistentHashSharding(
+    const std::vector<butil::EndPoint>& servers, HashFunc hash)
+    : _hash(hash) {
+    // Built in the same way as ConsistentHashingLoadBalancer.
+    const size_t num_replicas = policy::FLAGS_chash_num_replicas;
+    _ring.reserve(servers.size() * num_replicas);
+    for (size_t i = 0; i < servers.size(); ++i) {
+        for (size_t rep = 0; rep < num_replicas; ++rep) {
+            Node node;
+            node.hash = policy::ConsistentHashingLoadBalancer::GetReplicaHash(
+                hash, servers[i], rep);
+            node.addr = servers[i];
+            node.index = i;
+            _ring.push_back(node);
+        }
+    }
+    std::sort(_ring.begin(), _ring.end());
+}
+
+int MemcacheConsistentHashSharding::GetShard(
+    const butil::StringPiece& key) const {
+    if (_ring.empty()) {
+        return -1;
+    }
+    const uint32_t code = _hash(key.data(), key.size());
+    std::vector<Node>::const_iterator it =
+        std::lower_bound(_ring.begin(), _ring.end(), code);
+    if (it == _ring.end()) {
+        it = _ring.begin();
+    }
+    return it->index;
+}
+
+int MemcacheMultiGetMapper::GetShard(const butil::StringPiece& key,
+                                     int channel_count) {
+    return policy::MurmurHash32(key.data(), key.size()) % channel_count;
+}
+
+SubCall MemcacheMultiGetMapper::Map(
+    int /*channel_index*/,
+    const google::protobuf::MethodDescriptor* method,
+    const google::protobuf::Message* request,
+    google::protobuf::Message* response) {
+    const MemcacheRequest* req = dynamic_cast<const MemcacheRequest*>(request);
+    if (req == NULL || req->pipelined_count() != 1) {
+        LOG(ERROR) << "request must be a MemcacheRequest with only a MultiGet()";
+        return SubCall::Bad();
+    }
+    // Pick keys of this shard from the GETKQ commands. Headers are still
+    // in network byte order in requests.
+    butil::IOBuf buf = req->raw_buffer();
+    std::vector<std::string> keys;
+    std::string key;
+    policy::MemcacheRequestHeader header;
+    while (buf.cutn(&header, sizeof(header)) == sizeof(header)) {
+        const uint32_t body_length = butil::NetToHost32(header.total_body_length);
+        if (header.command == (uint8_t)policy::MC_BINARY_NOOP) {
+            break;
+        }
+        const uint16_t key_length = butil::NetToHost16(header.key_length);
+        if (header.command != (uint8_t)policy::MC_BINARY_GETKQ ||
+            buf.size() < body_length ||
+            body_length < (uint32_t)header.extras_length + key_length) {
+            LOG(ERROR) << "request must be a MemcacheRequest with only a MultiGet()";
+            return SubCall::Bad();
+        }
+        buf.pop_front(header.extras_length);
+        key.clear();
+        buf.cutn(&key, key_length);
+        buf.pop_front(body_length - header.extras_length - key_length);
+        const int shard = (_sharding != NULL ? _sharding->GetShard(key) :
+                           GetShard(key, _channel_count));
+        if (shard == _shard) {
+            keys.push_back(key);
+        }
+    }
+    if (keys.empty()) {
+        return SubCall::Skip();
+    }
+    MemcacheRequest* sub_request = new MemcacheRequest;
+    sub_request->MultiGet(keys);
+    return SubCall(method, sub_request, response->New(),
+                   DELETE_REQUEST | DELETE_RESPONSE);
+}
+
+ResponseMerger::Result MemcacheMultiGetMerger::Merge(
+    google::protobuf::Message* response,
+    const google::protobuf::Message* sub_response) {
+    MemcacheResponse* res = dynamic_cast<MemcacheResponse*>(response);
+    const MemcacheResponse* sub =
+        dynamic_cast<const MemcacheResponse*>(sub_response);
+    if (res == NULL || sub == NULL) {
+        return FAIL;
+    }
+    butil::IOBuf& buf = res->raw_buffer();
+    if (buf.empty()) {
+        buf = sub->raw_buffer();
+        return MERGED;
+    }
+    // Hits of `sub' go before the NOOP response terminating `res'. Headers
+    // of responses are in host byte order.
+    butil::IOBuf hits = sub->raw_buffer();
+    policy::MemcacheResponseHeader header;
+    if (hits.size() < sizeof(header)) {
+        return FAIL;
+    }
+    hits.copy_to(&header, sizeof(header), hits.size() - sizeof(header));
+    if (header.command != (uint8_t)policy::MC_BINARY_NOOP ||
+        header.total_body_length != 0) {
+        return FAIL;
+    }
+    hits.pop_back(sizeof(header));
+    hits.append(buf);
+    buf.swap(hits);
+    return MERGED;
+}
+
 } // namespace brpc
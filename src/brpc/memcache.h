@@ -18,6 +18,7 @@
 #define BRPC_MEMCACHE_H
 
 #include <string>
+#include <vector>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/generated_message_util.h>
 #include <google/protobuf/repeated_field.h>
@@ -26,10 +27,25 @@
 #include "google/protobuf/descriptor.pb.h"
 
 #include "butil/iobuf.h"
+#include "butil/endpoint.h"
+#include "butil/intrusive_ptr.hpp"
 #include "butil/strings/string_piece.h"
+#include "butil/containers/flat_map.h"
+#include "brpc/shared_object.h"
+#include "brpc/parallel_channel.h"
 
 namespace brpc {
 
+// A hit of MemcacheRequest::MultiGet(), `value' references the buffer of
+// the response rather than being copied.
+struct MemcacheHit {
+    butil::IOBuf value;
+    uint32_t flags;
+    uint64_t cas_value;
+};
+// Key -> hit.
+typedef butil::FlatMap<std::string, MemcacheHit> MemcacheHitMap;
+
 // Request to memcache.
 // Notice that you can pipeline multiple operations in one request and sent
 // them to memcached server together.
@@ -55,6 +71,12 @@ public:
 
     bool Get(const butil::StringPiece& key);
 
+    // Get values of all `keys' with quiet GETs (GETKQ) followed by a NOOP.
+    // Servers only respond to hits, which saves packets for batches with
+    // many misses. Hits are got by MemcacheResponse::PopMultiGet(), the
+    // batch counts as one operation in the pipeline.
+    bool MultiGet(const std::vector<std::string>& keys);
+
     // If the cas_value(Data Version Check) is non-zero, the requested operation
     // MUST only succeed if the item exists and has a cas_value identical to the
     // provided value.
@@ -112,6 +134,7 @@ public:
     const butil::IOBuf& raw_buffer() const { return _buf; }
     
 private:
+    bool AppendKeyCommand(uint8_t command, const butil::StringPiece& key);
     bool GetOrDelete(uint8_t command, const butil::StringPiece& key);
     bool Counter(uint8_t command, const butil::StringPiece& key, uint64_t delta,
                  uint64_t initial_value, uint32_t exptime);
@@ -191,6 +214,10 @@ public:
    
     bool PopGet(butil::IOBuf* value, uint32_t* flags, uint64_t* cas_value);
     bool PopGet(std::string* value, uint32_t* flags, uint64_t* cas_value);
+    // Put hits of a MultiGet() into `hits' which is initialized if it's not.
+    // Keys not found are absent in `hits', so are the keys failed with other
+    // errors, the last of which is in LastError().
+    bool PopMultiGet(MemcacheHitMap* hits);
     bool PopSet(uint64_t* cas_value);
     bool PopAdd(uint64_t* cas_value);
     bool PopReplace(uint64_t* cas_value);
@@ -251,6 +278,92 @@ friend void protobuf_ShutdownFile_baidu_2frpc_2fmemcache_5fbase_2eproto();
     static MemcacheResponse* default_instance_;
 };
 
+// Map keys to servers in the same way as a Channel with load balancer
+// "c_murmurhash" (or "c_md5") selects servers for requests whose
+// request_code is MurmurHash32 (or MD5Hash32) of the key, so that keys set
+// through such a channel are got from the same servers. Unlike the load
+// balancer, keys of failed servers are not moved to other servers.
+class MemcacheConsistentHashSharding : public SharedObject {
+public:
+    typedef uint32_t (*HashFunc)(const void* key, size_t len);
+
+    // `servers' are servers of the channel. `hash' is policy::MurmurHash32
+    // for c_murmurhash and policy::MD5Hash32 for c_md5.
+    MemcacheConsistentHashSharding(const std::vector<butil::EndPoint>& servers,
+                                   HashFunc hash);
+
+    // Index in `servers' of the server that `key' belongs to.
+    int GetShard(const butil::StringPiece& key) const;
+
+private:
+    struct Node {
+        uint32_t hash;
+        butil::EndPoint addr;
+        int index;
+        // Same order as nodes of ConsistentHashingLoadBalancer.
+        bool operator<(const Node& rhs) const {
+            return hash < rhs.hash || (hash == rhs.hash && addr < rhs.addr);
+        }
+        bool operator<(uint32_t code) const { return hash < code; }
+    };
+    HashFunc _hash;
+    std::vector<Node> _ring;
+};
+
+// Shard keys of a MemcacheRequest with a single MultiGet() across sub
+// channels of a ParallelChannel, which are usually channels to different
+// memcached servers. Every sub channel gets a MultiGet() of its keys, sub
+// channels without keys are skipped. Use with MemcacheMultiGetMerger.
+// Keys must be sharded in the same way as they're set, to read keys set
+// through a consistent hashing channel, use MemcacheConsistentHashSharding.
+// Example:
+//   std::vector<butil::EndPoint> servers = ...;  // servers of the channel
+//   butil::intrusive_ptr<brpc::MemcacheConsistentHashSharding> sharding(
+//       new brpc::MemcacheConsistentHashSharding(
+//           servers, brpc::policy::MurmurHash32));
+//   brpc::ParallelChannel pchan;
+//   for (size_t i = 0; i < servers.size(); ++i) {
+//       pchan.AddChannel(&sub_channels[i], brpc::DOESNT_OWN_CHANNEL,
+//                        new brpc::MemcacheMultiGetMapper(i, sharding.get()),
+//                        new brpc::MemcacheMultiGetMerger);
+//   }
+//   request.MultiGet(keys);
+//   pchan.CallMethod(NULL, &cntl, &request, &response, NULL);
+//   response.PopMultiGet(&hits);
+class MemcacheMultiGetMapper : public CallMapper {
+public:
+    // Keys whose hash modulo `channel_count' equals `shard' are sent to
+    // the sub channel this mapper is added with.
+    MemcacheMultiGetMapper(int shard, int channel_count)
+        : _shard(shard), _channel_count(channel_count) {}
+
+    // Keys that `sharding' maps to the `shard'-th server are sent to the
+    // sub channel this mapper is added with.
+    MemcacheMultiGetMapper(int shard, MemcacheConsistentHashSharding* sharding)
+        : _shard(shard), _channel_count(0), _sharding(sharding) {}
+
+    SubCall Map(int channel_index,
+                const google::protobuf::MethodDescriptor* method,
+                const google::protobuf::Message* request,
+                google::protobuf::Message* response);
+
+    // Index of the shard that `key' belongs to.
+    static int GetShard(const butil::StringPiece& key, int channel_count);
+
+private:
+    int _shard;
+    int _channel_count;
+    butil::intrusive_ptr<MemcacheConsistentHashSharding> _sharding;
+};
+
+// Merge responses of MultiGet() sent by MemcacheMultiGetMapper into one
+// MultiGet() response.
+class MemcacheMultiGetMerger : public ResponseMerger {
+public:
+    Result Merge(google::protobuf::Message* response,
+                 const google::protobuf::Message* sub_response);
+};
+
 } // namespace brpc
 
 
@@ -32,6 +32,22 @@ enum MongoOpCode {
     MONGO_OPCODE_GET_MORE      = 2005,
     MONGO_OPCODE_DELETE        = 2006,
     MONGO_OPCODE_KILL_CURSORS  = 2007,
+    // OP_MSG of MongoDB 3.6+, not the legacy MSG above.
+    MONGO_OPCODE_OP_MSG        = 2013,
+};
+
+// flagBits of OP_MSG.
+// https://docs.mongodb.com/manual/reference/mongodb-wire-protocol/#op-msg
+enum MongoMsgFlag {
+    MONGO_MSG_CHECKSUM_PRESENT = 1 << 0,
+    MONGO_MSG_MORE_TO_COME     = 1 << 1,
+    MONGO_MSG_EXHAUST_ALLOWED  = 1 << 16,
+};
+
+// Kinds of sections in OP_MSG.
+enum MongoMsgSectionKind {
+    MONGO_MSG_SECTION_BODY              = 0,
+    MONGO_MSG_SECTION_DOCUMENT_SEQUENCE = 1,
 };
 
 inline bool is_mongo_opcode(int32_t op_code) {
@@ -44,6 +60,7 @@ inline bool is_mongo_opcode(int32_t op_code) {
     case MONGO_OPCODE_GET_MORE:      return true; 
     case MONGO_OPCODE_DELETE:        return true; 
     case MONGO_OPCODE_KILL_CURSORS : return true;
+    case MONGO_OPCODE_OP_MSG:        return true;
     }
     return false;
 }
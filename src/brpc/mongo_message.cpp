@@ -0,0 +1,283 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#define INTERNAL_SUPPRESS_PROTOBUF_FIELD_DEPRECATION
+#include "brpc/mongo_message.h"
+
+#include <algorithm>
+#include "butil/logging.h"
+#include "butil/sys_byteorder.h"
+
+#include <google/protobuf/stubs/once.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite_inl.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/reflection_ops.h>
+#include <google/protobuf/wire_format.h>
+
+
+namespace brpc {
+
+namespace {
+const ::google::protobuf::Descriptor* MongoMessage_descriptor_ = NULL;
+}  // namespace
+
+
+void protobuf_AssignDesc_baidu_2frpc_2fmongo_5fmessage_2eproto() {
+    protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto();
+    const ::google::protobuf::FileDescriptor* file =
+        ::google::protobuf::DescriptorPool::generated_pool()->FindFileByName(
+            "baidu/rpc/mongo_message.proto");
+    GOOGLE_CHECK(file != NULL);
+    MongoMessage_descriptor_ = file->message_type(0);
+}
+
+namespace {
+
+GOOGLE_PROTOBUF_DECLARE_ONCE(protobuf_AssignDescriptors_once_);
+inline void protobuf_AssignDescriptorsOnce() {
+    ::google::protobuf::GoogleOnceInit(&protobuf_AssignDescriptors_once_,
+                                       &protobuf_AssignDesc_baidu_2frpc_2fmongo_5fmessage_2eproto);
+}
+
+void protobuf_RegisterTypes(const ::std::string&) {
+    protobuf_AssignDescriptorsOnce();
+    ::google::protobuf::MessageFactory::InternalRegisterGeneratedMessage(
+        MongoMessage_descriptor_, &MongoMessage::default_instance());
+}
+
+}  // namespace
+
+void protobuf_ShutdownFile_baidu_2frpc_2fmongo_5fmessage_2eproto() {
+    delete MongoMessage::default_instance_;
+}
+
+void protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto_impl() {
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+#if GOOGLE_PROTOBUF_VERSION >= 3002000
+    ::google::protobuf::internal::InitProtobufDefaults();
+#else
+    ::google::protobuf::protobuf_AddDesc_google_2fprotobuf_2fdescriptor_2eproto();
+#endif
+    ::google::protobuf::DescriptorPool::InternalAddGeneratedFile(
+        "\n\035baidu/rpc/mongo_message.proto\022\tbaidu."
+        "rpc\032 google/protobuf/descriptor.proto\"\016\n"
+        "\014MongoMessageB\003\200\001\001", 97);
+    ::google::protobuf::MessageFactory::InternalRegisterGeneratedFile(
+        "baidu/rpc/mongo_message.proto", &protobuf_RegisterTypes);
+    MongoMessage::default_instance_ = new MongoMessage();
+    MongoMessage::default_instance_->InitAsDefaultInstance();
+    ::google::protobuf::internal::OnShutdown(
+        &protobuf_ShutdownFile_baidu_2frpc_2fmongo_5fmessage_2eproto);
+}
+
+GOOGLE_PROTOBUF_DECLARE_ONCE(protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto_once);
+void protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto() {
+    ::google::protobuf::GoogleOnceInit(
+        &protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto_once,
+        &protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto_impl);
+}
+
+struct StaticDescriptorInitializer_baidu_2frpc_2fmongo_5fmessage_2eproto {
+    StaticDescriptorInitializer_baidu_2frpc_2fmongo_5fmessage_2eproto() {
+        protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto();
+    }
+} static_descriptor_initializer_baidu_2frpc_2fmongo_5fmessage_2eproto_;
+
+
+MongoMessage::MongoMessage()
+    : ::google::protobuf::Message() {
+    SharedCtor();
+}
+
+void MongoMessage::InitAsDefaultInstance() {
+}
+
+MongoMessage::MongoMessage(const MongoMessage& from)
+    : ::google::protobuf::Message() {
+    SharedCtor();
+    MergeFrom(from);
+}
+
+void MongoMessage::SharedCtor() {
+    flag_bits = 0;
+}
+
+MongoMessage::~MongoMessage() {
+    SharedDtor();
+}
+
+void MongoMessage::SharedDtor() {
+    if (this != default_instance_) {
+    }
+}
+
+const ::google::protobuf::Descriptor* MongoMessage::descriptor() {
+    protobuf_AssignDescriptorsOnce();
+    return MongoMessage_descriptor_;
+}
+
+const MongoMessage& MongoMessage::default_instance() {
+    if (default_instance_ == NULL)
+        protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto();
+    return *default_instance_;
+}
+
+MongoMessage* MongoMessage::default_instance_ = NULL;
+
+MongoMessage* MongoMessage::New() const {
+    return new MongoMessage;
+}
+
+void MongoMessage::Clear() {
+    flag_bits = 0;
+    sections.clear();
+}
+
+bool MongoMessage::MergePartialFromCodedStream(
+    ::google::protobuf::io::CodedInputStream* input) {
+#define DO_(EXPRESSION) if (!(EXPRESSION)) return false
+    ::google::protobuf::uint32 tag;
+    while ((tag = input->ReadTag()) != 0) {
+        if (::google::protobuf::internal::WireFormatLite::GetTagWireType(tag) ==
+            ::google::protobuf::internal::WireFormatLite::WIRETYPE_END_GROUP) {
+            return true;
+        }
+    }
+    return true;
+#undef DO_
+}
+
+void MongoMessage::SerializeWithCachedSizes(
+    ::google::protobuf::io::CodedOutputStream*) const {
+}
+
+::google::protobuf::uint8* MongoMessage::SerializeWithCachedSizesToArray(
+    ::google::protobuf::uint8* target) const {
+    return target;
+}
+
+int MongoMessage::ByteSize() const {
+    return sizeof(flag_bits) + sections.size();
+}
+
+void MongoMessage::MergeFrom(const ::google::protobuf::Message& from) {
+    GOOGLE_CHECK_NE(&from, this);
+    const MongoMessage* source =
+        ::google::protobuf::internal::dynamic_cast_if_available<const MongoMessage*>(
+            &from);
+    if (source == NULL) {
+        LOG(ERROR) << "Can only merge from MongoMessage";
+        return;
+    } else {
+        MergeFrom(*source);
+    }
+}
+
+void MongoMessage::MergeFrom(const MongoMessage& from) {
+    GOOGLE_CHECK_NE(&from, this);
+    // Sections of OP_MSG are concatenatable.
+    flag_bits |= from.flag_bits;
+    sections.append(from.sections);
+}
+
+void MongoMessage::CopyFrom(const ::google::protobuf::Message& from) {
+    if (&from == this) return;
+    Clear();
+    MergeFrom(from);
+}
+
+void MongoMessage::CopyFrom(const MongoMessage& from) {
+    if (&from == this) return;
+    Clear();
+    MergeFrom(from);
+}
+
+bool MongoMessage::IsInitialized() const {
+    return true;
+}
+
+void MongoMessage::Swap(MongoMessage* other) {
+    if (other != this) {
+        std::swap(flag_bits, other->flag_bits);
+        sections.swap(other->sections);
+    }
+}
+
+::google::protobuf::Metadata MongoMessage::GetMetadata() const {
+    protobuf_AssignDescriptorsOnce();
+    ::google::protobuf::Metadata metadata;
+    metadata.descriptor = MongoMessage_descriptor_;
+    metadata.reflection = NULL;
+    return metadata;
+}
+
+// Integers of mongo are little-endian.
+static void AppendInt32(butil::IOBuf* buf, int32_t value) {
+    const uint32_t le_value = butil::ByteSwapToLE32((uint32_t)value);
+    buf->append(&le_value, sizeof(le_value));
+}
+
+void MongoMessage::AppendBody(const butil::IOBuf& document) {
+    sections.push_back((char)MONGO_MSG_SECTION_BODY);
+    sections.append(document);
+}
+
+void MongoMessage::AppendDocumentSequence(const butil::StringPiece& identifier,
+                                          const butil::IOBuf* documents,
+                                          size_t count) {
+    // The size covers itself, the identifier as a cstring and the documents.
+    size_t size = sizeof(int32_t) + identifier.size() + 1;
+    for (size_t i = 0; i < count; ++i) {
+        size += documents[i].size();
+    }
+    sections.push_back((char)MONGO_MSG_SECTION_DOCUMENT_SEQUENCE);
+    AppendInt32(&sections, (int32_t)size);
+    sections.append(identifier.data(), identifier.size());
+    sections.push_back('\0');
+    for (size_t i = 0; i < count; ++i) {
+        sections.append(documents[i]);
+    }
+}
+
+bool MongoMessage::GetBody(butil::IOBuf* document) const {
+    // Both BSON documents and document sequences are prefixed with
+    // int32 sizes which include the size fields.
+    size_t offset = 0;
+    while (offset < sections.size()) {
+        char kind = 0;
+        uint32_t size = 0;
+        if (sections.copy_to(&kind, 1, offset) != 1 ||
+            sections.copy_to(&size, sizeof(size), offset + 1) != sizeof(size)) {
+            return false;
+        }
+        size = butil::ByteSwapToLE32(size);
+        if (size < sizeof(size) || size > sections.size() - offset - 1) {
+            return false;
+        }
+        if (kind == (char)MONGO_MSG_SECTION_BODY) {
+            document->clear();
+            sections.append_to(document, size, offset + 1);
+            return true;
+        }
+        if (kind != (char)MONGO_MSG_SECTION_DOCUMENT_SEQUENCE) {
+            return false;
+        }
+        offset += 1 + size;
+    }
+    return false;
+}
+
+} // namespace brpc
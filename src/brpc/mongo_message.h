@@ -0,0 +1,131 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BRPC_MONGO_MESSAGE_H
+#define BRPC_MONGO_MESSAGE_H
+
+#include <string>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/generated_message_util.h>
+#include <google/protobuf/repeated_field.h>
+#include <google/protobuf/extension_set.h>
+#include <google/protobuf/generated_message_reflection.h>
+#include "google/protobuf/descriptor.pb.h"
+
+#include "butil/iobuf.h"                           // IOBuf
+#include "butil/strings/string_piece.h"
+#include "brpc/mongo_head.h"
+
+
+namespace brpc {
+
+// Internal implementation detail -- do not call these.
+void protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto();
+void protobuf_AssignDesc_baidu_2frpc_2fmongo_5fmessage_2eproto();
+void protobuf_ShutdownFile_baidu_2frpc_2fmongo_5fmessage_2eproto();
+
+// Representing an OP_MSG request to or response from mongod. BSON documents
+// are not parsed and kept in IOBuf as they are, encode and decode them with
+// your favorite BSON library.
+// Example:
+//   brpc::ChannelOptions options;
+//   options.protocol = brpc::PROTOCOL_MONGO;
+//   channel.Init("127.0.0.1:27017", &options);
+//   brpc::MongoMessage request;
+//   brpc::MongoMessage response;
+//   request.AppendBody(bson_of_find_command);   // {find: "c", $db: "test"}
+//   channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+//   butil::IOBuf reply;
+//   response.GetBody(&reply);                   // {cursor: {...}, ok: 1}
+class MongoMessage : public ::google::protobuf::Message {
+public:
+    // flagBits of OP_MSG, see MongoMsgFlag. Checksums of requests with
+    // MONGO_MSG_CHECKSUM_PRESENT are computed by the framework. Requests
+    // with MONGO_MSG_MORE_TO_COME are rejected since they're not responded,
+    // so are requests with MONGO_MSG_EXHAUST_ALLOWED which may be responded
+    // multiple times.
+    uint32_t flag_bits;
+
+    // Sections of OP_MSG in wire format. Checksums of responses are
+    // verified and removed.
+    butil::IOBuf sections;
+
+public:
+    MongoMessage();
+    virtual ~MongoMessage();
+
+    MongoMessage(const MongoMessage& from);
+
+    inline MongoMessage& operator=(const MongoMessage& from) {
+        CopyFrom(from);
+        return *this;
+    }
+
+    // Append the body section (kind 0) with a BSON document. A message
+    // should have exactly one body.
+    void AppendBody(const butil::IOBuf& document);
+
+    // Append a document sequence section (kind 1), e.g. "documents" of an
+    // insert command, with `count' BSON documents.
+    void AppendDocumentSequence(const butil::StringPiece& identifier,
+                                const butil::IOBuf* documents, size_t count);
+
+    // Put the BSON document of the body section into `document', which
+    // references `sections' rather than copying.
+    // Returns true on success, false if there's no body or `sections' is
+    // malformed.
+    bool GetBody(butil::IOBuf* document) const;
+
+    static const ::google::protobuf::Descriptor* descriptor();
+    static const MongoMessage& default_instance();
+
+    void Swap(MongoMessage* other);
+
+    // implements Message ----------------------------------------------
+
+    MongoMessage* New() const;
+    void CopyFrom(const ::google::protobuf::Message& from);
+    void MergeFrom(const ::google::protobuf::Message& from);
+    void CopyFrom(const MongoMessage& from);
+    void MergeFrom(const MongoMessage& from);
+    void Clear();
+    bool IsInitialized() const;
+
+    int ByteSize() const;
+    bool MergePartialFromCodedStream(
+        ::google::protobuf::io::CodedInputStream* input);
+    void SerializeWithCachedSizes(
+        ::google::protobuf::io::CodedOutputStream* output) const;
+    ::google::protobuf::uint8* SerializeWithCachedSizesToArray(::google::protobuf::uint8* output) const;
+    int GetCachedSize() const { return ByteSize(); }
+    ::google::protobuf::Metadata GetMetadata() const;
+
+private:
+    void SharedCtor();
+    void SharedDtor();
+private:
+friend void protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto_impl();
+friend void protobuf_AddDesc_baidu_2frpc_2fmongo_5fmessage_2eproto();
+friend void protobuf_AssignDesc_baidu_2frpc_2fmongo_5fmessage_2eproto();
+friend void protobuf_ShutdownFile_baidu_2frpc_2fmongo_5fmessage_2eproto();
+
+    void InitAsDefaultInstance();
+    static MongoMessage* default_instance_;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_MONGO_MESSAGE_H
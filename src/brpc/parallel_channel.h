@@ -58,8 +58,10 @@ struct SubCall {
     }
 
     // True if this object is constructed by Bad().
+    // `method' is not checked since it's NULL for protocols without methods
+    // (memcache, redis ...).
     bool is_bad() const {
-        return request == NULL || response == NULL || method == NULL;
+        return request == NULL || response == NULL;
     }
 
     // True if this object is constructed by Skip().
@@ -22,6 +22,7 @@
 #include "butil/logging.h"                       // LOG()
 #include "butil/time.h"
 #include "butil/iobuf.h"                         // butil::IOBuf
+#include "butil/crc32c.h"                        // crc32c::Extend
 #include "butil/raw_pack.h"                      // RawPacker RawUnpacker
 #include "brpc/controller.h"                    // Controller
 #include "brpc/socket.h"                        // Socket
@@ -30,6 +31,7 @@
 #include "brpc/compress.h"                      // ParseFromCompressedData
 #include "brpc/stream_impl.h"
 #include "brpc/rpc_dump.h"                      // SampledRequest
+#include "brpc/reloadable_flags.h"              // BRPC_VALIDATE_GFLAG
 #include "brpc/policy/baidu_rpc_meta.pb.h"      // RpcRequestMeta
 #include "brpc/policy/baidu_rpc_protocol.h"
 #include "brpc/policy/most_common_message.h"
@@ -50,12 +52,20 @@ DEFINE_bool(baidu_protocol_use_fullname, true,
             "If this flag is true, baidu_std puts service.full_name in requests"
             ", otherwise puts service.name (required by jprotobuf).");
 
+DEFINE_bool(baidu_protocol_payload_checksum, false,
+            "Attach crc32c of the payload to baidu_std requests. Servers "
+            "verify the checksum and reply with checksummed responses");
+BRPC_VALIDATE_GFLAG(baidu_protocol_payload_checksum, PassValidate);
+
 // Notes:
 // 1. 12-byte header [PRPC][body_size][meta_size]
 // 2. body_size and meta_size are in network byte order
 // 3. Use service->full_name() + method_name to specify the method to call
 // 4. `attachment_size' is set iff request/response has attachment
 // 5. Not supported: chunk_info
+// 6. `payload_checksum' is crc32c of body and attachment, set in requests
+//    when -baidu_protocol_payload_checksum is on, and set in responses iff
+//    the corresponding requests have it.
 
 // Pack header into `buf'
 inline void PackRpcHeader(char* rpc_header, int meta_size, int payload_size) {
@@ -206,6 +216,15 @@ void SendRpcResponse(int64_t correlation_id,
     if (attached_size > 0) {
         meta.set_attachment_size(attached_size);
     }
+    if (accessor.payload_checksum()) {
+        uint32_t checksum = 0;
+        if (append_body) {
+            checksum = butil::crc32c::Extend(checksum, res_body);
+            checksum = butil::crc32c::Extend(
+                checksum, cntl->response_attachment());
+        }
+        meta.set_payload_checksum(checksum);
+    }
     SocketUniquePtr stream_ptr;
     if (response_stream_id != INVALID_STREAM_ID) {
         if (Socket::Address(response_stream_id, &stream_ptr) == 0) {
@@ -351,6 +370,7 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
     cntl->set_request_compress_type((CompressType)meta.compress_type());
     accessor.set_server(server)
         .set_security_mode(security_mode)
+        .set_payload_checksum(meta.has_payload_checksum())
         .set_peer_id(socket->id())
         .set_remote_side(socket->remote_side())
         .set_local_side(socket->local_side())
@@ -445,6 +465,15 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
             span->ResetServerSpanName(method->full_name());
         }
         const int reqsize = static_cast<int>(msg->payload.size());
+        if (meta.has_payload_checksum()) {
+            const uint32_t checksum = butil::crc32c::Value(msg->payload);
+            if (checksum != meta.payload_checksum()) {
+                cntl->SetFailed(EREQUEST, "Payload checksum mismatches, "
+                                "expected=%u actual=%u request_size=%d",
+                                meta.payload_checksum(), checksum, reqsize);
+                break;
+            }
+        }
         butil::IOBuf req_buf;
         butil::IOBuf* req_buf_ptr = &msg->payload;
         if (meta.has_attachment_size()) {
@@ -577,6 +606,15 @@ void ProcessRpcResponse(InputMessageBase* msg_base) {
         // Parse response message iff error code from meta is 0
         butil::IOBuf res_buf;
         const int res_size = msg->payload.length();
+        if (meta.has_payload_checksum()) {
+            const uint32_t checksum = butil::crc32c::Value(msg->payload);
+            if (checksum != meta.payload_checksum()) {
+                cntl->SetFailed(ERESPONSE, "Payload checksum mismatches, "
+                                "expected=%u actual=%u response_size=%d",
+                                meta.payload_checksum(), checksum, res_size);
+                break;
+            }
+        }
         butil::IOBuf* res_buf_ptr = &msg->payload;
         if (meta.has_attachment_size()) {
             if (meta.attachment_size() > res_size) {
@@ -660,6 +698,11 @@ void PackRpcRequest(butil::IOBuf* req_buf,
     if (attached_size) {
         meta.set_attachment_size(attached_size);
     }
+    if (FLAGS_baidu_protocol_payload_checksum) {
+        uint32_t checksum = butil::crc32c::Extend(0, request_body);
+        checksum = butil::crc32c::Extend(checksum, cntl->request_attachment());
+        meta.set_payload_checksum(checksum);
+    }
     Span* span = accessor.span();
     if (span) {
         request_meta->set_trace_id(span->trace_id());
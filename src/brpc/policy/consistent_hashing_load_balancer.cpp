@@ -109,6 +109,17 @@ size_t ConsistentHashingLoadBalancer::Remove(
     return fg.size() - bg.size();
 }
 
+uint32_t ConsistentHashingLoadBalancer::GetReplicaHash(
+    HashFunc hash, const butil::EndPoint& server, size_t index) {
+    char host[32];
+    // To be compatible with libmemcached, we formulate the key of
+    // a virtual node as `|address|-|replica_index|', see
+    // http://fe.baidu.com/-1bszwnf at line 297.
+    const int len = snprintf(host, sizeof(host), "%s-%lu",
+                             endpoint2str(server).c_str(), index);
+    return hash(host, len);
+}
+
 bool ConsistentHashingLoadBalancer::AddServer(const ServerId& server) {
     std::vector<Node> add_nodes;
     add_nodes.reserve(_num_replicas);
@@ -117,11 +128,8 @@ bool ConsistentHashingLoadBalancer::AddServer(const ServerId& server) {
         return false;
     }
     for (size_t i = 0; i < _num_replicas; ++i) {
-        char host[32];
-        int len = snprintf(host, sizeof(host), "%s-%lu", 
-                 endpoint2str(ptr->remote_side()).c_str(), i);
         Node node;
-        node.hash = _hash(host, len);
+        node.hash = GetReplicaHash(_hash, ptr->remote_side(), i);
         node.server_sock = server;
         node.server_addr = ptr->remote_side();
         add_nodes.push_back(node);
@@ -144,14 +152,8 @@ size_t ConsistentHashingLoadBalancer::AddServersInBatch(
             continue;
         }
         for (size_t rep = 0; rep < _num_replicas; ++rep) {
-            char host[32];
-            // To be compatible with libmemcached, we formulate the key of
-            // a virtual node as `|address|-|replica_index|', see
-            // http://fe.baidu.com/-1bszwnf at line 297.
-            int len = snprintf(host, sizeof(host), "%s-%lu",
-                              endpoint2str(ptr->remote_side()).c_str(), rep);
             Node node;
-            node.hash = _hash(host, len);
+            node.hash = GetReplicaHash(_hash, ptr->remote_side(), rep);
             node.server_sock = servers[i];
             node.server_addr = ptr->remote_side();
             add_nodes.push_back(node);
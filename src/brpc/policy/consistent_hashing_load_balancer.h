@@ -41,6 +41,10 @@ public:
     int SelectServer(const SelectIn &in, SelectOut *out);
     void Describe(std::ostream &os, const DescribeOptions& options);
 
+    // Hash of the `index'-th virtual node of `server' on the ring.
+    static uint32_t GetReplicaHash(HashFunc hash, const butil::EndPoint& server,
+                                   size_t index);
+
 private:
     void GetLoads(std::map<butil::EndPoint, double> *load_map);
     struct Node {
@@ -14,12 +14,13 @@
 
 // Authors: Ge,Jun (gejun@baidu.com)
 
-#include <stdio.h>                                      // getline
+#include <fcntl.h>                                      // open
 #include <string>                                       // std::string
 #include <set>                                          // std::set
 #include "butil/files/file_watcher.h"                    // FileWatcher
-#include "butil/files/scoped_file.h"                     // ScopedFILE
+#include "butil/fd_guard.h"                              // fd_guard
 #include "bthread/bthread.h"                            // bthread_usleep
+#include "bthread/unstable.h"                           // bthread_file_read
 #include "brpc/log.h"
 #include "brpc/policy/file_naming_service.h"
 
@@ -64,36 +65,57 @@ bool SplitIntoServerAndTag(const butil::StringPiece& line,
     return true;
 }
 
+// Read the whole file without blocking the worker when the disk is slow.
+static int ReadWholeFile(const char* path, std::string* content) {
+    content->clear();
+    butil::fd_guard fd(open(path, O_RDONLY));
+    if (fd < 0) {
+        return -1;
+    }
+    char buf[4096];
+    while (true) {
+        const ssize_t nr = bthread_file_read(fd, buf, sizeof(buf));
+        if (nr > 0) {
+            content->append(buf, nr);
+        } else if (nr == 0) {
+            return 0;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
 int FileNamingService::GetServers(const char *service_name,
                                   std::vector<ServerNode>* servers) {
     servers->clear();
-    char* line = NULL;
-    size_t line_len = 0;
-    ssize_t nr = 0;
     // Sort/unique the inserted vector is faster, but may have a different order
     // of addresses from the file. To make assertions in tests easier, we use
     // set to de-duplicate and keep the order.
     std::set<ServerNode> presence;
 
-    butil::ScopedFILE fp(fopen(service_name, "r"));
-    if (!fp) {
-        PLOG(ERROR) << "Fail to open `" << service_name << "'";
+    std::string content;
+    if (ReadWholeFile(service_name, &content) != 0) {
+        PLOG(ERROR) << "Fail to read `" << service_name << "'";
         return errno;
     }
-    while ((nr = getline(&line, &line_len, fp.get())) != -1) {
-        if (line[nr - 1] == '\n') { // remove ending newline
-            --nr;
+    size_t line_start = 0;
+    while (line_start < content.size()) {
+        size_t line_end = content.find('\n', line_start);
+        if (line_end == std::string::npos) {
+            line_end = content.size();
         }
+        const butil::StringPiece line(content.data() + line_start,
+                                      line_end - line_start);
+        line_start = line_end + 1;
         butil::StringPiece addr;
         butil::StringPiece tag;
-        if (!SplitIntoServerAndTag(butil::StringPiece(line, nr),
-                                   &addr, &tag)) {
+        if (!SplitIntoServerAndTag(line, &addr, &tag)) {
             continue;
         }
-        const_cast<char*>(addr.data())[addr.size()] = '\0'; // safe
+        const std::string addr_str = addr.as_string();
         butil::EndPoint point;
-        if (str2endpoint(addr.data(), &point) != 0 &&
-            hostname2endpoint(addr.data(), &point) != 0) {
+        if (str2endpoint(addr_str.c_str(), &point) != 0 &&
+            hostname2endpoint(addr_str.c_str(), &point) != 0) {
             LOG(ERROR) << "Invalid address=`" << addr << '\'';
             continue;
         }
@@ -108,7 +130,6 @@ int FileNamingService::GetServers(const char *service_name,
     }
     RPC_VLOG << "Got " << servers->size()
              << (servers->size() > 1 ? " servers" : " server");
-    free(line);
     return 0;
 }
 
@@ -28,6 +28,7 @@
 #include "brpc/errno.pb.h"                     // ENOSERVICE, ENOMETHOD
 #include "brpc/controller.h"                   // Controller
 #include "brpc/server.h"                       // Server
+#include "brpc/http_response_cache.h"          // HttpResponseCache
 #include "brpc/details/server_private_accessor.h"
 #include "brpc/span.h"
 #include "brpc/socket.h"                       // Socket
@@ -115,6 +116,13 @@ CommonStrings::CommonStrings()
     , KEEP_ALIVE("keep-alive")
     , CLOSE("close")
     , LOG_ID("log-id")
+    , PIPELINE_ID("x-bd-pipeline-id")
+    , ETAG("etag")
+    , IF_NONE_MATCH("if-none-match")
+    , CACHE_CONTROL("cache-control")
+    , SET_COOKIE("set-cookie")
+    , TRANSFER_ENCODING("transfer-encoding")
+    , CHUNKED("chunked")
     , DEFAULT_METHOD("default_method")
     , NO_METHOD("no_method")
     , H2_SCHEME(":scheme")
@@ -215,7 +223,12 @@ void ProcessHttpResponse(InputMessageBase* msg) {
     const int64_t start_parse_us = butil::cpuwide_time_us();
     DestroyingPtr<HttpContext> imsg_guard(static_cast<HttpContext*>(msg));
     Socket* socket = imsg_guard->socket();
-    uint64_t cid_value = socket->correlation_id();
+    // Responses of requests pipelined on single connection are correlated
+    // by the PipelinedInfo popped in ParseHttpMessage().
+    const bool pipelined =
+        (imsg_guard->pipelined_info().id_wait != INVALID_BTHREAD_ID);
+    uint64_t cid_value = (pipelined ? imsg_guard->pipelined_info().id_wait.value
+                          : socket->correlation_id());
     if (cid_value == 0) {
         LOG(WARNING) << "Fail to find correlation_id from " << *socket;
         return;
@@ -247,6 +260,32 @@ void ProcessHttpResponse(InputMessageBase* msg) {
     const int saved_error = cntl->ErrorCode();
 
     do {
+        if (pipelined) {
+            // HTTP/1.0 servers are not required to support pipelining, and
+            // servers processing pipelined requests in parallel may send back
+            // responses out of order, which is told by the echoed id.
+            const std::string* pipeline_id =
+                res_header->GetHeader(common->PIPELINE_ID);
+            if (res_header->before_http_1_1() ||
+                (pipeline_id != NULL &&
+                 strtoull(pipeline_id->c_str(), NULL, 10) != cid_value)) {
+                LOG(WARNING) << "Fall back to pooled connections since "
+                             << *socket << " does not support http pipelining";
+                SocketUniquePtr main_socket;
+                if (Socket::Address(socket->main_socket_id(), &main_socket) == 0) {
+                    main_socket->fallback_to_pooled();
+                }
+                // The pipelined socket is not the main socket, failing it
+                // does not mark the server as broken. Other RPCs in-flight
+                // on the connection are retried on pooled connections.
+                socket->SetFailed(EFAILEDSOCKET, "%s does not support http"
+                                  " pipelining", socket->description().c_str());
+                // The response may not belong to this RPC, retry it.
+                cntl->SetFailed(EFAILEDSOCKET, "%s does not support http"
+                                " pipelining", socket->description().c_str());
+                break;
+            }
+        }
         // If header has "Connection: close", close the connection.
         const std::string* conn_cmd = res_header->GetHeader(common->CONNECTION);
         if (conn_cmd != NULL && 0 == strcasecmp(conn_cmd->c_str(), "close")) {
@@ -429,6 +468,26 @@ void SerializeHttpRequest(butil::IOBuf* /*not used*/,
                         cntl->http_request().uri().status().error_cstr());
         return UpdateResponseHeader(HTTP_STATUS_BAD_REQUEST, cntl);
     }
+    if (cntl->is_request_written_progressively()) {
+        const HttpHeader& h = cntl->http_request();
+        if (h.before_http_1_1() || h.major_version() >= 2) {
+            cntl->SetFailed(EREQUEST, "Can't write request of HTTP/%d.%d "
+                            "progressively", h.major_version(),
+                            h.minor_version());
+            return UpdateResponseHeader(HTTP_STATUS_BAD_REQUEST, cntl);
+        }
+        if (cntl->method() == NULL && h.method() == HTTP_METHOD_GET) {
+            cntl->SetFailed(EREQUEST, "Can't write body of GET progressively");
+            return UpdateResponseHeader(HTTP_STATUS_BAD_REQUEST, cntl);
+        }
+        if (cntl->request_compress_type() != COMPRESS_TYPE_NONE) {
+            cntl->SetFailed(EREQUEST, "Can't compress request written "
+                            "progressively");
+            return UpdateResponseHeader(HTTP_STATUS_BAD_REQUEST, cntl);
+        }
+        cntl->http_request().SetHeader(common->TRANSFER_ENCODING,
+                                       common->CHUNKED);
+    }
     if (cntl->request_compress_type() != COMPRESS_TYPE_NONE) {
         if (cntl->request_compress_type() != COMPRESS_TYPE_GZIP) {
             cntl->SetFailed(EREQUEST, "http does not support %s",
@@ -498,10 +557,6 @@ void PackHttpRequest(butil::IOBuf* buf,
                      Controller* cntl,
                      const butil::IOBuf& /*unused*/,
                      const Authenticator* auth) {
-    if (cntl->connection_type() == CONNECTION_TYPE_SINGLE) {
-        cntl->SetFailed(EREQUEST, "http can't work with CONNECTION_TYPE_SINGLE");
-        return UpdateResponseHeader(HTTP_STATUS_BAD_REQUEST, cntl);
-    }
     ControllerPrivateAccessor accessor(cntl);
     HttpHeader* header = &cntl->http_request();
     if (auth != NULL && header->GetHeader(common->AUTHORIZATION) == NULL) {
@@ -514,12 +569,31 @@ void PackHttpRequest(butil::IOBuf* buf,
         header->SetHeader(common->AUTHORIZATION, auth_data);
     }
 
-    // Store `correlation_id' into Socket since http server
-    // may not echo back this field. But we send it anyway.
-    accessor.get_sending_socket()->set_correlation_id(correlation_id);
+    if (cntl->connection_type() == CONNECTION_TYPE_SINGLE) {
+        // Pipeline the request on the single connection. HTTP/1.1 servers
+        // send back responses in the same order as requests.
+        accessor.set_pipelined_count(1);
+        header->SetHeader(common->PIPELINE_ID, butil::string_printf(
+                              "%llu", (unsigned long long)correlation_id));
+    } else {
+        accessor.set_pipelined_count(0);
+        header->RemoveHeader(common->PIPELINE_ID);
+        // Store `correlation_id' into Socket since http server
+        // may not echo back this field. But we send it anyway.
+        accessor.get_sending_socket()->set_correlation_id(correlation_id);
+    }
 
-    SerializeHttpRequest(buf, header, cntl->remote_side(),
-                         &cntl->request_attachment());
+    if (cntl->is_request_written_progressively()) {
+        // Remaining chunks are written by the ProgressiveAttachment after
+        // the request is sent, check Controller::IssueRPC().
+        SerializeHttpRequest(buf, header, cntl->remote_side(), NULL);
+        if (!cntl->request_attachment().empty()) {
+            AppendHttpChunk(buf, cntl->request_attachment());
+        }
+    } else {
+        SerializeHttpRequest(buf, header, cntl->remote_side(),
+                             &cntl->request_attachment());
+    }
     if (FLAGS_http_verbose) {
         PrintMessage(*buf, true, true);
     }
@@ -557,12 +631,127 @@ inline int ErrorCode2StatusCode(int error_code) {
     }
 }
 
+// Passed to SendHttpResponse() for GET requests to services with
+// ServiceOptions.http_response_cache.
+struct HttpResponseCaching {
+    HttpResponseCaching(HttpResponseCache* cache2, bool is_leader2)
+        : cache(cache2), is_leader(is_leader2) {}
+    ~HttpResponseCaching() {
+        if (is_leader) {
+            // The response was not sent, let waiting requests go on.
+            cache->EndGenerating(key, NULL);
+        }
+    }
+    HttpResponseCache* cache;
+    std::string key;
+    // Generating the response of `key' for the cache.
+    bool is_leader;
+};
+
+static void MakeHttpResponseCacheKey(Controller* cntl,
+                                     const HttpResponseCacheOptions& options,
+                                     std::string* key) {
+    const HttpHeader& h = cntl->http_request();
+    key->append(HttpMethod2Str(h.method()));
+    key->push_back(' ');
+    key->append(h.uri().path());
+    const std::string& query = h.uri().query();
+    if (!query.empty()) {
+        key->push_back('?');
+        key->append(query);
+    }
+    // Responses may be compressed according to accept-encoding.
+    if (SupportGzip(cntl)) {
+        key->append("\n+gzip");
+    }
+    for (size_t i = 0; i < options.vary_headers.size(); ++i) {
+        const std::string* value = h.GetHeader(options.vary_headers[i]);
+        key->push_back('\n');
+        key->append(options.vary_headers[i]);
+        key->push_back(':');
+        if (value) {
+            key->append(*value);
+        }
+    }
+}
+
+// Returns NULL if the response should not be cached.
+static HttpResponseCache::Entry* NewHttpResponseCacheEntry(Controller* cntl) {
+    const HttpHeader& h = cntl->http_response();
+    if (cntl->Failed() || cntl->has_progressive_writer() ||
+        h.status_code() != HTTP_STATUS_OK ||
+        h.GetHeader(common->SET_COOKIE) != NULL) {
+        return NULL;
+    }
+    const std::string* cache_control = h.GetHeader(common->CACHE_CONTROL);
+    if (cache_control != NULL &&
+        (cache_control->find("no-store") != std::string::npos ||
+         cache_control->find("private") != std::string::npos)) {
+        return NULL;
+    }
+    HttpResponseCache::Entry* e = new (std::nothrow) HttpResponseCache::Entry;
+    if (e == NULL) {
+        return NULL;
+    }
+    e->status_code = h.status_code();
+    e->content_type = h.content_type();
+    for (HttpHeader::HeaderIterator it = h.HeaderBegin();
+         it != h.HeaderEnd(); ++it) {
+        if (strcasecmp(it->first.c_str(), common->ETAG.c_str()) == 0) {
+            e->etag = it->second;
+        } else if (strcasecmp(it->first.c_str(), common->CONNECTION.c_str()) != 0 &&
+                   strcasecmp(it->first.c_str(), common->PIPELINE_ID.c_str()) != 0) {
+            e->headers.push_back(*it);
+        }
+    }
+    // Share blocks with the response.
+    e->body = cntl->response_attachment();
+    return e;
+}
+
+static void FillCachedHttpResponse(Controller* cntl,
+                                   const HttpResponseCache::Entry& e) {
+    HttpHeader& h = cntl->http_response();
+    h.set_status_code(e.status_code);
+    h.set_content_type(e.content_type);
+    for (size_t i = 0; i < e.headers.size(); ++i) {
+        h.SetHeader(e.headers[i].first, e.headers[i].second);
+    }
+    if (!e.etag.empty()) {
+        h.SetHeader(common->ETAG, e.etag);
+    }
+    cntl->response_attachment() = e.body;
+}
+
+// Weak comparison of entity-tags in If-None-Match, see RFC 7232.
+static bool MatchIfNoneMatch(const std::string& if_none_match,
+                             const std::string& etag) {
+    butil::StringPiece tag2(etag);
+    if (tag2.starts_with("W/")) {
+        tag2.remove_prefix(2);
+    }
+    for (butil::StringMultiSplitter sp(if_none_match.c_str(), ", "); sp; ++sp) {
+        butil::StringPiece tag(sp.field(), sp.length());
+        if (tag == "*") {
+            return true;
+        }
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        if (tag == tag2) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void SendHttpResponse(Controller *cntl,
                              const google::protobuf::Message *req,
                              const google::protobuf::Message *res,
                              const Server* server,
                              MethodStatus* method_status_raw,
-                             long start_parse_us) {
+                             long start_parse_us,
+                             HttpResponseCaching* caching) {
     ControllerPrivateAccessor accessor(cntl);
     Span* span = accessor.span();
     if (span) {
@@ -572,6 +761,7 @@ static void SendHttpResponse(Controller *cntl,
     std::unique_ptr<Controller, LogErrorTextAndDelete> recycle_cntl(cntl);
     std::unique_ptr<const google::protobuf::Message> recycle_req(req);
     std::unique_ptr<const google::protobuf::Message> recycle_res(res);
+    std::unique_ptr<HttpResponseCaching> recycle_caching(caching);
     Socket* socket = accessor.get_sending_socket();
     ScopedRemoveConcurrency remove_concurrency_dummy(server, cntl);
     
@@ -661,6 +851,14 @@ static void SendHttpResponse(Controller *cntl,
     } // else user explicitly set Connection:close, clients of
     // HTTP 1.1/1.0/0.9 should all close the connection.
 
+    // Requests on one connection are processed in parallel and responses
+    // may be sent back out of order, echo the id of pipelined requests to
+    // make brpc clients fall back to pooled connections in that case.
+    const std::string* pipeline_id = req_header->GetHeader(common->PIPELINE_ID);
+    if (pipeline_id != NULL) {
+        res_header->SetHeader(common->PIPELINE_ID, *pipeline_id);
+    }
+
     if (cntl->Failed()) {
         // Set status-code with default value(converted from error code)
         // if user did not set it.
@@ -710,6 +908,27 @@ static void SendHttpResponse(Controller *cntl,
         }
     }
 
+    if (caching != NULL) {
+        if (caching->is_leader) {
+            caching->is_leader = false;
+            HttpResponseCache::EntryPtr entry(NewHttpResponseCacheEntry(cntl));
+            caching->cache->EndGenerating(caching->key, entry.get());
+            if (entry != NULL && !entry->etag.empty()) {
+                res_header->SetHeader(common->ETAG, entry->etag);
+            }
+        }
+        const std::string* etag = res_header->GetHeader(common->ETAG);
+        const std::string* if_none_match =
+            req_header->GetHeader(common->IF_NONE_MATCH);
+        if (etag != NULL && if_none_match != NULL && !cntl->Failed() &&
+            res_header->status_code() == HTTP_STATUS_OK &&
+            MatchIfNoneMatch(*if_none_match, *etag)) {
+            // The client has the same response.
+            res_header->set_status_code(HTTP_STATUS_NOT_MODIFIED);
+            cntl->response_attachment().clear();
+        }
+    }
+
     int rc = -1;
     // Have the risk of unlimited pending responses, in which case, tell
     // users to set max_concurrency.
@@ -749,7 +968,7 @@ static void SendHttpResponse(Controller *cntl,
 
 inline void SendHttpResponse(Controller *cntl, const Server* svr,
                              MethodStatus* method_status) {
-    SendHttpResponse(cntl, NULL, NULL, svr, method_status, -1);
+    SendHttpResponse(cntl, NULL, NULL, svr, method_status, -1, NULL);
 }
 
 // Normalize the sub string of `uri_path' covered by `splitter' and
@@ -873,8 +1092,39 @@ FindMethodPropertyByURI(const std::string& uri_path, const Server* server,
     return NULL;
 }
 
+// Responses of requests pipelined on single connection come back in the
+// same order as the requests, correlate them with PipelinedInfo pushed when
+// the requests were written. The queue is empty for pooled/short connections
+// which save correlation_id in the socket.
+static void PopPipelinedInfoIfNeeded(Socket* socket, HttpContext* http_imsg) {
+    PipelinedInfo pi;
+    if (socket->PopPipelinedInfo(&pi)) {
+        http_imsg->set_pipelined_info(pi);
+    }
+}
+
+int HttpContext::OnHeadersComplete() {
+    if (_server == NULL || read_body_progressively() ||
+        _server->options().http_master_service != NULL ||
+        !ServerPrivateAccessor(_server).has_progressive_read_service()) {
+        return 0;
+    }
+    // Saved for ProcessHttpRequest() and VerifyHttpRequest().
+    const Server::MethodProperty* mp = FindMethodPropertyByURI(
+        header().uri().path(), _server, &_unresolved_path);
+    _method_property = mp;
+    _method_resolved = true;
+    if (mp != NULL && mp->params.enable_progressive_read &&
+        !(mp->params.allow_http_body_to_pb &&
+          mp->method->input_type()->field_count() > 0)) {
+        // The body is not converted to protobuf, let the method read it.
+        set_read_body_progressively(true);
+    }
+    return 0;
+}
+
 ParseResult ParseHttpMessage(butil::IOBuf *source, Socket *socket, 
-                             bool read_eof, const void* /*arg*/) {
+                             bool read_eof, const void* arg) {
     HttpContext* http_imsg = 
         static_cast<HttpContext*>(socket->parsing_context());
     if (http_imsg == NULL) {
@@ -889,7 +1139,8 @@ ParseResult ParseHttpMessage(butil::IOBuf *source, Socket *socket,
             return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
         }
         http_imsg = new (std::nothrow) HttpContext(
-            socket->is_read_progressive());
+            socket->is_read_progressive(),
+            (socket->CreatedByConnect() ? NULL : (const Server*)arg));
         if (http_imsg == NULL) {
             LOG(FATAL) << "Fail to new HttpContext";
             return MakeParseError(PARSE_ERROR_NO_RESOURCE);
@@ -938,15 +1189,21 @@ ParseResult ParseHttpMessage(butil::IOBuf *source, Socket *socket,
         source->pop_front(rc);
         if (http_imsg->Completed()) {
             CHECK_EQ(http_imsg, socket->release_parsing_context());
+            if (socket->CreatedByConnect()) {
+                PopPipelinedInfoIfNeeded(socket, http_imsg);
+            }
             const ParseResult result = MakeMessage(http_imsg);
             if (socket->is_read_progressive()) {
                 socket->OnProgressiveReadCompleted();
             }
             return result;
-        } else if (socket->is_read_progressive() &&
+        } else if (http_imsg->read_body_progressively() &&
                    http_imsg->stage() >= HTTP_ON_HEADERS_COMPLELE) {
             // header part of a progressively-read http message is complete,
             // go on to ProcessHttpXXX w/o waiting for full body.
+            if (socket->CreatedByConnect()) {
+                PopPipelinedInfoIfNeeded(socket, http_imsg);
+            }
             http_imsg->AddOneRefForStage2(); // released when body is fully read
             return MakeMessage(http_imsg);
         } else {
@@ -1011,8 +1268,10 @@ bool VerifyHttpRequest(const InputMessageBase* msg) {
         // Fast pass
         return true;
     }
-    const Server::MethodProperty* mp = FindMethodPropertyByURI(
-        http_request->header().uri().path(), server, NULL);
+    const Server::MethodProperty* mp = http_request->method_resolved() ?
+        http_request->method_property() :
+        FindMethodPropertyByURI(http_request->header().uri().path(),
+                                server, NULL);
     if (mp != NULL &&
         mp->is_builtin_service &&
         mp->service->GetDescriptor() != BadMethodService::descriptor()) {
@@ -1077,6 +1336,13 @@ void ProcessHttpRequest(InputMessageBase *msg) {
         .set_auth_context(socket->auth_context())
         .set_request_protocol(PROTOCOL_HTTP)
         .move_in_server_receiving_sock(socket_guard);
+    if (imsg_guard->read_body_progressively()) {
+        // The body is read by the method or ignored when cntl is destroyed,
+        // which must be done in every branch below, otherwise the parsing
+        // of the socket is blocked when the buffered body is full.
+        accessor.set_readable_progressive_attachment(imsg_guard.get());
+        accessor.set_request_read_progressively(true);
+    }
     
     // Read log-id. errno may be set when input to strtoull overflows.
     // atoi/atol/atoll don't support 64-bit integer and can't be used.
@@ -1150,9 +1416,9 @@ void ProcessHttpRequest(InputMessageBase *msg) {
         google::protobuf::Closure* done = brpc::NewCallback<
             Controller*, const google::protobuf::Message*,
             const google::protobuf::Message*, const Server*,
-            MethodStatus *, long>(
+            MethodStatus *, long, HttpResponseCaching*>(
                 &SendHttpResponse, cntl.get(), NULL, NULL, server,
-                NULL, start_parse_us);
+                NULL, start_parse_us, NULL);
         if (span) {
             span->ResetServerSpanName(md->full_name());
             span->set_start_callback_us(butil::cpuwide_time_us());
@@ -1162,8 +1428,13 @@ void ProcessHttpRequest(InputMessageBase *msg) {
         return svc->CallMethod(md, cntl.release(), NULL, NULL, done);
     }
     
-    const Server::MethodProperty* const sp =
-        FindMethodPropertyByURI(path, server, &req_header._unresolved_path);
+    const Server::MethodProperty* sp = NULL;
+    if (imsg_guard->method_resolved()) {
+        sp = imsg_guard->method_property();
+        req_header._unresolved_path.swap(imsg_guard->unresolved_path());
+    } else {
+        sp = FindMethodPropertyByURI(path, server, &req_header._unresolved_path);
+    }
     if (NULL == sp) {
         if (security_mode) {
             std::string escape_path;
@@ -1277,20 +1548,40 @@ void ProcessHttpRequest(InputMessageBase *msg) {
                 }
             }
         }
-    } else {
+    } else if (!cntl->is_request_read_progressively()) {
         // A http server, just keep content as it is.
         cntl->request_attachment().swap(req_body);
     }
     
     imsg_guard.reset();  // optional, just release resourse ASAP
 
+    HttpResponseCaching* caching = NULL;
+    HttpResponseCache* cache = sp->params.http_response_cache;
+    if (cache != NULL && req_header.method() == HTTP_METHOD_GET) {
+        std::string key;
+        MakeHttpResponseCacheKey(cntl.get(), cache->options(), &key);
+        bool is_leader = false;
+        HttpResponseCache::EntryPtr entry = cache->Lookup(key, &is_leader);
+        if (entry != NULL) {
+            // Answer with the cached response without calling the method.
+            FillCachedHttpResponse(cntl.get(), *entry);
+            return SendHttpResponse(cntl.release(), NULL, NULL, server,
+                                    method_status, start_parse_us,
+                                    new HttpResponseCaching(cache, false));
+        }
+        if (is_leader) {
+            caching = new HttpResponseCaching(cache, true);
+            caching->key.swap(key);
+        }
+    }
+
     google::protobuf::Closure* done = brpc::NewCallback<
         Controller*, const google::protobuf::Message*,
         const google::protobuf::Message*, const Server*,
-        MethodStatus *, long>(
+        MethodStatus *, long, HttpResponseCaching*>(
             &SendHttpResponse, cntl.get(),
             req.get(), res.get(), server,
-            method_status, start_parse_us);
+            method_status, start_parse_us, caching);
     if (span) {
         span->set_start_callback_us(butil::cpuwide_time_us());
         span->AsParent();
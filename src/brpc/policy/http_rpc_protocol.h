@@ -22,6 +22,7 @@
 #include "brpc/details/controller_private_accessor.h"
 #include "brpc/input_messenger.h"              // InputMessenger
 #include "brpc/protocol.h"
+#include "brpc/server.h"                       // Server::MethodProperty
 
 namespace brpc {
 namespace policy {
@@ -50,6 +51,15 @@ struct CommonStrings {
     // rename this to `x-bd-log-id'.
     // NOTE: Keep in mind that this name also appears inside `http_message.cpp'
     std::string LOG_ID;
+    // Id of a request pipelined on single connection, echoed by servers so
+    // that clients can check the order of responses.
+    std::string PIPELINE_ID;
+    std::string ETAG;
+    std::string IF_NONE_MATCH;
+    std::string CACHE_CONTROL;
+    std::string SET_COOKIE;
+    std::string TRANSFER_ENCODING;
+    std::string CHUNKED;
     std::string DEFAULT_METHOD;
     std::string NO_METHOD;
     std::string H2_SCHEME;
@@ -71,10 +81,16 @@ class HttpContext : public ReadableProgressiveAttachment
                        , public InputMessageBase
                        , public HttpMessage {
 public:
-    HttpContext(bool read_body_progressively = false)
+    // `server' is non-NULL for requests received by the server, whose
+    // bodies are read progressively if the methods are configured so.
+    explicit HttpContext(bool read_body_progressively = false,
+                         const Server* server = NULL)
         : InputMessageBase()
         , HttpMessage(read_body_progressively)
-        , _is_stage2(false) {
+        , _is_stage2(false)
+        , _server(server)
+        , _method_resolved(false)
+        , _method_property(NULL) {
         // add one ref for Destroy
         butil::intrusive_ptr<HttpContext>(this).detach();
     }
@@ -91,18 +107,43 @@ public:
     // True if AddOneRefForStage2() was ever called.
     bool is_stage2() const { return _is_stage2; }
 
+    // Correspondence of a response to the request pipelined on single
+    // connection, `id_wait' is INVALID_BTHREAD_ID for other responses.
+    const PipelinedInfo& pipelined_info() const { return _pi; }
+    void set_pipelined_info(const PipelinedInfo& pi) { _pi = pi; }
+
+    // True if the method of the request was found by OnHeadersComplete(),
+    // in which case method_property() (NULL when no method matches) and
+    // unresolved_path() can be used without matching the uri again.
+    bool method_resolved() const { return _method_resolved; }
+    const Server::MethodProperty* method_property() const
+    { return _method_property; }
+    std::string& unresolved_path() { return _unresolved_path; }
+
     // @InputMessageBase
     void DestroyImpl() {
         RemoveOneRefForStage2();
     }
 
+    // @InputMessageBase
+    bool is_partial() const { return _is_stage2; }
+
     // @ReadableProgressiveAttachment
     void ReadProgressiveAttachmentBy(ProgressiveReader* r) {
         return SetBodyReader(r);
     }
 
+protected:
+    // @HttpMessage
+    int OnHeadersComplete();
+
 private:
     bool _is_stage2;
+    const Server* _server;
+    bool _method_resolved;
+    const Server::MethodProperty* _method_property;
+    std::string _unresolved_path;
+    PipelinedInfo _pi;
 };
 
 // Implement functions required in protocol.h
@@ -50,6 +50,7 @@ static pthread_once_t supported_cmd_map_once = PTHREAD_ONCE_INIT;
 static void InitSupportedCommandMap() {
     butil::bit_array_clear(supported_cmd_map, 256);
     butil::bit_array_set(supported_cmd_map, MC_BINARY_GET);
+    butil::bit_array_set(supported_cmd_map, MC_BINARY_GETKQ);
     butil::bit_array_set(supported_cmd_map, MC_BINARY_SET);
     butil::bit_array_set(supported_cmd_map, MC_BINARY_ADD);
     butil::bit_array_set(supported_cmd_map, MC_BINARY_REPLACE);
@@ -125,6 +126,12 @@ ParseResult ParseMemcacheMessage(butil::IOBuf* source,
         msg->meta.append(&local_header, sizeof(local_header));
         source->pop_front(sizeof(*header));
         source->cutn(&msg->meta, total_body_length);
+        if (header->command == (uint8_t)MC_BINARY_GETKQ) {
+            // Quiet GETs of a MultiGet() are ended by a NOOP, which is
+            // counted as the response of the batch.
+            socket->GivebackPipelinedInfo(pi);
+            continue;
+        }
         if (++msg->pi.count >= pi.count) {
             CHECK_EQ(msg->pi.count, pi.count);
             msg = static_cast<MostCommonMessage*>(socket->release_parsing_context());
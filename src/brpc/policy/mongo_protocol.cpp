@@ -17,11 +17,13 @@
 #include <gflags/gflags.h>
 #include "butil/time.h" 
 #include "butil/iobuf.h"                         // butil::IOBuf
+#include "butil/crc32c.h"
 #include "brpc/controller.h"               // Controller
 #include "brpc/socket.h"                   // Socket
 #include "brpc/server.h"                   // Server
 #include "brpc/span.h"
 #include "brpc/mongo_head.h"
+#include "brpc/mongo_message.h"
 #include "brpc/details/server_private_accessor.h"
 #include "brpc/details/controller_private_accessor.h"
 #include "brpc/mongo_service_adaptor.h"
@@ -112,10 +114,13 @@ void SendMongoResponse::Run() {
 ParseResult ParseMongoMessage(butil::IOBuf* source,
                               Socket* socket, bool /*read_eof*/, const void *arg) {
     const Server* server = static_cast<const Server*>(arg);
-    const MongoServiceAdaptor* adaptor = server->options().mongo_service_adaptor;
-    if (NULL == adaptor) {
-        // The server does not enable mongo adaptor.
-        return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+    const MongoServiceAdaptor* adaptor = NULL;
+    if (server != NULL) {
+        adaptor = server->options().mongo_service_adaptor;
+        if (NULL == adaptor) {
+            // The server does not enable mongo adaptor.
+            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+        }
     }
 
     char buf[sizeof(mongo_head_t)];
@@ -133,12 +138,32 @@ ParseResult ParseMongoMessage(butil::IOBuf* source,
         // definitely not a valid mongo packet.
         return MakeParseError(PARSE_ERROR_TRY_OTHERS);
     }
+    if (server == NULL && header.op_code != MONGO_OPCODE_OP_MSG) {
+        // Only OP_MSG is sent at client-side.
+        return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+    }
     uint32_t body_len = static_cast<uint32_t>(header.message_length);
     if (body_len > FLAGS_max_body_size) {
         return MakeParseError(PARSE_ERROR_TOO_BIG_DATA);
     } else if (source->length() < body_len) {
         return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
     }
+    if (server == NULL) {
+        // Responses at client-side. mongod processes requests on a
+        // connection one by one, so responses come back in the same order
+        // as the requests, which are correlated by the PipelinedInfo pushed
+        // when the requests were written.
+        PipelinedInfo pi;
+        if (!socket->PopPipelinedInfo(&pi)) {
+            LOG(WARNING) << "No corresponding PipelinedInfo in socket";
+            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+        }
+        policy::MostCommonMessage* msg = policy::MostCommonMessage::Get();
+        source->cutn(&msg->meta, sizeof(buf));
+        source->cutn(&msg->payload, body_len - sizeof(buf));
+        msg->pi = pi;
+        return MakeMessage(msg);
+    }
     // Mongo protocol is a protocol with state. Each connection has its own
     // mongo context. (e.g. last error occured on the connection, the cursor
     // created by the last Query). The context is stored in
@@ -292,5 +317,156 @@ void ProcessMongoRequest(InputMessageBase* msg_base) {
     mongo_done->Run();
 }
 
+void ProcessMongoResponse(InputMessageBase* msg_base) {
+    const int64_t start_parse_us = butil::cpuwide_time_us();
+    DestroyingPtr<MostCommonMessage> msg(static_cast<MostCommonMessage*>(msg_base));
+
+    const bthread_id_t cid = msg->pi.id_wait;
+    Controller* cntl = NULL;
+    const int rc = bthread_id_lock(cid, (void**)&cntl);
+    if (rc != 0) {
+        LOG_IF(ERROR, rc != EINVAL && rc != EPERM)
+            << "Fail to lock correlation_id=" << cid << ": " << berror(rc);
+        return;
+    }
+
+    ControllerPrivateAccessor accessor(cntl);
+    Span* span = accessor.span();
+    if (span) {
+        span->set_base_real_us(msg->base_real_us());
+        span->set_received_us(msg->received_us());
+        span->set_response_size(msg->meta.size() + msg->payload.size());
+        span->set_start_parse_us(start_parse_us);
+    }
+    const int saved_error = cntl->ErrorCode();
+    do {
+        mongo_head_t header;
+        msg->meta.copy_to(&header, sizeof(header));
+        header.make_host_endian();
+        // request_id of the request is lower 32 bits of the correlation_id,
+        // see PackMongoRequest().
+        if (header.response_to != (int32_t)cid.value) {
+            cntl->SetFailed(ERESPONSE, "response_to=%d does not match "
+                            "request_id=%d", header.response_to,
+                            (int32_t)cid.value);
+            break;
+        }
+        uint32_t flag_bits = 0;
+        if (msg->payload.copy_to(&flag_bits, sizeof(flag_bits)) !=
+            sizeof(flag_bits)) {
+            cntl->SetFailed(ERESPONSE, "Fail to parse flagBits of OP_MSG");
+            break;
+        }
+        flag_bits = butil::ByteSwapToLE32(flag_bits);
+        if (flag_bits & MONGO_MSG_CHECKSUM_PRESENT) {
+            // CRC-32C of the whole message except the checksum itself.
+            uint32_t checksum = 0;
+            if (msg->payload.size() < sizeof(flag_bits) + sizeof(checksum)) {
+                cntl->SetFailed(ERESPONSE, "Fail to parse checksum of OP_MSG");
+                break;
+            }
+            msg->payload.copy_to(&checksum, sizeof(checksum),
+                                 msg->payload.size() - sizeof(checksum));
+            msg->payload.pop_back(sizeof(checksum));
+            const uint32_t actual = butil::crc32c::Extend(
+                butil::crc32c::Value(msg->meta), msg->payload);
+            if (butil::ByteSwapToLE32(checksum) != actual) {
+                cntl->SetFailed(ERESPONSE, "Unmatched checksum of OP_MSG");
+                break;
+            }
+        }
+        msg->payload.pop_front(sizeof(flag_bits));
+        if (cntl->response() == NULL) {
+            break;  // silently ignore the response.
+        }
+        if (cntl->response()->GetDescriptor() != MongoMessage::descriptor()) {
+            cntl->SetFailed(ERESPONSE, "Must be MongoMessage");
+            break;
+        }
+        MongoMessage* response = (MongoMessage*)cntl->response();
+        response->flag_bits = flag_bits;
+        response->sections.swap(msg->payload);
+    } while (false);
+
+    // Unlocks correlation_id inside. Revert controller's
+    // error code if it version check of `cid' fails
+    msg.reset();  // optional, just release resourse ASAP
+    accessor.OnResponse(cid, saved_error);
+}
+
+void SerializeMongoRequest(butil::IOBuf* buf,
+                           Controller* cntl,
+                           const google::protobuf::Message* request) {
+    if (request == NULL) {
+        return cntl->SetFailed(EREQUEST, "request is NULL");
+    }
+    if (request->GetDescriptor() != MongoMessage::descriptor()) {
+        return cntl->SetFailed(EREQUEST, "The request is not a MongoMessage");
+    }
+    if (cntl->response() != NULL &&
+        cntl->response()->GetDescriptor() != MongoMessage::descriptor()) {
+        return cntl->SetFailed(EREQUEST, "The response is not a MongoMessage");
+    }
+    const MongoMessage* req = (const MongoMessage*)request;
+    if (req->flag_bits & MONGO_MSG_MORE_TO_COME) {
+        return cntl->SetFailed(EREQUEST, "Requests with moreToCome are not "
+                               "responded and not supported");
+    }
+    if (req->flag_bits & MONGO_MSG_EXHAUST_ALLOWED) {
+        return cntl->SetFailed(EREQUEST, "Requests with exhaustAllowed may be "
+                               "responded multiple times and not supported");
+    }
+    if (req->sections.empty()) {
+        return cntl->SetFailed(EREQUEST, "The request has no sections");
+    }
+    const uint32_t flag_bits = butil::ByteSwapToLE32(req->flag_bits);
+    buf->append(&flag_bits, sizeof(flag_bits));
+    buf->append(req->sections);
+    // Every request has exactly one response.
+    ControllerPrivateAccessor(cntl).set_pipelined_count(1);
+}
+
+void PackMongoRequest(butil::IOBuf* buf,
+                      SocketMessage**,
+                      uint64_t correlation_id,
+                      const google::protobuf::MethodDescriptor*,
+                      Controller* cntl,
+                      const butil::IOBuf& request,
+                      const Authenticator* /*auth*/) {
+    uint32_t flag_bits = 0;
+    request.copy_to(&flag_bits, sizeof(flag_bits));
+    const bool has_checksum =
+        (butil::ByteSwapToLE32(flag_bits) & MONGO_MSG_CHECKSUM_PRESENT);
+    // Lower 32 bits of `correlation_id' (version of the bthread_id) differ
+    // between retries and consecutive RPCs, being good enough to tell
+    // mismatched responses.
+    mongo_head_t header = {
+        (int32_t)(sizeof(mongo_head_t) + request.size() +
+                  (has_checksum ? sizeof(uint32_t) : 0)),
+        (int32_t)correlation_id,
+        0,
+        MONGO_OPCODE_OP_MSG
+    };
+    header.make_host_endian();  // to little-endian.
+    buf->append(&header, sizeof(header));
+    buf->append(request);
+    if (has_checksum) {
+        const uint32_t checksum =
+            butil::ByteSwapToLE32(butil::crc32c::Value(*buf));
+        buf->append(&checksum, sizeof(checksum));
+    }
+    Span* span = ControllerPrivateAccessor(cntl).span();
+    if (span) {
+        span->set_request_size(buf->size());
+    }
+}
+
+const std::string& GetMongoMethodName(
+    const google::protobuf::MethodDescriptor*,
+    const Controller*) {
+    const static std::string MONGOD_STR = "mongod";
+    return MONGOD_STR;
+}
+
 }  // namespace policy
 } // namespace brpc
@@ -28,6 +28,27 @@ ParseResult ParseMongoMessage(butil::IOBuf* source, Socket* socket, bool read_eo
 // Actions to a (client) request in mongo format
 void ProcessMongoRequest(InputMessageBase* msg);
 
+// Actions to a (server) response in mongo format
+void ProcessMongoResponse(InputMessageBase* msg);
+
+// Serialize a MongoMessage into the body of OP_MSG
+void SerializeMongoRequest(butil::IOBuf* buf,
+                           Controller* cntl,
+                           const google::protobuf::Message* request);
+
+// Pack the body into an OP_MSG
+void PackMongoRequest(butil::IOBuf* buf,
+                      SocketMessage**,
+                      uint64_t correlation_id,
+                      const google::protobuf::MethodDescriptor* method,
+                      Controller* controller,
+                      const butil::IOBuf& request,
+                      const Authenticator* auth);
+
+const std::string& GetMongoMethodName(
+    const google::protobuf::MethodDescriptor*,
+    const Controller*);
+
 } // namespace policy
 } // namespace brpc
 
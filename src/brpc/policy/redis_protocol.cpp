@@ -26,6 +26,7 @@
 #include "brpc/server.h"                   // Server
 #include "brpc/details/server_private_accessor.h"
 #include "brpc/span.h"
+#include "brpc/reloadable_flags.h"
 #include "brpc/redis.h"
 #include "brpc/policy/redis_protocol.h"
 
@@ -33,11 +34,16 @@
 namespace brpc {
 
 DECLARE_bool(enable_rpcz);
+DECLARE_uint64(max_body_size);
 
 namespace policy {
 
 DEFINE_bool(redis_verbose, false,
             "[DEBUG] Print EVERY redis request/response to stderr");
+DEFINE_int32(redis_max_command_args, 1024 * 1024,
+             "Maximum number of arguments in a command to RedisService, "
+             "the connection is closed when a command has more arguments");
+BRPC_VALIDATE_GFLAG(redis_max_command_args, PositiveInteger);
 
 struct InputResponse : public InputMessageBase {
     bthread_id_t id_wait;
@@ -49,12 +55,145 @@ struct InputResponse : public InputMessageBase {
     }
 };
 
-// "Message" = "Response" as we only implement the client for redis.
+// Parsing context of a connection to RedisService. A command may be split
+// into multiple reads, the parsed part is kept here.
+class RedisConnContext : public Destroyable {
+public:
+    RedisConnContext() : parsing_command(false) {}
+
+    // @Destroyable
+    void Destroy() { delete this; }
+
+    // True if `command' was partially parsed.
+    bool parsing_command;
+    RedisReply command;
+    // Memory of the command being parsed and its reply. Cleared after each
+    // command is run, so that it's bounded by the largest command even if
+    // reads of a pipelining client keep ending in the middle of commands.
+    butil::Arena arena;
+    std::vector<butil::StringPiece> args;
+};
+
+// Run `command' and append the reply to `appender'.
+static void RunRedisCommand(const RedisService* service,
+                            RedisConnContext* ctx,
+                            butil::IOBufAppender* appender) {
+    const RedisReply& command = ctx->command;
+    RedisReply output;
+    ctx->args.clear();
+    for (size_t i = 0; i < command.size(); ++i) {
+        if (!command[i].is_string()) {
+            output.SetError("ERR Protocol error: expected bulk strings",
+                            &ctx->arena);
+            output.SerializeTo(appender);
+            return;
+        }
+        ctx->args.push_back(command[i].data());
+    }
+    if (ctx->args.empty()) {
+        output.SetError("ERR Protocol error: empty command", &ctx->arena);
+        output.SerializeTo(appender);
+        return;
+    }
+    RedisCommandHandler* handler =
+        service->FindCommandHandler(command[0].c_str());
+    if (handler == NULL) {
+        std::string err = "ERR unknown command '";
+        err.append(ctx->args[0].data(), ctx->args[0].size());
+        err.push_back('\'');
+        output.SetError(err, &ctx->arena);
+        output.SerializeTo(appender);
+        return;
+    }
+    handler->Run(ctx->args, &output, &ctx->arena);
+    output.SerializeTo(appender);
+}
+
+// Parse and run all complete commands in `source', write their replies
+// in one batch. Commands are run inside parsing rather than being
+// processed in separate bthreads, because replies must be returned in
+// the order of commands.
+static ParseResult ParseAndRunRedisCommands(butil::IOBuf* source,
+                                            Socket* socket,
+                                            const RedisService* service) {
+    RedisConnContext* ctx =
+        static_cast<RedisConnContext*>(socket->parsing_context());
+    if (ctx == NULL) {
+        // Commands are sent as arrays of bulk strings. Inline commands are
+        // not supported since they're hardly distinguishable from other
+        // text protocols like http.
+        const char* pfc = (const char*)source->fetch1();
+        if (pfc == NULL || *pfc != '*') {
+            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+        }
+        ctx = new RedisConnContext;
+        socket->reset_parsing_context(ctx);
+    }
+    butil::IOBufAppender appender;
+    int ncommand = 0;
+    ParseError err = PARSE_OK;
+    while (!source->empty()) {
+        if (!ctx->parsing_command) {
+            const char* pfc = (const char*)source->fetch1();
+            if (*pfc != '*') {
+                LOG(WARNING) << "Invalid first character=" << (int)*pfc
+                             << " of redis command from "
+                             << socket->remote_side();
+                err = PARSE_ERROR_ABSOLUTELY_WRONG;
+                break;
+            }
+            ctx->parsing_command = true;
+        }
+        // Bulk strings of the command are bounded by -max_body_size.
+        err = ctx->command.ConsumePartialCommand(
+            *source, &ctx->arena, FLAGS_redis_max_command_args,
+            FLAGS_max_body_size);
+        if (err != PARSE_OK) {
+            LOG_IF(WARNING, err != PARSE_ERROR_NOT_ENOUGH_DATA)
+                << "Fail to parse redis command from "
+                << socket->remote_side() << ": " << ParseErrorToString(err);
+            break;
+        }
+        ctx->parsing_command = false;
+        RunRedisCommand(service, ctx, &appender);
+        // The reply was serialized into `appender', nothing references
+        // the arena now.
+        ctx->command.Clear();
+        ctx->arena.clear();
+        ++ncommand;
+    }
+    if (ncommand != 0) {
+        // Replies of commands before an invalid one are still written.
+        butil::IOBuf replies;
+        appender.move_to(replies);
+        if (socket->Write(&replies) != 0) {
+            PLOG(WARNING) << "Fail to write replies into " << *socket;
+        }
+    }
+    if (err != PARSE_OK && err != PARSE_ERROR_NOT_ENOUGH_DATA) {
+        return MakeParseError(err);
+    }
+    if (ncommand == 0) {
+        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    }
+    // Nothing to process.
+    return MakeMessage(NULL);
+}
+
 ParseResult ParseRedisMessage(butil::IOBuf* source, Socket* socket,
-                              bool /*read_eof*/, const void* /*arg*/) {
+                              bool /*read_eof*/, const void* arg) {
     if (source->empty()) {
         return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
     }
+    const Server* server = static_cast<const Server*>(arg);
+    if (server != NULL) {
+        const RedisService* service = server->options().redis_service;
+        if (service == NULL) {
+            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+        }
+        return ParseAndRunRedisCommands(source, socket, service);
+    }
+    // Parse responses at client-side.
     // NOTE(gejun): PopPipelinedInfo() is actually more contended than what
     // I thought before. The Socket._pipeline_q is a SPSC queue pushed before
     // sending and popped when response comes back, being protected by a
@@ -132,6 +271,12 @@ void ProcessRedisResponse(InputMessageBase* msg_base) {
     accessor.OnResponse(cid, saved_error);
 }
 
+void ProcessRedisRequest(InputMessageBase* msg_base) {
+    // Commands are run by ParseRedisMessage() which never returns messages.
+    DestroyingPtr<InputMessageBase> msg(msg_base);
+    LOG(ERROR) << "Impossible! redis commands should have been run";
+}
+
 void SerializeRedisRequest(butil::IOBuf* buf,
                            Controller* cntl,
                            const google::protobuf::Message* request) {
@@ -23,10 +23,14 @@
 namespace brpc {
 namespace policy {
 
-// Parse redis response.
+// Parse redis response at client-side, or parse and run redis commands
+// with ServerOptions.redis_service at server-side.
 ParseResult ParseRedisMessage(butil::IOBuf* source, Socket *socket, bool read_eof,
                               const void *arg);
 
+// Required by server-side protocols, never called.
+void ProcessRedisRequest(InputMessageBase* msg);
+
 // Actions to a redis response.
 void ProcessRedisResponse(InputMessageBase* msg);
 
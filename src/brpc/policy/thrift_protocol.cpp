@@ -0,0 +1,627 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <google/protobuf/descriptor.h>         // MethodDescriptor
+#include <google/protobuf/message.h>            // Message
+#include <gflags/gflags.h>
+#include "butil/time.h"
+#include "butil/iobuf.h"                         // butil::IOBuf
+#include "butil/sys_byteorder.h"
+#include "butil/scoped_lock.h"
+#include "butil/containers/flat_map.h"
+#include "brpc/log.h"
+#include "brpc/controller.h"               // Controller
+#include "brpc/socket.h"                   // Socket
+#include "brpc/server.h"                   // Server
+#include "brpc/span.h"
+#include "brpc/destroyable.h"
+#include "brpc/details/server_private_accessor.h"
+#include "brpc/details/controller_private_accessor.h"
+#include "brpc/thrift_service.h"
+#include "brpc/policy/most_common_message.h"
+#include "brpc/policy/thrift_protocol.h"
+#include "brpc/details/usercode_backup_pool.h"
+
+extern "C" {
+void bthread_assign_data(void* data) __THROW;
+}
+
+
+namespace brpc {
+
+// Version of TBinaryProtocol in strict mode, occupying higher 16 bits of
+// the first int32 of a message, the lower 8 bits are the message type.
+static const uint32_t THRIFT_VERSION_MASK = 0xffff0000;
+static const uint32_t THRIFT_VERSION_1 = 0x80010000;
+static const uint32_t THRIFT_TYPE_MASK = 0x000000ff;
+
+// Field types of TBinaryProtocol used in TApplicationException.
+static const char THRIFT_T_STOP = 0;
+static const char THRIFT_T_I32 = 8;
+static const char THRIFT_T_STRING = 11;
+
+// Types of TApplicationException.
+static const int32_t THRIFT_UNKNOWN_METHOD = 1;
+static const int32_t THRIFT_INTERNAL_ERROR = 6;
+
+static void AppendInt32(butil::IOBuf* buf, int32_t value) {
+    const uint32_t net_value = butil::HostToNet32((uint32_t)value);
+    buf->append(&net_value, sizeof(net_value));
+}
+
+static void AppendString(butil::IOBuf* buf, const std::string& str) {
+    AppendInt32(buf, (int32_t)str.size());
+    if (!str.empty()) {
+        buf->append(str.data(), str.size());
+    }
+}
+
+static void AppendFieldBegin(butil::IOBuf* buf, char type, int16_t id) {
+    const uint16_t net_id = butil::HostToNet16((uint16_t)id);
+    buf->push_back(type);
+    buf->append(&net_id, sizeof(net_id));
+}
+
+// Cut the message header (version|type, name, seqid) of TBinaryProtocol
+// from the front of `buf'. Returns false if the header is malformed.
+static bool CutThriftMessageHeader(butil::IOBuf* buf, std::string* name,
+                                   int32_t* type, int32_t* seq_id) {
+    uint32_t raw[2];
+    if (buf->size() < sizeof(raw) + sizeof(int32_t)) {
+        return false;
+    }
+    buf->copy_to(raw, sizeof(raw));
+    const uint32_t version_and_type = butil::NetToHost32(raw[0]);
+    if ((version_and_type & THRIFT_VERSION_MASK) != THRIFT_VERSION_1) {
+        return false;
+    }
+    const uint32_t name_len = butil::NetToHost32(raw[1]);
+    if (name_len > buf->size() - sizeof(raw) - sizeof(int32_t)) {
+        return false;
+    }
+    buf->pop_front(sizeof(raw));
+    name->resize(name_len);
+    if (name_len) {
+        buf->cutn(&(*name)[0], name_len);
+    }
+    uint32_t raw_seq_id = 0;
+    buf->cutn(&raw_seq_id, sizeof(raw_seq_id));
+    *type = (int32_t)(version_and_type & THRIFT_TYPE_MASK);
+    *seq_id = (int32_t)butil::NetToHost32(raw_seq_id);
+    return true;
+}
+
+// Encode a TApplicationException { 1: string message, 2: i32 type }
+static void AppendApplicationException(butil::IOBuf* buf,
+                                       const std::string& message,
+                                       int32_t type) {
+    AppendFieldBegin(buf, THRIFT_T_STRING, 1);
+    AppendString(buf, message);
+    AppendFieldBegin(buf, THRIFT_T_I32, 2);
+    AppendInt32(buf, type);
+    buf->push_back(THRIFT_T_STOP);
+}
+
+// Decode a TApplicationException, fields other than the message and the
+// type are not expected and end the parsing.
+static void ParseApplicationException(const butil::IOBuf& body,
+                                      std::string* message,
+                                      int32_t* type) {
+    butil::IOBuf buf = body;
+    char field_type = THRIFT_T_STOP;
+    uint16_t field_id = 0;
+    while (buf.cut1(&field_type) && field_type != THRIFT_T_STOP &&
+           buf.cutn(&field_id, sizeof(field_id)) == sizeof(field_id)) {
+        field_id = butil::NetToHost16(field_id);
+        uint32_t value = 0;
+        if (buf.cutn(&value, sizeof(value)) != sizeof(value)) {
+            return;
+        }
+        value = butil::NetToHost32(value);
+        if (field_id == 1 && field_type == THRIFT_T_STRING) {
+            if (value > buf.size()) {
+                return;
+            }
+            message->clear();
+            buf.cutn(message, value);
+        } else if (field_id == 2 && field_type == THRIFT_T_I32) {
+            *type = (int32_t)value;
+        } else {
+            return;
+        }
+    }
+}
+
+ThriftClosure::ThriftClosure()
+    : _socket_ptr(NULL)
+    , _server(NULL)
+    , _start_parse_us(0)
+    , _seq_id(0)
+    , _do_respond(true) {
+}
+
+ThriftClosure::~ThriftClosure() {
+    LogErrorTextAndDelete(false)(&_controller);
+}
+
+class DeleteThriftClosure {
+public:
+    void operator()(ThriftClosure* done) const {
+        delete done;
+    }
+};
+
+void ThriftClosure::Run() {
+    // Recycle itself after `Run'
+    std::unique_ptr<ThriftClosure, DeleteThriftClosure> recycle_ctx(this);
+    SocketUniquePtr sock(_socket_ptr);
+    ScopedRemoveConcurrency remove_concurrency_dummy(_server, &_controller);
+
+    ControllerPrivateAccessor accessor(&_controller);
+    Span* span = accessor.span();
+    if (span) {
+        span->set_start_send_us(butil::cpuwide_time_us());
+    }
+    ScopedMethodStatus method_status(_server->options().thrift_service->_status);
+    if (!method_status) {
+        // Judge errors belongings.
+        // may not be accurate, but it does not matter too much.
+        const int error_code = _controller.ErrorCode();
+        if (error_code == ENOSERVICE ||
+            error_code == ENOMETHOD ||
+            error_code == EREQUEST ||
+            error_code == ECLOSE ||
+            error_code == ELOGOFF ||
+            error_code == ELIMIT) {
+            ServerPrivateAccessor(_server).AddError();
+        }
+    }
+
+    if (_controller.IsCloseConnection()) {
+        sock->SetFailed();
+        return;
+    }
+
+    if (_do_respond) {
+        // Errors in the controller are sent as TApplicationException which
+        // is understood by all thrift clients.
+        butil::IOBuf body;
+        int32_t type = THRIFT_REPLY;
+        if (_controller.Failed()) {
+            type = THRIFT_EXCEPTION;
+            AppendApplicationException(
+                &body, _controller.ErrorText(),
+                (_controller.ErrorCode() == ENOMETHOD ?
+                 THRIFT_UNKNOWN_METHOD : THRIFT_INTERNAL_ERROR));
+        } else {
+            if (_response.message_type == THRIFT_EXCEPTION) {
+                type = THRIFT_EXCEPTION;
+            }
+            body.swap(_response.body);
+        }
+        const std::string& name = (_response.method_name.empty() ?
+                                   _request.method_name :
+                                   _response.method_name);
+        butil::IOBuf write_buf;
+        AppendInt32(&write_buf, (int32_t)(sizeof(int32_t) * 3 + name.size() +
+                                          body.size()));
+        AppendInt32(&write_buf, (int32_t)(THRIFT_VERSION_1 | type));
+        AppendString(&write_buf, name);
+        AppendInt32(&write_buf, _seq_id);
+        write_buf.append(body.movable());
+        if (span) {
+            span->set_response_size(write_buf.size());
+        }
+        // Have the risk of unlimited pending responses, in which case, tell
+        // users to set max_concurrency.
+        Socket::WriteOptions wopt;
+        wopt.ignore_eovercrowded = true;
+        if (sock->Write(&write_buf, &wopt) != 0) {
+            const int errcode = errno;
+            PLOG_IF(WARNING, errcode != EPIPE) << "Fail to write into " << *sock;
+            _controller.SetFailed(errcode, "Fail to write into %s",
+                                  sock->description().c_str());
+            return;
+        }
+    }
+    if (span) {
+        // TODO: this is not sent
+        span->set_sent_us(butil::cpuwide_time_us());
+    }
+    if (method_status) {
+        method_status.release()->OnResponded(
+            !_controller.Failed(), butil::cpuwide_time_us() - cpuwide_start_us());
+    }
+}
+
+namespace policy {
+
+// Correlating responses with calls at client-side. Thrift servers are free
+// to send back responses out of order (as brpc does), so the calls are
+// multiplexed on a connection by seqid which is allocated from this context
+// rather than carrying the 64-bit correlation_id. The context is attached
+// to the socket as the parsing context and reset along with the fd.
+class ThriftClientContext : public Destroyable {
+public:
+    ThriftClientContext() : _last_seq_id(0) {
+        CHECK_EQ(0, _id_map.init(64));
+        CHECK_EQ(0, _seq_map.init(64));
+    }
+
+    void Destroy() { delete this; }
+
+    // Returns the seqid for the call.
+    int32_t AddCall(uint64_t correlation_id) {
+        BAIDU_SCOPED_LOCK(_mutex);
+        // Unsigned arithmetic wraps around on long-lived connections.
+        const int32_t seq_id = (int32_t)++_last_seq_id;
+        _id_map[seq_id] = correlation_id;
+        _seq_map[correlation_id] = seq_id;
+        return seq_id;
+    }
+
+    // Returns true and set `correlation_id' if `seq_id' was added.
+    bool RemoveCall(int32_t seq_id, uint64_t* correlation_id) {
+        BAIDU_SCOPED_LOCK(_mutex);
+        uint64_t* id = _id_map.seek(seq_id);
+        if (id == NULL) {
+            return false;
+        }
+        *correlation_id = *id;
+        _id_map.erase(seq_id);
+        _seq_map.erase(*correlation_id);
+        return true;
+    }
+
+    // Forget the call which ended without a response.
+    void RemoveCallById(uint64_t correlation_id) {
+        BAIDU_SCOPED_LOCK(_mutex);
+        int32_t* seq_id = _seq_map.seek(correlation_id);
+        if (seq_id != NULL) {
+            _id_map.erase(*seq_id);
+            _seq_map.erase(correlation_id);
+        }
+    }
+
+private:
+    butil::Mutex _mutex;
+    uint32_t _last_seq_id;
+    butil::FlatMap<int32_t, uint64_t> _id_map;
+    butil::FlatMap<uint64_t, int32_t> _seq_map;
+};
+
+ParseResult ParseThriftFramedMessage(butil::IOBuf* source,
+                                     Socket*, bool /*read_eof*/,
+                                     const void* arg) {
+    const Server* server = static_cast<const Server*>(arg);
+    if (server != NULL && server->options().thrift_service == NULL) {
+        // The server does not serve thrift.
+        return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+    }
+    // frame size + the first int32 of TBinaryProtocol
+    char header_buf[8];
+    const size_t n = source->copy_to(header_buf, sizeof(header_buf));
+    if (n < 6) {
+        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    }
+    // Higher 16 bits of the version in strict mode plays the role of
+    // "magic number" here.
+    if ((uint8_t)header_buf[4] != 0x80 || (uint8_t)header_buf[5] != 0x01) {
+        return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+    }
+    uint32_t frame_size = 0;
+    memcpy(&frame_size, header_buf, sizeof(frame_size));
+    frame_size = butil::NetToHost32(frame_size);
+    if (frame_size > FLAGS_max_body_size) {
+        return MakeParseError(PARSE_ERROR_TOO_BIG_DATA);
+    } else if (source->length() < sizeof(frame_size) + frame_size) {
+        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    }
+    policy::MostCommonMessage* msg = policy::MostCommonMessage::Get();
+    source->pop_front(sizeof(frame_size));
+    source->cutn(&msg->payload, frame_size);
+    return MakeMessage(msg);
+}
+
+struct CallMethodInBackupThreadArgs {
+    ThriftService* service;
+    const Server* server;
+    Controller* controller;
+    const ThriftFramedMessage* request;
+    ThriftFramedMessage* response;
+    ThriftClosure* done;
+};
+
+static void CallMethodInBackupThread(void* void_args) {
+    CallMethodInBackupThreadArgs* args = (CallMethodInBackupThreadArgs*)void_args;
+    args->service->ProcessThriftFramedRequest(*args->server, args->controller,
+                                              *args->request, args->response,
+                                              args->done);
+    delete args;
+}
+
+static void EndRunningCallMethodInPool(ThriftService* service,
+                                       const Server& server,
+                                       Controller* controller,
+                                       const ThriftFramedMessage& request,
+                                       ThriftFramedMessage* response,
+                                       ThriftClosure* done) {
+    CallMethodInBackupThreadArgs* args = new CallMethodInBackupThreadArgs;
+    args->service = service;
+    args->server = &server;
+    args->controller = controller;
+    args->request = &request;
+    args->response = response;
+    args->done = done;
+    return EndRunningUserCodeInPool(CallMethodInBackupThread, args);
+};
+
+void ProcessThriftFramedRequest(InputMessageBase* msg_base) {
+    const int64_t start_parse_us = butil::cpuwide_time_us();
+
+    DestroyingPtr<MostCommonMessage> msg(static_cast<MostCommonMessage*>(msg_base));
+    SocketUniquePtr socket(msg->ReleaseSocket());
+    const Server* server = static_cast<const Server*>(msg_base->arg());
+    ScopedNonServiceError non_service_error(server);
+
+    ThriftService* service = server->options().thrift_service;
+    if (service == NULL) {
+        LOG_EVERY_SECOND(WARNING)
+            << "Received thrift request however the server does not set"
+            " ServerOptions.thrift_service, close the connection.";
+        socket->SetFailed();
+        return;
+    }
+    const size_t request_size = sizeof(int32_t) + msg->payload.size();
+    std::string method_name;
+    int32_t type = 0;
+    int32_t seq_id = 0;
+    if (!CutThriftMessageHeader(&msg->payload, &method_name, &type, &seq_id) ||
+        (type != THRIFT_CALL && type != THRIFT_ONEWAY)) {
+        LOG_EVERY_SECOND(WARNING)
+            << "Received malformed thrift request from " << *socket
+            << ", close the connection.";
+        socket->SetFailed();
+        return;
+    }
+
+    // Switch to service-specific error.
+    non_service_error.release();
+    MethodStatus* method_status = service->_status;
+    if (method_status) {
+        CHECK(method_status->OnRequested());
+    }
+
+    ThriftClosure* thrift_done = new ThriftClosure;
+    Controller* cntl = &(thrift_done->_controller);
+    ThriftFramedMessage* req = &(thrift_done->_request);
+    ThriftFramedMessage* res = &(thrift_done->_response);
+
+    req->method_name.swap(method_name);
+    req->message_type = type;
+    msg->payload.swap(req->body);
+    thrift_done->_start_parse_us = start_parse_us;
+    thrift_done->_socket_ptr = socket.get();
+    thrift_done->_server = server;
+    thrift_done->_seq_id = seq_id;
+    thrift_done->_do_respond = (type != THRIFT_ONEWAY);
+
+    ServerPrivateAccessor server_accessor(server);
+    ControllerPrivateAccessor accessor(cntl);
+    const bool security_mode = server->options().security_mode() &&
+                               socket->user() == server_accessor.acceptor();
+    accessor.set_server(server)
+        .set_security_mode(security_mode)
+        .set_peer_id(socket->id())
+        .set_remote_side(socket->remote_side())
+        .set_local_side(socket->local_side())
+        .set_request_protocol(PROTOCOL_THRIFT);
+
+    // Tag the bthread with this server's key for thread_local_data().
+    if (server->thread_local_options().thread_local_data_factory) {
+        bthread_assign_data((void*)&server->thread_local_options());
+    }
+
+    Span* span = NULL;
+    if (IsTraceable(false)) {
+        span = Span::CreateServerSpan(0, 0, 0, msg->base_real_us());
+        accessor.set_span(span);
+        span->set_remote_side(cntl->remote_side());
+        span->set_protocol(PROTOCOL_THRIFT);
+        span->set_received_us(msg->received_us());
+        span->set_start_parse_us(start_parse_us);
+        span->set_request_size(request_size);
+    }
+
+    do {
+        if (!server->IsRunning()) {
+            cntl->SetFailed(ELOGOFF, "Server is stopping");
+            break;
+        }
+        if (!server_accessor.AddConcurrency(cntl)) {
+            cntl->SetFailed(ELIMIT, "Reached server's max_concurrency=%d",
+                            server->options().max_concurrency);
+            break;
+        }
+        if (FLAGS_usercode_in_pthread && TooManyUserCode()) {
+            cntl->SetFailed(ELIMIT, "Too many user code to run when"
+                            " -usercode_in_pthread is on");
+            break;
+        }
+    } while (false);
+
+    msg.reset();  // optional, just release resourse ASAP
+    // `socket' will be held until response has been sent
+    socket.release();
+    if (span) {
+        span->ResetServerSpanName(req->method_name);
+        span->set_start_callback_us(butil::cpuwide_time_us());
+        span->AsParent();
+    }
+    if (!FLAGS_usercode_in_pthread) {
+        return service->ProcessThriftFramedRequest(*server, cntl, *req, res,
+                                                   thrift_done);
+    }
+    if (BeginRunningUserCode()) {
+        service->ProcessThriftFramedRequest(*server, cntl, *req, res,
+                                            thrift_done);
+        return EndRunningUserCodeInPlace();
+    } else {
+        return EndRunningCallMethodInPool(
+            service, *server, cntl, *req, res, thrift_done);
+    }
+}
+
+void ProcessThriftFramedResponse(InputMessageBase* msg_base) {
+    const int64_t start_parse_us = butil::cpuwide_time_us();
+    DestroyingPtr<MostCommonMessage> msg(static_cast<MostCommonMessage*>(msg_base));
+
+    const size_t response_size = sizeof(int32_t) + msg->payload.size();
+    std::string method_name;
+    int32_t type = 0;
+    int32_t seq_id = 0;
+    if (!CutThriftMessageHeader(&msg->payload, &method_name, &type, &seq_id)) {
+        LOG(WARNING) << "Fail to parse thrift response from "
+                     << *msg->socket();
+        return;
+    }
+    // The context was set in PackThriftFramedRequest() and can't be reset
+    // while `msg' references the socket.
+    ThriftClientContext* ctx =
+        dynamic_cast<ThriftClientContext*>(msg->socket()->parsing_context());
+    CallId cid = INVALID_BTHREAD_ID;
+    if (ctx == NULL || !ctx->RemoveCall(seq_id, &cid.value)) {
+        LOG(WARNING) << "Fail to find the call of seqid=" << seq_id;
+        return;
+    }
+    Controller* cntl = NULL;
+    const int rc = bthread_id_lock(cid, (void**)&cntl);
+    if (rc != 0) {
+        LOG_IF(ERROR, rc != EINVAL && rc != EPERM)
+            << "Fail to lock correlation_id=" << cid << ": " << berror(rc);
+        return;
+    }
+
+    ControllerPrivateAccessor accessor(cntl);
+    Span* span = accessor.span();
+    if (span) {
+        span->set_base_real_us(msg->base_real_us());
+        span->set_received_us(msg->received_us());
+        span->set_response_size(response_size);
+        span->set_start_parse_us(start_parse_us);
+    }
+    const int saved_error = cntl->ErrorCode();
+    if (type == THRIFT_EXCEPTION) {
+        std::string message;
+        int32_t exception_type = THRIFT_INTERNAL_ERROR;
+        ParseApplicationException(msg->payload, &message, &exception_type);
+        cntl->SetFailed((exception_type == THRIFT_UNKNOWN_METHOD ?
+                         ENOMETHOD : EINTERNAL), "%s", message.c_str());
+    } else if (type != THRIFT_REPLY) {
+        cntl->SetFailed(ERESPONSE, "Unexpected type=%d of thrift response",
+                        type);
+    } else if (cntl->response() != NULL) {
+        // MUST be ThriftFramedMessage (checked in SerializeThriftFramedRequest)
+        ThriftFramedMessage* response = (ThriftFramedMessage*)cntl->response();
+        response->method_name.swap(method_name);
+        response->message_type = type;
+        msg->payload.swap(response->body);
+    } // else just ignore the response.
+
+    // Unlocks correlation_id inside. Revert controller's
+    // error code if it version check of `cid' fails
+    msg.reset();  // optional, just release resourse ASAP
+    accessor.OnResponse(cid, saved_error);
+}
+
+void SerializeThriftFramedRequest(butil::IOBuf* request_buf, Controller* cntl,
+                                  const google::protobuf::Message* req_base) {
+    if (req_base == NULL) {
+        return cntl->SetFailed(EREQUEST, "request is NULL");
+    }
+    if (req_base->GetDescriptor() != ThriftFramedMessage::descriptor()) {
+        return cntl->SetFailed(EINVAL, "Type of request must be ThriftFramedMessage");
+    }
+    if (cntl->response() != NULL &&
+        cntl->response()->GetDescriptor() != ThriftFramedMessage::descriptor()) {
+        return cntl->SetFailed(EINVAL, "Type of response must be ThriftFramedMessage");
+    }
+    const ThriftFramedMessage* req = (const ThriftFramedMessage*)req_base;
+    if (req->method_name.empty()) {
+        return cntl->SetFailed(EREQUEST, "method_name of request is empty");
+    }
+    if (req->message_type != THRIFT_CALL) {
+        // Oneway calls are not responded, which can't end RPC.
+        return cntl->SetFailed(EREQUEST, "Only THRIFT_CALL is supported");
+    }
+    // seqid is inserted after the name in PackThriftFramedRequest
+    AppendInt32(request_buf, (int32_t)(THRIFT_VERSION_1 | THRIFT_CALL));
+    AppendString(request_buf, req->method_name);
+    request_buf->append(req->body);
+}
+
+void PackThriftFramedRequest(
+    butil::IOBuf* packet_buf,
+    SocketMessage**,
+    uint64_t correlation_id,
+    const google::protobuf::MethodDescriptor*,
+    Controller* cntl,
+    const butil::IOBuf& request,
+    const Authenticator*) {
+    ControllerPrivateAccessor accessor(cntl);
+    Socket* sock = accessor.get_sending_socket();
+    ThriftClientContext* ctx =
+        dynamic_cast<ThriftClientContext*>(sock->parsing_context());
+    if (ctx == NULL) {
+        ctx = new ThriftClientContext;
+        if (!sock->initialize_parsing_context(&ctx)) {
+            ctx = dynamic_cast<ThriftClientContext*>(sock->parsing_context());
+        }
+        if (ctx == NULL) {
+            return cntl->SetFailed(
+                EINVAL, "The connection is used by protocols other than thrift");
+        }
+    }
+    uint32_t name_len = 0;
+    request.copy_to(&name_len, sizeof(name_len), sizeof(int32_t));
+    const size_t seq_id_offset = sizeof(int32_t) * 2 + butil::NetToHost32(name_len);
+    AppendInt32(packet_buf, (int32_t)(request.size() + sizeof(int32_t)));
+    request.append_to(packet_buf, seq_id_offset, 0);
+    AppendInt32(packet_buf, ctx->AddCall(correlation_id));
+    request.append_to(packet_buf, request.size() - seq_id_offset,
+                      seq_id_offset);
+
+    Span* span = accessor.span();
+    if (span) {
+        span->set_request_size(packet_buf->size());
+    }
+}
+
+void OnThriftFramedCallEnded(Socket* sock, uint64_t correlation_id) {
+    ThriftClientContext* ctx =
+        dynamic_cast<ThriftClientContext*>(sock->parsing_context());
+    if (ctx != NULL) {
+        ctx->RemoveCallById(correlation_id);
+    }
+}
+
+const std::string& GetThriftFramedMethodName(
+    const google::protobuf::MethodDescriptor*,
+    const Controller*) {
+    const static std::string THRIFT_STR = "thrift";
+    return THRIFT_STR;
+}
+
+} // namespace policy
+} // namespace brpc
@@ -0,0 +1,59 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BRPC_POLICY_THRIFT_PROTOCOL_H
+#define BRPC_POLICY_THRIFT_PROTOCOL_H
+
+#include "brpc/protocol.h"
+
+
+namespace brpc {
+namespace policy {
+
+// Parse thrift messages in TFramedTransport + TBinaryProtocol(strict)
+ParseResult ParseThriftFramedMessage(butil::IOBuf* source, Socket* socket,
+                                     bool read_eof, const void *arg);
+
+// Actions to a (client) request in thrift format
+void ProcessThriftFramedRequest(InputMessageBase* msg);
+
+// Actions to a (server) response in thrift format
+void ProcessThriftFramedResponse(InputMessageBase* msg);
+
+void SerializeThriftFramedRequest(butil::IOBuf* request_buf,
+                                  Controller* controller,
+                                  const google::protobuf::Message* request);
+
+void PackThriftFramedRequest(
+    butil::IOBuf* packet_buf,
+    SocketMessage**,
+    uint64_t correlation_id,
+    const google::protobuf::MethodDescriptor*,
+    Controller* controller,
+    const butil::IOBuf&,
+    const Authenticator*);
+
+// Called when a call sent through `sock' ends without a response (timedout,
+// canceled, retried...), so that the connection stops waiting for it.
+void OnThriftFramedCallEnded(Socket* sock, uint64_t correlation_id);
+
+const std::string& GetThriftFramedMethodName(
+    const google::protobuf::MethodDescriptor*,
+    const Controller*);
+
+} // namespace policy
+} // namespace brpc
+
+
+#endif // BRPC_POLICY_THRIFT_PROTOCOL_H
@@ -20,6 +20,7 @@
 #include "brpc/progressive_attachment.h"
 #include "brpc/socket.h"
 #include "brpc/errno.pb.h"
+#include "brpc/details/http_message.h"    // AppendHttpChunk
 
 
 namespace brpc {
@@ -48,7 +49,7 @@ ProgressiveAttachment::~ProgressiveAttachment() {
             // note: _httpsock may already be failed.
             if (_rpc_state.load(butil::memory_order_relaxed) == RPC_SUCCEED) {
                 butil::IOBuf tmpbuf;
-                tmpbuf.append("0\r\n\r\n", 5);
+                AppendLastHttpChunk(&tmpbuf);
                 Socket::WriteOptions wopt;
                 wopt.ignore_eovercrowded = true;
                 _httpsock->Write(&tmpbuf, &wopt);
@@ -67,37 +68,10 @@ ProgressiveAttachment::~ProgressiveAttachment() {
     }
 }
 
-static char s_hex_map[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8',
-                            '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-inline char ToHex(uint32_t size/*0-15*/) { return s_hex_map[size]; }
-
-inline void AppendChunkHead(butil::IOBuf* buf, uint32_t size) {
-    char tmp[32];
-    int i = (int)sizeof(tmp);
-    tmp[--i] = '\n';
-    tmp[--i] = '\r';
-    if (size == 0) {
-        tmp[--i] = '0';
-    } else {
-        for (--i; i >= 0; --i) {
-            const uint32_t new_size = (size >> 4);
-            tmp[i] = ToHex(size - (new_size << 4));
-            size = new_size;
-            if (size == 0) {
-                --i;
-                break;
-            }
-        }
-    }
-    buf->append(tmp + i + 1, sizeof(tmp) - i - 1);
-}
-
 inline void AppendAsChunk(butil::IOBuf* chunk_buf, const butil::IOBuf& data,
                           bool before_http_1_1) {
     if (!before_http_1_1) {
-        AppendChunkHead(chunk_buf, data.size());
-        chunk_buf->append(data);
-        chunk_buf->append("\r\n", 2);   
+        AppendHttpChunk(chunk_buf, data);
     } else {
         chunk_buf->append(data);
     }
@@ -106,9 +80,7 @@ inline void AppendAsChunk(butil::IOBuf* chunk_buf, const butil::IOBuf& data,
 inline void AppendAsChunk(butil::IOBuf* chunk_buf, const void* data,
                           size_t length, bool before_http_1_1) {
     if (!before_http_1_1) {
-        AppendChunkHead(chunk_buf, length);
-        chunk_buf->append(data, length);
-        chunk_buf->append("\r\n", 2);   
+        AppendHttpChunk(chunk_buf, data, length);
     } else {
         chunk_buf->append(data, length);
     }
@@ -198,6 +170,10 @@ void ProgressiveAttachment::MarkRPCAsDone(bool rpc_failed) {
     const int MAX_TRY = 3;
     int ntry = 0;
     bool permanent_error = false;
+    if (_httpsock == NULL) {
+        // [Client-side] The request was never sent.
+        rpc_failed = true;
+    }
     do {
         std::unique_lock<butil::Mutex> mu(_mutex);
         if (_saved_buf.empty() || permanent_error || rpc_failed) {
@@ -223,6 +199,13 @@ void ProgressiveAttachment::MarkRPCAsDone(bool rpc_failed) {
     } while (true);
 }
 
+void ProgressiveAttachment::MarkRequestAsSent(SocketUniquePtr& movable_httpsock) {
+    // Write() does not touch _httpsock until it sees RPC_SUCCEED which is
+    // stored with release semantics in MarkRPCAsDone().
+    _httpsock.swap(movable_httpsock);
+    MarkRPCAsDone(false);
+}
+
 butil::EndPoint ProgressiveAttachment::remote_side() const {
     return _httpsock ? _httpsock->remote_side() : butil::EndPoint();
 }
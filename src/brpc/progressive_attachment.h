@@ -38,6 +38,7 @@ public:
     int Write(const void* data, size_t n);
 
     // Get ip/port of peer/self.
+    // [Client-side] Valid after the request is sent.
     butil::EndPoint remote_side() const;
     butil::EndPoint local_side() const;
 
@@ -60,6 +61,11 @@ protected:
 
     // Called by controller only.
     void MarkRPCAsDone(bool rpc_failed);
+
+    // [Client-side] Called by controller after headers of the request (and
+    // request_attachment as the first chunk) were written into
+    // `movable_httpsock'. Buffered chunks are written after them.
+    void MarkRequestAsSent(SocketUniquePtr& movable_httpsock);
     
     bool _before_http_1_1;
     bool _pause_from_mark_rpc_as_done;
@@ -505,6 +505,17 @@ void RedisResponse::Swap(RedisResponse* other) {
     }
 }
 
+void RedisResponse::MoveReplies(RedisReply* replies, int reply_count,
+                                butil::Arena* arena) {
+    Clear();
+    _arena.swap(*arena);
+    if (reply_count > 0) {
+        _first_reply.Swap(replies[0]);
+    }
+    _other_replies = (reply_count > 1 ? replies + 1 : NULL);
+    _nreply = reply_count;
+}
+
 ::google::protobuf::Metadata RedisResponse::GetMetadata() const {
     protobuf_AssignDescriptorsOnce();
     ::google::protobuf::Metadata metadata;
@@ -568,5 +579,28 @@ std::ostream& operator<<(std::ostream& os, const RedisResponse& response) {
     }
     return os;
 }
+
+RedisService::RedisService() {
+    CHECK_EQ(0, _command_map.init(64));
+}
+
+bool RedisService::AddCommandHandler(const std::string& name,
+                                     RedisCommandHandler* handler) {
+    if (name.empty() || handler == NULL) {
+        LOG(ERROR) << "Parameter[name] is empty or Parameter[handler] is NULL";
+        return false;
+    }
+    if (_command_map.seek(name) != NULL) {
+        LOG(ERROR) << "Redis command=" << name << " is already handled";
+        return false;
+    }
+    _command_map[name] = handler;
+    return true;
+}
+
+RedisCommandHandler* RedisService::FindCommandHandler(const char* name) const {
+    RedisCommandHandler* const* handler = _command_map.seek(name);
+    return handler ? *handler : NULL;
+}
  
 } // namespace brpc
@@ -18,6 +18,7 @@
 #define BRPC_REDIS_H
 
 #include <string>
+#include <vector>
 #include <google/protobuf/stubs/common.h>
 
 #include <google/protobuf/generated_message_util.h>
@@ -29,6 +30,7 @@
 #include "butil/iobuf.h"
 #include "butil/strings/string_piece.h"
 #include "butil/arena.h"
+#include "butil/containers/case_ignored_flat_map.h"
 #include "redis_reply.h"
 
 
@@ -203,10 +205,17 @@ public:
     ::google::protobuf::Metadata GetMetadata() const;
     
 private:
+friend class RedisClusterChannel;
+
     void SharedCtor();
     void SharedDtor();
     void SetCachedSize(int size) const;
 
+    // Replace replies of this response with `replies[0, reply_count)'
+    // allocated on `arena', which is swapped into this response.
+    void MoveReplies(RedisReply* replies, int reply_count,
+                     butil::Arena* arena);
+
     RedisReply _first_reply;
     RedisReply* _other_replies;
     butil::Arena _arena;
@@ -225,6 +234,46 @@ friend void protobuf_ShutdownFile_baidu_2frpc_2fredis_5fbase_2eproto();
 std::ostream& operator<<(std::ostream& os, const RedisRequest&);
 std::ostream& operator<<(std::ostream& os, const RedisResponse&);
 
+// Handle one kind of redis commands at server-side.
+class RedisCommandHandler {
+public:
+    virtual ~RedisCommandHandler() {}
+
+    // Called when a command routed to this handler is received.
+    // `args' are the command name(args[0]) and its arguments, referencing
+    // memory valid only during the call. Fill the reply into `output' and
+    // allocate memory of the reply on `arena'.
+    // Commands from one connection are run one by one in the order of being
+    // received, in the bthread reading the connection, thus a blocking
+    // handler delays following commands of the connection.
+    virtual void Run(const std::vector<butil::StringPiece>& args,
+                     RedisReply* output,
+                     butil::Arena* arena) = 0;
+};
+
+// Serve redis protocol on brpc::Server by assigning an instance to
+// ServerOptions.redis_service. Commands pipelined by clients are parsed
+// and run in batch, replies to the batch are written back at once.
+class RedisService {
+public:
+    RedisService();
+    virtual ~RedisService() {}
+
+    // Route commands named `name'(case-insensitive) to `handler', which is
+    // not owned by the service and must be valid when the server is running.
+    // Returns true on success.
+    bool AddCommandHandler(const std::string& name,
+                           RedisCommandHandler* handler);
+
+    // Find the handler of command `name', NULL if not found.
+    RedisCommandHandler* FindCommandHandler(const char* name) const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(RedisService);
+
+    butil::CaseIgnoredFlatMap<RedisCommandHandler*> _command_map;
+};
+
 } // namespace brpc
 
 
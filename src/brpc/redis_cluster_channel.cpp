@@ -0,0 +1,690 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <inttypes.h>                       // PRId64
+#include <stdlib.h>                         // strtol
+#include <string.h>                         // strncmp
+#include "butil/fast_rand.h"                // fast_rand_less_than
+#include "butil/scoped_lock.h"              // BAIDU_SCOPED_LOCK
+#include "butil/string_printf.h"            // string_appendf
+#include "butil/string_splitter.h"          // StringMultiSplitter
+#include "butil/synchronization/lock.h"     // butil::Mutex
+#include "butil/time.h"                     // gettimeofday_us
+#include "bthread/bthread.h"
+#include "bthread/unstable.h"               // bthread_timer_add
+#include "brpc/controller.h"
+#include "brpc/redis.h"
+#include "brpc/redis_cluster_channel.h"
+
+
+namespace brpc {
+
+RedisClusterChannelOptions::RedisClusterChannelOptions()
+    : max_redirections(5) {
+    channel_options.protocol = PROTOCOL_REDIS;
+}
+
+// CRC16-CCITT (XMODEM) as specified by redis cluster.
+static uint16_t crc16(const char* buf, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= (uint16_t)(uint8_t)buf[i] << 8;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+int RedisClusterChannel::GetKeySlot(const butil::StringPiece& key) {
+    // Only the part between the first '{' and the following '}' is hashed
+    // if it's not empty, so that keys with a same tag are in one slot.
+    const size_t start = key.find('{');
+    if (start != butil::StringPiece::npos) {
+        const size_t end = key.find('}', start + 1);
+        if (end != butil::StringPiece::npos && end != start + 1) {
+            return crc16(key.data() + start + 1, end - start - 1) % SLOT_COUNT;
+        }
+    }
+    return crc16(key.data(), key.size()) % SLOT_COUNT;
+}
+
+// Parse error replies like "MOVED 3999 127.0.0.1:6381".
+static bool ParseRedirection(const RedisReply& reply, bool* ask,
+                             int* slot, std::string* addr) {
+    const char* msg = reply.error_message();
+    if (strncmp(msg, "MOVED ", 6) == 0) {
+        *ask = false;
+        msg += 6;
+    } else if (strncmp(msg, "ASK ", 4) == 0) {
+        *ask = true;
+        msg += 4;
+    } else {
+        return false;
+    }
+    char* endptr = NULL;
+    const long s = strtol(msg, &endptr, 10);
+    if (endptr == msg || *endptr != ' ' ||
+        s < 0 || s >= RedisClusterChannel::SLOT_COUNT) {
+        return false;
+    }
+    *slot = (int)s;
+    addr->assign(endptr + 1);
+    return !addr->empty();
+}
+
+RedisClusterChannel::RedisClusterChannel()
+    : _refreshing(false)
+    , _refresh_tid(INVALID_BTHREAD) {
+    pthread_mutex_init(&_mutex, NULL);
+    _slots.Modify(InitSlots);
+}
+
+RedisClusterChannel::~RedisClusterChannel() {
+    if (_refresh_tid != INVALID_BTHREAD) {
+        bthread_join(_refresh_tid, NULL);
+    }
+    for (std::map<std::string, Channel*>::iterator
+             it = _channels.begin(); it != _channels.end(); ++it) {
+        delete it->second;
+    }
+    _channels.clear();
+    pthread_mutex_destroy(&_mutex);
+}
+
+size_t RedisClusterChannel::InitSlots(SlotTable& bg) {
+    bg.assign(SLOT_COUNT, NULL);
+    return 1;
+}
+
+size_t RedisClusterChannel::ResetSlots(SlotTable& bg, const SlotTable& fg) {
+    bg = fg;
+    return 1;
+}
+
+size_t RedisClusterChannel::SetSlot(SlotTable& bg, const int& slot,
+                                    Channel* const& channel) {
+    bg[slot] = channel;
+    return 1;
+}
+
+int RedisClusterChannel::Init(const char* seeds,
+                              const RedisClusterChannelOptions* options) {
+    if (options) {
+        _options = *options;
+    }
+    _options.channel_options.protocol = PROTOCOL_REDIS;
+    int nseed = 0;
+    for (butil::StringMultiSplitter sp(seeds, ", "); sp; ++sp) {
+        if (GetOrNewChannel(std::string(sp.field(), sp.length())) != NULL) {
+            ++nseed;
+        }
+    }
+    if (nseed == 0) {
+        LOG(ERROR) << "No valid seed nodes in `" << seeds << '\'';
+        return -1;
+    }
+    if (RefreshSlots() != 0) {
+        LOG(ERROR) << "Fail to load slots of redis cluster from `"
+                   << seeds << '\'';
+        return -1;
+    }
+    return 0;
+}
+
+Channel* RedisClusterChannel::GetOrNewChannel(const std::string& addr) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    std::map<std::string, Channel*>::const_iterator it = _channels.find(addr);
+    if (it != _channels.end()) {
+        return it->second;
+    }
+    Channel* channel = new Channel;
+    if (channel->Init(addr.c_str(), &_options.channel_options) != 0) {
+        LOG(ERROR) << "Fail to init channel to redis node=" << addr;
+        delete channel;
+        return NULL;
+    }
+    _channels[addr] = channel;
+    return channel;
+}
+
+Channel* RedisClusterChannel::GetSlotChannel(int slot) {
+    butil::DoublyBufferedData<SlotTable>::ScopedPtr ptr;
+    if (_slots.Read(&ptr) != 0) {
+        return NULL;
+    }
+    return (*ptr)[slot];
+}
+
+int RedisClusterChannel::ParseSlots(const RedisReply& reply,
+                                    const butil::EndPoint& from,
+                                    SlotTable* table) {
+    // Each element is [start, end, [ip, port, id], replicas...]
+    if (!reply.is_array()) {
+        return -1;
+    }
+    table->assign(SLOT_COUNT, NULL);
+    for (size_t i = 0; i < reply.size(); ++i) {
+        const RedisReply& range = reply[i];
+        if (!range.is_array() || range.size() < 3 ||
+            !range[0].is_integer() || !range[1].is_integer() ||
+            !range[2].is_array() || range[2].size() < 2 ||
+            !range[2][0].is_string() || !range[2][1].is_integer()) {
+            LOG(WARNING) << "Invalid slot range: " << range;
+            return -1;
+        }
+        const int64_t start = range[0].integer();
+        const int64_t end = range[1].integer();
+        if (start < 0 || start > end || end >= SLOT_COUNT) {
+            LOG(WARNING) << "Invalid slot range: " << range;
+            return -1;
+        }
+        // Empty ip means the node that answers.
+        std::string addr = range[2][0].data().as_string();
+        if (addr.empty()) {
+            addr = butil::ip2str(from.ip).c_str();
+        }
+        butil::string_appendf(&addr, ":%lld", (long long)range[2][1].integer());
+        Channel* channel = GetOrNewChannel(addr);
+        if (channel == NULL) {
+            return -1;
+        }
+        for (int64_t slot = start; slot <= end; ++slot) {
+            (*table)[slot] = channel;
+        }
+    }
+    return 0;
+}
+
+int RedisClusterChannel::RefreshSlots() {
+    std::vector<Channel*> nodes;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        nodes.reserve(_channels.size());
+        for (std::map<std::string, Channel*>::const_iterator
+                 it = _channels.begin(); it != _channels.end(); ++it) {
+            nodes.push_back(it->second);
+        }
+    }
+    if (nodes.empty()) {
+        return -1;
+    }
+    RedisRequest request;
+    request.AddCommand("cluster slots");
+    // Start from a random node to spread the load of refreshing.
+    const size_t offset = butil::fast_rand_less_than(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        Controller cntl;
+        RedisResponse response;
+        nodes[(offset + i) % nodes.size()]->CallMethod(
+            NULL, &cntl, &request, &response, NULL);
+        if (cntl.Failed()) {
+            LOG(WARNING) << "Fail to get slots from " << cntl.remote_side()
+                         << ": " << cntl.ErrorText();
+            continue;
+        }
+        SlotTable table;
+        if (ParseSlots(response.reply(0), cntl.remote_side(), &table) != 0) {
+            LOG(WARNING) << "Fail to parse slots from " << cntl.remote_side()
+                         << ": " << response.reply(0);
+            continue;
+        }
+        _slots.Modify(ResetSlots, table);
+        return 0;
+    }
+    return -1;
+}
+
+void* RedisClusterChannel::RunRefresh(void* arg) {
+    RedisClusterChannel* c = static_cast<RedisClusterChannel*>(arg);
+    c->RefreshSlots();
+    c->_refreshing.store(false, butil::memory_order_release);
+    return NULL;
+}
+
+void RedisClusterChannel::ScheduleRefresh() {
+    // At most one refreshing at any time, MOVED replies during the
+    // refreshing are covered by it.
+    if (_refreshing.exchange(true, butil::memory_order_acquire)) {
+        return;
+    }
+    if (bthread_start_background(&_refresh_tid, NULL, RunRefresh, this) != 0) {
+        LOG(ERROR) << "Fail to start bthread to refresh slots";
+        _refreshing.store(false, butil::memory_order_release);
+    }
+}
+
+int RedisClusterChannel::CheckHealth() {
+    butil::DoublyBufferedData<SlotTable>::ScopedPtr ptr;
+    if (_slots.Read(&ptr) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < ptr->size(); ++i) {
+        if ((*ptr)[i] == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void RedisClusterChannel::Describe(std::ostream& os,
+                                   const DescribeOptions&) const {
+    os << "RedisClusterChannel[";
+    BAIDU_SCOPED_LOCK(_mutex);
+    for (std::map<std::string, Channel*>::const_iterator
+             it = _channels.begin(); it != _channels.end(); ++it) {
+        if (it != _channels.begin()) {
+            os << ' ';
+        }
+        os << it->first;
+    }
+    os << ']';
+}
+
+// Commands sent to one node in one round.
+struct RedisSubCall {
+    Channel* channel;
+    // Index of the command for each reply, -1 for replies of ASKING.
+    std::vector<int> command_indexes;
+    RedisRequest request;
+    RedisResponse response;
+    Controller cntl;
+};
+
+struct RedisPendingCommand {
+    int index;
+    // Non-NULL if the command was redirected by ASK.
+    Channel* ask_channel;
+};
+
+// Set as the done of the controller of a call to RedisClusterChannel, which
+// is run by the controller when the call is finished, canceled or timedout.
+// Like ParallelChannelDone, the call_id of the controller is destroyed after
+// both DoCallMethod() and Run() are over.
+class RedisClusterDone : public google::protobuf::Closure {
+public:
+    RedisClusterDone(RedisClusterChannel* channel2, Controller* cntl,
+                     const RedisRequest* request2, RedisResponse* response2,
+                     google::protobuf::Closure* user_done)
+        : channel(channel2)
+        , request(request2)
+        , response(response2)
+        , _parent(cntl)
+        , _user_done(user_done)
+        , _canceled(false)
+        , _state(0) {
+        cntl_in_call.set_timeout_ms(cntl->timeout_ms());
+        if (cntl->max_retry() != UNSET_MAGIC_NUM) {
+            cntl_in_call.set_max_retry(cntl->max_retry());
+        }
+        cntl_in_call.set_log_id(cntl->log_id());
+    }
+
+    // Remember call_id of the sub calls to be started so that they can be
+    // canceled. Returns false if the call was already canceled.
+    bool SetSubCalls(const std::vector<CallId>& ids) {
+        BAIDU_SCOPED_LOCK(_mutex);
+        if (_canceled) {
+            return false;
+        }
+        _sub_ids = ids;
+        return true;
+    }
+
+    // Called when DoCallMethod() returns.
+    void OnCallMethodDone() {
+        const CallId saved_cid = _parent->call_id();
+        // The release fence is matched with the acquire fence in Run().
+        const uint32_t val =
+            _state.fetch_or(CALLMETHOD_DONE, butil::memory_order_acq_rel);
+        if (!(val & RUN_CALLED)) {
+            // Stop call_id of the controller by sending a special error
+            // which will be cleared in Run().
+            bthread_id_error(saved_cid, EPCHANFINISH);
+            return;
+        }
+        OnComplete();
+    }
+
+    void Run() {
+        // [ Called by the controller with call_id locked ]
+        if (_parent->ErrorCode() == EPCHANFINISH) {
+            _parent->_error_code = 0;
+            _parent->_error_text.clear();
+        } else {
+            // Canceled or timedout, stop the sub calls in-flight.
+            BAIDU_SCOPED_LOCK(_mutex);
+            _canceled = true;
+            for (size_t i = 0; i < _sub_ids.size(); ++i) {
+                StartCancel(_sub_ids[i]);
+            }
+        }
+        const uint32_t val =
+            _state.fetch_or(RUN_CALLED, butil::memory_order_acq_rel);
+        if (!(val & CALLMETHOD_DONE)) {
+            // OnCallMethodDone() completes the call.
+            return;
+        }
+        OnComplete();
+    }
+
+    RedisClusterChannel* const channel;
+    const RedisRequest* const request;
+    RedisResponse* const response;
+    // DoCallMethod() fails this controller instead of the one of user,
+    // which may be failed by canceling concurrently.
+    Controller cntl_in_call;
+
+private:
+    static const uint32_t CALLMETHOD_DONE = 1;
+    static const uint32_t RUN_CALLED = 2;
+
+    void OnComplete() {
+        // [ Rendezvous point ]
+        // One and only one thread arrives here with call_id of the
+        // controller locked.
+        Controller* cntl = _parent;
+        if (!cntl->FailedInline() && cntl_in_call.FailedInline()) {
+            cntl->SetFailed(cntl_in_call.ErrorCode(), "%s",
+                            cntl_in_call.ErrorText().c_str());
+        }
+        google::protobuf::Closure* user_done = _user_done;
+        const CallId saved_cid = cntl->call_id();
+        cntl->_done = NULL;
+        delete this;
+        if (user_done) {
+            cntl->OnRPCEnd(butil::gettimeofday_us());
+            user_done->Run();
+        }
+        CHECK_EQ(0, bthread_id_unlock_and_destroy(saved_cid));
+    }
+
+    Controller* _parent;
+    google::protobuf::Closure* _user_done;
+    butil::Mutex _mutex;
+    bool _canceled;
+    std::vector<CallId> _sub_ids;
+    butil::atomic<uint32_t> _state;
+};
+
+static RedisReply* NewReplies(int n, butil::Arena* arena) {
+    RedisReply* replies =
+        (RedisReply*)arena->allocate(sizeof(RedisReply) * n);
+    if (replies != NULL) {
+        for (int i = 0; i < n; ++i) {
+            new (&replies[i]) RedisReply;
+        }
+    }
+    return replies;
+}
+
+void RedisClusterChannel::DoCallMethod(RedisClusterDone* d) {
+    Controller* cntl = &d->cntl_in_call;
+    const RedisRequest* request = d->request;
+    RedisResponse* response = d->response;
+    const int ncommand = request->command_size();
+    butil::IOBuf buf;
+    if (ncommand == 0 || !request->SerializeTo(&buf)) {
+        cntl->SetFailed(EREQUEST, "Fail to serialize RedisRequest");
+        return;
+    }
+    // Split the request into commands, which are arrays of bulk strings.
+    // Replies are allocated on a separate arena which is moved into
+    // `response' at last.
+    butil::Arena arena;
+    butil::Arena reply_arena;
+    RedisReply* commands = NewReplies(ncommand, &arena);
+    RedisReply* replies = NewReplies(ncommand, &reply_arena);
+    if (commands == NULL || replies == NULL) {
+        cntl->SetFailed(ENOMEM, "Fail to allocate RedisReply[%d]", ncommand);
+        return;
+    }
+    std::vector<RedisPendingCommand> pending(ncommand);
+    for (int i = 0; i < ncommand; ++i) {
+        if (!commands[i].ConsumePartialIOBuf(buf, &arena) ||
+            !commands[i].is_array() || commands[i].size() == 0) {
+            cntl->SetFailed(EREQUEST, "Fail to parse command[%d]", i);
+            return;
+        }
+        pending[i].index = i;
+        pending[i].ask_channel = NULL;
+    }
+
+    // Redirected commands share the timeout of the whole call.
+    int64_t timeout_ms = cntl->timeout_ms();
+    if (timeout_ms == UNSET_MAGIC_NUM) {
+        timeout_ms = _options.channel_options.timeout_ms;
+    }
+    const int64_t deadline_us =
+        (timeout_ms >= 0 ? butil::gettimeofday_us() + timeout_ms * 1000L : -1);
+
+    std::vector<butil::StringPiece> components;
+    std::map<Channel*, RedisSubCall*> sub_calls;
+    std::string addr;
+    for (int nredirect = 0; !pending.empty(); ++nredirect) {
+        for (size_t i = 0; i < pending.size(); ++i) {
+            const RedisReply& cmd = commands[pending[i].index];
+            Channel* channel = pending[i].ask_channel;
+            if (channel == NULL) {
+                const int slot = (cmd.size() > 1 ? GetKeySlot(cmd[1].data()) : 0);
+                channel = GetSlotChannel(slot);
+                if (channel == NULL) {
+                    cntl->SetFailed(EHOSTDOWN, "No node serves slot=%d", slot);
+                    break;
+                }
+            }
+            RedisSubCall*& sub = sub_calls[channel];
+            if (sub == NULL) {
+                sub = new RedisSubCall;
+                sub->channel = channel;
+            }
+            if (pending[i].ask_channel != NULL) {
+                sub->request.AddCommand("ASKING");
+                sub->command_indexes.push_back(-1);
+            }
+            components.resize(cmd.size());
+            for (size_t j = 0; j < cmd.size(); ++j) {
+                components[j] = cmd[j].data();
+            }
+            sub->request.AddCommandByComponents(&components[0],
+                                                components.size());
+            sub->command_indexes.push_back(pending[i].index);
+        }
+        pending.clear();
+        int64_t sub_timeout_ms = -1;
+        if (!cntl->Failed() && deadline_us >= 0) {
+            const int64_t left_us = deadline_us - butil::gettimeofday_us();
+            if (left_us <= 0) {
+                cntl->SetFailed(ERPCTIMEDOUT, "Reached timeout=%" PRId64 "ms",
+                                timeout_ms);
+            }
+            sub_timeout_ms = (left_us + 999) / 1000;
+        }
+        if (!cntl->Failed()) {
+            std::vector<CallId> sub_ids;
+            sub_ids.reserve(sub_calls.size());
+            for (std::map<Channel*, RedisSubCall*>::iterator
+                     it = sub_calls.begin(); it != sub_calls.end(); ++it) {
+                sub_ids.push_back(it->second->cntl.call_id());
+            }
+            if (!d->SetSubCalls(sub_ids)) {
+                cntl->SetFailed(ECANCELED, "RedisClusterChannel call is canceled");
+            }
+        }
+        if (!cntl->Failed()) {
+            for (std::map<Channel*, RedisSubCall*>::iterator
+                     it = sub_calls.begin(); it != sub_calls.end(); ++it) {
+                RedisSubCall* sub = it->second;
+                sub->cntl.set_timeout_ms(sub_timeout_ms);
+                if (cntl->max_retry() != UNSET_MAGIC_NUM) {
+                    sub->cntl.set_max_retry(cntl->max_retry());
+                }
+                sub->cntl.set_log_id(cntl->log_id());
+                sub->channel->CallMethod(NULL, &sub->cntl, &sub->request,
+                                         &sub->response, DoNothing());
+            }
+            for (std::map<Channel*, RedisSubCall*>::iterator
+                     it = sub_calls.begin(); it != sub_calls.end(); ++it) {
+                Join(it->second->cntl.call_id());
+            }
+        }
+        for (std::map<Channel*, RedisSubCall*>::iterator
+                 it = sub_calls.begin(); it != sub_calls.end(); ++it) {
+            RedisSubCall* sub = it->second;
+            if (cntl->Failed() || sub->cntl.Failed()) {
+                if (!cntl->Failed()) {
+                    cntl->SetFailed(sub->cntl.ErrorCode(), "%s",
+                                    sub->cntl.ErrorText().c_str());
+                }
+                delete sub;
+                continue;
+            }
+            for (size_t j = 0; j < sub->command_indexes.size(); ++j) {
+                const int index = sub->command_indexes[j];
+                if (index < 0) {
+                    continue;
+                }
+                const RedisReply& reply = sub->response.reply(j);
+                bool ask = false;
+                int slot = 0;
+                if (reply.is_error() &&
+                    nredirect < _options.max_redirections &&
+                    ParseRedirection(reply, &ask, &slot, &addr)) {
+                    Channel* target = GetOrNewChannel(addr);
+                    if (target != NULL) {
+                        RedisPendingCommand pc = { index, NULL };
+                        if (ask) {
+                            pc.ask_channel = target;
+                        } else if (GetSlotChannel(slot) != target) {
+                            // Update the slot right now and the whole map
+                            // later, which probably has other moved slots.
+                            _slots.Modify(SetSlot, slot, target);
+                            ScheduleRefresh();
+                        }
+                        pending.push_back(pc);
+                        continue;
+                    }
+                }
+                replies[index].CopyFromDifferentArena(reply, &reply_arena);
+            }
+            delete sub;
+        }
+        sub_calls.clear();
+        if (cntl->Failed()) {
+            return;
+        }
+    }
+
+    response->MoveReplies(replies, ncommand, &reply_arena);
+}
+
+void* RedisClusterChannel::RunCallMethod(void* arg) {
+    RedisClusterDone* d = static_cast<RedisClusterDone*>(arg);
+    d->channel->DoCallMethod(d);
+    d->OnCallMethodDone();
+    return NULL;
+}
+
+static void HandleTimeout(void* arg) {
+    bthread_id_t correlation_id = { (uint64_t)arg };
+    bthread_id_error(correlation_id, ERPCTIMEDOUT);
+}
+
+void RunDoneByState(Controller*, google::protobuf::Closure*);
+
+void RedisClusterChannel::CallMethod(
+    const google::protobuf::MethodDescriptor* /*method*/,
+    google::protobuf::RpcController* controller,
+    const google::protobuf::Message* request,
+    google::protobuf::Message* response,
+    google::protobuf::Closure* done) {
+    Controller* cntl = static_cast<Controller*>(controller);
+    cntl->OnRPCBegin(butil::gettimeofday_us());
+
+    const CallId cid = cntl->call_id();
+    const int rc = bthread_id_lock(cid, NULL);
+    if (rc != 0) {
+        CHECK_EQ(EINVAL, rc);
+        const int err = cntl->ErrorCode();
+        if (err != ECANCELED) {
+            // it's very likely that user reused a un-Reset() Controller.
+            cntl->SetFailed((err ? err : EINVAL),
+                            "call_id=%lld was destroyed before CallMethod(), "
+                            "did you forget to Reset() the Controller?",
+                            (long long)cid.value);
+        }
+        RunDoneByState(cntl, done);
+        return;
+    }
+
+    RedisClusterDone* d = NULL;
+    if (request == NULL ||
+        request->GetDescriptor() != RedisRequest::descriptor()) {
+        cntl->SetFailed(EINVAL, "request must be RedisRequest");
+        goto FAIL;
+    }
+    if (response == NULL ||
+        response->GetDescriptor() != RedisResponse::descriptor()) {
+        cntl->SetFailed(EINVAL, "response must be RedisResponse");
+        goto FAIL;
+    }
+    if (cntl->timeout_ms() == UNSET_MAGIC_NUM) {
+        cntl->set_timeout_ms(_options.channel_options.timeout_ms);
+    }
+    d = new RedisClusterDone(this, cntl,
+                             static_cast<const RedisRequest*>(request),
+                             static_cast<RedisResponse*>(response), done);
+    cntl->_response = response;
+    cntl->_done = d;
+    cntl->add_flag(Controller::FLAGS_DESTROY_CID_IN_DONE);
+    if (cntl->timeout_ms() >= 0) {
+        cntl->_abstime_us = cntl->timeout_ms() * 1000L + cntl->_begin_time_us;
+        // Setup timer for RPC timetout
+        const int rc = bthread_timer_add(
+            &cntl->_timeout_id,
+            butil::microseconds_to_timespec(cntl->_abstime_us),
+            HandleTimeout, (void*)cid.value);
+        if (rc != 0) {
+            cntl->SetFailed(rc, "Fail to add timer");
+            goto FAIL;
+        }
+    } else {
+        cntl->_abstime_us = -1;
+    }
+    CHECK_EQ(0, bthread_id_unlock(cid));
+    // Don't touch cntl again.
+
+    if (done == NULL) {
+        RunCallMethod(d);
+        Join(cid);
+        cntl->OnRPCEnd(butil::gettimeofday_us());
+        return;
+    }
+    bthread_t th;
+    if (bthread_start_background(&th, NULL, RunCallMethod, d) != 0) {
+        LOG(ERROR) << "Fail to start bthread";
+        RunCallMethod(d);
+    }
+    return;
+
+FAIL:
+    if (d) {
+        cntl->_done = NULL;
+        delete d;
+    }
+    RunDoneByState(cntl, done);
+    CHECK_EQ(0, bthread_id_unlock_and_destroy(cid));
+}
+
+} // namespace brpc
@@ -0,0 +1,137 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BRPC_REDIS_CLUSTER_CHANNEL_H
+#define BRPC_REDIS_CLUSTER_CHANNEL_H
+
+// To brpc developers: This is a header included by user, don't depend
+// on internal structures, use opaque pointers instead.
+
+#include <map>
+#include <string>
+#include <vector>
+#include "butil/atomicops.h"
+#include "butil/strings/string_piece.h"
+#include "butil/containers/doubly_buffered_data.h"
+#include "bthread/types.h"                  // bthread_t
+#include "brpc/channel.h"
+
+
+namespace brpc {
+
+class RedisReply;
+class RedisRequest;
+class RedisResponse;
+class RedisClusterDone;
+
+struct RedisClusterChannelOptions {
+    // Constructed with default options.
+    RedisClusterChannelOptions();
+
+    // Options of the channels to nodes of the cluster. `protocol' is
+    // always set to redis.
+    ChannelOptions channel_options;
+
+    // Max times of following MOVED/ASK redirections for a command. When the
+    // limit is reached, the last redirection error is returned as the reply
+    // of the command.
+    // Default: 5
+    int max_redirections;
+};
+
+// A channel to a redis cluster (https://redis.io/topics/cluster-spec).
+// Keys are mapped to the 16384 slots by CRC16 with hash tags ("{...}")
+// supported, and commands are sent to the nodes serving the slots:
+//   * Commands in one RedisRequest are grouped by nodes and sent in
+//     parallel, one pipeline per node. Replies are put into RedisResponse
+//     in the same order as the commands.
+//   * The slot map is loaded by CLUSTER SLOTS at Init(). A MOVED reply
+//     updates the slot immediately and triggers a refresh of the whole map
+//     in background. An ASK reply redirects the command once with ASKING.
+//   * The key of a command is its second component, keyless commands are
+//     sent to the node serving slot 0. Commands with multiple keys (MGET,
+//     MSET ...) must put all keys in one slot (e.g. with a same hash tag),
+//     as redis cluster requires.
+// The channel is thread-safe and supports synchronous and asynchronous
+// calls. Asynchronous calls run in background bthreads, the channel and
+// `request' must be valid until `done' is called. Canceling `call_id' of
+// the controller or reaching the timeout cancels commands in-flight.
+class RedisClusterChannel : public ChannelBase/*non-copyable*/ {
+public:
+    RedisClusterChannel();
+    ~RedisClusterChannel();
+
+    // Connect to the cluster that the nodes in `seeds' belong to. `seeds'
+    // is a list of "ip:port" separated by commas or spaces, one reachable
+    // node is enough to load the slot map.
+    // If `options' is NULL, use default options.
+    // Returns 0 on success, -1 otherwise.
+    int Init(const char* seeds, const RedisClusterChannelOptions* options);
+
+    // `request' must be RedisRequest and `response' must be RedisResponse.
+    // `method' is unused.
+    void CallMethod(const google::protobuf::MethodDescriptor* method,
+                    google::protobuf::RpcController* controller,
+                    const google::protobuf::Message* request,
+                    google::protobuf::Message* response,
+                    google::protobuf::Closure* done);
+
+    // Reload the slot map from any known node by CLUSTER SLOTS.
+    // Returns 0 on success, -1 otherwise.
+    int RefreshSlots();
+
+    // Returns 0 if every slot is served by a node, -1 otherwise.
+    int CheckHealth();
+
+    void Describe(std::ostream& os, const DescribeOptions&) const;
+
+    // Slot of `key' in the cluster, hash tags are respected.
+    static int GetKeySlot(const butil::StringPiece& key);
+
+    static const int SLOT_COUNT = 16384;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(RedisClusterChannel);
+    // Node serving each slot, NULL for unassigned slots.
+    typedef std::vector<Channel*> SlotTable;
+
+    Channel* GetOrNewChannel(const std::string& addr);
+    Channel* GetSlotChannel(int slot);
+    int ParseSlots(const RedisReply& reply, const butil::EndPoint& from,
+                   SlotTable* table);
+    void ScheduleRefresh();
+    void DoCallMethod(RedisClusterDone* d);
+    static void* RunCallMethod(void* args);
+    static void* RunRefresh(void* arg);
+    static size_t InitSlots(SlotTable& bg);
+    static size_t ResetSlots(SlotTable& bg, const SlotTable& fg);
+    static size_t SetSlot(SlotTable& bg, const int& slot,
+                          Channel* const& channel);
+
+    RedisClusterChannelOptions _options;
+    std::vector<std::string> _seeds;
+    // Channels to nodes are created on demand and never removed until
+    // the cluster channel is destroyed, so that pointers in the slot table
+    // are always valid.
+    mutable pthread_mutex_t _mutex;
+    std::map<std::string, Channel*> _channels;
+    butil::DoublyBufferedData<SlotTable> _slots;
+    butil::atomic<bool> _refreshing;
+    bthread_t _refresh_tid;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_REDIS_CLUSTER_CHANNEL_H
@@ -14,12 +14,93 @@
 
 // Authors: Ge,Jun (gejun@baidu.com)
 
+#include <stdio.h>                      // snprintf
+#include <stdlib.h>                     // malloc
 #include <limits>
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
 #include "butil/logging.h"
+#include "brpc/reloadable_flags.h"
 #include "brpc/redis_reply.h"
 
 namespace brpc {
 
+DEFINE_int32(redis_reply_min_referenced_size, 32768,
+             "Bulk strings in redis replies(and commands to RedisService) not "
+             "shorter than this value reference the received IOBuf instead "
+             "of being copied, non-positive value disables the referencing");
+BRPC_VALIDATE_GFLAG(redis_reply_min_referenced_size, PassValidate);
+
+struct RedisReply::ReferencedString {
+    butil::IOBuf buf;
+    // Contiguous copy of `buf' ended with \0, created on demand.
+    butil::atomic<char*> flat;
+
+    ReferencedString() : flat(NULL) {}
+    ~ReferencedString() { free(flat.load(butil::memory_order_relaxed)); }
+};
+
+void RedisReply::DestroyReferencedString(void* arg) {
+    static_cast<ReferencedString*>(arg)->~ReferencedString();
+}
+
+RedisReply::ReferencedString*
+RedisReply::NewReferencedString(butil::Arena* arena) {
+    void* mem = arena->allocate(sizeof(ReferencedString));
+    if (mem == NULL) {
+        return NULL;
+    }
+    ReferencedString* ref = new (mem) ReferencedString;
+    if (arena->add_cleanup(DestroyReferencedString, ref) != 0) {
+        ref->~ReferencedString();
+        return NULL;
+    }
+    return ref;
+}
+
+const char* RedisReply::FlattenReferencedString() const {
+    ReferencedString* ref = _data.long_str.ref;
+    char* flat = ref->flat.load(butil::memory_order_acquire);
+    if (flat != NULL) {
+        return flat;
+    }
+    char* d = (char*)malloc(_length + 1);
+    if (d == NULL) {
+        LOG(FATAL) << "Fail to allocate string[" << _length << "]";
+        return "";
+    }
+    ref->buf.copy_to(d, _length);
+    d[_length] = '\0';
+    // Concurrent readers may flatten simultaneously, only one copy wins.
+    if (!ref->flat.compare_exchange_strong(flat, d, butil::memory_order_acq_rel)) {
+        free(d);
+        return flat;
+    }
+    return d;
+}
+
+butil::StringPiece RedisReply::ReferencedData() const {
+    const butil::IOBuf& buf = _data.long_str.ref->buf;
+    if (buf.backing_block_num() == 1) {
+        return buf.backing_block(0);
+    }
+    return butil::StringPiece(FlattenReferencedString(), _length);
+}
+
+void RedisReply::AppendDataTo(butil::IOBuf* out) const {
+    if (!is_string()) {
+        CHECK(false) << "The reply is " << RedisReplyTypeToString(_type)
+                     << ", not a string";
+        return;
+    }
+    if (_length >= sizeof(_data.short_str) && _data.long_str.ref != NULL) {
+        out->append(_data.long_str.ref->buf);
+    } else {
+        const butil::StringPiece str = data();
+        out->append(str.data(), str.size());
+    }
+}
+
 //BAIDU_CASSERT(sizeof(RedisReply) == 24, size_match);
 
 const char* RedisReplyTypeToString(RedisReplyType type) {
@@ -35,25 +116,43 @@ const char* RedisReplyTypeToString(RedisReplyType type) {
 }
 
 bool RedisReply::ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena) {
+    return ConsumePartialIOBufImpl(
+        buf, arena, std::numeric_limits<uint32_t>::max(),
+        std::numeric_limits<uint32_t>::max(), -1) == PARSE_OK;
+}
+
+ParseError RedisReply::ConsumePartialCommand(butil::IOBuf& buf,
+                                             butil::Arena* arena,
+                                             size_t max_args,
+                                             size_t max_length) {
+    return ConsumePartialIOBufImpl(buf, arena, max_args, max_length, 1);
+}
+
+ParseError RedisReply::ConsumePartialIOBufImpl(
+    butil::IOBuf& buf, butil::Arena* arena, uint64_t max_count,
+    uint64_t max_length, int depth) {
     if (_type == REDIS_REPLY_ARRAY && _data.array.last_index >= 0) {
         // The parsing was suspended while parsing sub replies,
         // continue the parsing.
         RedisReply* subs = (RedisReply*)_data.array.replies;
         for (uint32_t i = _data.array.last_index; i < _length; ++i) {
-            if (!subs[i].ConsumePartialIOBuf(buf, arena)) {
-                return false;
+            const ParseError err = subs[i].ConsumePartialIOBufImpl(
+                buf, arena, max_count, max_length, depth - 1);
+            if (err != PARSE_OK) {
+                return err;
             }
             ++_data.array.last_index;
         }
         // We've got an intact reply. reset the index.
         _data.array.last_index = -1;
-        return true;
+        return PARSE_OK;
     }
 
-    // Notice that all branches returning false must not change `buf'.
+    // Notice that all branches returning PARSE_ERROR_NOT_ENOUGH_DATA must
+    // not change `buf'.
     const char* pfc = (const char*)buf.fetch1();
     if (pfc == NULL) {
-        return false;
+        return PARSE_ERROR_NOT_ENOUGH_DATA;
     }
     const char fc = *pfc;  // first character
     switch (fc) {
@@ -61,7 +160,12 @@ bool RedisReply::ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena) {
     case '+': { // Simple String  "+<string>\r\n"
         butil::IOBuf str;
         if (buf.cut_until(&str, "\r\n") != 0) {
-            return false;
+            if (buf.size() > max_length + 3/*fc and CRLF*/) {
+                LOG(ERROR) << "Too long simple string, max length="
+                           << max_length;
+                return PARSE_ERROR_TOO_BIG_DATA;
+            }
+            return PARSE_ERROR_NOT_ENOUGH_DATA;
         }
         const size_t len = str.size() - 1;
         if (len < sizeof(_data.short_str)) {
@@ -69,41 +173,50 @@ bool RedisReply::ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena) {
             _type = (fc == '-' ? REDIS_REPLY_ERROR : REDIS_REPLY_STATUS);
             _length = len;
             str.copy_to_cstr(_data.short_str, (size_t)-1L, 1/*skip fc*/);
-            return true;
+            return PARSE_OK;
         }
         char* d = (char*)arena->allocate((len/8 + 1)*8);
         if (d == NULL) {
             LOG(FATAL) << "Fail to allocate string[" << len << "]";
-            return false;
+            return PARSE_ERROR_NO_RESOURCE;
         }
         CHECK_EQ(len, str.copy_to_cstr(d, (size_t)-1L, 1/*skip fc*/));
         _type = (fc == '-' ? REDIS_REPLY_ERROR : REDIS_REPLY_STATUS);
         _length = len;
-        _data.long_str = d;
-        return true;
+        _data.long_str.str = d;
+        _data.long_str.ref = NULL;
+        return PARSE_OK;
     }
     case '$':   // Bulk String   "$<length>\r\n<string>\r\n"
     case '*':   // Array         "*<size>\r\n<sub-reply1><sub-reply2>..."
     case ':': { // Integer       ":<integer>\r\n"
         char intbuf[32];  // enough for fc + 64-bit decimal + \r\n
-        const size_t ncopied = buf.copy_to(intbuf, sizeof(intbuf) - 1);
-        intbuf[ncopied] = '\0';
-        const size_t crlf_pos = butil::StringPiece(intbuf, ncopied).find("\r\n");
-        if (crlf_pos == butil::StringPiece::npos) {  // not enough data
-            return false;
+        const size_t crlf_pos = buf.find("\r\n");
+        if (crlf_pos == butil::IOBuf::npos) {
+            if (buf.size() >= sizeof(intbuf)) {
+                LOG(ERROR) << "Too long integer line, length>=" << buf.size();
+                return PARSE_ERROR_ABSOLUTELY_WRONG;
+            }
+            return PARSE_ERROR_NOT_ENOUGH_DATA;
+        }
+        if (crlf_pos >= sizeof(intbuf)) {
+            LOG(ERROR) << "Too long integer line, length=" << crlf_pos;
+            return PARSE_ERROR_ABSOLUTELY_WRONG;
         }
+        buf.copy_to(intbuf, crlf_pos);
+        intbuf[crlf_pos] = '\0';
         char* endptr = NULL;
         int64_t value = strtoll(intbuf + 1/*skip fc*/, &endptr, 10);
         if (endptr != intbuf + crlf_pos) {
             LOG(ERROR) << '`' << intbuf + 1 << "' is not a valid 64-bit decimal";
-            return false;
+            return PARSE_ERROR_ABSOLUTELY_WRONG;
         }
         if (fc == ':') {
             buf.pop_front(crlf_pos + 2/*CRLF*/);
             _type = REDIS_REPLY_INTEGER;
             _length = 0;
             _data.integer = value;
-            return true;
+            return PARSE_OK;
         } else if (fc == '$') {
             const int64_t len = value;  // `value' is length of the string
             if (len < 0) {  // redis nil
@@ -111,17 +224,17 @@ bool RedisReply::ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena) {
                 _type = REDIS_REPLY_NIL;
                 _length = 0;
                 _data.integer = 0;
-                return true;
+                return PARSE_OK;
             }
-            if (len > (int64_t)std::numeric_limits<uint32_t>::max()) {
-                LOG(ERROR) << "bulk string is too long! max length=2^32-1,"
-                    " actually=" << len;
-                return false;
+            if ((uint64_t)len > max_length) {
+                LOG(ERROR) << "bulk string is too long! max length="
+                           << max_length << " actually=" << len;
+                return PARSE_ERROR_TOO_BIG_DATA;
             }
             // We provide c_str(), thus even if bulk string is started with
             // length, we have to end it with \0.
             if (buf.size() < crlf_pos + 2 + (size_t)len + 2/*CRLF*/) {
-                return false;
+                return PARSE_ERROR_NOT_ENOUGH_DATA;
             }
             if ((size_t)len < sizeof(_data.short_str)) {
                 // SSO short strings, including empty string.
@@ -130,33 +243,53 @@ bool RedisReply::ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena) {
                 buf.pop_front(crlf_pos + 2);
                 buf.cutn(_data.short_str, len);
                 _data.short_str[len] = '\0';
+            } else if (FLAGS_redis_reply_min_referenced_size > 0 &&
+                       len >= FLAGS_redis_reply_min_referenced_size) {
+                // Reference blocks of `buf' rather than copying long strings
+                // which are probably copied again by users.
+                ReferencedString* ref = NewReferencedString(arena);
+                if (ref == NULL) {
+                    LOG(FATAL) << "Fail to allocate string[" << len << "]";
+                    return PARSE_ERROR_NO_RESOURCE;
+                }
+                buf.pop_front(crlf_pos + 2/*CRLF*/);
+                buf.cutn(&ref->buf, len);
+                _type = REDIS_REPLY_STRING;
+                _length = len;
+                _data.long_str.str = NULL;
+                _data.long_str.ref = ref;
             } else {
                 char* d = (char*)arena->allocate((len/8 + 1)*8);
                 if (d == NULL) {
                     LOG(FATAL) << "Fail to allocate string[" << len << "]";
-                    return false;
+                    return PARSE_ERROR_NO_RESOURCE;
                 }
                 buf.pop_front(crlf_pos + 2/*CRLF*/);
                 buf.cutn(d, len);
                 d[len] = '\0';
                 _type = REDIS_REPLY_STRING;
                 _length = len;
-                _data.long_str = d;
+                _data.long_str.str = d;
+                _data.long_str.ref = NULL;
             }
             char crlf[2];
             buf.cutn(crlf, sizeof(crlf));
             if (crlf[0] != '\r' || crlf[1] != '\n') {
                 LOG(ERROR) << "Bulk string is not ended with CRLF";
             }
-            return true;
+            return PARSE_OK;
         } else {
             const int64_t count = value;  // `value' is count of sub replies
+            if (depth == 0) {
+                LOG(ERROR) << "Unexpected nested array";
+                return PARSE_ERROR_ABSOLUTELY_WRONG;
+            }
             if (count < 0) { // redis nil
                 buf.pop_front(crlf_pos + 2/*CRLF*/);
                 _type = REDIS_REPLY_NIL;
                 _length = 0;
                 _data.integer = 0;
-                return true;
+                return PARSE_OK;
             }
             if (count == 0) { // empty array
                 buf.pop_front(crlf_pos + 2/*CRLF*/);
@@ -164,18 +297,19 @@ bool RedisReply::ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena) {
                 _length = 0;
                 _data.array.last_index = -1;
                 _data.array.replies = NULL;
-                return true;
+                return PARSE_OK;
             }
-            if (count > (int64_t)std::numeric_limits<uint32_t>::max()) {
-                LOG(ERROR) << "Too many sub replies! max count=2^32-1,"
-                    " actually=" << count;
-                return false;
+            // Checked before allocating the sub replies.
+            if ((uint64_t)count > max_count) {
+                LOG(ERROR) << "Too many sub replies! max count=" << max_count
+                           << " actually=" << count;
+                return PARSE_ERROR_TOO_BIG_DATA;
             }
             // FIXME(gejun): Call allocate_aligned instead.
             RedisReply* subs = (RedisReply*)arena->allocate(sizeof(RedisReply) * count);
             if (subs == NULL) {
                 LOG(FATAL) << "Fail to allocate RedisReply[" << count << "]";
-                return false;
+                return PARSE_ERROR_NO_RESOURCE;
             }
             for (int64_t i = 0; i < count; ++i) {
                 new (&subs[i]) RedisReply;
@@ -189,20 +323,133 @@ bool RedisReply::ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena) {
             // be continued in next calls by tracking _data.array.last_index.
             _data.array.last_index = 0;
             for (int64_t i = 0; i < count; ++i) {
-                if (!subs[i].ConsumePartialIOBuf(buf, arena)) {
-                    return false;
+                const ParseError err = subs[i].ConsumePartialIOBufImpl(
+                    buf, arena, max_count, max_length, depth - 1);
+                if (err != PARSE_OK) {
+                    return err;
                 }
                 ++_data.array.last_index;
             }
             _data.array.last_index = -1;
-            return true;
+            return PARSE_OK;
         }
     }
     default:
         LOG(ERROR) << "Invalid first character=" << (int)fc;
+        return PARSE_ERROR_ABSOLUTELY_WRONG;
+    }
+    return PARSE_ERROR_ABSOLUTELY_WRONG;
+}
+
+void RedisReply::SetStringImpl(RedisReplyType type,
+                               const butil::StringPiece& str,
+                               butil::Arena* arena) {
+    const size_t len = str.size();
+    if (len > std::numeric_limits<uint32_t>::max()) {
+        LOG(ERROR) << "string is too long! max length=2^32-1,"
+            " actually=" << len;
+        return;
+    }
+    if (len < sizeof(_data.short_str)) {
+        // SSO short strings, including empty string.
+        memcpy(_data.short_str, str.data(), len);
+        _data.short_str[len] = '\0';
+    } else {
+        char* d = (char*)arena->allocate((len/8 + 1)*8);
+        if (d == NULL) {
+            LOG(FATAL) << "Fail to allocate string[" << len << "]";
+            return;
+        }
+        memcpy(d, str.data(), len);
+        d[len] = '\0';
+        _data.long_str.str = d;
+        _data.long_str.ref = NULL;
+    }
+    _type = type;
+    _length = len;
+}
+
+bool RedisReply::SetArray(size_t size, butil::Arena* arena) {
+    if (size > std::numeric_limits<uint32_t>::max()) {
+        LOG(ERROR) << "Too many sub replies! max count=2^32-1,"
+            " actually=" << size;
         return false;
     }
-    return false;
+    RedisReply* subs = NULL;
+    if (size != 0) {
+        subs = (RedisReply*)arena->allocate(sizeof(RedisReply) * size);
+        if (subs == NULL) {
+            LOG(FATAL) << "Fail to allocate RedisReply[" << size << "]";
+            return false;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            new (&subs[i]) RedisReply;
+        }
+    }
+    _type = REDIS_REPLY_ARRAY;
+    _length = size;
+    _data.array.last_index = -1;
+    _data.array.replies = subs;
+    return true;
+}
+
+// Append a status or an error which can't span lines. CR and LF inside,
+// probably from arguments of commands, are replaced with spaces as
+// redis-server does, otherwise clients could inject replies.
+static void AppendLine(butil::IOBufAppender* appender, char fc,
+                       const butil::StringPiece& str) {
+    appender->push_back(fc);
+    size_t begin = 0;
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] == '\r' || str[i] == '\n') {
+            appender->append(str.data() + begin, i - begin);
+            appender->push_back(' ');
+            begin = i + 1;
+        }
+    }
+    appender->append(str.data() + begin, str.size() - begin);
+    appender->append("\r\n", 2);
+}
+
+static void AppendInteger(butil::IOBufAppender* appender, char fc,
+                          int64_t value) {
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "%c%lld\r\n", fc,
+                             (long long)value);
+    appender->append(buf, len);
+}
+
+void RedisReply::SerializeTo(butil::IOBufAppender* appender) const {
+    switch (_type) {
+    case REDIS_REPLY_STRING:
+        AppendInteger(appender, '$', _length);
+        if (_length >= sizeof(_data.short_str) && _data.long_str.ref != NULL) {
+            // Append referenced blocks without copying.
+            appender->buf().append(_data.long_str.ref->buf);
+        } else {
+            appender->append(data());
+        }
+        appender->append("\r\n", 2);
+        break;
+    case REDIS_REPLY_ARRAY:
+        AppendInteger(appender, '*', _length);
+        for (uint32_t i = 0; i < _length; ++i) {
+            _data.array.replies[i].SerializeTo(appender);
+        }
+        break;
+    case REDIS_REPLY_INTEGER:
+        AppendInteger(appender, ':', _data.integer);
+        break;
+    case REDIS_REPLY_NIL:
+        appender->append("$-1\r\n", 5);
+        break;
+    case REDIS_REPLY_STATUS:
+        AppendLine(appender, '+', data());
+        break;
+    case REDIS_REPLY_ERROR:
+        AppendLine(appender, '-', butil::StringPiece(error_message(), _length));
+        break;
+    }
 }
 
 static void PrintBinaryData(std::ostream& os, const butil::StringPiece& s) {
@@ -239,11 +486,7 @@ void RedisReply::Print(std::ostream& os) const {
     switch (_type) {
     case REDIS_REPLY_STRING:
         os << '"';
-        if (_length < sizeof(_data.short_str)) {
-            os << _data.short_str;
-        } else {
-            PrintBinaryData(os, butil::StringPiece(_data.long_str, _length));
-        }
+        PrintBinaryData(os, data());
         os << '"';
         break;
     case REDIS_REPLY_ARRAY:
@@ -269,7 +512,7 @@ void RedisReply::Print(std::ostream& os) const {
         if (_length < sizeof(_data.short_str)) {
             os << _data.short_str;
         } else {
-            PrintBinaryData(os, butil::StringPiece(_data.long_str, _length));
+            PrintBinaryData(os, butil::StringPiece(_data.long_str.str, _length));
         }
         break;
     default:
@@ -293,10 +536,12 @@ void RedisReply::CopyFromDifferentArena(const RedisReply& other,
             new (&subs[i]) RedisReply;
         }
         _data.array.last_index = other._data.array.last_index;
-        if (_data.array.last_index > 0) {
-            for (int i = 0; i < _data.array.last_index; ++i) {
-                subs[i].CopyFromDifferentArena(other._data.array.replies[i], arena);
-            }
+        // Only sub replies before last_index are parsed if the parsing of
+        // `other' is suspended, otherwise all of them are.
+        const uint32_t nparsed = (_data.array.last_index >= 0 ?
+                                  (uint32_t)_data.array.last_index : _length);
+        for (uint32_t i = 0; i < nparsed; ++i) {
+            subs[i].CopyFromDifferentArena(other._data.array.replies[i], arena);
         }
         _data.array.replies = subs;
     }
@@ -313,14 +558,25 @@ void RedisReply::CopyFromDifferentArena(const RedisReply& other,
     case REDIS_REPLY_STATUS:
         if (_length < sizeof(_data.short_str)) {
             memcpy(_data.short_str, other._data.short_str, _length + 1);
+        } else if (other._data.long_str.ref != NULL) {
+            // Share the referenced blocks.
+            ReferencedString* ref = NewReferencedString(arena);
+            if (ref == NULL) {
+                LOG(FATAL) << "Fail to allocate string[" << _length << "]";
+                return;
+            }
+            ref->buf = other._data.long_str.ref->buf;
+            _data.long_str.str = NULL;
+            _data.long_str.ref = ref;
         } else {
             char* d = (char*)arena->allocate((_length/8 + 1)*8);
             if (d == NULL) {
                 LOG(FATAL) << "Fail to allocate string[" << _length << "]";
                 return;
             }
-            memcpy(d, other._data.long_str, _length + 1);
-            _data.long_str = d;
+            memcpy(d, other._data.long_str.str, _length + 1);
+            _data.long_str.str = d;
+            _data.long_str.ref = NULL;
         }
         break;
     }
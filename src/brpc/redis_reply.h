@@ -21,6 +21,7 @@
 #include "butil/strings/string_piece.h"   // butil::StringPiece
 #include "butil/arena.h"                  // butil::Arena
 #include "butil/logging.h"                // CHECK
+#include "brpc/parse_result.h"            // ParseError
 
 
 namespace brpc {
@@ -69,6 +70,11 @@ public:
     // call stacks are logged and "" is returned. 
     // If you need a std::string, call .data().as_string() (which allocates mem)
     butil::StringPiece data() const;
+    // Append the string to `out'. Long bulk strings which reference the
+    // parsed IOBuf (see -redis_reply_min_referenced_size) are appended
+    // without copying, prefer this method to data() for them. If the reply
+    // is not a string, call stacks are logged.
+    void AppendDataTo(butil::IOBuf* out) const;
 
     // Return number of sub replies in the array. If this reply is not an array,
     // 0 is returned (call stacks are not logged).
@@ -88,6 +94,39 @@ public:
     // intact, the complexity in worst case may be O(N^2).
     bool ConsumePartialIOBuf(butil::IOBuf& buf, butil::Arena* arena);
 
+    // Parse a command sent to RedisService, which is an array of at most
+    // `max_args' sub replies not being arrays, from `buf' in the same way as
+    // ConsumePartialIOBuf(). Strings longer than `max_length' are rejected.
+    // Unlike ConsumePartialIOBuf(), invalid input is told apart from
+    // incomplete input:
+    //   PARSE_OK                     an intact command is cut off from `buf'
+    //   PARSE_ERROR_NOT_ENOUGH_DATA  call again with more data
+    //   PARSE_ERROR_TOO_BIG_DATA     the limits are exceeded
+    //   PARSE_ERROR_ABSOLUTELY_WRONG `buf' is malformed
+    ParseError ConsumePartialCommand(butil::IOBuf& buf, butil::Arena* arena,
+                                     size_t max_args, size_t max_length);
+
+    // Set the reply to nil, an integer, a status(simple string), an error or
+    // a (bulk) string. Memory of long strings is allocated on `arena'.
+    // These methods are for building replies of RedisCommandHandler.
+    void SetNil() { Clear(); }
+    void SetInteger(int64_t value);
+    void SetStatus(const butil::StringPiece& str, butil::Arena* arena)
+    { SetStringImpl(REDIS_REPLY_STATUS, str, arena); }
+    void SetError(const butil::StringPiece& str, butil::Arena* arena)
+    { SetStringImpl(REDIS_REPLY_ERROR, str, arena); }
+    void SetString(const butil::StringPiece& str, butil::Arena* arena)
+    { SetStringImpl(REDIS_REPLY_STRING, str, arena); }
+    // Set the reply to an array of `size' nil replies which can be modified
+    // by operator[] afterwards. Returns false on allocation failure.
+    bool SetArray(size_t size, butil::Arena* arena);
+    // Get the index-th sub reply for modification. Unlike the const version,
+    // this reply must be an array and `index' must be less than size().
+    RedisReply& operator[](size_t index);
+
+    // Append the reply in the format of redis protocol(RESP) to `appender'.
+    void SerializeTo(butil::IOBufAppender* appender) const;
+
     // Swap internal fields with another reply.
     void Swap(RedisReply& other);
 
@@ -109,13 +148,35 @@ private:
     // RedisReply does not own the memory of fields, copying must be done
     // by calling CopyFrom[Different|Same]Arena.
     DISALLOW_COPY_AND_ASSIGN(RedisReply);
+
+    // A long bulk string referencing blocks of the parsed IOBuf instead of
+    // being copied into the arena.
+    struct ReferencedString;
+    static ReferencedString* NewReferencedString(butil::Arena* arena);
+    static void DestroyReferencedString(void* arg);
+    // The referenced string is copied into a contiguous buffer at the first
+    // call to c_str(), or data() when the string spans multiple blocks.
+    const char* FlattenReferencedString() const;
+    butil::StringPiece ReferencedData() const;
+
+    void SetStringImpl(RedisReplyType type, const butil::StringPiece& str,
+                       butil::Arena* arena);
+
+    // Sub replies deeper than `depth' levels are rejected, unlimited when
+    // `depth' is negative.
+    ParseError ConsumePartialIOBufImpl(butil::IOBuf& buf, butil::Arena* arena,
+                                       uint64_t max_count, uint64_t max_length,
+                                       int depth);
     
     RedisReplyType _type;
     uint32_t _length;  // length of short_str/long_str, count of replies
     union {
         int64_t integer;
         char short_str[16];
-        const char* long_str;
+        struct {
+            const char* str;  // ended with \0, NULL if `ref' is non-NULL
+            ReferencedString* ref;
+        } long_str;
         struct {
             int32_t last_index;  // >= 0 if previous parsing suspends on replies.
             RedisReply* replies;
@@ -158,8 +219,10 @@ inline const char* RedisReply::c_str() const {
     if (is_string()) {
         if (_length < sizeof(_data.short_str)) { // SSO
             return _data.short_str;
+        } else if (_data.long_str.ref == NULL) {
+            return _data.long_str.str;
         } else {
-            return _data.long_str;
+            return FlattenReferencedString();
         }
     }
     CHECK(false) << "The reply is " << RedisReplyTypeToString(_type)
@@ -171,8 +234,10 @@ inline butil::StringPiece RedisReply::data() const {
     if (is_string()) {
         if (_length < sizeof(_data.short_str)) { // SSO
             return butil::StringPiece(_data.short_str, _length);
+        } else if (_data.long_str.ref == NULL) {
+            return butil::StringPiece(_data.long_str.str, _length);
         } else {
-            return butil::StringPiece(_data.long_str, _length);
+            return ReferencedData();
         }
     }
     CHECK(false) << "The reply is " << RedisReplyTypeToString(_type)
@@ -185,7 +250,7 @@ inline const char* RedisReply::error_message() const {
         if (_length < sizeof(_data.short_str)) { // SSO
             return _data.short_str;
         } else {
-            return _data.long_str;
+            return _data.long_str.str;
         }
     }
     CHECK(false) << "The reply is " << RedisReplyTypeToString(_type)
@@ -205,6 +270,21 @@ inline const RedisReply& RedisReply::operator[](size_t index) const {
     return redis_nil;
 }
 
+inline RedisReply& RedisReply::operator[](size_t index) {
+    // Don't return the shared nil of the const version which would be
+    // corrupted by modifications.
+    CHECK(is_array() && index < _length)
+        << "Fail to modify sub reply[" << index << "] of the "
+        << RedisReplyTypeToString(_type) << " reply, size=" << size();
+    return _data.array.replies[index];
+}
+
+inline void RedisReply::SetInteger(int64_t value) {
+    _type = REDIS_REPLY_INTEGER;
+    _length = 0;
+    _data.integer = value;
+}
+
 inline void RedisReply::Swap(RedisReply& other) {
     std::swap(_type, other._type);
     std::swap(_length, other._length);
@@ -31,6 +31,7 @@
 #include "butil/time.h"
 #include "butil/class_name.h"
 #include "butil/string_printf.h"
+#include "butil/iobuf_profiler.h"                    // block_sampling_rate
 #include "brpc/log.h"
 #include "brpc/compress.h"
 #include "brpc/policy/nova_pbrpc_protocol.h"
@@ -40,6 +41,8 @@
 #include "brpc/details/ssl_helper.h"           // CreateSSLContext
 #include "brpc/protocol.h"                     // ListProtocols
 #include "brpc/nshead_service.h"               // NsheadService
+#include "brpc/redis.h"                        // RedisService
+#include "brpc/thrift_service.h"               // ThriftService
 #include "brpc/builtin/bad_method_service.h"   // BadMethodService
 #include "brpc/builtin/get_favicon_service.h"
 #include "brpc/builtin/get_js_service.h"
@@ -54,6 +57,7 @@
 #include "brpc/builtin/connections_service.h"  // ConnectionsService
 #include "brpc/builtin/flags_service.h"        // FlagsService
 #include "brpc/builtin/vars_service.h"         // VarsService
+#include "brpc/builtin/prometheus_metrics_service.h" // PrometheusMetricsService
 #include "brpc/builtin/rpcz_service.h"         // RpczService
 #include "brpc/builtin/dir_service.h"          // DirService
 #include "brpc/builtin/pprof_service.h"        // PProfService
@@ -128,6 +132,8 @@ ServerOptions::ServerOptions()
     : idle_timeout_sec(-1)
     , nshead_service(NULL)
     , mongo_service_adaptor(NULL)
+    , redis_service(NULL)
+    , thrift_service(NULL)
     , auth(NULL)
     , server_owns_auth(false)
     , num_threads(8)
@@ -152,7 +158,9 @@ ServerOptions::ServerOptions()
 Server::MethodProperty::OpaqueParams::OpaqueParams()
     : is_tabbed(false)
     , allow_http_body_to_pb(true)
-    , pb_bytes_to_base64(false) {
+    , pb_bytes_to_base64(false)
+    , enable_progressive_read(false)
+    , http_response_cache(NULL) {
 }
 
 Server::MethodProperty::MethodProperty()
@@ -219,6 +227,9 @@ static void PrintEnabledProfilers(std::ostream& os, void*) {
             os << "heap(no TCMALLOC_SAMPLE_PARAMETER in env) ";
         }
     }
+    if (butil::iobuf::block_sampling_rate() != 0) {
+        os << "iobuf ";
+    }
     os << "contention";
 }
 
@@ -314,6 +325,9 @@ void* Server::UpdateDerivedVars(void* arg) {
     if (server->options().nshead_service) {
         server->options().nshead_service->Expose(prefix);
     }
+    if (server->options().thrift_service) {
+        server->options().thrift_service->Expose(prefix);
+    }
 
     int64_t last_time = butil::gettimeofday_us();
     int consecutive_nosleep = 0;
@@ -372,6 +386,7 @@ Server::Server(ProfilerLinker)
     , _builtin_service_count(0)
     , _virtual_service_count(0)
     , _failed_to_set_max_concurrency_of_method(false)
+    , _has_progressive_read_service(false)
     , _am(NULL)
     , _internal_am(NULL)
     , _first_service(NULL)
@@ -397,6 +412,11 @@ Server::~Server() {
     delete _options.nshead_service;
     _options.nshead_service = NULL;
 
+    delete _options.redis_service;
+    _options.redis_service = NULL;
+    delete _options.thrift_service;
+    _options.thrift_service = NULL;
+
     delete _options.http_master_service;
     _options.http_master_service = NULL;
     
@@ -460,6 +480,10 @@ int Server::AddBuiltinServices() {
         LOG(ERROR) << "Fail to add HealthService";
         return -1;
     }
+    if (AddBuiltinService(new (std::nothrow) PrometheusMetricsService)) {
+        LOG(ERROR) << "Fail to add PrometheusMetricsService";
+        return -1;
+    }
     if (AddBuiltinService(new (std::nothrow) ProtobufsService(this))) {
         LOG(ERROR) << "Fail to add ProtobufsService";
         return -1;
@@ -1118,6 +1142,8 @@ int Server::AddServiceInternal(google::protobuf::Service* service,
         mp.params.is_tabbed = !!tabbed;
         mp.params.allow_http_body_to_pb = svc_opt.allow_http_body_to_pb;
         mp.params.pb_bytes_to_base64 = svc_opt.pb_bytes_to_base64;
+        mp.params.enable_progressive_read = svc_opt.enable_progressive_read;
+        mp.params.http_response_cache = svc_opt.http_response_cache;
         mp.service = service;
         mp.method = md;
         mp.status = new MethodStatus;
@@ -1146,6 +1172,9 @@ int Server::AddServiceInternal(google::protobuf::Service* service,
         is_builtin_service, svc_opt.ownership, service, NULL };
     _fullname_service_map[sd->full_name()] = ss;
     _service_map[sd->name()] = ss;
+    if (svc_opt.enable_progressive_read) {
+        _has_progressive_read_service = true;
+    }
     if (is_builtin_service) {
         ++_builtin_service_count;
     } else {
@@ -1204,6 +1233,8 @@ int Server::AddServiceInternal(google::protobuf::Service* service,
                 params.is_tabbed = !!tabbed;
                 params.allow_http_body_to_pb = svc_opt.allow_http_body_to_pb;
                 params.pb_bytes_to_base64 = svc_opt.pb_bytes_to_base64;
+                params.enable_progressive_read = svc_opt.enable_progressive_read;
+                params.http_response_cache = svc_opt.http_response_cache;
                 if (!_global_restful_map->AddMethod(
                         mappings[i].path, service, params,
                         mappings[i].method_name, mp->status)) {
@@ -1241,6 +1272,8 @@ int Server::AddServiceInternal(google::protobuf::Service* service,
             params.is_tabbed = !!tabbed;
             params.allow_http_body_to_pb = svc_opt.allow_http_body_to_pb;
             params.pb_bytes_to_base64 = svc_opt.pb_bytes_to_base64;
+            params.enable_progressive_read = svc_opt.enable_progressive_read;
+            params.http_response_cache = svc_opt.http_response_cache;
             if (!m->AddMethod(mappings[i].path, service, params,
                               mappings[i].method_name, mp->status)) {
                 LOG(ERROR) << "Fail to map `" << mappings[i].path << "' to `"
@@ -1299,6 +1332,8 @@ ServiceOptions::ServiceOptions()
 #else
     , pb_bytes_to_base64(true)
 #endif
+    , enable_progressive_read(false)
+    , http_response_cache(NULL)
     {}
 
 int Server::AddService(google::protobuf::Service* service,
@@ -1450,6 +1485,7 @@ void Server::ClearServices() {
     _method_map.clear();
     _builtin_service_count = 0;
     _virtual_service_count = 0;
+    _has_progressive_read_service = false;
     _first_service = NULL;
 }
 
@@ -1495,7 +1531,8 @@ void Server::GenerateVersionIfNeeded() {
     if (!_version.empty()) {
         return;
     }
-    int extra_count = !!_options.nshead_service + !!_options.rtmp_service;
+    int extra_count = !!_options.nshead_service + !!_options.rtmp_service +
+        !!_options.thrift_service;
     _version.reserve((extra_count + service_count()) * 20);
     for (ServiceMap::const_iterator it = _fullname_service_map.begin();
          it != _fullname_service_map.end(); ++it) {
@@ -1512,6 +1549,12 @@ void Server::GenerateVersionIfNeeded() {
         }
         _version.append(butil::class_name_str(*_options.nshead_service));
     }
+    if (_options.thrift_service) {
+        if (!_version.empty()) {
+            _version.push_back('+');
+        }
+        _version.append(butil::class_name_str(*_options.thrift_service));
+    }
     if (_options.rtmp_service) {
         if (!_version.empty()) {
             _version.push_back('+');
@@ -49,6 +49,9 @@ class SimpleDataPool;
 class MongoServiceAdaptor;
 class RestfulMap;
 class RtmpService;
+class RedisService;
+class ThriftService;
+class HttpResponseCache;
 
 struct CertInfo {
     // Certificate in PEM format.
@@ -144,6 +147,17 @@ struct ServerOptions {
     // and must remain valid when server is running.
     const MongoServiceAdaptor* mongo_service_adaptor;
 
+    // Serve redis protocol, check src/brpc/redis.h for details.
+    // Owned by Server and deleted in server's destructor
+    // Default: NULL
+    RedisService* redis_service;
+
+    // Process thrift requests in TFramedTransport + TBinaryProtocol, check
+    // src/brpc/thrift_service.h for details.
+    // Owned by Server and deleted in server's destructor
+    // Default: NULL
+    ThriftService* thrift_service;
+
     // Turn on authentication for all services if `auth' is not NULL.
     // Default: NULL
     const Authenticator* auth;
@@ -334,6 +348,22 @@ struct ServiceOptions {
     // option is turned on.
     // Default: false if BAIDU_INTERNAL is defined, otherwise true
     bool pb_bytes_to_base64;
+
+    // If this flag is true, methods of the service are called as soon as
+    // headers of http requests are received, and bodies of the requests
+    // should be read by Controller::ReadProgressiveAttachmentBy() as they
+    // arrive instead of being buffered into request_attachment() entirely.
+    // Only effective to methods whose bodies are not converted to protobuf
+    // (see allow_http_body_to_pb), and not effective with http_master_service.
+    // Default: false
+    bool enable_progressive_read;
+
+    // If this field is non-NULL, responses to http GET requests of the
+    // service are cached according to options of the cache, check comments
+    // in brpc/http_response_cache.h for details. The cache is NOT owned by
+    // server and must be valid during lifetime of the server.
+    // Default: NULL
+    HttpResponseCache* http_response_cache;
 };
 
 // Represent ports inside [min_port, max_port]
@@ -382,6 +412,8 @@ public:
             bool is_tabbed;
             bool allow_http_body_to_pb;
             bool pb_bytes_to_base64;
+            bool enable_progressive_read;
+            HttpResponseCache* http_response_cache;
             OpaqueParams();
         };
         OpaqueParams params;        
@@ -671,6 +703,9 @@ friend class Controller;
     // number of the virtual services for mapping URL to methods.
     int _virtual_service_count;
     bool _failed_to_set_max_concurrency_of_method;
+    // True if any service was added with enable_progressive_read, http
+    // requests are not matched with methods before bodies are read otherwise.
+    bool _has_progressive_read_service;
     Acceptor* _am;
     Acceptor* _internal_am;
     
@@ -20,6 +20,7 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <netinet/tcp.h>                         // getsockopt
+#include <linux/errqueue.h>                      // sock_extended_err
 #include <gflags/gflags.h>
 #include "bthread/unstable.h"                    // bthread_timer_del
 #include "butil/fd_utility.h"                     // make_non_blocking
@@ -70,6 +71,19 @@ DEFINE_int64(socket_max_unwritten_bytes, 64 * 1024 * 1024,
              "Max unwritten bytes in each socket, if the limit is reached,"
              " Socket.Write fails with EOVERCROWDED");
 
+DEFINE_int64(socket_zerocopy_min_bytes, 0,
+             "Writes with at least so many bytes are sent with MSG_ZEROCOPY "
+             "which pins the data until the kernel completes transmission "
+             "instead of copying it, <= 0 disables zero copy. Smaller writes "
+             "are cheaper to copy than to track completions of. Pinned data "
+             "is bounded by -socket_max_unwritten_bytes, beyond which writes "
+             "are copied. Requires kernels >= 4.14");
+BRPC_VALIDATE_GFLAG(socket_zerocopy_min_bytes, PassValidate);
+
+// Max number of zero-copy sends waiting for completions in one socket,
+// writes beyond the limit are copied.
+static const size_t MAX_ZEROCOPY_PENDING = 1024;
+
 DEFINE_int32(max_connection_pool_size, 100,
              "maximum pooled connection count to a single endpoint");
 BRPC_VALIDATE_GFLAG(max_connection_pool_size, PassValidate);
@@ -148,6 +162,13 @@ public:
     // The socket newing this object.
     SocketId creator_socket_id;
 
+    // The connection on which http requests are pipelined, corresponding
+    // to CONNECTION_TYPE_SINGLE of http. Unlike the main socket, it can be
+    // closed by the server (e.g. responding "Connection: close") without
+    // marking the server as broken, and is replaced with a new connection
+    // in GetPipelinedSocket().
+    butil::atomic<SocketId> pipelined_socket_id;
+
     // _in_size, _in_num_messages, _out_size, _out_num_messages of pooled
     // sockets are counted into the corresponding fields in their _main_socket.
     butil::atomic<size_t> in_size;
@@ -168,6 +189,7 @@ public:
 Socket::SharedPart::SharedPart(SocketId creator_socket_id2)
     : socket_pool(NULL)
     , creator_socket_id(creator_socket_id2)
+    , pipelined_socket_id((SocketId)-1)
     , in_size(0)
     , in_num_messages(0)
     , out_size(0)
@@ -249,6 +271,8 @@ struct SocketVarsCollector {
         , nkeepwrite_second("rpc_keepwrite_second", &nkeepwrite)
         , nwaitepollout("rpc_waitepollout_count")
         , nwaitepollout_second("rpc_waitepollout_second", &nwaitepollout)
+        , nzerocopy("rpc_zerocopy_count")
+        , nzerocopy_copied("rpc_zerocopy_copied_count")
     {}
 
     bvar::Adder<int64_t> nsocket;
@@ -260,6 +284,9 @@ struct SocketVarsCollector {
     bvar::PerSecond<bvar::Adder<int64_t> > nkeepwrite_second;
     bvar::Adder<int64_t> nwaitepollout;
     bvar::PerSecond<bvar::Adder<int64_t> > nwaitepollout_second;
+    bvar::Adder<int64_t> nzerocopy;
+    // Zero-copy sends that the kernel fell back to copying(e.g. loopback)
+    bvar::Adder<int64_t> nzerocopy_copied;
 };
 
 static SocketVarsCollector* s_vars = NULL;
@@ -408,6 +435,7 @@ Socket::Socket(Forbidden)
     , _hc_count(0)
     , _last_msg_size(0)
     , _avg_msg_size(0)
+    , _last_read_full(false)
     , _last_readtime_us(0)
     , _parsing_context(NULL)
     , _correlation_id(0)
@@ -423,10 +451,16 @@ Socket::Socket(Forbidden)
     , _controller_released_socket(false)
     , _overcrowded(false)
     , _fail_me_at_server_stop(false)
+    , _fallback_to_pooled(false)
     , _logoff_flag(false)
     , _recycle_flag(false)
     , _error_code(0)
     , _pipeline_q(NULL)
+    , _zerocopy_bufs(NULL)
+    , _zerocopy_seq(0)
+    , _zerocopy_state(0)
+    , _zerocopy_pinned_bytes(0)
+    , _zerocopy_reap_scheduled(false)
     , _last_writetime_us(0)
     , _unwritten_bytes(0)
     , _epollout_butex(NULL)
@@ -498,6 +532,19 @@ int Socket::ResetFileDescriptor(int fd) {
     // Reset message sizes when fd is changed.
     _last_msg_size = 0;
     _avg_msg_size = 0;
+    _last_read_full = false;
+    // Completions of zero-copy sends are counted per fd.
+    {
+        BAIDU_SCOPED_LOCK(_zerocopy_mutex);
+        if (_zerocopy_bufs) {
+            _zerocopy_bufs->clear();
+        }
+        _zerocopy_seq = 0;
+        _zerocopy_state = 0;
+        _zerocopy_pinned_bytes = 0;
+        // A reap scheduled for the previous user of the Socket never runs.
+        _zerocopy_reap_scheduled = false;
+    }
     // MUST store `_fd' before adding itself into epoll device to avoid
     // race conditions with the callback function inside epoll
     _fd.store(fd, butil::memory_order_release);
@@ -609,6 +656,7 @@ int Socket::Create(const SocketOptions& options, SocketId* id) {
     m->_overcrowded = false;
     // May be non-zero for RTMP connections.
     m->_fail_me_at_server_stop = false;
+    m->_fallback_to_pooled.store(false, butil::memory_order_relaxed);
     m->_logoff_flag.store(false, butil::memory_order_relaxed);
     m->_recycle_flag.store(false, butil::memory_order_relaxed);
     m->_error_code = 0;
@@ -987,6 +1035,12 @@ void Socket::OnRecycle() {
     }
     SharedPart* sp = _shared_part.exchange(NULL, butil::memory_order_acquire);
     if (sp) {
+        if (sp->creator_socket_id == id()) {
+            // The pipelined socket shares stats with this main socket and
+            // references `sp', fail it to break the cycle.
+            Socket::SetFailed(sp->pipelined_socket_id.exchange(
+                                  (SocketId)-1, butil::memory_order_relaxed));
+        }
         sp->RemoveRefManually();
     }
     const int prev_fd = _fd.exchange(-1, butil::memory_order_relaxed);
@@ -1015,6 +1069,9 @@ void Socket::OnRecycle() {
     delete _pipeline_q;
     _pipeline_q = NULL;
 
+    delete _zerocopy_bufs;
+    _zerocopy_bufs = NULL;
+
     delete _auth_context;
     _auth_context = NULL;
 
@@ -1278,6 +1335,11 @@ int Socket::HandleEpollOut(SocketId id) {
         return -1;
     }
 
+    // Completions of zero-copy sends are notified with EPOLLERR which is
+    // also dispatched here. Reap them later rather than in the next write,
+    // otherwise an idle connection pins the sent data forever.
+    s->ScheduleZeroCopyReap();
+
     EpollOutRequest* req = dynamic_cast<EpollOutRequest*>(s->user());
     if (req != NULL) {
         return s->HandleEpollOutRequest(0, req);
@@ -1511,13 +1573,9 @@ int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
     }
     
     // Write once in the calling thread. If the write is not complete,
-    // continue it in KeepWrite thread.
-    if (_conn) {
-        butil::IOBuf* data_arr[1] = { &req->data };
-        nw = _conn->CutMessageIntoFileDescriptor(fd(), data_arr, 1);
-    } else {
-        nw = req->data.cut_into_file_descriptor(fd());
-    }
+    // continue it in KeepWrite thread. `req' is the only request in the
+    // batch since req->next is NULL.
+    nw = DoWrite(req);
     if (nw < 0) {
         // RTMP may return EOVERCROWDED
         if (errno != EAGAIN && errno != EOVERCROWDED) {
@@ -1633,6 +1691,175 @@ void* Socket::KeepWrite(void* void_arg) {
     return NULL;
 }
 
+struct Socket::ZeroCopyBuf {
+    uint32_t seq;
+    bool completed;
+    butil::IOBuf data;
+};
+
+ssize_t Socket::DoZeroCopyWrite(butil::IOBuf* const* data_list, size_t ndata) {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    const int fd = this->fd();
+    BAIDU_SCOPED_LOCK(_zerocopy_mutex);
+    if (_zerocopy_state == 0) {
+        const int on = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0) {
+            // Old kernels or non-TCP sockets(e.g. unix domain sockets).
+            RPC_VLOG << "Fail to enable SO_ZEROCOPY on fd=" << fd << ": "
+                     << berror();
+            _zerocopy_state = -1;
+            errno = ENOTSUP;
+            return -1;
+        }
+        _zerocopy_state = 1;
+    }
+    if (_zerocopy_bufs == NULL) {
+        _zerocopy_bufs = new (std::nothrow) std::deque<ZeroCopyBuf>;
+        if (_zerocopy_bufs == NULL) {
+            errno = ENOTSUP;
+            return -1;
+        }
+    }
+    if (_zerocopy_bufs->size() >= MAX_ZEROCOPY_PENDING ||
+        _zerocopy_pinned_bytes >= FLAGS_socket_max_unwritten_bytes) {
+        // Completions are late, don't pin more memory.
+        errno = ENOTSUP;
+        return -1;
+    }
+    const size_t IOV_MAX_NUM = 256;
+    struct iovec vec[IOV_MAX_NUM];
+    size_t nvec = 0;
+    for (size_t i = 0; i < ndata && nvec < IOV_MAX_NUM; ++i) {
+        const butil::IOBuf* p = data_list[i];
+        const size_t nblock = p->backing_block_num();
+        for (size_t j = 0; j < nblock && nvec < IOV_MAX_NUM; ++j, ++nvec) {
+            const butil::StringPiece blk = p->backing_block(j);
+            vec[nvec].iov_base = const_cast<char*>(blk.data());
+            vec[nvec].iov_len = blk.size();
+        }
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = nvec;
+    const ssize_t nw = sendmsg(fd, &msg, MSG_ZEROCOPY);
+    if (nw < 0) {
+        if (errno == ENOBUFS) {
+            // Exceeded optmem_max for notifications, copy instead.
+            errno = ENOTSUP;
+        }
+        return -1;
+    }
+    // Each successful send is numbered by the kernel. Pin the written
+    // data until the completion of the number is notified.
+    _zerocopy_bufs->push_back(ZeroCopyBuf());
+    ZeroCopyBuf& zbuf = _zerocopy_bufs->back();
+    zbuf.seq = _zerocopy_seq++;
+    zbuf.completed = false;
+    size_t left = nw;
+    for (size_t i = 0; i < ndata && left > 0; ++i) {
+        left -= data_list[i]->cutn(&zbuf.data, left);
+    }
+    _zerocopy_pinned_bytes += nw;
+    s_vars->nzerocopy << 1;
+    return nw;
+#else
+    (void)data_list;
+    (void)ndata;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+// Completions notified meanwhile are merged by the kernel into the unread
+// notification without raising EPOLLERR again, so the delay batches
+// completions of a busy connection into one input event.
+static const int64_t ZEROCOPY_REAP_DELAY_US = 1000;
+
+void Socket::ScheduleZeroCopyReap() {
+    {
+        BAIDU_SCOPED_LOCK(_zerocopy_mutex);
+        if (_zerocopy_bufs == NULL || _zerocopy_bufs->empty() ||
+            _zerocopy_reap_scheduled) {
+            return;
+        }
+        _zerocopy_reap_scheduled = true;
+    }
+    bthread_timer_t timer;
+    if (bthread_timer_add(&timer,
+                          butil::microseconds_from_now(ZEROCOPY_REAP_DELAY_US),
+                          ReapZeroCopyCompletionsLater, (void*)id()) != 0) {
+        {
+            BAIDU_SCOPED_LOCK(_zerocopy_mutex);
+            _zerocopy_reap_scheduled = false;
+        }
+        ReapZeroCopyCompletions();
+    }
+}
+
+void Socket::ReapZeroCopyCompletionsLater(void* arg) {
+    SocketUniquePtr s;
+    if (Socket::Address((SocketId)arg, &s) != 0) {
+        return;
+    }
+    {
+        // Cleared before reaping, so that completions notified after the
+        // reaping schedule another one.
+        BAIDU_SCOPED_LOCK(s->_zerocopy_mutex);
+        s->_zerocopy_reap_scheduled = false;
+    }
+    s->ReapZeroCopyCompletions();
+}
+
+void Socket::ReapZeroCopyCompletions() {
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+    BAIDU_SCOPED_LOCK(_zerocopy_mutex);
+    if (_zerocopy_bufs == NULL || _zerocopy_bufs->empty()) {
+        return;
+    }
+    std::deque<ZeroCopyBuf>& q = *_zerocopy_bufs;
+    char control[128];
+    while (true) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            // EAGAIN: no more notifications.
+            break;
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            const struct sock_extended_err* serr =
+                (const struct sock_extended_err*)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 ||
+                serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // Sends numbered in [ee_info, ee_data] are completed.
+            const uint32_t lo = serr->ee_info;
+            const uint32_t n = serr->ee_data - lo;
+            for (size_t i = 0; i < q.size(); ++i) {
+                if (q[i].seq - lo <= n) {
+                    q[i].completed = true;
+                }
+            }
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                s_vars->nzerocopy_copied << (int64_t)n + 1;
+            }
+        }
+    }
+    while (!q.empty() && q.front().completed) {
+        _zerocopy_pinned_bytes -= q.front().data.size();
+        q.pop_front();
+    }
+#endif
+}
+
 ssize_t Socket::DoWrite(WriteRequest* req) {
     if (ssl_state() == SSL_OFF) {
         // Group butil::IOBuf in the list into a batch array.
@@ -1646,6 +1873,20 @@ ssize_t Socket::DoWrite(WriteRequest* req) {
         if (_conn) {
             return _conn->CutMessageIntoFileDescriptor(fd(), data_list, ndata);
         } else {
+            ReapZeroCopyCompletions();
+            const int64_t min_zerocopy_bytes = FLAGS_socket_zerocopy_min_bytes;
+            if (min_zerocopy_bytes > 0 && _zerocopy_state >= 0) {
+                size_t nbytes = 0;
+                for (size_t i = 0; i < ndata; ++i) {
+                    nbytes += data_list[i]->size();
+                }
+                if (nbytes >= (size_t)min_zerocopy_bytes) {
+                    const ssize_t nw = DoZeroCopyWrite(data_list, ndata);
+                    if (nw >= 0 || errno != ENOTSUP) {
+                        return nw;
+                    }
+                }
+            }
             ssize_t nw = butil::IOBuf::cut_multiple_into_file_descriptor(
                 fd(), data_list, ndata);
             return nw;
@@ -2342,6 +2583,43 @@ int Socket::GetShortSocket(Socket* main_socket,
     return 0;
 }
 
+int Socket::GetPipelinedSocket(Socket* main_socket,
+                               SocketUniquePtr* pipelined_socket) {
+    if (main_socket == NULL || pipelined_socket == NULL) {
+        LOG(ERROR) << "main_socket or pipelined_socket is NULL";
+        return -1;
+    }
+    SharedPart* main_sp = main_socket->GetOrNewSharedPart();
+    if (main_sp == NULL) {
+        LOG(ERROR) << "main_socket->_shared_part is NULL";
+        return -1;
+    }
+    SocketId id = main_sp->pipelined_socket_id.load(butil::memory_order_acquire);
+    while (true) {
+        if (id != (SocketId)-1 && Socket::Address(id, pipelined_socket) == 0) {
+            return 0;
+        }
+        // Not created yet or failed (e.g. closed by the server), replace it
+        // with a new connection optimistically.
+        SocketId new_id;
+        if (get_client_side_messenger()->Create(
+                main_socket->remote_side(), -1, &new_id) != 0) {
+            return -1;
+        }
+        if (Socket::Address(new_id, pipelined_socket) != 0) {
+            return -1;
+        }
+        (*pipelined_socket)->ShareStats(main_socket);
+        if (main_sp->pipelined_socket_id.compare_exchange_strong(
+                id, new_id, butil::memory_order_acq_rel)) {
+            return 0;
+        }
+        // Replaced by another thread, `id' is the new one.
+        (*pipelined_socket)->SetFailed();
+        pipelined_socket->reset();
+    }
+}
+
 void Socket::GetStat(SocketStat* s) const {
     BAIDU_CASSERT(offsetof(Socket, _preferred_index) >= 64, different_cacheline);
     BAIDU_CASSERT(sizeof(WriteRequest) == 64, sizeof_write_request_is_64);
@@ -2354,6 +2632,11 @@ void Socket::GetStat(SocketStat* s) const {
     }
 }
 
+int64_t Socket::held_bytes() const {
+    return (int64_t)_read_buf.size() +
+        _unwritten_bytes.load(butil::memory_order_relaxed);
+}
+
 void Socket::AddInputBytes(size_t bytes) {
     GetOrNewSharedPart()->in_size.fetch_add(bytes, butil::memory_order_relaxed);
 }
@@ -371,6 +371,11 @@ public:
     // fields will be zero.
     void GetStat(SocketStat* out) const;
 
+    // Bytes of IOBuf held by this socket, namely input not consumed by
+    // parsing yet plus output not written yet. Read without synchronization
+    // with the reading thread, for monitoring only.
+    int64_t held_bytes() const;
+
     // Call this when you receive an EOF event. `SetFailed' will be
     // called at last if EOF event is no longer postponed
     void SetEOF();
@@ -406,6 +411,11 @@ public:
     static int GetShortSocket(Socket* main_socket,
                               SocketUniquePtr* short_socket);
 
+    // Get the socket shared by http requests pipelined to the same place of
+    // main_socket, a new one is created if it's not created yet or failed.
+    static int GetPipelinedSocket(Socket* main_socket,
+                                  SocketUniquePtr* pipelined_socket);
+
     // Where the stats of this socket are accumulated to.
     SocketId main_socket_id() const;
 
@@ -419,6 +429,14 @@ public:
     void fail_me_at_server_stop() { _fail_me_at_server_stop = true; }
     bool shall_fail_me_at_server_stop() const { return _fail_me_at_server_stop; }
 
+    // Let RPCs with CONNECTION_TYPE_SINGLE to this (main) socket use pooled
+    // connections instead of the pipelined socket, because the server does
+    // not handle pipelined requests correctly, e.g. a HTTP/1.0 server.
+    void fallback_to_pooled()
+    { _fallback_to_pooled.store(true, butil::memory_order_relaxed); }
+    bool is_fallen_back_to_pooled() const
+    { return _fallback_to_pooled.load(butil::memory_order_relaxed); }
+
     // Tag the socket so that the response coming back from socket will be
     // parsed progressively. For example: in HTTP, the RPC may end w/o reading
     // the body part fully.
@@ -465,6 +483,22 @@ friend void DereferenceSocket(Socket*);
     // success, -1 otherwise and errno is set
     ssize_t DoWrite(WriteRequest* req);
 
+    // Write `data_list' into the fd with MSG_ZEROCOPY, written data is kept
+    // in `_zerocopy_bufs' until the kernel completes the transmission.
+    // Returns written bytes on success, -1 otherwise and errno is set.
+    // errno is ENOTSUP when zero copy is not usable for now, in which case
+    // the caller should write normally.
+    ssize_t DoZeroCopyWrite(butil::IOBuf* const* data_list, size_t ndata);
+
+    // Release data of completed zero-copy sends notified in the error
+    // queue of the fd. Called by the writing thread before each write and
+    // shortly after EPOLLERR by ScheduleZeroCopyReap().
+    void ReapZeroCopyCompletions();
+    // Called by the dispatcher on EPOLLERR, reap completions in a timer
+    // unless it's already scheduled.
+    void ScheduleZeroCopyReap();
+    static void ReapZeroCopyCompletionsLater(void* arg);
+
     // Called before returning to pool.
     void OnRecycle();
 
@@ -641,6 +675,8 @@ private:
     uint32_t _last_msg_size;
     // Average message size of last #MSG_SIZE_WINDOW messages (roughly)
     uint32_t _avg_msg_size;
+    // True if last read was limited by the size to read.
+    bool _last_read_full;
 
     // Storing data read from `_fd' but cut-off yet.
     butil::IOPortal _read_buf;
@@ -693,6 +729,8 @@ private:
 
     bool _fail_me_at_server_stop;
 
+    butil::atomic<bool> _fallback_to_pooled;
+
     // Set by SetLogOff
     butil::atomic<bool> _logoff_flag;
 
@@ -709,6 +747,21 @@ private:
     butil::Mutex _pipeline_mutex;
     std::deque<PipelinedInfo>* _pipeline_q;
 
+    // Data sent with MSG_ZEROCOPY which can't be released until completions
+    // are notified. Written by the writing thread and reaped by both the
+    // writing thread and the dispatcher, protected by _zerocopy_mutex.
+    butil::Mutex _zerocopy_mutex;
+    struct ZeroCopyBuf;
+    std::deque<ZeroCopyBuf>* _zerocopy_bufs;
+    // Sequence number of the next zero-copy send, counted by the kernel.
+    uint32_t _zerocopy_seq;
+    // 0: SO_ZEROCOPY is not tried on the fd, 1: enabled, -1: not supported.
+    int _zerocopy_state;
+    // Total bytes in _zerocopy_bufs.
+    int64_t _zerocopy_pinned_bytes;
+    // True if ReapZeroCopyCompletionsLater() is scheduled.
+    bool _zerocopy_reap_scheduled;
+
     // For storing call-id of in-progress RPC.
     pthread_mutex_t _id_wait_list_mutex;
     bthread_id_list_t _id_wait_list;
@@ -0,0 +1,115 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BRPC_THRIFT_MESSAGE_H
+#define BRPC_THRIFT_MESSAGE_H
+
+#include <string>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/generated_message_util.h>
+#include <google/protobuf/repeated_field.h>
+#include <google/protobuf/extension_set.h>
+#include <google/protobuf/generated_message_reflection.h>
+#include "google/protobuf/descriptor.pb.h"
+
+#include "butil/iobuf.h"                           // IOBuf
+
+
+namespace brpc {
+
+// Internal implementation detail -- do not call these.
+void protobuf_AddDesc_baidu_2frpc_2fthrift_5fframed_5fmessage_2eproto();
+void protobuf_AssignDesc_baidu_2frpc_2fthrift_5fframed_5fmessage_2eproto();
+void protobuf_ShutdownFile_baidu_2frpc_2fthrift_5fframed_5fmessage_2eproto();
+
+// Types of thrift messages, same with TMessageType of thrift.
+enum ThriftMessageType {
+    THRIFT_CALL      = 1,
+    THRIFT_REPLY     = 2,
+    THRIFT_EXCEPTION = 3,
+    THRIFT_ONEWAY    = 4,
+};
+
+// Representing a thrift request or response in TFramedTransport and
+// TBinaryProtocol (strict). The message header (name, type and seqid) is
+// parsed, and the struct after it is kept in `body' as it is, which is
+// encoded/decoded by thrift-generated code(e.g. with TMemoryBuffer) or any
+// other TBinaryProtocol implementation.
+class ThriftFramedMessage : public ::google::protobuf::Message {
+public:
+    // Name of the thrift method. Responses use names of requests if this
+    // field is empty.
+    std::string method_name;
+
+    // One of ThriftMessageType. Requests are always THRIFT_CALL. Responses
+    // are THRIFT_REPLY unless being set to THRIFT_EXCEPTION by the service.
+    int32_t message_type;
+
+    // The args struct of a request or the result struct of a response,
+    // ending with T_STOP. seqid is filled by the framework.
+    butil::IOBuf body;
+
+public:
+    ThriftFramedMessage();
+    virtual ~ThriftFramedMessage();
+
+    ThriftFramedMessage(const ThriftFramedMessage& from);
+
+    inline ThriftFramedMessage& operator=(const ThriftFramedMessage& from) {
+        CopyFrom(from);
+        return *this;
+    }
+
+    static const ::google::protobuf::Descriptor* descriptor();
+    static const ThriftFramedMessage& default_instance();
+
+    void Swap(ThriftFramedMessage* other);
+
+    // implements Message ----------------------------------------------
+
+    ThriftFramedMessage* New() const;
+    void CopyFrom(const ::google::protobuf::Message& from);
+    void MergeFrom(const ::google::protobuf::Message& from);
+    void CopyFrom(const ThriftFramedMessage& from);
+    void MergeFrom(const ThriftFramedMessage& from);
+    void Clear();
+    bool IsInitialized() const;
+
+    int ByteSize() const;
+    bool MergePartialFromCodedStream(
+        ::google::protobuf::io::CodedInputStream* input);
+    void SerializeWithCachedSizes(
+        ::google::protobuf::io::CodedOutputStream* output) const;
+    ::google::protobuf::uint8* SerializeWithCachedSizesToArray(::google::protobuf::uint8* output) const;
+    int GetCachedSize() const { return ByteSize(); }
+    ::google::protobuf::Metadata GetMetadata() const;
+
+private:
+    void SharedCtor();
+    void SharedDtor();
+private:
+friend void protobuf_AddDesc_baidu_2frpc_2fthrift_5fframed_5fmessage_2eproto_impl();
+friend void protobuf_AddDesc_baidu_2frpc_2fthrift_5fframed_5fmessage_2eproto();
+friend void protobuf_AssignDesc_baidu_2frpc_2fthrift_5fframed_5fmessage_2eproto();
+friend void protobuf_ShutdownFile_baidu_2frpc_2fthrift_5fframed_5fmessage_2eproto();
+
+    void InitAsDefaultInstance();
+    static ThriftFramedMessage* default_instance_;
+};
+
+} // namespace brpc
+
+
+#endif  // BRPC_THRIFT_MESSAGE_H
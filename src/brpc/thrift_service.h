@@ -0,0 +1,128 @@
+// Copyright (c) 2018 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BRPC_THRIFT_SERVICE_H
+#define BRPC_THRIFT_SERVICE_H
+
+#include "brpc/controller.h"                 // Controller
+#include "brpc/thrift_message.h"             // ThriftFramedMessage
+#include "brpc/describable.h"
+
+
+namespace brpc {
+
+class Socket;
+class Server;
+class MethodStatus;
+class StatusService;
+namespace policy {
+void ProcessThriftFramedRequest(InputMessageBase* msg_base);
+}
+
+// The continuation of request processing. Namely send response back to client.
+// NOTE: you DON'T need to inherit this class or create instance of this class.
+class ThriftClosure : public google::protobuf::Closure {
+public:
+    ThriftClosure();
+
+    // [Required] Call this to send response back to the client.
+    // If the controller is failed, a TApplicationException with the error
+    // text is sent instead of the response. Oneway requests are not
+    // responded.
+    void Run();
+
+    // The starting time of the RPC, got from butil::cpuwide_time_us().
+    int64_t cpuwide_start_us() const { return _start_parse_us; }
+
+private:
+friend void policy::ProcessThriftFramedRequest(InputMessageBase* msg_base);
+friend class DeleteThriftClosure;
+    // Only callable by Run().
+    ~ThriftClosure();
+
+    Socket* _socket_ptr;
+    const Server* _server;
+    int64_t _start_parse_us;
+    int32_t _seq_id;
+    // False for oneway requests.
+    bool _do_respond;
+    ThriftFramedMessage _request;
+    ThriftFramedMessage _response;
+    Controller _controller;
+};
+
+// Inherit this class to let brpc server understands thrift requests in
+// TFramedTransport + TBinaryProtocol. Requests are processed in separate
+// bthreads, responses of requests on one connection may be sent back
+// out of order, which is fine for clients checking seqid.
+// Example:
+//   class MyThriftService : public brpc::ThriftService {
+//   public:
+//       void ProcessThriftFramedRequest(const brpc::Server&,
+//                                       brpc::Controller* cntl,
+//                                       const brpc::ThriftFramedMessage& req,
+//                                       brpc::ThriftFramedMessage* res,
+//                                       brpc::ThriftClosure* done) {
+//           brpc::ClosureGuard done_guard(done);
+//           if (req.method_name == "Echo") {
+//               res->body = req.body;  // args and result are alike here.
+//           } else {
+//               cntl->SetFailed(ENOMETHOD, "Unknown method");
+//           }
+//       }
+//   };
+//   ServerOptions options;
+//   options.thrift_service = new MyThriftService;
+class ThriftService : public Describable {
+public:
+    ThriftService();
+    virtual ~ThriftService();
+
+    // Implement this method to handle thrift requests. Notice that this
+    // method can be called with a failed Controller(something wrong with the
+    // request before calling this method), in which case the implemenetation
+    // shall send specific response with error information back to client.
+    // Parameters:
+    //   server      The server receiving the request.
+    //   controller  per-rpc settings.
+    //   request     The thrift request received.
+    //   response    The thrift response that you should fill in.
+    //   done        You must call done->Run() to end the processing.
+    virtual void ProcessThriftFramedRequest(const Server& server,
+                                            Controller* controller,
+                                            const ThriftFramedMessage& request,
+                                            ThriftFramedMessage* response,
+                                            ThriftClosure* done) = 0;
+
+    // Put descriptions into the stream.
+    void Describe(std::ostream &os, const DescribeOptions&) const;
+
+private:
+DISALLOW_COPY_AND_ASSIGN(ThriftService);
+friend class ThriftClosure;
+friend void policy::ProcessThriftFramedRequest(InputMessageBase* msg_base);
+friend class StatusService;
+friend class Server;
+
+private:
+    void Expose(const butil::StringPiece& prefix);
+
+    MethodStatus* _status;
+    std::string _cached_name;
+};
+
+} // namespace brpc
+
+
+#endif // BRPC_THRIFT_SERVICE_H
@@ -106,6 +106,29 @@ start_from_non_worker(bthread_t* __restrict tid,
         tid, attr, fn, arg);
 }
 
+BASE_FORCE_INLINE int
+start_batch_from_non_worker(bthread_t* __restrict tids,
+                            size_t n,
+                            const bthread_attr_t* __restrict attr,
+                            void * (*fn)(void*),
+                            void* const* args) {
+    TaskControl* c = get_or_new_task_control();
+    if (NULL == c) {
+        return ENOMEM;
+    }
+    if (attr != NULL && (attr->flags & BTHREAD_NOSIGNAL)) {
+        // See comments in start_from_non_worker().
+        TaskGroup* g = tls_task_group_nosignal;
+        if (NULL == g) {
+            g = c->choose_one_group();
+            tls_task_group_nosignal = g;
+        }
+        return g->start_background_batch<true>(tids, n, attr, fn, args);
+    }
+    return c->choose_one_group()->start_background_batch<true>(
+        tids, n, attr, fn, args);
+}
+
 int stop_butex_wait(bthread_t tid);
 
 struct TidTraits {
@@ -156,6 +179,22 @@ int bthread_start_background(bthread_t* __restrict tid,
     return bthread::start_from_non_worker(tid, attr, fn, arg);
 }
 
+int bthread_start_batch(bthread_t* __restrict tids,
+                        size_t n,
+                        const bthread_attr_t* __restrict attr,
+                        void * (*fn)(void*),
+                        void* const* args) __THROW {
+    if (n == 0) {
+        return 0;
+    }
+    bthread::TaskGroup* g = bthread::tls_task_group;
+    if (g) {
+        // start from worker
+        return g->start_background_batch<false>(tids, n, attr, fn, args);
+    }
+    return bthread::start_batch_from_non_worker(tids, n, attr, fn, args);
+}
+
 void bthread_flush() __THROW {
     bthread::TaskGroup* g = bthread::tls_task_group;
     if (g) {
@@ -52,6 +52,18 @@ extern int bthread_start_background(bthread_t* __restrict tid,
                                     void * (*fn)(void*),
                                     void* __restrict arg) __THROW;
 
+// Create `n' bthreads `fn(args[i])' with attributes `attr' and put the
+// identifiers into `tids[i]'. Behaves like calling bthread_start_background()
+// `n' times, but the bthreads are pushed into the runqueue together and
+// idle workers are signalled once, which is cheaper for fan-out workloads.
+// Returns 0 on success, errno otherwise. On error, bthreads created before
+// the error are still scheduled and rest of `tids' are INVALID_BTHREAD.
+extern int bthread_start_batch(bthread_t* __restrict tids,
+                               size_t n,
+                               const bthread_attr_t* __restrict attr,
+                               void * (*fn)(void*),
+                               void* const* args) __THROW;
+
 // Ask the bthread `tid' to stop. Operations which would suspend the thread
 // except bthread_join will not block, instead they return ESTOP.
 // This is a cooperative stopping mechanism.
@@ -0,0 +1,115 @@
+// bthread - A M:N threading library to make applications more concurrent.
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BTHREAD_CHANNEL_H
+#define  BTHREAD_CHANNEL_H
+
+#include <time.h>                                // timespec
+#include <vector>
+#include "butil/atomicops.h"
+#include "butil/macros.h"
+#include "butil/synchronization/lock.h"          // butil::Mutex
+#include "bthread/bthread.h"
+
+namespace bthread {
+
+template <typename T> class Channel;
+
+// Receive an item from any of the |n| channels. Channels are scanned from
+// a random position to avoid starving the later ones.
+// Returns 0 on success and the item is copied into |value|, index of the
+// channel is written into |index| if it's not NULL. Returns EPIPE when
+// all channels are closed and drained, ETIMEDOUT when CLOCK_REALTIME
+// reached |abstime| if it's not NULL, errno otherwise.
+template <typename T>
+int channel_select(Channel<T>* const* channels, size_t n,
+                   T* value, size_t* index, const timespec* abstime = NULL);
+
+// A Go-like bounded channel for bthreads and pthreads. Senders block when
+// the channel is full and receivers block when it's empty. Blocked threads
+// sleep on butexes which are only woken when there are waiters, so an
+// uncontended send/recv costs a short critical section and nothing else.
+// Methods returning int return 0 on success, EPIPE if the channel is
+// closed, ETIMEDOUT if CLOCK_REALTIME reached |abstime| (when it's not
+// NULL), EAGAIN if try_* would block, and other errno on errors (e.g.
+// ESTOP if the bthread is stopped).
+template <typename T>
+class Channel {
+public:
+    // |capacity| must be positive.
+    explicit Channel(size_t capacity);
+    ~Channel();
+
+    // Put |value| into the channel, block when the channel is full.
+    // Sending into a closed channel returns EPIPE.
+    int send(const T& value, const timespec* abstime = NULL);
+    int try_send(const T& value);
+
+    // Take an item from the channel, block when the channel is empty.
+    // Items sent before close() can still be received, EPIPE is returned
+    // after all of them are consumed.
+    int recv(T* value, const timespec* abstime = NULL);
+    int try_recv(T* value);
+
+    // Block until at least one item is available, then pop at most
+    // |max_count| items into |out| (appended) under one critical section.
+    int recv_batch(std::vector<T>* out, size_t max_count,
+                   const timespec* abstime = NULL);
+
+    // Make the channel unable to send and wake up all blocked threads.
+    void close();
+
+    bool closed() const;
+    size_t size() const;
+    size_t capacity() const { return _capacity; }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(Channel);
+template <typename U> friend int channel_select(
+    Channel<U>* const*, size_t, U*, size_t*, const timespec*);
+
+    typedef butil::atomic<int> Butex;
+
+    // Called with _mutex locked, unlocks it before waking up waiters.
+    void push_and_unlock(const T& value);
+    void pop_locked(T* value);
+    void wake_after_pop_and_unlock(size_t npopped);
+    // Wait until |*butex| is changed by others, _mutex is unlocked
+    // during the wait and locked again before returning.
+    int wait_locked(Butex* butex, int* nwaiters, const timespec* abstime);
+
+    void add_selector(Butex* butex);
+    void remove_selector(Butex* butex);
+
+    mutable butil::Mutex _mutex;
+    std::vector<T> _buf;
+    size_t _capacity;
+    size_t _head;
+    size_t _size;
+    bool _closed;
+    // Incremented on each push/pop/close, waited by receivers/senders.
+    Butex* _not_empty;
+    Butex* _not_full;
+    int _nrecv_waiters;
+    int _nsend_waiters;
+    // Butexes of channel_select() waiting on this channel.
+    std::vector<Butex*> _selectors;
+};
+
+}  // namespace bthread
+
+#include "bthread/channel_inl.h"
+
+#endif  // BTHREAD_CHANNEL_H
@@ -0,0 +1,330 @@
+// bthread - A M:N threading library to make applications more concurrent.
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BTHREAD_CHANNEL_INL_H
+#define  BTHREAD_CHANNEL_INL_H
+
+#include <errno.h>
+#include <algorithm>                             // std::find
+#include "butil/fast_rand.h"                     // fast_rand_less_than
+#include "butil/logging.h"
+#include "butil/scoped_lock.h"                   // BAIDU_SCOPED_LOCK
+#include "bthread/butex.h"
+
+namespace bthread {
+
+template <typename T>
+Channel<T>::Channel(size_t capacity)
+    : _capacity(capacity)
+    , _head(0)
+    , _size(0)
+    , _closed(false)
+    , _not_empty(NULL)
+    , _not_full(NULL)
+    , _nrecv_waiters(0)
+    , _nsend_waiters(0) {
+    if (capacity == 0) {
+        LOG(FATAL) << "Invalid capacity=0";
+        abort();
+    }
+    _buf.resize(capacity);
+    _not_empty = butex_create_checked<Butex>();
+    _not_empty->store(0, butil::memory_order_relaxed);
+    _not_full = butex_create_checked<Butex>();
+    _not_full->store(0, butil::memory_order_relaxed);
+}
+
+template <typename T>
+Channel<T>::~Channel() {
+    butex_destroy(_not_empty);
+    butex_destroy(_not_full);
+}
+
+template <typename T>
+int Channel<T>::wait_locked(Butex* butex, int* nwaiters,
+                            const timespec* abstime) {
+    // The value is only changed with _mutex locked, a change after the
+    // unlock makes butex_wait() return immediately.
+    const int expected = butex->load(butil::memory_order_relaxed);
+    ++*nwaiters;
+    _mutex.unlock();
+    const int rc = butex_wait(butex, expected, abstime);
+    const int saved_errno = errno;
+    _mutex.lock();
+    --*nwaiters;
+    if (rc < 0 && saved_errno != EWOULDBLOCK && saved_errno != EINTR) {
+        return saved_errno;
+    }
+    return 0;
+}
+
+template <typename T>
+void Channel<T>::push_and_unlock(const T& value) {
+    _buf[(_head + _size) % _capacity] = value;
+    ++_size;
+    _not_empty->fetch_add(1, butil::memory_order_relaxed);
+    const bool wake_receiver = (_nrecv_waiters > 0);
+    std::vector<Butex*> selectors;
+    if (!_selectors.empty()) {
+        selectors = _selectors;
+        for (size_t i = 0; i < selectors.size(); ++i) {
+            selectors[i]->fetch_add(1, butil::memory_order_relaxed);
+        }
+    }
+    _mutex.unlock();
+    // Wake up after unlocking since butex_wake() may switch to the woken
+    // bthread directly.
+    if (wake_receiver) {
+        butex_wake(_not_empty);
+    }
+    for (size_t i = 0; i < selectors.size(); ++i) {
+        // The selector may have returned and destroyed the butex, which is
+        // fine because memory of butexes is never freed, the worst case
+        // is a spurious wakeup.
+        butex_wake(selectors[i]);
+    }
+}
+
+template <typename T>
+void Channel<T>::pop_locked(T* value) {
+    *value = _buf[_head];
+    // Don't hold resources of the item inside the channel.
+    _buf[_head] = T();
+    _head = (_head + 1) % _capacity;
+    --_size;
+}
+
+template <typename T>
+void Channel<T>::wake_after_pop_and_unlock(size_t npopped) {
+    _not_full->fetch_add(1, butil::memory_order_relaxed);
+    const size_t nwake = std::min(npopped, (size_t)_nsend_waiters);
+    _mutex.unlock();
+    for (size_t i = 0; i < nwake; ++i) {
+        if (butex_wake(_not_full) == 0) {
+            break;
+        }
+    }
+}
+
+template <typename T>
+int Channel<T>::send(const T& value, const timespec* abstime) {
+    _mutex.lock();
+    while (true) {
+        if (_closed) {
+            _mutex.unlock();
+            return EPIPE;
+        }
+        if (_size < _capacity) {
+            push_and_unlock(value);
+            return 0;
+        }
+        const int rc = wait_locked(_not_full, &_nsend_waiters, abstime);
+        if (rc != 0) {
+            _mutex.unlock();
+            return rc;
+        }
+    }
+}
+
+template <typename T>
+int Channel<T>::try_send(const T& value) {
+    _mutex.lock();
+    if (_closed) {
+        _mutex.unlock();
+        return EPIPE;
+    }
+    if (_size >= _capacity) {
+        _mutex.unlock();
+        return EAGAIN;
+    }
+    push_and_unlock(value);
+    return 0;
+}
+
+template <typename T>
+int Channel<T>::recv(T* value, const timespec* abstime) {
+    _mutex.lock();
+    while (true) {
+        if (_size > 0) {
+            pop_locked(value);
+            wake_after_pop_and_unlock(1);
+            return 0;
+        }
+        if (_closed) {
+            _mutex.unlock();
+            return EPIPE;
+        }
+        const int rc = wait_locked(_not_empty, &_nrecv_waiters, abstime);
+        if (rc != 0) {
+            _mutex.unlock();
+            return rc;
+        }
+    }
+}
+
+template <typename T>
+int Channel<T>::try_recv(T* value) {
+    _mutex.lock();
+    if (_size > 0) {
+        pop_locked(value);
+        wake_after_pop_and_unlock(1);
+        return 0;
+    }
+    const bool closed = _closed;
+    _mutex.unlock();
+    return closed ? EPIPE : EAGAIN;
+}
+
+template <typename T>
+int Channel<T>::recv_batch(std::vector<T>* out, size_t max_count,
+                           const timespec* abstime) {
+    if (max_count == 0) {
+        return EINVAL;
+    }
+    _mutex.lock();
+    while (true) {
+        if (_size > 0) {
+            const size_t n = std::min(_size, max_count);
+            const size_t old_size = out->size();
+            out->resize(old_size + n);
+            for (size_t i = 0; i < n; ++i) {
+                pop_locked(&(*out)[old_size + i]);
+            }
+            wake_after_pop_and_unlock(n);
+            return 0;
+        }
+        if (_closed) {
+            _mutex.unlock();
+            return EPIPE;
+        }
+        const int rc = wait_locked(_not_empty, &_nrecv_waiters, abstime);
+        if (rc != 0) {
+            _mutex.unlock();
+            return rc;
+        }
+    }
+}
+
+template <typename T>
+void Channel<T>::close() {
+    _mutex.lock();
+    if (_closed) {
+        _mutex.unlock();
+        return;
+    }
+    _closed = true;
+    _not_empty->fetch_add(1, butil::memory_order_relaxed);
+    _not_full->fetch_add(1, butil::memory_order_relaxed);
+    std::vector<Butex*> selectors = _selectors;
+    for (size_t i = 0; i < selectors.size(); ++i) {
+        selectors[i]->fetch_add(1, butil::memory_order_relaxed);
+    }
+    _mutex.unlock();
+    butex_wake_all(_not_empty);
+    butex_wake_all(_not_full);
+    for (size_t i = 0; i < selectors.size(); ++i) {
+        butex_wake(selectors[i]);
+    }
+}
+
+template <typename T>
+bool Channel<T>::closed() const {
+    BAIDU_SCOPED_LOCK(_mutex);
+    return _closed;
+}
+
+template <typename T>
+size_t Channel<T>::size() const {
+    BAIDU_SCOPED_LOCK(_mutex);
+    return _size;
+}
+
+template <typename T>
+void Channel<T>::add_selector(Butex* butex) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    _selectors.push_back(butex);
+}
+
+template <typename T>
+void Channel<T>::remove_selector(Butex* butex) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    typename std::vector<Butex*>::iterator it =
+        std::find(_selectors.begin(), _selectors.end(), butex);
+    if (it != _selectors.end()) {
+        *it = _selectors.back();
+        _selectors.pop_back();
+    }
+}
+
+template <typename T>
+int channel_select(Channel<T>* const* channels, size_t n,
+                   T* value, size_t* index, const timespec* abstime) {
+    if (n == 0 || value == NULL) {
+        return EINVAL;
+    }
+    typedef typename Channel<T>::Butex Butex;
+    Butex* butex = butex_create_checked<Butex>();
+    if (butex == NULL) {
+        return ENOMEM;
+    }
+    butex->store(0, butil::memory_order_relaxed);
+    for (size_t i = 0; i < n; ++i) {
+        channels[i]->add_selector(butex);
+    }
+    const size_t offset = butil::fast_rand_less_than(n);
+    int rc = 0;
+    while (true) {
+        // Read the butex before scanning, an item sent after the scan
+        // changes the butex and makes butex_wait() return immediately.
+        const int expected = butex->load(butil::memory_order_acquire);
+        size_t nclosed = 0;
+        size_t i = 0;
+        for (; i < n; ++i) {
+            const size_t k = (offset + i) % n;
+            const int rc2 = channels[k]->try_recv(value);
+            if (rc2 == 0) {
+                if (index) {
+                    *index = k;
+                }
+                break;
+            }
+            if (rc2 == EPIPE) {
+                ++nclosed;
+            }
+        }
+        if (i < n) {
+            rc = 0;
+            break;
+        }
+        if (nclosed == n) {
+            rc = EPIPE;
+            break;
+        }
+        if (butex_wait(butex, expected, abstime) < 0 &&
+            errno != EWOULDBLOCK && errno != EINTR) {
+            rc = errno;
+            break;
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        channels[i]->remove_selector(butex);
+    }
+    butex_destroy(butex);
+    return rc;
+}
+
+}  // namespace bthread
+
+#endif  // BTHREAD_CHANNEL_INL_H
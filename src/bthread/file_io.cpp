@@ -0,0 +1,234 @@
+// bthread - A M:N threading library to make applications more concurrent.
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <new>                                   // std::nothrow
+#include <unistd.h>                              // read, write, fsync
+#include <pthread.h>
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
+#include "butil/logging.h"
+#include "bthread/butex.h"                       // butex_*
+#include "bthread/task_group.h"                  // TaskGroup
+#include "bthread/unstable.h"
+
+// Run blocking file operations of bthreads in a small pool of pthreads, so
+// that a slow disk suspends the calling bthread instead of the worker.
+
+DEFINE_int32(bthread_file_io_threads, 4,
+             "Number of pthreads running blocking file operations issued by "
+             "bthread_file_* functions, only read at the first call");
+
+namespace bthread {
+
+extern BAIDU_THREAD_LOCAL TaskGroup* tls_task_group;
+
+enum FileOpType {
+    FILE_OP_READ,
+    FILE_OP_WRITE,
+    FILE_OP_PREAD,
+    FILE_OP_PWRITE,
+    FILE_OP_FSYNC,
+};
+
+struct FileOp {
+    FileOpType type;
+    int fd;
+    void* buf;
+    size_t count;
+    off_t offset;
+    ssize_t rc;
+    int error;
+    // Set to 1 when the operation is done.
+    butil::atomic<int>* butex;
+    FileOp* next;
+};
+
+static void run_file_op(FileOp* op) {
+    switch (op->type) {
+    case FILE_OP_READ:
+        op->rc = ::read(op->fd, op->buf, op->count);
+        break;
+    case FILE_OP_WRITE:
+        op->rc = ::write(op->fd, op->buf, op->count);
+        break;
+    case FILE_OP_PREAD:
+        op->rc = ::pread(op->fd, op->buf, op->count, op->offset);
+        break;
+    case FILE_OP_PWRITE:
+        op->rc = ::pwrite(op->fd, op->buf, op->count, op->offset);
+        break;
+    case FILE_OP_FSYNC:
+        op->rc = ::fsync(op->fd);
+        break;
+    }
+    op->error = (op->rc < 0 ? errno : 0);
+}
+
+class FileIOThreadPool {
+public:
+    FileIOThreadPool() : _head(NULL), _tail(NULL) {
+        pthread_mutex_init(&_mutex, NULL);
+        pthread_cond_init(&_cond, NULL);
+    }
+
+    // Returns number of threads started.
+    int start(int nthreads) {
+        int nstarted = 0;
+        for (int i = 0; i < nthreads; ++i) {
+            pthread_t th;
+            if (pthread_create(&th, NULL, run_this, this) != 0) {
+                PLOG(ERROR) << "Fail to create file io thread";
+                break;
+            }
+            pthread_detach(th);
+            ++nstarted;
+        }
+        return nstarted;
+    }
+
+    void submit(FileOp* op) {
+        op->next = NULL;
+        pthread_mutex_lock(&_mutex);
+        if (_tail) {
+            _tail->next = op;
+        } else {
+            _head = op;
+        }
+        _tail = op;
+        pthread_mutex_unlock(&_mutex);
+        pthread_cond_signal(&_cond);
+    }
+
+private:
+    static void* run_this(void* arg) {
+        static_cast<FileIOThreadPool*>(arg)->run();
+        return NULL;
+    }
+
+    void run() {
+        while (true) {
+            pthread_mutex_lock(&_mutex);
+            while (_head == NULL) {
+                pthread_cond_wait(&_cond, &_mutex);
+            }
+            FileOp* op = _head;
+            _head = op->next;
+            if (_head == NULL) {
+                _tail = NULL;
+            }
+            pthread_mutex_unlock(&_mutex);
+
+            run_file_op(op);
+            // `op' is on the stack of the waiter which may return right
+            // after seeing the store, save the butex before.
+            butil::atomic<int>* butex = op->butex;
+            butex->store(1, butil::memory_order_release);
+            butex_wake(butex);
+        }
+    }
+
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+    FileOp* _head;
+    FileOp* _tail;
+};
+
+static pthread_once_t g_file_io_pool_once = PTHREAD_ONCE_INIT;
+static FileIOThreadPool* g_file_io_pool = NULL;
+
+static void init_file_io_pool() {
+    FileIOThreadPool* pool = new (std::nothrow) FileIOThreadPool;
+    if (pool == NULL) {
+        LOG(FATAL) << "Fail to new FileIOThreadPool";
+        return;
+    }
+    if (pool->start(FLAGS_bthread_file_io_threads) <= 0) {
+        LOG(ERROR) << "Fail to start any file io thread, file operations "
+            "of bthreads will block workers";
+        // Threads may be started partially, never delete the pool.
+        return;
+    }
+    g_file_io_pool = pool;
+}
+
+static ssize_t submit_file_op(FileOp* op) {
+    TaskGroup* g = tls_task_group;
+    if (NULL == g || g->is_current_pthread_task()) {
+        // Blocking a pthread is fine.
+        run_file_op(op);
+        errno = op->error;
+        return op->rc;
+    }
+    pthread_once(&g_file_io_pool_once, init_file_io_pool);
+    FileIOThreadPool* pool = g_file_io_pool;
+    if (NULL == pool) {
+        run_file_op(op);
+        errno = op->error;
+        return op->rc;
+    }
+    op->butex = butex_create_checked<butil::atomic<int> >();
+    if (NULL == op->butex) {
+        run_file_op(op);
+        errno = op->error;
+        return op->rc;
+    }
+    op->butex->store(0, butil::memory_order_relaxed);
+    pool->submit(op);
+    // The buffer is being accessed by the pool, we must not return until
+    // the operation is done, even if the bthread is stopped.
+    while (op->butex->load(butil::memory_order_acquire) == 0) {
+        butex_wait_uninterruptible(op->butex, 0, NULL);
+    }
+    butex_destroy(op->butex);
+    errno = op->error;
+    return op->rc;
+}
+
+}  // namespace bthread
+
+extern "C" {
+
+ssize_t bthread_file_read(int fd, void* buf, size_t count) {
+    bthread::FileOp op = { bthread::FILE_OP_READ, fd, buf, count, 0,
+                           0, 0, NULL, NULL };
+    return bthread::submit_file_op(&op);
+}
+
+ssize_t bthread_file_write(int fd, const void* buf, size_t count) {
+    bthread::FileOp op = { bthread::FILE_OP_WRITE, fd, const_cast<void*>(buf),
+                           count, 0, 0, 0, NULL, NULL };
+    return bthread::submit_file_op(&op);
+}
+
+ssize_t bthread_file_pread(int fd, void* buf, size_t count, off_t offset) {
+    bthread::FileOp op = { bthread::FILE_OP_PREAD, fd, buf, count, offset,
+                           0, 0, NULL, NULL };
+    return bthread::submit_file_op(&op);
+}
+
+ssize_t bthread_file_pwrite(int fd, const void* buf, size_t count,
+                            off_t offset) {
+    bthread::FileOp op = { bthread::FILE_OP_PWRITE, fd, const_cast<void*>(buf),
+                           count, offset, 0, 0, NULL, NULL };
+    return bthread::submit_file_op(&op);
+}
+
+int bthread_file_fsync(int fd) {
+    bthread::FileOp op = { bthread::FILE_OP_FSYNC, fd, NULL, 0, 0,
+                           0, 0, NULL, NULL };
+    return (int)bthread::submit_file_op(&op);
+}
+
+}  // extern "C"
@@ -20,6 +20,7 @@
 #include <execinfo.h>
 #include <dlfcn.h>                               // dlsym
 #include <fcntl.h>                               // O_RDONLY
+#include <gflags/gflags.h>
 #include "butil/atomicops.h"
 #include "bvar/bvar.h"
 #include "bvar/collector.h"
@@ -37,6 +38,7 @@
 #include "bthread/butex.h"                       // butex_*
 #include "bthread/processor.h"                   // cpu_relax, barrier
 #include "bthread/mutex.h"                       // bthread_mutex_t
+#include "bthread/bthread.h"                     // bthread_getconcurrency
 #include "bthread/sys_futex.h"
 #include "bthread/log.h"
 
@@ -45,6 +47,31 @@ extern void* _dl_sym(void* handle, const char* symbol, void* caller);
 }
 
 namespace bthread {
+
+static bool validate_non_negative(const char*, int32_t val) { return val >= 0; }
+
+DEFINE_int32(bthread_mutex_max_spin, 0,
+             "A contended bthread_mutex_lock spins at most so many times for "
+             "the owner to unlock before sleeping. Not spinning when there's "
+             "only one worker. 0 disables spinning");
+const bool ALLOW_UNUSED dummy_bthread_mutex_max_spin =
+    ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_bthread_mutex_max_spin,
+                                    validate_non_negative);
+
+DEFINE_int32(bthread_mutex_starvation_us, 0,
+             "When a waiter of bthread_mutex waited longer than so many "
+             "microseconds, the mutex is handed to waiters in FIFO order "
+             "rather than being released, until a waiter gets it in time. "
+             "0 disables the handoff");
+const bool ALLOW_UNUSED dummy_bthread_mutex_starvation_us =
+    ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_bthread_mutex_starvation_us,
+                                    validate_non_negative);
+
+DEFINE_bool(bthread_mutex_profile_lock_site, false,
+            "Make contention profiler attribute the waiting time of "
+            "bthread_mutex to the call sites of locking rather than unlocking. "
+            "Backtraces are taken inside the critical sections");
+
 // Warm up backtrace before main().
 void* dummy_buf[4];
 const int ALLOW_UNUSED dummy_bt = backtrace(dummy_buf, arraysize(dummy_buf));
@@ -619,27 +646,156 @@ const MutexInternal MUTEX_LOCKED_RAW = {{1},{0},0};
 BAIDU_CASSERT(sizeof(unsigned) == sizeof(MutexInternal),
               sizeof_mutex_internal_must_equal_unsigned);
 
-inline int mutex_lock_contended(bthread_mutex_t* m) {
-    butil::atomic<unsigned>* whole = (butil::atomic<unsigned>*)m->butex;
-    while (whole->exchange(BTHREAD_MUTEX_CONTENDED) & BTHREAD_MUTEX_LOCKED) {
-        if (bthread::butex_wait(whole, BTHREAD_MUTEX_CONTENDED, NULL) < 0
-            && errno != EWOULDBLOCK) {
-            return errno;
+// Set in the padding while bthread_mutex is in FIFO mode: the mutex is not
+// released by unlock but handed to the waiter woken up.
+const MutexInternal MUTEX_STARVING_RAW = {{0},{0},1};
+// Set by unlock to hand the locked mutex to one of the waiters.
+const MutexInternal MUTEX_HANDOFF_RAW = {{0},{0},2};
+#define BTHREAD_MUTEX_STARVING (*(const unsigned*)&bthread::MUTEX_STARVING_RAW)
+#define BTHREAD_MUTEX_HANDOFF (*(const unsigned*)&bthread::MUTEX_HANDOFF_RAW)
+
+// Spin for a while before sleeping, which saves a pair of context switches
+// when the critical section is short and the owner is running on another
+// worker. Returns true if the mutex looks released.
+inline bool spin_for_mutex(butil::atomic<unsigned>* whole) {
+    const int max_spin = FLAGS_bthread_mutex_max_spin;
+    // The owner can't be running in parallel with only one worker.
+    if (max_spin <= 0 || bthread_getconcurrency() <= 1) {
+        return false;
+    }
+    for (int i = 0; i < max_spin; ++i) {
+        const unsigned v = whole->load(butil::memory_order_relaxed);
+        if (v & BTHREAD_MUTEX_STARVING) {
+            // The mutex will be handed to sleeping waiters.
+            return false;
         }
+        if (!(v & BTHREAD_MUTEX_LOCKED)) {
+            return true;
+        }
+        cpu_relax();
+    }
+    return false;
+}
+
+// Unlock a starving mutex by handing it to the waiter woken up, which is
+// the one waited longest since butex wakes up waiters in FIFO order, so
+// that the waiter can't be overtaken by newcomers again.
+inline void mutex_handoff(butil::atomic<unsigned>* whole) {
+    const unsigned prev = whole->fetch_or(BTHREAD_MUTEX_HANDOFF,
+                                          butil::memory_order_release);
+    if (bthread::butex_wake(whole) > 0) {
+        return;
+    }
+    // No one is sleeping. Release the mutex unless a waiter which was about
+    // to sleep already took it.
+    // CAUTION: the mutex may be taken, unlocked and destroyed before the CAS,
+    // which is safe as long as butex is never freed and the value with
+    // BTHREAD_MUTEX_HANDOFF set is unlikely to be reproduced by reuse.
+    unsigned expected = prev | BTHREAD_MUTEX_HANDOFF;
+    if (whole->compare_exchange_strong(expected, 0, butil::memory_order_release)) {
+        // Newcomers may start sleeping on the handed-off value after the
+        // butex_wake above, wake them up to take the released mutex.
+        bthread::butex_wake(whole);
     }
-    return 0;
 }
 
-inline int mutex_timedlock_contended(
-    bthread_mutex_t* m, const struct timespec* __restrict abstime) {
+// `queued' is true if the caller was woken up from a butex that may have been
+// requeued onto the mutex, say bthread_cond_broadcast, which makes it eligible
+// for the handed-off mutex as well as waiters woken up here.
+inline int mutex_lock_contended(bthread_mutex_t* m,
+                                const struct timespec* __restrict abstime,
+                                bool queued = false) {
     butil::atomic<unsigned>* whole = (butil::atomic<unsigned>*)m->butex;
-    while (whole->exchange(BTHREAD_MUTEX_CONTENDED) & BTHREAD_MUTEX_LOCKED) {
-        if (bthread::butex_wait(whole, BTHREAD_MUTEX_CONTENDED, abstime) < 0
-            && errno != EWOULDBLOCK) {
-            return errno;
+    const int64_t starvation_ns = FLAGS_bthread_mutex_starvation_us * 1000L;
+    const int64_t start_ns = (starvation_ns > 0 ? butil::cpuwide_time_ns() : 0);
+    bool spun = false;
+    // True after being woken up from butex_wait, namely this is a queued
+    // waiter which may be the one woken up by mutex_handoff().
+    bool woken = queued;
+    unsigned v = whole->load(butil::memory_order_relaxed);
+    while (true) {
+        unsigned expected = v;
+        if (v & BTHREAD_MUTEX_HANDOFF) {
+            if (woken) {
+                // Take the mutex from the unlocker, it's still locked.
+                if (!whole->compare_exchange_weak(
+                        v, v & ~BTHREAD_MUTEX_HANDOFF,
+                        butil::memory_order_acquire)) {
+                    continue;
+                }
+                if (starvation_ns <= 0 ||
+                    butil::cpuwide_time_ns() - start_ns < starvation_ns) {
+                    // This waiter did not starve, back to normal mode.
+                    whole->fetch_and(~BTHREAD_MUTEX_STARVING,
+                                     butil::memory_order_relaxed);
+                }
+                return 0;
+            }
+            // The mutex is handed to a waiter woken up by the unlocker, a
+            // newcomer queues behind it without spinning or touching the
+            // mutex, otherwise the starving waiter is overtaken again.
+        } else if (!(v & BTHREAD_MUTEX_LOCKED)) {
+            // Keep the mutex contended since there may be other waiters.
+            if (whole->compare_exchange_weak(
+                    v, v | BTHREAD_MUTEX_CONTENDED, butil::memory_order_acquire)) {
+                return 0;
+            }
+            continue;
+        } else {
+            if (!spun) {
+                spun = true;
+                if (spin_for_mutex(whole)) {
+                    v = whole->load(butil::memory_order_relaxed);
+                    continue;
+                }
+            }
+            expected = v | BTHREAD_MUTEX_CONTENDED;
+            if (starvation_ns > 0 && !(v & BTHREAD_MUTEX_STARVING) &&
+                butil::cpuwide_time_ns() - start_ns >= starvation_ns) {
+                expected |= BTHREAD_MUTEX_STARVING;
+            }
+            if (expected != v && !whole->compare_exchange_weak(
+                    v, expected, butil::memory_order_relaxed)) {
+                continue;
+            }
         }
+        const int rc = bthread::butex_wait(whole, expected, abstime);
+        if (rc < 0 && errno != EWOULDBLOCK) {
+            const int saved_errno = errno;
+            // The mutex may be handed to this waiter before the failure,
+            // pass it on otherwise the mutex is never unlocked.
+            v = whole->load(butil::memory_order_relaxed);
+            while (v & BTHREAD_MUTEX_HANDOFF) {
+                if (whole->compare_exchange_weak(
+                        v, v & ~BTHREAD_MUTEX_HANDOFF,
+                        butil::memory_order_acquire)) {
+                    bthread_mutex_unlock(m);
+                    break;
+                }
+            }
+            return saved_errno;
+        }
+        if (rc == 0) {
+            // Not set for EWOULDBLOCK which means this waiter was never
+            // queued and must not take the handoff.
+            woken = true;
+        }
+        v = whole->load(butil::memory_order_relaxed);
     }
-    return 0;
+}
+
+// Called inside lock after a sampled contended locking.
+BASE_FORCE_INLINE void save_or_submit_wait(bthread_mutex_t* m, int64_t start_ns,
+                                size_t sampling_range) {
+    const int64_t end_ns = butil::cpuwide_time_ns();
+    if (FLAGS_bthread_mutex_profile_lock_site) {
+        const bthread_contention_site_t csite = {end_ns - start_ns, sampling_range};
+        submit_contention(csite, end_ns);
+        return;
+    }
+    // Submitted in unlock along with the time taken by waking up waiters.
+    m->csite.duration_ns = end_ns - start_ns;
+    m->csite.sampling_range = sampling_range;
 }
 
 #ifdef BTHREAD_USE_FAST_PTHREAD_MUTEX
@@ -708,8 +864,10 @@ int bthread_mutex_trylock(bthread_mutex_t* m) __THROW {
     return EBUSY;
 }
 
+// Called by bthread_cond_wait whose waiters may be requeued onto the mutex
+// and woken up by an unlock handing the mutex off.
 int bthread_mutex_lock_contended(bthread_mutex_t* m) {
-    return bthread::mutex_lock_contended(m);
+    return bthread::mutex_lock_contended(m, NULL, true);
 }
 
 int bthread_mutex_lock(bthread_mutex_t* m) __THROW {
@@ -719,21 +877,20 @@ int bthread_mutex_lock(bthread_mutex_t* m) __THROW {
     }
     // Don't sample when contention profiler is off.
     if (!bthread::g_cp) {
-        return bthread::mutex_lock_contended(m);
+        return bthread::mutex_lock_contended(m, NULL);
     }
     // Ask Collector if this (contended) locking should be sampled.
     const size_t sampling_range = bvar::is_collectable(&bthread::g_cp_sl);
     if (!sampling_range) { // Don't sample
-        return bthread::mutex_lock_contended(m);
+        return bthread::mutex_lock_contended(m, NULL);
     }
     // Start sampling.
     const int64_t start_ns = butil::cpuwide_time_ns();
     // NOTE: Don't modify m->csite outside lock since multiple threads are
     // still contending with each other.
-    const int rc = bthread::mutex_lock_contended(m);
+    const int rc = bthread::mutex_lock_contended(m, NULL);
     if (!rc) { // Inside lock
-        m->csite.duration_ns = butil::cpuwide_time_ns() - start_ns;
-        m->csite.sampling_range = sampling_range;
+        bthread::save_or_submit_wait(m, start_ns, sampling_range);
     } // else rare
     return rc;
 }
@@ -746,21 +903,20 @@ int bthread_mutex_timedlock(bthread_mutex_t* __restrict m,
     }
     // Don't sample when contention profiler is off.
     if (!bthread::g_cp) {
-        return bthread::mutex_timedlock_contended(m, abstime);
+        return bthread::mutex_lock_contended(m, abstime);
     }
     // Ask Collector if this (contended) locking should be sampled.
     const size_t sampling_range = bvar::is_collectable(&bthread::g_cp_sl);
     if (!sampling_range) { // Don't sample
-        return bthread::mutex_timedlock_contended(m, abstime);
+        return bthread::mutex_lock_contended(m, abstime);
     }
     // Start sampling.
     const int64_t start_ns = butil::cpuwide_time_ns();
     // NOTE: Don't modify m->csite outside lock since multiple threads are
     // still contending with each other.
-    const int rc = bthread::mutex_timedlock_contended(m, abstime);
+    const int rc = bthread::mutex_lock_contended(m, abstime);
     if (!rc) { // Inside lock
-        m->csite.duration_ns = butil::cpuwide_time_ns() - start_ns;
-        m->csite.sampling_range = sampling_range;
+        bthread::save_or_submit_wait(m, start_ns, sampling_range);
     } else if (rc == ETIMEDOUT) {
         // Failed to lock due to ETIMEDOUT, submit the elapse directly.
         const int64_t end_ns = butil::cpuwide_time_ns();
@@ -777,6 +933,18 @@ int bthread_mutex_unlock(bthread_mutex_t* m) __THROW {
         saved_csite = m->csite;
         bthread::make_contention_site_invalid(&m->csite);
     }
+    if (whole->load(butil::memory_order_relaxed) & BTHREAD_MUTEX_STARVING) {
+        if (!bthread::is_contention_site_valid(saved_csite)) {
+            bthread::mutex_handoff(whole);
+            return 0;
+        }
+        const int64_t unlock_start_ns = butil::cpuwide_time_ns();
+        bthread::mutex_handoff(whole);
+        const int64_t unlock_end_ns = butil::cpuwide_time_ns();
+        saved_csite.duration_ns += unlock_end_ns - unlock_start_ns;
+        bthread::submit_contention(saved_csite, unlock_end_ns);
+        return 0;
+    }
     const unsigned prev = whole->exchange(0, butil::memory_order_release);
     // CAUTION: the mutex may be destroyed, check comments before butex_create
     if (prev == BTHREAD_MUTEX_LOCKED) {
@@ -37,12 +37,19 @@ public:
         int val;
     };
 
-    ParkingLot() : _pending_signal(0) {}
+    ParkingLot() : _pending_signal(0), _nwaiters(0) {}
 
     // Wake up at most `num_task' workers.
     // Returns #workers woken up.
     int signal(int num_task) {
-        _pending_signal.fetch_add((num_task << 1), butil::memory_order_release);
+        _pending_signal.fetch_add((num_task << 1), butil::memory_order_seq_cst);
+        // Skip the syscall when no worker is sleeping in wait(), which is
+        // common when idle workers are spinning. A waiter increases
+        // _nwaiters before futex_wait, so either we see it here or its
+        // futex_wait sees the modified _pending_signal and returns.
+        if (_nwaiters.load(butil::memory_order_seq_cst) == 0) {
+            return 0;
+        }
         return futex_wake_private(&_pending_signal, num_task);
     }
 
@@ -54,7 +61,9 @@ public:
     // Wait for tasks.
     // If the `expected_state' does not match, wait() may finish directly.
     void wait(const State& expected_state) {
+        _nwaiters.fetch_add(1, butil::memory_order_seq_cst);
         futex_wait_private(&_pending_signal, expected_state.val, NULL);
+        _nwaiters.fetch_sub(1, butil::memory_order_relaxed);
     }
 
     // Wakeup suspended wait() and make them unwaitable ever. 
@@ -65,6 +74,8 @@ public:
 private:
     // higher 31 bits for signalling, MLB for stopping.
     butil::atomic<int> _pending_signal;
+    // number of workers inside wait().
+    butil::atomic<int> _nwaiters;
 };
 
 }  // namespace bthread
@@ -0,0 +1,88 @@
+// bthread - A M:N threading library to make applications more concurrent.
+// Copyright (c) 2017 Baidu, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "butil/logging.h"
+#include "bthread/butex.h"
+#include "bthread/semaphore.h"
+
+namespace bthread {
+
+Semaphore::Semaphore(int initial_count) : _nwaiters(0) {
+    if (initial_count < 0) {
+        LOG(FATAL) << "Invalid initial_count=" << initial_count;
+        abort();
+    }
+    _butex = butex_create_checked<butil::atomic<int> >();
+    _butex->store(initial_count, butil::memory_order_relaxed);
+}
+
+Semaphore::~Semaphore() {
+    butex_destroy(_butex);
+}
+
+void Semaphore::post(int n) {
+    if (n <= 0) {
+        LOG_IF(ERROR, n < 0) << "Invalid n=" << n;
+        return;
+    }
+    _butex->fetch_add(n, butil::memory_order_seq_cst);
+    // A waiter increases _nwaiters before butex_wait(), so either we see
+    // it here or its butex_wait() sees the increased counter and returns.
+    int nwaiters = _nwaiters.load(butil::memory_order_seq_cst);
+    for (; nwaiters > 0 && n > 0; --nwaiters, --n) {
+        if (butex_wake(_butex) == 0) {
+            break;
+        }
+    }
+}
+
+bool Semaphore::try_wait() {
+    int cur = _butex->load(butil::memory_order_relaxed);
+    while (cur > 0) {
+        if (_butex->compare_exchange_weak(cur, cur - 1,
+                                          butil::memory_order_acquire,
+                                          butil::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int Semaphore::wait_impl(const timespec* duetime) {
+    while (!try_wait()) {
+        _nwaiters.fetch_add(1, butil::memory_order_seq_cst);
+        const int rc = butex_wait(_butex, 0, duetime);
+        const int saved_errno = errno;
+        _nwaiters.fetch_sub(1, butil::memory_order_relaxed);
+        if (rc < 0 && saved_errno != EWOULDBLOCK && saved_errno != EINTR) {
+            return saved_errno;
+        }
+    }
+    return 0;
+}
+
+int Semaphore::wait() {
+    return wait_impl(NULL);
+}
+
+int Semaphore::timed_wait(const timespec& duetime) {
+    return wait_impl(&duetime);
+}
+
+int Semaphore::value() const {
+    return _butex->load(butil::memory_order_relaxed);
+}
+
+}  // namespace bthread
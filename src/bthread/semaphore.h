@@ -0,0 +1,63 @@
+// bthread - A M:N threading library to make applications more concurrent.
+// Copyright (c) 2017 Baidu, Inc.
+// 
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+// 
+//     http://www.apache.org/licenses/LICENSE-2.0
+// 
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BTHREAD_SEMAPHORE_H
+#define  BTHREAD_SEMAPHORE_H
+
+#include <time.h>                                // timespec
+#include "butil/atomicops.h"
+#include "butil/macros.h"
+#include "bthread/bthread.h"
+
+namespace bthread {
+
+// A counting semaphore for bthreads and pthreads. The counter lives in a
+// butex, so post() and wait() wake each other directly without the
+// mutex+condition pair and wake-ups are skipped when nobody is waiting.
+class Semaphore {
+public:
+    explicit Semaphore(int initial_count = 0);
+    ~Semaphore();
+
+    // Increase the counter by |n| and wake up at most |n| waiters.
+    void post(int n = 1);
+
+    // Decrease the counter by 1, block current thread until the counter
+    // is positive.
+    // Returns 0 on success, errno otherwise(ESTOP if the bthread is stopped).
+    int wait();
+
+    // Same as wait() but gives up when CLOCK_REALTIME reached |duetime|.
+    // Returns 0 on success, ETIMEDOUT on timeout, errno otherwise.
+    int timed_wait(const timespec& duetime);
+
+    // Decrease the counter by 1 if it's positive, never block.
+    // Returns true on success.
+    bool try_wait();
+
+    // Current value of the counter. Notice that it may change soon.
+    int value() const;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(Semaphore);
+    int wait_impl(const timespec* duetime);
+
+    butil::atomic<int>* _butex;
+    butil::atomic<int> _nwaiters;
+};
+
+}  // namespace bthread
+
+#endif  // BTHREAD_SEMAPHORE_H
@@ -113,6 +113,10 @@ static int64_t get_cumulated_signal_count_from_this(void *arg) {
     return static_cast<TaskControl*>(arg)->get_cumulated_signal_count();
 }
 
+static double get_cumulated_spin_time_from_this(void *arg) {
+    return static_cast<TaskControl*>(arg)->get_cumulated_spin_time();
+}
+
 TaskControl::TaskControl()
     // NOTE: all fileds must be initialized before the vars.
     : _ngroup(0)
@@ -129,6 +133,8 @@ TaskControl::TaskControl()
     , _switch_per_second(&_cumulated_switch_count)
     , _cumulated_signal_count(get_cumulated_signal_count_from_this, this)
     , _signal_per_second(&_cumulated_signal_count)
+    , _cumulated_spin_time(get_cumulated_spin_time_from_this, this)
+    , _spin_usage_second(&_cumulated_spin_time, 1)
     , _status(print_rq_sizes_in_the_tc, this)
     , _nbthreads("bthread_count")
 {
@@ -164,6 +170,7 @@ int TaskControl::init(int concurrency) {
     _worker_usage_second.expose("bthread_worker_usage");
     _switch_per_second.expose("bthread_switch_second");
     _signal_per_second.expose("bthread_signal_second");
+    _spin_usage_second.expose("bthread_worker_spin_usage");
     _status.expose("bthread_group_status");
 
     // Wait for at least one group is added so that choose_one_group()
@@ -245,6 +252,7 @@ TaskControl::~TaskControl() {
     _worker_usage_second.hide();
     _switch_per_second.hide();
     _signal_per_second.hide();
+    _spin_usage_second.hide();
     _status.hide();
     
     stop_and_join();
@@ -430,6 +438,30 @@ int64_t TaskControl::get_cumulated_signal_count() {
     return c;
 }
 
+double TaskControl::get_cumulated_spin_time() {
+    int64_t spin_ns = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const size_t ngroup = _ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        if (_groups[i]) {
+            spin_ns += _groups[i]->_cumulated_spin_ns;
+        }
+    }
+    return spin_ns / 1000000000.0;
+}
+
+int64_t TaskControl::get_cumulated_spin_found_count() {
+    int64_t c = 0;
+    BAIDU_SCOPED_LOCK(_modify_group_mutex);
+    const size_t ngroup = _ngroup.load(butil::memory_order_relaxed);
+    for (size_t i = 0; i < ngroup; ++i) {
+        if (_groups[i]) {
+            c += _groups[i]->_nspin_found;
+        }
+    }
+    return c;
+}
+
 bvar::LatencyRecorder* TaskControl::create_exposed_pending_time() {
     bool is_creator = false;
     _pending_time_mutex.lock();
@@ -66,6 +66,8 @@ public:
     double get_cumulated_worker_time();
     int64_t get_cumulated_switch_count();
     int64_t get_cumulated_signal_count();
+    double get_cumulated_spin_time();
+    int64_t get_cumulated_spin_found_count();
 
     // [Not thread safe] Add more worker threads.
     // Return the number of workers actually added, which may be less then |num|
@@ -105,6 +107,8 @@ private:
     bvar::PerSecond<bvar::PassiveStatus<int64_t> > _switch_per_second;
     bvar::PassiveStatus<int64_t> _cumulated_signal_count;
     bvar::PerSecond<bvar::PassiveStatus<int64_t> > _signal_per_second;
+    bvar::PassiveStatus<double> _cumulated_spin_time;
+    bvar::PerSecond<bvar::PassiveStatus<double> > _spin_usage_second;
     bvar::PassiveStatus<std::string> _status;
     bvar::Adder<int64_t> _nbthreads;
 
@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 #include <stddef.h>                         // size_t
+#include <algorithm>                        // std::min
 #include <gflags/gflags.h>
 #include "butil/macros.h"                    // ARRAY_SIZE
 #include "butil/scoped_lock.h"               // BAIDU_SCOPED_LOCK
@@ -39,6 +40,10 @@ static const bthread_attr_t BTHREAD_ATTR_TASKGROUP = {
     BTHREAD_STACKTYPE_UNKNOWN, 0, NULL };
 
 static bool pass_bool(const char*, bool) { return true; }
+static bool validate_non_negative(const char*, int32_t val) { return val >= 0; }
+static bool validate_percent(const char*, int32_t val) {
+    return val >= 0 && val <= 100;
+}
 
 DEFINE_bool(show_bthread_creation_in_vars, false, "When this flags is on, The time "
             "from bthread creation to first run will be recorded and shown "
@@ -53,6 +58,21 @@ const bool ALLOW_UNUSED dummy_show_per_worker_usage_in_vars =
     ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_show_per_worker_usage_in_vars,
                                     pass_bool);
 
+DEFINE_int32(task_group_max_spin_us, 0,
+             "An idle worker spins for at most so many microseconds before "
+             "parking. The actual spinning time is learned from recent idle "
+             "intervals of the worker. 0 disables spinning");
+const bool ALLOW_UNUSED dummy_task_group_max_spin_us =
+    ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_task_group_max_spin_us,
+                                    validate_non_negative);
+
+DEFINE_int32(task_group_spin_cpu_percent, 10,
+             "Cpu time spent on spinning by each worker is capped at so many "
+             "percents of elapsed time");
+const bool ALLOW_UNUSED dummy_task_group_spin_cpu_percent =
+    ::GFLAGS_NS::RegisterFlagValidator(&FLAGS_task_group_spin_cpu_percent,
+                                    validate_percent);
+
 __thread TaskGroup* tls_task_group = NULL;
 __thread LocalStorage tls_bls = BTHREAD_LOCAL_STORAGE_INITIALIZER;
 
@@ -140,7 +160,63 @@ int set_butex_waiter(bthread_t tid, ButexWaiter* w) {
     return -1;
 }
 
+bool TaskGroup::spin_for_task(bthread_t* tid) {
+    const int64_t max_spin_ns = FLAGS_task_group_max_spin_us * 1000L;
+    if (max_spin_ns <= 0 || _avg_idle_ns > max_spin_ns) {
+        // Disabled, or tasks usually come too late to be caught by spinning.
+        return false;
+    }
+    const int64_t start_ns = butil::cpuwide_time_ns();
+    _spin_budget_ns += (start_ns - _last_spin_refill_ns) *
+        FLAGS_task_group_spin_cpu_percent / 100;
+    _last_spin_refill_ns = start_ns;
+    if (_spin_budget_ns > max_spin_ns) {
+        _spin_budget_ns = max_spin_ns;
+    }
+    // Spin a bit longer than the average so that most of the intervals
+    // around the average are covered.
+    const int64_t spin_ns = std::min(_avg_idle_ns * 2, _spin_budget_ns);
+    if (spin_ns <= 0) {
+        return false;
+    }
+    const int64_t deadline_ns = start_ns + spin_ns;
+    bool found = false;
+    int64_t now_ns = start_ns;
+    for (int i = 1; now_ns < deadline_ns; ++i) {
+        cpu_relax();
+        // Stealing scans other groups, don't do it after every pause.
+        if ((i & 15) == 0 && steal_task(tid)) {
+            found = true;
+            break;
+        }
+        now_ns = butil::cpuwide_time_ns();
+    }
+    const int64_t spent_ns = butil::cpuwide_time_ns() - start_ns;
+    _spin_budget_ns -= spent_ns;
+    _cumulated_spin_ns += spent_ns;
+    if (found) {
+        ++_nspin_found;
+    }
+    return found;
+}
+
+void TaskGroup::update_idle_stat(int64_t idle_start_ns) {
+    const int64_t max_spin_ns = FLAGS_task_group_max_spin_us * 1000L;
+    int64_t idle_ns = butil::cpuwide_time_ns() - idle_start_ns;
+    // Long sleeps only need to push the average above max_spin_ns, clamp
+    // them so that the average comes back quickly when workload changes.
+    if (idle_ns > 2 * max_spin_ns) {
+        idle_ns = 2 * max_spin_ns;
+    }
+    _avg_idle_ns += (idle_ns - _avg_idle_ns) / 8;
+}
+
 bool TaskGroup::wait_task(bthread_t* tid) {
+    const int64_t idle_start_ns = butil::cpuwide_time_ns();
+    if (spin_for_task(tid)) {
+        update_idle_stat(idle_start_ns);
+        return true;
+    }
     do {
 #ifndef BTHREAD_DONT_SAVE_PARKING_STATE
         if (_last_pl_state.stopped()) {
@@ -148,6 +224,7 @@ bool TaskGroup::wait_task(bthread_t* tid) {
         }
         _pl->wait(_last_pl_state);
         if (steal_task(tid)) {
+            update_idle_stat(idle_start_ns);
             return true;
         }
 #else
@@ -156,6 +233,7 @@ bool TaskGroup::wait_task(bthread_t* tid) {
             return -1;
         }
         if (steal_task(tid)) {
+            update_idle_stat(idle_start_ns);
             return true;
         }
         _pl->wait(st);
@@ -209,6 +287,11 @@ TaskGroup::TaskGroup(TaskControl* c)
     , _last_context_remained(NULL)
     , _last_context_remained_arg(NULL)
     , _pl(NULL) 
+    , _avg_idle_ns(0)
+    , _spin_budget_ns(0)
+    , _last_spin_refill_ns(butil::cpuwide_time_ns())
+    , _cumulated_spin_ns(0)
+    , _nspin_found(0)
     , _main_stack(NULL)
     , _main_tid(0)
     , _remote_num_nosignal(0)
@@ -490,6 +573,73 @@ TaskGroup::start_background<false>(bthread_t* __restrict th,
                                    void * (*fn)(void*),
                                    void* __restrict arg);
 
+template <bool REMOTE>
+int TaskGroup::start_background_batch(bthread_t* __restrict tids,
+                                      size_t n,
+                                      const bthread_attr_t* __restrict attr,
+                                      void * (*fn)(void*),
+                                      void* const* args) {
+    if (__builtin_expect(!fn, 0)) {
+        return EINVAL;
+    }
+    const int64_t start_ns = butil::cpuwide_time_ns();
+    const bthread_attr_t using_attr = (attr ? *attr : BTHREAD_ATTR_NORMAL);
+    int rc = 0;
+    size_t ncreated = 0;
+    for (; ncreated < n; ++ncreated) {
+        butil::ResourceId<TaskMeta> slot;
+        TaskMeta* m = butil::get_resource(&slot);
+        if (__builtin_expect(!m, 0)) {
+            rc = ENOMEM;
+            break;
+        }
+        CHECK(m->current_waiter.load(butil::memory_order_relaxed) == NULL);
+        m->stop = false;
+        m->interruptible = true;
+        m->about_to_quit = false;
+        m->fn = fn;
+        m->arg = args[ncreated];
+        CHECK(m->stack == NULL);
+        m->attr = using_attr;
+        m->local_storage = LOCAL_STORAGE_INIT;
+        m->cpuwide_start_ns = start_ns;
+        m->stat = EMPTY_STAT;
+        m->tid = make_tid(*m->version_butex, slot);
+        tids[ncreated] = m->tid;
+        if (using_attr.flags & BTHREAD_LOG_START_AND_FINISH) {
+            LOG(INFO) << "Started bthread " << m->tid;
+        }
+    }
+    for (size_t i = ncreated; i < n; ++i) {
+        tids[i] = INVALID_BTHREAD;
+    }
+    if (ncreated == 0) {
+        return rc;
+    }
+    _control->_nbthreads << ncreated;
+    if (REMOTE) {
+        ready_to_run_remote_batch(tids, ncreated,
+                                  (using_attr.flags & BTHREAD_NOSIGNAL));
+    } else {
+        ready_to_run_batch(tids, ncreated,
+                           (using_attr.flags & BTHREAD_NOSIGNAL));
+    }
+    return rc;
+}
+
+template int
+TaskGroup::start_background_batch<true>(bthread_t* __restrict tids,
+                                        size_t n,
+                                        const bthread_attr_t* __restrict attr,
+                                        void * (*fn)(void*),
+                                        void* const* args);
+template int
+TaskGroup::start_background_batch<false>(bthread_t* __restrict tids,
+                                         size_t n,
+                                         const bthread_attr_t* __restrict attr,
+                                         void * (*fn)(void*),
+                                         void* const* args);
+
 int TaskGroup::join(bthread_t tid, void** return_value) {
     if (__builtin_expect(!tid, 0)) {  // tid of bthread is never 0.
         return EINVAL;
@@ -704,6 +854,26 @@ void TaskGroup::flush_nosignal_tasks() {
     }
 }
 
+void TaskGroup::ready_to_run_batch(const bthread_t* tids, size_t n,
+                                   bool nosignal) {
+    size_t i = 0;
+    while (true) {
+        const size_t npushed = _rq.push_batch(tids + i, n - i);
+        i += npushed;
+        _num_nosignal += npushed;
+        if (i >= n) {
+            break;
+        }
+        // Same as push_rq(): let other workers steal pushed tasks and retry.
+        flush_nosignal_tasks();
+        LOG_EVERY_SECOND(ERROR) << "_rq is full, capacity=" << _rq.capacity();
+        ::usleep(1000);
+    }
+    if (!nosignal) {
+        flush_nosignal_tasks();
+    }
+}
+
 void TaskGroup::ready_to_run_remote(bthread_t tid, bool nosignal) {
     _remote_rq._mutex.lock();
     while (!_remote_rq.push_locked(tid)) {
@@ -725,6 +895,26 @@ void TaskGroup::ready_to_run_remote(bthread_t tid, bool nosignal) {
     }
 }
 
+void TaskGroup::ready_to_run_remote_batch(const bthread_t* tids, size_t n,
+                                          bool nosignal) {
+    _remote_rq._mutex.lock();
+    for (size_t i = 0; i < n; ++i) {
+        while (!_remote_rq.push_locked(tids[i])) {
+            flush_nosignal_tasks_remote_locked(_remote_rq._mutex);
+            LOG_EVERY_SECOND(ERROR) << "_remote_rq is full, capacity="
+                                    << _remote_rq.capacity();
+            ::usleep(1000);
+            _remote_rq._mutex.lock();
+        }
+        ++_remote_num_nosignal;
+    }
+    if (nosignal) {
+        _remote_rq._mutex.unlock();
+    } else {
+        flush_nosignal_tasks_remote_locked(_remote_rq._mutex);
+    }
+}
+
 void TaskGroup::flush_nosignal_tasks_remote_locked(butil::Mutex& locked_mutex) {
     const int val = _remote_num_nosignal;
     if (!val) {
@@ -71,6 +71,20 @@ public:
                          void * (*fn)(void*),
                          void* __restrict arg);
 
+    // Create `n' tasks `fn(args[i])' with attributes `attr' in this
+    // TaskGroup and put the identifiers into `tids'. The tasks are pushed
+    // into the runqueue together and workers are signalled only once.
+    //   Called from worker: start_background_batch<false>
+    //   Called from non-worker: start_background_batch<true>
+    // Return 0 on success, errno otherwise. On error, tasks created before
+    // the error are still scheduled and rest of `tids' are INVALID_BTHREAD.
+    template <bool REMOTE>
+    int start_background_batch(bthread_t* __restrict tids,
+                               size_t n,
+                               const bthread_attr_t* __restrict attr,
+                               void * (*fn)(void*),
+                               void* const* args);
+
     // Suspend caller and run next bthread in TaskGroup *pg.
     static void sched(TaskGroup** pg);
     static void ending_sched(TaskGroup** pg);
@@ -147,8 +161,14 @@ public:
     // Flush tasks pushed to rq but signalled.
     void flush_nosignal_tasks();
 
+    // Push bthreads into the runqueue and signal for all of them once.
+    void ready_to_run_batch(const bthread_t* tids, size_t n,
+                            bool nosignal = false);
+
     // Push a bthread into the runqueue from another non-worker thread.
     void ready_to_run_remote(bthread_t tid, bool nosignal = false);
+    void ready_to_run_remote_batch(const bthread_t* tids, size_t n,
+                                   bool nosignal = false);
     void flush_nosignal_tasks_remote_locked(butil::Mutex& locked_mutex);
     void flush_nosignal_tasks_remote();
 
@@ -203,6 +223,15 @@ friend class TaskControl;
     // loop calling this function should end.
     bool wait_task(bthread_t* tid);
 
+    // Spin for a while (learned from recent idle intervals of this worker)
+    // to catch tasks arriving shortly after the worker becomes idle, which
+    // saves futex wait/wake on both sides.
+    // Returns true if a task was stolen into `tid'.
+    bool spin_for_task(bthread_t* tid);
+
+    // Feed the elapse of last wait_task() to the moving average.
+    void update_idle_stat(int64_t idle_start_ns);
+
     bool steal_task(bthread_t* tid) {
         if (_remote_rq.pop(tid)) {
             return true;
@@ -232,6 +261,15 @@ friend class TaskControl;
     void* _last_context_remained_arg;
 
     ParkingLot* _pl;
+    // Moving average of idle intervals between tasks.
+    int64_t _avg_idle_ns;
+    // Remaining cpu time allowed for spinning, refilled proportionally to
+    // elapsed time, see FLAGS_task_group_spin_cpu_percent.
+    int64_t _spin_budget_ns;
+    int64_t _last_spin_refill_ns;
+    // Cpu time spent on spinning and # of tasks found by spinning.
+    int64_t _cumulated_spin_ns;
+    size_t _nspin_found;
 #ifndef BTHREAD_DONT_SAVE_PARKING_STATE
     ParkingLot::State _last_pl_state;
 #endif
@@ -76,6 +76,20 @@ extern int bthread_close(int fd) __THROW;
 extern int bthread_connect(int sockfd, const sockaddr* serv_addr,
                            socklen_t addrlen) __THROW;
 
+// Replacements of read(2), write(2), pread(2), pwrite(2) and fsync(2) on
+// regular files. When called from a bthread, the operation runs in a small
+// pool of pthreads (-bthread_file_io_threads) and only the calling bthread
+// is suspended, so a slow disk does not block the worker. When called from
+// a pthread, the syscall is issued directly.
+// Returns same values as the syscalls and errno is set on error.
+extern ssize_t bthread_file_read(int fd, void* buf, size_t count);
+extern ssize_t bthread_file_write(int fd, const void* buf, size_t count);
+extern ssize_t bthread_file_pread(int fd, void* buf, size_t count,
+                                  off_t offset);
+extern ssize_t bthread_file_pwrite(int fd, const void* buf, size_t count,
+                                   off_t offset);
+extern int bthread_file_fsync(int fd);
+
 // Add a startup function that each pthread worker will run at the beginning
 // To run code at the end, use butil::thread_atexit()
 // Returns 0 on success, error code otherwise.
@@ -29,11 +29,13 @@ ArenaOptions::ArenaOptions()
 Arena::Arena(const ArenaOptions& options)
     : _cur_block(NULL)
     , _isolated_blocks(NULL)
+    , _cleanups(NULL)
     , _block_size(options.initial_block_size)
     , _options(options) {
 }
 
 Arena::~Arena() {
+    run_cleanups();
     while (_cur_block != NULL) {
         Block* const saved_next = _cur_block->next;
         free(_cur_block);
@@ -49,6 +51,7 @@ Arena::~Arena() {
 void Arena::swap(Arena& other) {
     std::swap(_cur_block, other._cur_block);
     std::swap(_isolated_blocks, other._isolated_blocks);
+    std::swap(_cleanups, other._cleanups);
     std::swap(_block_size, other._block_size);
     const ArenaOptions tmp = _options;
     _options = other._options;
@@ -56,13 +59,44 @@ void Arena::swap(Arena& other) {
 }
 
 void Arena::clear() {
-    // TODO(gejun): Reuse memory
-    Arena a;
-    swap(a);
+    run_cleanups();
+    while (_isolated_blocks != NULL) {
+        Block* const saved_next = _isolated_blocks->next;
+        free(_isolated_blocks);
+        _isolated_blocks = saved_next;
+    }
+    // _cur_block is the largest one among regular blocks, reuse it.
+    if (_cur_block != NULL) {
+        _cur_block->alloc_size = 0;
+    }
+}
+
+int Arena::add_cleanup(void (*fn)(void*), void* arg) {
+    Cleanup* c = (Cleanup*)allocate(sizeof(Cleanup));
+    if (c == NULL) {
+        return -1;
+    }
+    c->fn = fn;
+    c->arg = arg;
+    c->next = _cleanups;
+    _cleanups = c;
+    return 0;
+}
+
+void Arena::run_cleanups() {
+    // Cleanups are allocated on the blocks, which are not freed yet.
+    while (_cleanups != NULL) {
+        Cleanup* const c = _cleanups;
+        _cleanups = c->next;
+        c->fn(c->arg);
+    }
 }
 
 void* Arena::allocate_new_block(size_t n) {
     Block* b = (Block*)malloc(offsetof(Block, data) + n);
+    if (NULL == b) {
+        return NULL;
+    }
     b->next = _isolated_blocks;
     b->alloc_size = n;
     b->size = n;
@@ -41,6 +41,15 @@ public:
     void swap(Arena&);
     void* allocate(size_t n);
     void* allocate_aligned(size_t n);  // not implemented.
+
+    // Call `fn(arg)' when the arena is cleared or destroyed, in the reverse
+    // order of adding. Objects owning resources (e.g. IOBuf) can be put on
+    // the arena with this function.
+    // Returns 0 on success, -1 otherwise.
+    int add_cleanup(void (*fn)(void*), void* arg);
+
+    // Free all allocated memory. The last block is kept for later
+    // allocations so that a cleared arena does not malloc again.
     void clear();
 
 private:
@@ -55,8 +64,15 @@ private:
         char data[0];
     };
 
+    struct Cleanup {
+        void (*fn)(void*);
+        void* arg;
+        Cleanup* next;
+    };
+
     void* allocate_in_other_blocks(size_t n);
     void* allocate_new_block(size_t n);
+    void run_cleanups();
     Block* pop_block(Block* & head) {
         Block* saved_head = head;
         head = head->next;
@@ -65,6 +81,7 @@ private:
     
     Block* _cur_block;
     Block* _isolated_blocks;
+    Cleanup* _cleanups;
     size_t _block_size;
     ArenaOptions _options;
 };
@@ -14,10 +14,12 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <pthread.h>
 #ifdef __SSE4_2__
 #include <nmmintrin.h>
 #endif
 #include "butil/build_config.h"
+#include "butil/iobuf.h"
 
 namespace butil {
 namespace crc32c {
@@ -421,6 +423,131 @@ uint32_t ExtendImpl(uint32_t crc, const char* buf, size_t size) {
   return static_cast<uint32_t>(l ^ 0xffffffffu);
 }
 
+#if defined(__SSE4_2__) && defined(__LP64__)
+// The crc32 instruction has a latency of 3 cycles and a throughput of 1 per
+// cycle, computing crc of 3 independent streams in parallel and combining
+// them afterwards is nearly 3 times faster than doing it serially for large
+// buffers. Combining appends zeros to the crc of the former stream by
+// multiplying a 32x32 matrix over GF(2), which is accelerated by 4 lookup
+// tables for each stream length. Derived from crc32c.c by Mark Adler.
+
+static const size_t kLongStream = 8192;
+static const size_t kShortStream = 256;
+static uint32_t long_zeros_[4][256];
+static uint32_t short_zeros_[4][256];
+static pthread_once_t zeros_once_ = PTHREAD_ONCE_INIT;
+
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec) {
+  uint32_t sum = 0;
+  for (; vec; vec >>= 1, ++mat) {
+    if (vec & 1) {
+      sum ^= *mat;
+    }
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat) {
+  for (int n = 0; n < 32; ++n) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+// Construct the operator appending `len' zero bytes to a crc, `len' must
+// be a power of 2.
+static void crc32c_zeros_op(uint32_t* even, size_t len) {
+  uint32_t odd[32];
+  // Operator for one zero bit.
+  odd[0] = 0x82f63b78;  // reflected polynomial of crc32c
+  uint32_t row = 1;
+  for (int n = 1; n < 32; ++n) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  gf2_matrix_square(even, odd);  // 2 zero bits
+  gf2_matrix_square(odd, even);  // 4 zero bits
+  // The first square puts the operator for one zero byte into even, the
+  // next one puts the operator for two zero bytes into odd, and so on.
+  do {
+    gf2_matrix_square(even, odd);
+    len >>= 1;
+    if (len == 0) {
+      return;
+    }
+    gf2_matrix_square(odd, even);
+    len >>= 1;
+  } while (len);
+  memcpy(even, odd, sizeof(odd));
+}
+
+static void crc32c_zeros(uint32_t zeros[][256], size_t len) {
+  uint32_t op[32];
+  crc32c_zeros_op(op, len);
+  for (uint32_t n = 0; n < 256; ++n) {
+    zeros[0][n] = gf2_matrix_times(op, n);
+    zeros[1][n] = gf2_matrix_times(op, n << 8);
+    zeros[2][n] = gf2_matrix_times(op, n << 16);
+    zeros[3][n] = gf2_matrix_times(op, n << 24);
+  }
+}
+
+static void init_zeros_tables() {
+  crc32c_zeros(long_zeros_, kLongStream);
+  crc32c_zeros(short_zeros_, kShortStream);
+}
+
+static inline uint32_t crc32c_shift(const uint32_t zeros[][256], uint32_t crc) {
+  return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+      zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+// Compute crc of 3 consecutive streams of `len' bytes in parallel.
+static inline const uint8_t* crc32c_3way(uint64_t* crc, const uint8_t* p,
+                                         size_t len,
+                                         const uint32_t zeros[][256]) {
+  uint64_t crc0 = *crc;
+  uint64_t crc1 = 0;
+  uint64_t crc2 = 0;
+  const uint8_t* const end = p + len;
+  do {
+    crc0 = _mm_crc32_u64(crc0, LE_LOAD64(p));
+    crc1 = _mm_crc32_u64(crc1, LE_LOAD64(p + len));
+    crc2 = _mm_crc32_u64(crc2, LE_LOAD64(p + len * 2));
+    p += 8;
+  } while (p < end);
+  crc0 = crc32c_shift(zeros, (uint32_t)crc0) ^ crc1;
+  crc0 = crc32c_shift(zeros, (uint32_t)crc0) ^ crc2;
+  *crc = crc0;
+  return p + len * 2;
+}
+
+static uint32_t ExtendInterleaved(uint32_t crc, const char* buf, size_t size) {
+  if (size < kShortStream * 3) {
+    return ExtendImpl<FastCRC32Functor>(crc, buf, size);
+  }
+  pthread_once(&zeros_once_, init_zeros_tables);
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  uint64_t l = crc ^ 0xffffffffu;
+  // Align p to 8 bytes.
+  for (; (reinterpret_cast<uintptr_t>(p) & 7) != 0; ++p, --size) {
+    l = _mm_crc32_u8((uint32_t)l, *p);
+  }
+  for (; size >= kLongStream * 3; size -= kLongStream * 3) {
+    p = crc32c_3way(&l, p, kLongStream, long_zeros_);
+  }
+  for (; size >= kShortStream * 3; size -= kShortStream * 3) {
+    p = crc32c_3way(&l, p, kShortStream, short_zeros_);
+  }
+  for (; size >= 8; size -= 8, p += 8) {
+    l = _mm_crc32_u64(l, LE_LOAD64(p));
+  }
+  for (; size > 0; --size, ++p) {
+    l = _mm_crc32_u8((uint32_t)l, *p);
+  }
+  return static_cast<uint32_t>(l ^ 0xffffffffu);
+}
+#endif  // __SSE4_2__ && __LP64__
+
 // Detect if SS42 or not.
 static bool isSSE42() {
 #if defined(__GNUC__) && defined(__x86_64__) && !defined(IOS_CROSS_COMPILE)
@@ -436,8 +563,13 @@ static bool isSSE42() {
 typedef uint32_t (*Function)(uint32_t, const char*, size_t);
 
 static inline Function Choose_Extend() {
+#if defined(__SSE4_2__) && defined(__LP64__)
+  return isSSE42() ? (Function)ExtendInterleaved :
+                    (Function)ExtendImpl<SlowCRC32Functor>;
+#else
   return isSSE42() ? (Function)ExtendImpl<FastCRC32Functor> : 
                     (Function)ExtendImpl<SlowCRC32Functor>;
+#endif
 }
 
 bool IsFastCrc32Supported() {
@@ -453,5 +585,14 @@ uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
   return ChosenExtend(crc, buf, size);
 }
 
+uint32_t Extend(uint32_t crc, const IOBuf& buf) {
+  const size_t n = buf.backing_block_num();
+  for (size_t i = 0; i < n; ++i) {
+    const StringPiece blk = buf.backing_block(i);
+    crc = Extend(crc, blk.data(), blk.size());
+  }
+  return crc;
+}
+
 }  // namespace crc32c
 }  // namespace butil
@@ -14,6 +14,9 @@
 #include <stdint.h>
 
 namespace butil {
+
+class IOBuf;
+
 namespace crc32c {
 
 extern bool IsFastCrc32Supported();
@@ -28,6 +31,15 @@ inline uint32_t Value(const char* data, size_t n) {
   return Extend(0, data, n);
 }
 
+// Return the crc32c of concat(A, buf) where init_crc is the crc32c of A.
+// Blocks of `buf' are computed one by one without being flattened.
+extern uint32_t Extend(uint32_t init_crc, const IOBuf& buf);
+
+// Return the crc32c of buf
+inline uint32_t Value(const IOBuf& buf) {
+  return Extend(0, buf);
+}
+
 static const uint32_t kMaskDelta = 0xa282ead8ul;
 
 // Return a masked representation of crc.
@@ -0,0 +1,108 @@
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BUTIL_FAST_MEMCHR_H
+#define BUTIL_FAST_MEMCHR_H
+
+#include <stddef.h>                      // size_t
+#include <string.h>                      // memchr
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Vectorized scanning of bytes, used by parsers looking for delimiters.
+// Compared 32 bytes(AVX2) or 16 bytes(SSE2) at a time depending on the
+// compiling flags, scalar code is used on other platforms.
+//
+//   fast_memchr(s, n, c)          : first `c' in [s, s+n), NULL if absent
+//   fast_memchr2(s, n, c1, c2)    : first `c1' or `c2', NULL if absent
+//   fast_memcount(s, n, c)        : number of `c' in [s, s+n)
+
+namespace butil {
+
+namespace detail {
+
+#if defined(__AVX2__)
+typedef __m256i ByteVector;
+static const size_t BYTE_VECTOR_SIZE = 32;
+inline ByteVector byte_vector_set1(char c) { return _mm256_set1_epi8(c); }
+inline ByteVector byte_vector_load(const char* s) {
+    return _mm256_loadu_si256((const __m256i*)s);
+}
+// One bit per byte, set if the bytes are equal.
+inline unsigned byte_vector_eq(ByteVector a, ByteVector b) {
+    return (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+#elif defined(__SSE2__)
+typedef __m128i ByteVector;
+static const size_t BYTE_VECTOR_SIZE = 16;
+inline ByteVector byte_vector_set1(char c) { return _mm_set1_epi8(c); }
+inline ByteVector byte_vector_load(const char* s) {
+    return _mm_loadu_si128((const __m128i*)s);
+}
+inline unsigned byte_vector_eq(ByteVector a, ByteVector b) {
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+#endif
+
+}  // namespace detail
+
+inline const char* fast_memchr(const char* s, size_t n, char c) {
+    // memchr of glibc is vectorized already.
+    return (const char*)memchr(s, c, n);
+}
+
+inline const char* fast_memchr2(const char* s, size_t n, char c1, char c2) {
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    using namespace detail;
+    const ByteVector v1 = byte_vector_set1(c1);
+    const ByteVector v2 = byte_vector_set1(c2);
+    for (; i + BYTE_VECTOR_SIZE <= n; i += BYTE_VECTOR_SIZE) {
+        const ByteVector d = byte_vector_load(s + i);
+        const unsigned mask = byte_vector_eq(d, v1) | byte_vector_eq(d, v2);
+        if (mask != 0) {
+            return s + i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (s[i] == c1 || s[i] == c2) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+inline size_t fast_memcount(const char* s, size_t n, char c) {
+    size_t count = 0;
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    using namespace detail;
+    const ByteVector v = byte_vector_set1(c);
+    for (; i + BYTE_VECTOR_SIZE <= n; i += BYTE_VECTOR_SIZE) {
+        count += __builtin_popcount(byte_vector_eq(byte_vector_load(s + i), v));
+    }
+#endif
+    for (; i < n; ++i) {
+        count += (s[i] == c);
+    }
+    return count;
+}
+
+}  // namespace butil
+
+#endif  // BUTIL_FAST_MEMCHR_H
@@ -28,6 +28,7 @@
 #include "butil/macros.h"                   // BAIDU_CASSERT
 #include "butil/logging.h"                  // CHECK, LOG
 #include "butil/fd_guard.h"                 // butil::fd_guard
+#include "butil/fast_memchr.h"               // fast_memchr
 #include "butil/iobuf.h"
 
 namespace butil {
@@ -210,6 +211,12 @@ butil::static_atomic<size_t> g_nblock = BASE_STATIC_ATOMIC_INIT(0);
 butil::static_atomic<size_t> g_blockmem = BASE_STATIC_ATOMIC_INIT(0);
 butil::static_atomic<size_t> g_newbigview = BASE_STATIC_ATOMIC_INIT(0);
 
+// Defined in iobuf_profiler.cpp
+extern butil::static_atomic<size_t> g_block_sampling_rate;
+extern butil::static_atomic<size_t> g_nsampled_block;
+void sample_block(const void* block, size_t size);
+void unsample_block(const void* block);
+
 }  // namespace iobuf
 
 size_t IOBuf::block_count() {
@@ -224,21 +231,36 @@ size_t IOBuf::new_bigview_count() {
     return iobuf::g_newbigview.load(butil::memory_order_relaxed);
 }
 
+// Placed after the header of blocks referencing user data.
+struct UserDataExtension {
+    char* data;
+    void (*deleter)(void*);
+};
+
 struct IOBuf::Block {
     butil::atomic<int> nshared;
     uint16_t size;
-    uint16_t cap;
+    uint16_t cap;  // 0 for blocks referencing user data, which are always full.
     Block* portal_next;
-    char data[0];
+    char payload[0];
         
     explicit Block(size_t block_size)
-        : nshared(1), size(0), cap(block_size - offsetof(Block, data))
+        : nshared(1), size(0), cap(block_size - offsetof(Block, payload))
         , portal_next(NULL) {
         assert(block_size <= MAX_BLOCK_SIZE);
         iobuf::g_nblock.fetch_add(1, butil::memory_order_relaxed);
         iobuf::g_blockmem.fetch_add(block_size, butil::memory_order_relaxed);
     }
 
+    // The user data is not counted in block_memory().
+    Block(char* user_data, void (*deleter)(void*))
+        : nshared(1), size(0), cap(0), portal_next(NULL) {
+        UserDataExtension* ext = user_data_extension();
+        ext->data = user_data;
+        ext->deleter = deleter;
+        iobuf::g_nblock.fetch_add(1, butil::memory_order_relaxed);
+    }
+
     void inc_ref() {
         nshared.fetch_add(1, butil::memory_order_relaxed);
     }
@@ -247,8 +269,17 @@ struct IOBuf::Block {
         if (nshared.fetch_sub(1, butil::memory_order_release) == 1) {
             butil::atomic_thread_fence(butil::memory_order_acquire);
             iobuf::g_nblock.fetch_sub(1, butil::memory_order_relaxed);
-            iobuf::g_blockmem.fetch_sub(cap + offsetof(Block, data),
-                                        butil::memory_order_relaxed);
+            if (is_user_data()) {
+                UserDataExtension* ext = user_data_extension();
+                ext->deleter(ext->data);
+            } else {
+                iobuf::g_blockmem.fetch_sub(cap + offsetof(Block, payload),
+                                            butil::memory_order_relaxed);
+            }
+            if (BAIDU_UNLIKELY(iobuf::g_nsampled_block.load(
+                                   butil::memory_order_relaxed) != 0)) {
+                iobuf::unsample_block(this);
+            }
             this->~Block();
             iobuf::blockmem_deallocate(this);
         }
@@ -258,6 +289,19 @@ struct IOBuf::Block {
         return nshared.load(butil::memory_order_relaxed);
     }
 
+    bool is_user_data() const { return cap == 0; }
+
+    UserDataExtension* user_data_extension() {
+        return reinterpret_cast<UserDataExtension*>(payload);
+    }
+
+    char* data() {
+        if (BAIDU_LIKELY(!is_user_data())) {
+            return payload;
+        }
+        return user_data_extension()->data;
+    }
+
     bool full() const { return size >= cap; }
     size_t left_space() const { return cap - size; }
 };
@@ -278,13 +322,51 @@ uint16_t block_cap(IOBuf::Block const *b) {
 inline IOBuf::Block* create_block(const size_t block_size) {
     void* mem = iobuf::blockmem_allocate(block_size);
     if (BAIDU_LIKELY(mem != NULL)) {
-        return new (mem) IOBuf::Block(block_size);
+        IOBuf::Block* b = new (mem) IOBuf::Block(block_size);
+        if (BAIDU_UNLIKELY(g_block_sampling_rate.load(
+                               butil::memory_order_relaxed) != 0)) {
+            sample_block(b, block_size);
+        }
+        return b;
     }
     return NULL;
 }
 
+inline IOBuf::Block* create_user_data_block(
+    void* data, void (*deleter)(void*)) {
+    const size_t block_size =
+        offsetof(IOBuf::Block, payload) + sizeof(UserDataExtension);
+    void* mem = iobuf::blockmem_allocate(block_size);
+    if (BAIDU_LIKELY(mem != NULL)) {
+        IOBuf::Block* b = new (mem) IOBuf::Block((char*)data, deleter);
+        if (BAIDU_UNLIKELY(g_block_sampling_rate.load(
+                               butil::memory_order_relaxed) != 0)) {
+            sample_block(b, block_size);
+        }
+        return b;
+    }
+    return NULL;
+}
+
+// Changed by reloadable -iobuf_block_size while blocks are being created.
+static butil::static_atomic<size_t> g_default_block_size =
+    BASE_STATIC_ATOMIC_INIT(IOBuf::DEFAULT_BLOCK_SIZE);
+
+int set_default_block_size(size_t size) {
+    if (size < 4096 || size > IOBuf::MAX_BLOCK_SIZE) {
+        LOG(ERROR) << "Invalid block_size=" << size;
+        return -1;
+    }
+    g_default_block_size.store(size, butil::memory_order_relaxed);
+    return 0;
+}
+
+size_t default_block_size() {
+    return g_default_block_size.load(butil::memory_order_relaxed);
+}
+
 inline IOBuf::Block* create_block() {
-    return create_block(IOBuf::DEFAULT_BLOCK_SIZE);
+    return create_block(default_block_size());
 }
 
 // === Share TLS blocks between appending operations ===
@@ -754,7 +836,7 @@ bool IOBuf::cut1(char* c) {
         return false;
     }
     IOBuf::BlockRef &r = _front_ref();
-    *c = r.block->data[r.offset];
+    *c = r.block->data()[r.offset];
     if (r.length > 1) {
         ++r.offset;
         --r.length;
@@ -825,12 +907,12 @@ size_t IOBuf::cutn(void* out, size_t n) {
     while (n) {   // length() == 0 does not enter
         IOBuf::BlockRef &r = _front_ref();
         if (r.length <= n) {
-            iobuf::cp(out, r.block->data + r.offset, r.length);
+            iobuf::cp(out, r.block->data() + r.offset, r.length);
             out = (char*)out + r.length;
             n -= r.length;
             _pop_front_ref();
         } else {
-            iobuf::cp(out, r.block->data + r.offset, n);
+            iobuf::cp(out, r.block->data() + r.offset, n);
             out = (char*)out + n;
             r.offset += n;
             r.length -= n;
@@ -858,61 +940,100 @@ size_t IOBuf::cutn(std::string* out, size_t n) {
 }
 
 int IOBuf::_cut_by_char(IOBuf* out, char d) {
+    const size_t n = find(d);
+    if (n == npos) {
+        return -1;
+    }
+    // There's no way cutn/pop_front fails
+    cutn(out, n);
+    pop_front(1);
+    return 0;
+}
+
+int IOBuf::_cut_by_delim(IOBuf* out, char const* dbegin, size_t ndelim) {
+    const size_t n = find(StringPiece(dbegin, ndelim));
+    if (n == npos) {
+        return -1;
+    }
+    // There's no way cutn/pop_front fails
+    cutn(out, n);
+    pop_front(ndelim);
+    return 0;
+}
+
+const size_t IOBuf::npos;
+
+size_t IOBuf::find(char c, size_t pos) const {
     const size_t nref = _ref_num();
-    size_t n = 0;
-    
+    size_t offset = 0;  // offset of the ref inside this IOBuf
     for (size_t i = 0; i < nref; ++i) {
         IOBuf::BlockRef const& r = _ref_at(i);
-        char const* const s = r.block->data + r.offset;
-        for (uint32_t j = 0; j < r.length; ++j, ++n) {
-            if (s[j] == d) {
-                // There's no way cutn/pop_front fails
-                cutn(out, n);
-                pop_front(1);
-                return 0;
+        if (pos < offset + r.length) {
+            const size_t skip = (pos > offset ? pos - offset : 0);
+            char const* const s = r.block->data() + r.offset;
+            char const* const p = fast_memchr(s + skip, r.length - skip, c);
+            if (p != NULL) {
+                return offset + (p - s);
             }
         }
+        offset += r.length;
     }
-
-    return -1;
+    return npos;
 }
 
-int IOBuf::_cut_by_delim(IOBuf* out, char const* dbegin, size_t ndelim) {
-    typedef unsigned long SigType;
-    const size_t NMAX = sizeof(SigType);
-    
-    if (ndelim > NMAX || ndelim > length()) {
-        return -1;
-    }
-    
-    SigType dsig = 0;
-    for (size_t i = 0; i < ndelim; ++i) {
-        dsig = (dsig << CHAR_BIT) | static_cast<SigType>(dbegin[i]);
+bool IOBuf::_equals_at(size_t ref_index, size_t offset,
+                       const StringPiece& str) const {
+    const size_t nref = _ref_num();
+    size_t ncmp = 0;
+    for (size_t i = ref_index; i < nref && ncmp < str.size(); ++i) {
+        IOBuf::BlockRef const& r = _ref_at(i);
+        const size_t len = std::min((size_t)r.length - offset,
+                                    str.size() - ncmp);
+        if (memcmp(r.block->data() + r.offset + offset,
+                   str.data() + ncmp, len) != 0) {
+            return false;
+        }
+        ncmp += len;
+        offset = 0;
     }
-    
-    const SigType SIGMASK =
-        (ndelim == NMAX ? (SigType)-1 : (((SigType)1 << (ndelim * CHAR_BIT)) - 1));
+    return ncmp == str.size();
+}
 
+size_t IOBuf::find(const StringPiece& delim, size_t pos) const {
+    if (delim.size() <= 1) {
+        return delim.empty() ? npos : find(delim[0], pos);
+    }
+    const char first = delim[0];
     const size_t nref = _ref_num();
-    SigType sig = 0;
-    size_t n = 0;
-
+    size_t offset = 0;
     for (size_t i = 0; i < nref; ++i) {
         IOBuf::BlockRef const& r = _ref_at(i);
-        char const* const s = r.block->data + r.offset;
-        
-        for (uint32_t j = 0; j < r.length; ++j, ++n) {
-            sig = ((sig << CHAR_BIT) | static_cast<SigType>(s[j])) & SIGMASK;
-            if (sig == dsig) {
-                // There's no way cutn/pop_front fails
-                cutn(out, n + 1 - ndelim);
-                pop_front(ndelim);
-                return 0;
+        char const* const s = r.block->data() + r.offset;
+        size_t j = (pos > offset ? pos - offset : 0);
+        while (j < r.length) {
+            char const* const p = fast_memchr(s + j, r.length - j, first);
+            if (p == NULL) {
+                break;
+            }
+            j = p - s;
+            if (_equals_at(i, j, delim)) {
+                return offset + j;
             }
+            ++j;
         }
+        offset += r.length;
     }
+    return npos;
+}
 
-    return -1;
+size_t IOBuf::count(char c) const {
+    const size_t nref = _ref_num();
+    size_t n = 0;
+    for (size_t i = 0; i < nref; ++i) {
+        IOBuf::BlockRef const& r = _ref_at(i);
+        n += fast_memcount(r.block->data() + r.offset, r.length, c);
+    }
+    return n;
 }
 
 // Since cut_into_file_descriptor() allocates iovec on stack, IOV_MAX=1024
@@ -931,7 +1052,7 @@ ssize_t IOBuf::pcut_into_file_descriptor(int fd, off_t offset, size_t size_hint)
 
     do {
         IOBuf::BlockRef const& r = _ref_at(nvec);
-        vec[nvec].iov_base = r.block->data + r.offset;
+        vec[nvec].iov_base = r.block->data() + r.offset;
         vec[nvec].iov_len = r.length;
         ++nvec;
         cur_len += r.length;
@@ -958,7 +1079,7 @@ ssize_t IOBuf::cut_into_SSL_channel(SSL* ssl, int* ssl_error) {
     }
     
     IOBuf::BlockRef const& r = _ref_at(0);
-    const int nw = SSL_write(ssl, r.block->data + r.offset, r.length);
+    const int nw = SSL_write(ssl, r.block->data() + r.offset, r.length);
     if (nw > 0) {
         pop_front(nw);
     }
@@ -981,7 +1102,7 @@ ssize_t IOBuf::pcut_multiple_into_file_descriptor(
         const size_t nref = p->_ref_num();
         for (size_t j = 0; j < nref && nvec < IOBUF_IOV_MAX; ++j, ++nvec) {
             IOBuf::BlockRef const& r = p->_ref_at(j);
-            vec[nvec].iov_base = r.block->data + r.offset;
+            vec[nvec].iov_base = r.block->data() + r.offset;
             vec[nvec].iov_len = r.length;
         }
     }
@@ -1034,7 +1155,7 @@ int IOBuf::push_back(char c) {
     if (BAIDU_UNLIKELY(!b)) {
         return -1;
     }
-    b->data[b->size] = c;
+    b->data()[b->size] = c;
     const IOBuf::BlockRef r = { b->size, 1, b };
     ++b->size;
     _push_back_ref(r);
@@ -1062,7 +1183,7 @@ int IOBuf::append(void const* data, size_t count) {
             return -1;
         }
         const size_t nc = std::min(count - total_nc, b->left_space());
-        iobuf::cp(b->data + b->size, (char*)data + total_nc, nc);
+        iobuf::cp(b->data() + b->size, (char*)data + total_nc, nc);
         
         const IOBuf::BlockRef r = { (uint32_t)b->size, (uint32_t)nc, b };
         _push_back_ref(r);
@@ -1072,6 +1193,31 @@ int IOBuf::append(void const* data, size_t count) {
     return 0;
 }
 
+int IOBuf::append_user_data(void* data, size_t size, void (*deleter)(void*)) {
+    if (BAIDU_UNLIKELY(!data)) {
+        return -1;
+    }
+    // The first bit of BlockRef::offset is shared with BigView::start.
+    if (size > 0x7FFFFFFFUL) {
+        LOG(ERROR) << "data_size=" << size << " is too large";
+        return -1;
+    }
+    if (deleter == NULL) {
+        deleter = ::free;
+    }
+    if (size == 0) {
+        deleter(data);
+        return 0;
+    }
+    IOBuf::Block* b = iobuf::create_user_data_block(data, deleter);
+    if (BAIDU_UNLIKELY(!b)) {
+        return -1;
+    }
+    const IOBuf::BlockRef r = { 0, (uint32_t)size, b };
+    _move_back_ref(r);
+    return 0;
+}
+
 int IOBuf::appendv(const const_iovec* vec, size_t n) {
     size_t offset = 0;
     for (size_t i = 0; i < n;) {
@@ -1083,7 +1229,7 @@ int IOBuf::appendv(const const_iovec* vec, size_t n) {
         for (; i < n; ++i, offset = 0) {
             const const_iovec & vec_i = vec[i];
             const size_t nc = std::min(vec_i.iov_len - offset, b->left_space() - total_cp);
-            iobuf::cp(b->data + b->size + total_cp, (char*)vec_i.iov_base + offset, nc);
+            iobuf::cp(b->data() + b->size + total_cp, (char*)vec_i.iov_base + offset, nc);
             total_cp += nc;
             offset += nc;
             if (offset != vec_i.iov_len) {
@@ -1112,7 +1258,7 @@ int IOBuf::resize(size_t n, char c) {
             return -1;
         }
         const size_t nc = std::min(count - total_nc, b->left_space());
-        memset(b->data + b->size, c, nc);
+        memset(b->data() + b->size, c, nc);
         
         const IOBuf::BlockRef r = { (uint32_t)b->size, (uint32_t)nc, b };
         _push_back_ref(r);
@@ -1190,7 +1336,7 @@ int IOBuf::unsafe_assign(Area area, const void* data) {
         // (by different BlockRef-s)
         
         const size_t nc = std::min(length, r.length - ref_offset);
-        iobuf::cp(r.block->data + r.offset + ref_offset, data, nc);
+        iobuf::cp(r.block->data() + r.offset + ref_offset, data, nc);
         if (length == nc) {
             return 0;
         }
@@ -1251,7 +1397,7 @@ size_t IOBuf::copy_to(void* d, size_t n, size_t pos) const {
     for (; m != 0 && i < nref; ++i) {
         IOBuf::BlockRef const& r = _ref_at(i);
         const size_t nc = std::min(m, (size_t)r.length - offset);
-        iobuf::cp(d, r.block->data + r.offset + offset, nc);
+        iobuf::cp(d, r.block->data() + r.offset + offset, nc);
         offset = 0;
         d = (char*)d + nc;
         m -= nc;
@@ -1296,20 +1442,20 @@ void const* IOBuf::fetch(void* d, size_t n) const {
     if (n <= length()) {
         IOBuf::BlockRef const& r0 = _ref_at(0);
         if (n <= r0.length) {
-            return r0.block->data + r0.offset;
+            return r0.block->data() + r0.offset;
         }
     
-        iobuf::cp(d, r0.block->data + r0.offset, r0.length);
+        iobuf::cp(d, r0.block->data() + r0.offset, r0.length);
         size_t total_nc = r0.length;
         const size_t nref = _ref_num();
         for (size_t i = 1; i < nref; ++i) {
             IOBuf::BlockRef const& r = _ref_at(i);
             if (n <= r.length + total_nc) {
                 iobuf::cp((char*)d + total_nc,
-                            r.block->data + r.offset, n - total_nc);
+                            r.block->data() + r.offset, n - total_nc);
                 return d;
             }
-            iobuf::cp((char*)d + total_nc, r.block->data + r.offset, r.length);
+            iobuf::cp((char*)d + total_nc, r.block->data() + r.offset, r.length);
             total_nc += r.length;
         }
     }
@@ -1319,7 +1465,7 @@ void const* IOBuf::fetch(void* d, size_t n) const {
 const void* IOBuf::fetch1() const {
     if (!empty()) {
         const IOBuf::BlockRef& r0 = _front_ref();
-        return r0.block->data + r0.offset;
+        return r0.block->data() + r0.offset;
     }
     return NULL;
 }
@@ -1429,7 +1575,7 @@ bool IOBuf::equals(const butil::StringPiece& s) const {
     size_t soff = 0;
     for (size_t i = 0; i < nref; ++i) {
         const BlockRef& r = _ref_at(i);
-        if (memcmp(r.block->data + r.offset, s.data() + soff, r.length) != 0) {
+        if (memcmp(r.block->data() + r.offset, s.data() + soff, r.length) != 0) {
             return false;
         }
         soff += r.length;
@@ -1440,7 +1586,7 @@ bool IOBuf::equals(const butil::StringPiece& s) const {
 StringPiece IOBuf::backing_block(size_t i) const {
     if (i < _ref_num()) {
         const BlockRef& r = _ref_at(i);
-        return StringPiece(r.block->data + r.offset, r.length);
+        return StringPiece(r.block->data() + r.offset, r.length);
     }
     return StringPiece();
 }
@@ -1454,10 +1600,10 @@ bool IOBuf::equals(const butil::IOBuf& other) const {
         return true;
     }
     const BlockRef& r1 = _ref_at(0);
-    const char* d1 = r1.block->data + r1.offset;
+    const char* d1 = r1.block->data() + r1.offset;
     size_t len1 = r1.length;
     const BlockRef& r2 = other._ref_at(0);
-    const char* d2 = r2.block->data + r2.offset;
+    const char* d2 = r2.block->data() + r2.offset;
     size_t len2 = r2.length;
     const size_t nref1 = _ref_num();
     const size_t nref2 = other._ref_num();
@@ -1474,7 +1620,7 @@ bool IOBuf::equals(const butil::IOBuf& other) const {
                 return true;
             }
             const BlockRef& r = _ref_at(i++);
-            d1 = r.block->data + r.offset;
+            d1 = r.block->data() + r.offset;
             len1 = r.length;
         } else {
             d1 += cmplen;
@@ -1485,7 +1631,7 @@ bool IOBuf::equals(const butil::IOBuf& other) const {
                 return true;
             }
             const BlockRef& r = other._ref_at(j++);
-            d2 = r.block->data + r.offset;
+            d2 = r.block->data() + r.offset;
             len2 = r.length;
         } else {
             d2 += cmplen;
@@ -1530,7 +1676,7 @@ ssize_t IOPortal::pappend_from_file_descriptor(
                 _block = p;
             }
         }
-        vec[nvec].iov_base = p->data + p->size;
+        vec[nvec].iov_base = p->data() + p->size;
         vec[nvec].iov_len = std::min(p->left_space(), max_count - space);
         space += vec[nvec].iov_len;
         ++nvec;
@@ -1580,7 +1726,7 @@ ssize_t IOPortal::append_from_SSL_channel(SSL* ssl, int* ssl_error) {
             return -1;
         }
     }
-    const int nr = SSL_read(ssl, _block->data + _block->size, _block->left_space());
+    const int nr = SSL_read(ssl, _block->data() + _block->size, _block->left_space());
     *ssl_error = SSL_get_error(ssl, nr);
     if (nr > 0) {
         const IOBuf::BlockRef r = { (uint32_t)_block->size, (uint32_t)nr, _block };
@@ -1595,6 +1741,24 @@ ssize_t IOPortal::append_from_SSL_channel(SSL* ssl, int* ssl_error) {
     return nr;
 }
 
+bool IOPortal::compact(size_t max_length) {
+    const size_t len = length();
+    if (len == 0 || len > max_length) {
+        return false;
+    }
+    IOBuf tmp;
+    const size_t nref = _ref_num();
+    for (size_t i = 0; i < nref; ++i) {
+        const IOBuf::BlockRef& r = _ref_at(i);
+        if (tmp.append(r.block->data() + r.offset, r.length) != 0) {
+            return false;
+        }
+    }
+    IOBuf::swap(tmp);
+    return_cached_blocks();
+    return true;
+}
+
 void IOPortal::return_cached_blocks_impl(Block* b) {
     iobuf::release_tls_block_chain(b);
 }
@@ -1610,7 +1774,7 @@ IOBufAsZeroCopyInputStream::IOBufAsZeroCopyInputStream(const IOBuf& buf)
 
 bool IOBufAsZeroCopyInputStream::Next(const void** data, int* size) {
     if (_cur_ref != NULL) {
-        *data = _cur_ref->block->data + _cur_ref->offset + _add_offset;
+        *data = _cur_ref->block->data() + _cur_ref->offset + _add_offset;
         // Impl. of Backup/Skip guarantees that _add_offset < _cur_ref->length.
         *size = _cur_ref->length - _add_offset;
         _byte_count += _cur_ref->length - _add_offset;
@@ -1673,7 +1837,7 @@ IOBufAsZeroCopyOutputStream::IOBufAsZeroCopyOutputStream(
     , _cur_block(NULL)
     , _byte_count(0) {
     
-    if (_block_size <= offsetof(IOBuf::Block, data)) {
+    if (_block_size <= offsetof(IOBuf::Block, payload)) {
         throw std::invalid_argument("block_size is too small");
     }
 }
@@ -1697,7 +1861,7 @@ bool IOBufAsZeroCopyOutputStream::Next(void** data, int* size) {
     const IOBuf::BlockRef r = { _cur_block->size, 
                                 (uint32_t)_cur_block->left_space(),
                                 _cur_block };
-    *data = _cur_block->data + r.offset;
+    *data = _cur_block->data() + r.offset;
     *size = r.length;
     _cur_block->size = _cur_block->cap;
     _buf->_push_back_ref(r);
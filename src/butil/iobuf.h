@@ -146,6 +146,20 @@ public:
     // std::string version, `delim' could be binary
     int cut_until(IOBuf* out, const std::string& delim);
 
+    // Returned by find() when nothing is found.
+    static const size_t npos = (size_t)-1;
+
+    // Returns offset of the first `c' at or after `pos', npos if not found.
+    // Bytes are compared with SIMD instructions when they're available.
+    size_t find(char c, size_t pos = 0) const;
+
+    // Returns offset of the first `delim' at or after `pos', npos if not
+    // found or `delim' is empty. `delim' may cross boundaries of blocks.
+    size_t find(const StringPiece& delim, size_t pos = 0) const;
+
+    // Number of `c' inside.
+    size_t count(char c) const;
+
     // Cut at most `size_hint' bytes(approximately) into the file descriptor
     // Returns bytes cut on success, -1 otherwise and errno is set.
     ssize_t cut_into_file_descriptor(int fd, size_t size_hint = 1024*1024);
@@ -202,6 +216,13 @@ public:
     // Returns 0 on success(include count == 0), -1 otherwise.
     int append(void const* data, size_t count);
 
+    // Append the user-owned memory [data, data+size) to back side without
+    // copying. The memory is referenced by a block which calls deleter(data)
+    // when the block is no longer referenced by any IOBuf, free() is used
+    // if deleter is NULL. The memory must not be modified before that.
+    // Returns 0 on success, -1 otherwise and the caller still owns `data'.
+    int append_user_data(void* data, size_t size, void (*deleter)(void*));
+
     // Append multiple data to back side in one call, faster than appending
     // one by one separately.
     // Returns 0 on success, -1 otherwise.
@@ -340,6 +361,9 @@ public:
 protected:
     int _cut_by_char(IOBuf* out, char);
     int _cut_by_delim(IOBuf* out, char const* dbegin, size_t ndelim);
+    // True if bytes starting from `offset' of #ref_index ref equal `s'
+    bool _equals_at(size_t ref_index, size_t offset,
+                    const StringPiece& s) const;
 
     // Returns: true iff this should be viewed as SmallView
     bool _small() const;
@@ -454,6 +478,13 @@ public:
     // performance. Read comments on field `_block' below.
     void return_cached_blocks();
 
+    // If this IOPortal has no more than `max_length' bytes, copy them into
+    // blocks shared by the thread and return cached blocks. Call this
+    // function when the IOPortal keeps a small residual(e.g. an incomplete
+    // message) and no more data is coming soon, otherwise the residual pins
+    // the mostly-unused blocks of reads. Returns true if compacted.
+    bool compact(size_t max_length);
+
 private:
     static void return_cached_blocks_impl(Block*);
 
@@ -661,6 +692,21 @@ private:
     const butil::IOBuf* _buf;
 };
 
+namespace iobuf {
+// Memory of IOBuf::Block is allocated and deallocated by these functions,
+// which are malloc() and free() by default. Replace them before any block
+// is created, or make the new deallocator able to free blocks allocated by
+// the previous allocator. See butil/iobuf_slab_allocator.h for an example.
+extern void* (*blockmem_allocate)(size_t);
+extern void  (*blockmem_deallocate)(void*);
+
+// Set size of blocks created by IOBuf, including the header. Blocks
+// created before are not affected.
+// Returns 0 on success, -1 if `size' is not in [4096, IOBuf::MAX_BLOCK_SIZE].
+int set_default_block_size(size_t size);
+size_t default_block_size();
+}  // namespace iobuf
+
 }  // namespace butil
 
 // Specialize std::swap for IOBuf
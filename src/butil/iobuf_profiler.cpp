@@ -0,0 +1,196 @@
+// iobuf - A non-continuous zero-copied buffer
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>                          // snprintf
+#include <stdint.h>                         // uintptr_t
+#include <string.h>                         // memcmp
+#include <pthread.h>
+#include <execinfo.h>                       // backtrace
+#include <map>
+#include <vector>
+#include "butil/atomicops.h"                // butil::static_atomic
+#include "butil/macros.h"                   // arraysize
+#include "butil/scoped_lock.h"              // BAIDU_SCOPED_LOCK
+#include "butil/file_util.h"                // ReadFileToString
+#include "butil/iobuf_profiler.h"
+
+namespace butil {
+namespace iobuf {
+
+// Read by IOBuf before creating and freeing blocks.
+butil::static_atomic<size_t> g_block_sampling_rate = BASE_STATIC_ATOMIC_INIT(0);
+butil::static_atomic<size_t> g_nsampled_block = BASE_STATIC_ATOMIC_INIT(0);
+
+static const int MAX_STACK_FRAMES = 30;
+// Skip the frame of sample_block().
+static const int SKIPPED_STACK_FRAMES = 1;
+
+struct BlockSample {
+    size_t size;
+    size_t rate;
+    int nframes;
+    void* stack[MAX_STACK_FRAMES];
+};
+
+// Sampled blocks are spread into shards by addresses to reduce contentions
+// between threads freeing blocks.
+static const size_t NSHARD = 64;
+struct SampleShard {
+    pthread_mutex_t mutex;
+    std::map<const void*, BlockSample>* samples;
+};
+static SampleShard g_shards[NSHARD];
+static pthread_once_t g_shards_once = PTHREAD_ONCE_INIT;
+
+// Number of sampled blocks hashed into each slot. Non-sampled blocks are
+// freed without locking when their slots are zero, which is the common
+// case because only a small portion of blocks are sampled.
+static const size_t NFILTER = 4096;
+static butil::static_atomic<int> g_filter[NFILTER];
+
+static void init_shards() {
+    for (size_t i = 0; i < NSHARD; ++i) {
+        pthread_mutex_init(&g_shards[i].mutex, NULL);
+        g_shards[i].samples = new std::map<const void*, BlockSample>;
+    }
+}
+
+inline size_t hash_block(const void* block) {
+    // Blocks are at least 16-byte aligned.
+    return ((uintptr_t)block >> 4) * 0x9E3779B97F4A7C15ULL >> 32;
+}
+
+// Countdown to the next sampled block of current thread.
+static __thread size_t tls_nblock_to_sample = 0;
+
+void sample_block(const void* block, size_t size) {
+    const size_t rate = g_block_sampling_rate.load(butil::memory_order_relaxed);
+    if (rate == 0) {
+        return;
+    }
+    if (tls_nblock_to_sample > 0) {
+        --tls_nblock_to_sample;
+        return;
+    }
+    tls_nblock_to_sample = rate - 1;
+    BlockSample s;
+    s.size = size;
+    s.rate = rate;
+    s.nframes = backtrace(s.stack, arraysize(s.stack));
+    pthread_once(&g_shards_once, init_shards);
+    const size_t h = hash_block(block);
+    SampleShard& shard = g_shards[h % NSHARD];
+    {
+        BAIDU_SCOPED_LOCK(shard.mutex);
+        (*shard.samples)[block] = s;
+    }
+    g_filter[h % NFILTER].fetch_add(1, butil::memory_order_relaxed);
+    g_nsampled_block.fetch_add(1, butil::memory_order_relaxed);
+}
+
+void unsample_block(const void* block) {
+    const size_t h = hash_block(block);
+    if (g_filter[h % NFILTER].load(butil::memory_order_relaxed) == 0) {
+        return;
+    }
+    SampleShard& shard = g_shards[h % NSHARD];
+    {
+        BAIDU_SCOPED_LOCK(shard.mutex);
+        if (shard.samples->erase(block) == 0) {
+            return;
+        }
+    }
+    g_filter[h % NFILTER].fetch_sub(1, butil::memory_order_relaxed);
+    g_nsampled_block.fetch_sub(1, butil::memory_order_relaxed);
+}
+
+void set_block_sampling_rate(size_t rate) {
+    g_block_sampling_rate.store(rate, butil::memory_order_relaxed);
+}
+
+size_t block_sampling_rate() {
+    return g_block_sampling_rate.load(butil::memory_order_relaxed);
+}
+
+size_t sampled_block_count() {
+    return g_nsampled_block.load(butil::memory_order_relaxed);
+}
+
+struct StackLess {
+    bool operator()(const BlockSample& a, const BlockSample& b) const {
+        if (a.nframes != b.nframes) {
+            return a.nframes < b.nframes;
+        }
+        return memcmp(a.stack, b.stack, sizeof(void*) * a.nframes) < 0;
+    }
+};
+
+struct StackStat {
+    size_t count;
+    size_t bytes;
+};
+
+void dump_block_profile(std::string* out) {
+    pthread_once(&g_shards_once, init_shards);
+    // Samples are merged outside locks of shards since memory allocated
+    // during the merging may create (and sample) blocks.
+    std::vector<BlockSample> samples;
+    for (size_t i = 0; i < NSHARD; ++i) {
+        BAIDU_SCOPED_LOCK(g_shards[i].mutex);
+        const std::map<const void*, BlockSample>& m = *g_shards[i].samples;
+        for (std::map<const void*, BlockSample>::const_iterator
+                 it = m.begin(); it != m.end(); ++it) {
+            samples.push_back(it->second);
+        }
+    }
+    std::map<BlockSample, StackStat, StackLess> stacks;
+    StackStat total = { 0, 0 };
+    for (size_t i = 0; i < samples.size(); ++i) {
+        StackStat& st = stacks[samples[i]];
+        st.count += samples[i].rate;
+        st.bytes += samples[i].size * samples[i].rate;
+        total.count += samples[i].rate;
+        total.bytes += samples[i].size * samples[i].rate;
+    }
+    char buf[128];
+    snprintf(buf, sizeof(buf),
+             "heap profile: %lu: %lu [%lu: %lu] @ heapprofile\n",
+             (unsigned long)total.count, (unsigned long)total.bytes,
+             (unsigned long)total.count, (unsigned long)total.bytes);
+    out->append(buf);
+    for (std::map<BlockSample, StackStat, StackLess>::const_iterator
+             it = stacks.begin(); it != stacks.end(); ++it) {
+        snprintf(buf, sizeof(buf), "%lu: %lu [%lu: %lu] @",
+                 (unsigned long)it->second.count,
+                 (unsigned long)it->second.bytes,
+                 (unsigned long)it->second.count,
+                 (unsigned long)it->second.bytes);
+        out->append(buf);
+        for (int i = SKIPPED_STACK_FRAMES; i < it->first.nframes; ++i) {
+            snprintf(buf, sizeof(buf), " %p", it->first.stack[i]);
+            out->append(buf);
+        }
+        out->push_back('\n');
+    }
+    // Required by pprof to symbolize addresses in shared libraries.
+    std::string maps;
+    if (butil::ReadFileToString(butil::FilePath("/proc/self/maps"), &maps)) {
+        out->append("\nMAPPED_LIBRARIES:\n");
+        out->append(maps);
+    }
+}
+
+}  // namespace iobuf
+}  // namespace butil
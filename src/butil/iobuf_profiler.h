@@ -0,0 +1,49 @@
+// iobuf - A non-continuous zero-copied buffer
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BUTIL_IOBUF_PROFILER_H
+#define BUTIL_IOBUF_PROFILER_H
+
+#include <stddef.h>                          // size_t
+#include <string>
+
+// Sampled profiling of memory held by IOBuf.
+//
+// When sampling is on, call stack of one in every N blocks created by IOBuf
+// is recorded until the block is freed. Stacks of alive blocks can be
+// dumped in the format of heap profiles of pprof, which tells which code
+// allocated the blocks still being held (by sockets, protocols or users).
+// Blocks referencing user data are counted with the size of their headers.
+
+namespace butil {
+namespace iobuf {
+
+// Record the call stack of one in every `rate' blocks created. 0 turns
+// sampling off, sampled blocks are still tracked until they're freed.
+void set_block_sampling_rate(size_t rate);
+size_t block_sampling_rate();
+
+// Number of sampled blocks not freed yet.
+size_t sampled_block_count();
+
+// Append sampled blocks not freed yet into `out' in the text format of
+// heap profiles of pprof. Numbers of blocks and bytes are multiplied by
+// the sampling rate at the allocation to estimate the whole population.
+void dump_block_profile(std::string* out);
+
+}  // namespace iobuf
+}  // namespace butil
+
+#endif  // BUTIL_IOBUF_PROFILER_H
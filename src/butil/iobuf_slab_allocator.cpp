@@ -0,0 +1,272 @@
+// iobuf - A non-continuous zero-copied buffer
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>                         // malloc, free
+#include <stdint.h>                         // uintptr_t
+#include <pthread.h>
+#include <algorithm>                        // std::min
+#include <sys/mman.h>                       // mmap, mprotect, madvise
+#include "butil/atomicops.h"                // butil::static_atomic
+#include "butil/logging.h"                  // LOG, PLOG
+#include "butil/macros.h"                   // BAIDU_CASSERT
+#include "butil/scoped_lock.h"              // BAIDU_SCOPED_LOCK
+#include "butil/thread_local.h"             // thread_atexit
+#include "butil/iobuf.h"
+#include "butil/iobuf_slab_allocator.h"
+
+namespace butil {
+namespace iobuf {
+
+// The smallest class is for headers of blocks referencing user data.
+const size_t SLAB_BLOCK_SIZES[SLAB_SIZE_CLASS_NUM] = {
+    256, IOBuf::DEFAULT_BLOCK_SIZE, IOBuf::MAX_BLOCK_SIZE
+};
+
+static const size_t SLAB_SIZE = 2 * 1024 * 1024;  // size of a hugepage
+
+// Max number of blocks cached by each thread for each size class, a half
+// of it is exchanged with the global free list in one batch.
+static const int MAGAZINE_CAPS[SLAB_SIZE_CLASS_NUM] = { 64, 32, 4 };
+static const int MAX_MAGAZINE_CAP = 64;
+
+struct FreeNode {
+    FreeNode* next;
+};
+
+struct SizeClass {
+    pthread_mutex_t mutex;
+    FreeNode* free_list;
+    // Unused part of the slab being carved.
+    char* slab_cur;
+    char* slab_end;
+    butil::static_atomic<size_t> ncarved;
+    butil::static_atomic<size_t> nfree;
+};
+
+static SizeClass g_classes[SLAB_SIZE_CLASS_NUM] = {
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL,
+      BASE_STATIC_ATOMIC_INIT(0), BASE_STATIC_ATOMIC_INIT(0) },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL,
+      BASE_STATIC_ATOMIC_INIT(0), BASE_STATIC_ATOMIC_INIT(0) },
+    { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, NULL,
+      BASE_STATIC_ATOMIC_INIT(0), BASE_STATIC_ATOMIC_INIT(0) },
+};
+
+// The reserved address range. g_begin is set after others.
+static butil::static_atomic<uintptr_t> g_begin = BASE_STATIC_ATOMIC_INIT(0);
+static size_t g_size = 0;
+static size_t g_nslab = 0;
+// Size class of each slab.
+static unsigned char* g_slab_classes = NULL;
+static butil::static_atomic<size_t> g_next_slab = BASE_STATIC_ATOMIC_INIT(0);
+static pthread_mutex_t g_install_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct Magazine {
+    int n;
+    void* items[MAX_MAGAZINE_CAP];
+};
+
+struct TLSMagazines {
+    bool registered;
+    // True when the thread is exiting, blocks are freed to global lists
+    // directly since magazines are not flushed anymore.
+    bool exiting;
+    Magazine mags[SLAB_SIZE_CLASS_NUM];
+};
+
+static __thread TLSMagazines tls_magazines;
+
+inline int size_class_of(size_t size) {
+    for (size_t i = 0; i < SLAB_SIZE_CLASS_NUM; ++i) {
+        if (size <= SLAB_BLOCK_SIZES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Make a new slab usable for size class `c'. Called with the mutex of the
+// class locked. Returns false when the reserved range is exhausted.
+static bool add_slab(int c) {
+    const size_t index = g_next_slab.fetch_add(1, butil::memory_order_relaxed);
+    if (index >= g_nslab) {
+        return false;
+    }
+    char* slab = (char*)g_begin.load(butil::memory_order_relaxed)
+        + index * SLAB_SIZE;
+    if (mprotect(slab, SLAB_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        PLOG(ERROR) << "Fail to mprotect slab";
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    // Failures are not critical, the slab is backed by normal pages.
+    madvise(slab, SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+    g_slab_classes[index] = c;
+    SizeClass& sc = g_classes[c];
+    sc.slab_cur = slab;
+    sc.slab_end = slab + SLAB_SIZE;
+    return true;
+}
+
+// Move blocks from global list (or new slabs) of size class `c' into `mag'.
+// Returns number of blocks moved.
+static int refill_magazine(int c, Magazine* mag) {
+    SizeClass& sc = g_classes[c];
+    const int n = MAGAZINE_CAPS[c] / 2;
+    const size_t block_size = SLAB_BLOCK_SIZES[c];
+    BAIDU_SCOPED_LOCK(sc.mutex);
+    while (mag->n < n && sc.free_list != NULL) {
+        FreeNode* node = sc.free_list;
+        sc.free_list = node->next;
+        mag->items[mag->n++] = node;
+        sc.nfree.fetch_sub(1, butil::memory_order_relaxed);
+    }
+    while (mag->n < n) {
+        if (sc.slab_cur == sc.slab_end && !add_slab(c)) {
+            break;
+        }
+        mag->items[mag->n++] = sc.slab_cur;
+        sc.slab_cur += block_size;
+        sc.ncarved.fetch_add(1, butil::memory_order_relaxed);
+    }
+    return mag->n;
+}
+
+// Move `n' blocks from `mag' into global list of size class `c'.
+static void flush_magazine(int c, Magazine* mag, int n) {
+    SizeClass& sc = g_classes[c];
+    BAIDU_SCOPED_LOCK(sc.mutex);
+    for (; n > 0 && mag->n > 0; --n) {
+        FreeNode* node = (FreeNode*)mag->items[--mag->n];
+        node->next = sc.free_list;
+        sc.free_list = node;
+        sc.nfree.fetch_add(1, butil::memory_order_relaxed);
+    }
+}
+
+static void flush_tls_magazines() {
+    TLSMagazines& tls = tls_magazines;
+    tls.exiting = true;
+    for (size_t c = 0; c < SLAB_SIZE_CLASS_NUM; ++c) {
+        flush_magazine(c, &tls.mags[c], tls.mags[c].n);
+    }
+}
+
+inline void register_tls_magazines(TLSMagazines& tls) {
+    if (!tls.registered) {
+        tls.registered = true;
+        butil::thread_atexit(flush_tls_magazines);
+    }
+}
+
+void* slab_allocate(size_t size) {
+    const int c = size_class_of(size);
+    if (c < 0 || g_begin.load(butil::memory_order_acquire) == 0) {
+        return malloc(size);
+    }
+    TLSMagazines& tls = tls_magazines;
+    Magazine& mag = tls.mags[c];
+    if (mag.n == 0) {
+        register_tls_magazines(tls);
+        if (refill_magazine(c, &mag) == 0) {
+            // Reserved range is exhausted.
+            return malloc(size);
+        }
+    }
+    return mag.items[--mag.n];
+}
+
+void slab_deallocate(void* mem) {
+    const uintptr_t begin = g_begin.load(butil::memory_order_acquire);
+    if (begin == 0 || (uintptr_t)mem - begin >= g_size) {
+        free(mem);
+        return;
+    }
+    const int c = g_slab_classes[((uintptr_t)mem - begin) / SLAB_SIZE];
+    TLSMagazines& tls = tls_magazines;
+    Magazine& mag = tls.mags[c];
+    if (mag.n >= MAGAZINE_CAPS[c]) {
+        flush_magazine(c, &mag, MAGAZINE_CAPS[c] / 2);
+    }
+    mag.items[mag.n++] = mem;
+    if (tls.exiting) {
+        flush_magazine(c, &mag, mag.n);
+    } else {
+        register_tls_magazines(tls);
+    }
+}
+
+int install_slab_allocator(size_t max_memory) {
+    BAIDU_SCOPED_LOCK(g_install_mutex);
+    if (g_begin.load(butil::memory_order_relaxed) == 0) {
+        const size_t size = (max_memory + SLAB_SIZE - 1) / SLAB_SIZE * SLAB_SIZE;
+        if (size == 0) {
+            LOG(ERROR) << "max_memory is 0";
+            return -1;
+        }
+        // Reserve one more slab for the alignment. Pages are not committed
+        // until slabs are added.
+        void* mem = mmap(NULL, size + SLAB_SIZE, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) {
+            PLOG(ERROR) << "Fail to reserve " << size << " bytes";
+            return -1;
+        }
+        const uintptr_t begin =
+            ((uintptr_t)mem + SLAB_SIZE - 1) / SLAB_SIZE * SLAB_SIZE;
+        if (begin != (uintptr_t)mem) {
+            munmap(mem, begin - (uintptr_t)mem);
+        }
+        munmap((char*)begin + size, (uintptr_t)mem + SLAB_SIZE - begin);
+        g_nslab = size / SLAB_SIZE;
+        g_slab_classes = new unsigned char[g_nslab];
+        g_size = size;
+        g_begin.store(begin, butil::memory_order_release);
+    }
+    // The process may be running. Switch the deallocator first, which frees
+    // memory from malloc() as well, so that a block allocated from slabs is
+    // never passed to free() by threads seeing the new allocator only.
+    blockmem_deallocate = slab_deallocate;
+    butil::atomic_thread_fence(butil::memory_order_release);
+    blockmem_allocate = slab_allocate;
+    return 0;
+}
+
+void uninstall_slab_allocator() {
+    BAIDU_SCOPED_LOCK(g_install_mutex);
+    if (blockmem_allocate == slab_allocate) {
+        // Keep the deallocator which frees both kinds of memory.
+        blockmem_allocate = ::malloc;
+    }
+}
+
+size_t slab_block_count(size_t size_class) {
+    if (size_class >= SLAB_SIZE_CLASS_NUM) {
+        return 0;
+    }
+    SizeClass& sc = g_classes[size_class];
+    const size_t ncarved = sc.ncarved.load(butil::memory_order_relaxed);
+    const size_t nfree = sc.nfree.load(butil::memory_order_relaxed);
+    return ncarved > nfree ? ncarved - nfree : 0;
+}
+
+size_t slab_memory() {
+    const size_t n = g_next_slab.load(butil::memory_order_relaxed);
+    return std::min(n, g_nslab) * SLAB_SIZE;
+}
+
+}  // namespace iobuf
+}  // namespace butil
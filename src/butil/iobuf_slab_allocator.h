@@ -0,0 +1,67 @@
+// iobuf - A non-continuous zero-copied buffer
+// Copyright (c) 2017 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BUTIL_IOBUF_SLAB_ALLOCATOR_H
+#define BUTIL_IOBUF_SLAB_ALLOCATOR_H
+
+#include <stddef.h>                          // size_t
+
+// A slab allocator for memory of IOBuf::Block.
+//
+// Memory is carved from 2MB slabs inside an address range reserved at
+// installation, each slab only serves one size class and is backed by
+// a transparent hugepage when the kernel supports it, so that blocks of
+// IOBuf are packed into fewer pages and TLB entries. Freed blocks are
+// cached in per-thread magazines and exchanged with the global free list
+// of the size class in batches, which keeps the global lock cold.
+// Memory of slabs is never returned to the system.
+
+namespace butil {
+namespace iobuf {
+
+// Block sizes are rounded up to one of the size classes.
+static const size_t SLAB_SIZE_CLASS_NUM = 3;
+extern const size_t SLAB_BLOCK_SIZES[SLAB_SIZE_CLASS_NUM];
+
+// Allocate memory with at least `size' bytes. Sizes larger than the
+// largest size class or exhaustion of the reserved range fall back to
+// malloc().
+void* slab_allocate(size_t size);
+
+// Deallocate memory returned by slab_allocate() or malloc(). Memory outside
+// the reserved range is passed to free(), thus blocks allocated before
+// installation are freed correctly.
+void slab_deallocate(void* mem);
+
+// Reserve `max_memory' bytes of address space (rounded up to 2MB) and make
+// IOBuf allocate blocks with slab_allocate(). Calling more than once is
+// a no-op. Returns 0 on success, -1 otherwise.
+int install_slab_allocator(size_t max_memory);
+
+// Let IOBuf allocate blocks with malloc() again. Blocks already allocated
+// from slabs are still freed correctly.
+void uninstall_slab_allocator();
+
+// Number of blocks of the size class carved from slabs and not in the
+// global free list (blocks cached in per-thread magazines are counted).
+size_t slab_block_count(size_t size_class);
+
+// Bytes of slabs being used.
+size_t slab_memory();
+
+}  // namespace iobuf
+}  // namespace butil
+
+#endif  // BUTIL_IOBUF_SLAB_ALLOCATOR_H
@@ -0,0 +1,74 @@
+// Copyright (c) 2015 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bvar/detail/histogram.h"
+#include "butil/logging.h"
+
+namespace bvar {
+namespace detail {
+
+struct AddToHistogram {
+    void operator()(ThreadLocalHistogram& h, uint32_t value) const {
+        h.add(value);
+    }
+};
+
+HistogramPercentile::HistogramPercentile() : _combiner(NULL), _sampler(NULL) {
+    _combiner = new combiner_type;
+}
+
+HistogramPercentile::~HistogramPercentile() {
+    // Have to destroy sampler first to avoid the race between destruction and
+    // sampler
+    if (_sampler != NULL) {
+        _sampler->destroy();
+        _sampler = NULL;
+    }
+    delete _combiner;
+}
+
+HistogramPercentile::value_type HistogramPercentile::reset() {
+    return _combiner->reset_all_agents();
+}
+
+HistogramPercentile::value_type HistogramPercentile::get_value() const {
+    return _combiner->combine_agents();
+}
+
+HistogramPercentile& HistogramPercentile::operator<<(int64_t latency) {
+    agent_type* agent = _combiner->get_or_create_tls_agent();
+    if (BAIDU_UNLIKELY(!agent)) {
+        LOG(FATAL) << "Fail to create agent";
+        return *this;
+    }
+    if (latency < 0) {
+        if (!_debug_name.empty()) {
+            LOG(WARNING) << "Input=" << latency << " to `" << _debug_name
+                       << "' is negative, drop";
+        } else {
+            LOG(WARNING) << "Input=" << latency << " to HistogramPercentile("
+                       << (void*)this << ") is negative, drop";
+        }
+        return *this;
+    }
+    // Overflowed values are counted in the last bucket, same as Percentile.
+    if (latency > std::numeric_limits<uint32_t>::max()) {
+        latency = std::numeric_limits<uint32_t>::max();
+    }
+    agent->element.modify(AddToHistogram(), (uint32_t)latency);
+    return *this;
+}
+
+}  // namespace detail
+}  // namespace bvar
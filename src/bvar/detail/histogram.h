@@ -0,0 +1,205 @@
+// Copyright (c) 2015 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BVAR_DETAIL_HISTOGRAM_H
+#define  BVAR_DETAIL_HISTOGRAM_H
+
+#include <string.h>                     // memset
+#include <stdint.h>                     // uint32_t
+#include <math.h>                       // ceil
+#include <limits>                       // std::numeric_limits
+#include <ostream>                      // std::ostream
+#include "butil/macros.h"
+#include "butil/logging.h"              // CHECK
+#include "bvar/reducer.h"               // VoidOp
+#include "bvar/detail/combiner.h"       // AgentCombiner
+#include "bvar/detail/sampler.h"        // ReducerSampler
+
+namespace bvar {
+namespace detail {
+
+// Values are counted in buckets with exponentially growing widths: values
+// less than HISTOGRAM_SUB_BUCKETS have their own buckets, values inside
+// [2^k, 2^(k+1)) are split into HISTOGRAM_SUB_BUCKETS buckets with equal
+// widths. A value is represented by the middle of its bucket, thus the
+// relative error is at most 1/(2*HISTOGRAM_SUB_BUCKETS) (1.6%) no matter
+// how many values are added, and histograms are merged exactly by adding
+// up counts of the same buckets.
+static const size_t HISTOGRAM_SUB_BITS = 5;
+static const size_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+// Covers all uint32_t.
+static const size_t HISTOGRAM_NUM_BUCKETS =
+    (32 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS;
+
+inline size_t histogram_bucket_index(uint32_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    const size_t exp = 31 - __builtin_clz(value);  // >= HISTOGRAM_SUB_BITS
+    return ((exp - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+        + (value >> (exp - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB_BUCKETS;
+}
+
+// Smallest value in the bucket.
+inline uint64_t histogram_bucket_lower(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    const size_t k = index >> HISTOGRAM_SUB_BITS;
+    return (uint64_t)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS)
+        << (k - 1);
+}
+
+inline uint64_t histogram_bucket_width(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return 1;
+    }
+    return (uint64_t)1 << ((index >> HISTOGRAM_SUB_BITS) - 1);
+}
+
+// Counts of values in each bucket. Thread-local histograms use 32-bit
+// counts and are merged into the global one every second.
+template <typename Count>
+class Histogram {
+public:
+    Histogram() : _num_added(0) {
+        memset(_counts, 0, sizeof(_counts));
+    }
+
+    void add(uint32_t value) {
+        ++_counts[histogram_bucket_index(value)];
+        ++_num_added;
+    }
+
+    template <typename Count2>
+    void merge(const Histogram<Count2>& rhs) {
+        if (rhs._num_added == 0) {
+            return;
+        }
+        for (size_t i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i) {
+            _counts[i] += rhs._counts[i];
+        }
+        _num_added += rhs._num_added;
+    }
+
+    // Get the |ratio|-ile value, E.g. 0.99 means 99%-ile.
+    uint32_t get_number(double ratio) const {
+        uint64_t n = (uint64_t)ceil(ratio * _num_added);
+        if (n > _num_added) {
+            n = _num_added;
+        } else if (n == 0) {
+            return 0;
+        }
+        for (size_t i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i) {
+            if (n <= _counts[i]) {
+                return histogram_bucket_lower(i) +
+                    (histogram_bucket_width(i) - 1) / 2;
+            }
+            n -= _counts[i];
+        }
+        CHECK(false) << "Can't reach here";
+        return std::numeric_limits<uint32_t>::max();
+    }
+
+    size_t added_count() const { return _num_added; }
+    Count count_at(size_t index) const { return _counts[index]; }
+
+    // Print non-empty buckets as lower_bound:count.
+    void describe(std::ostream& os) const {
+        os << "{num_added=" << _num_added;
+        for (size_t i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i) {
+            if (_counts[i]) {
+                os << ' ' << histogram_bucket_lower(i) << ':' << _counts[i];
+            }
+        }
+        os << '}';
+    }
+
+private:
+template <typename Count2> friend class Histogram;
+
+    Count _num_added;
+    Count _counts[HISTOGRAM_NUM_BUCKETS];
+};
+
+template <typename Count>
+std::ostream& operator<<(std::ostream& os, const Histogram<Count>& h) {
+    h.describe(os);
+    return os;
+}
+
+typedef Histogram<uint64_t> GlobalHistogram;
+typedef Histogram<uint32_t> ThreadLocalHistogram;
+
+// A reducer for finding the percentile of latencies with histograms, an
+// alternative to Percentile.
+// NOTE: DON'T use it directly, use LatencyRecorder instead.
+class HistogramPercentile {
+public:
+    struct AddHistogram {
+        template <typename Count1, typename Count2>
+        void operator()(Histogram<Count1>& h1,
+                        const Histogram<Count2>& h2) const {
+            h1.merge(h2);
+        }
+    };
+
+    typedef GlobalHistogram                                 value_type;
+    typedef ReducerSampler<HistogramPercentile,
+                           GlobalHistogram,
+                           AddHistogram, VoidOp>            sampler_type;
+    typedef AgentCombiner <GlobalHistogram,
+                           ThreadLocalHistogram,
+                           AddHistogram>                    combiner_type;
+    typedef combiner_type::Agent                            agent_type;
+    HistogramPercentile();
+    ~HistogramPercentile();
+
+    AddHistogram op() const { return AddHistogram(); }
+    VoidOp inv_op() const { return VoidOp(); }
+
+    // The sampler for windows over percentile.
+    sampler_type* get_sampler() {
+        if (NULL == _sampler) {
+            _sampler = new sampler_type(this);
+            _sampler->schedule();
+        }
+        return _sampler;
+    }
+
+    value_type reset();
+
+    value_type get_value() const;
+
+    HistogramPercentile& operator<<(int64_t latency);
+
+    bool valid() const { return _combiner != NULL && _combiner->valid(); }
+
+    // This name is useful for warning negative latencies in operator<<
+    void set_debug_name(const butil::StringPiece& name) {
+        _debug_name.assign(name.data(), name.size());
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(HistogramPercentile);
+
+    combiner_type*          _combiner;
+    sampler_type*           _sampler;
+    std::string _debug_name;
+};
+
+}  // namespace detail
+}  // namespace bvar
+
+#endif  //BVAR_DETAIL_HISTOGRAM_H
@@ -0,0 +1,120 @@
+// Copyright (c) 2014 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BVAR_DETAIL_WILDCARD_MATCHER_H
+#define  BVAR_DETAIL_WILDCARD_MATCHER_H
+
+#include <set>                                  // std::set
+#include <string>
+#include <vector>
+#include "butil/string_splitter.h"               // butil::StringMultiSplitter
+
+// Match names of variables against wildcards in DumpOptions, shared by
+// Variable and MVariable.
+
+namespace bvar {
+namespace detail {
+
+// Written by Jack Handy
+// <A href="mailto:jakkhandy@hotmail.com">jakkhandy@hotmail.com</A>
+inline bool wildcmp(const char* wild, const char* str, char question_mark) {
+    const char* cp = NULL;
+    const char* mp = NULL;
+
+    while (*str && *wild != '*') {
+        if (*wild != *str && *wild != question_mark) {
+            return false;
+        }
+        ++wild;
+        ++str;
+    }
+
+    while (*str) {
+        if (*wild == '*') {
+            if (!*++wild) {
+                return true;
+            }
+            mp = wild;
+            cp = str+1;
+        } else if (*wild == *str || *wild == question_mark) {
+            ++wild;
+            ++str;
+        } else {
+            wild = mp;
+            str = cp++;
+        }
+    }
+
+    while (*wild == '*') {
+        ++wild;
+    }
+    return !*wild;
+}
+
+class WildcardMatcher {
+public:
+    WildcardMatcher(const std::string& wildcards,
+                    char question_mark,
+                    bool on_both_empty)
+        : _question_mark(question_mark)
+        , _on_both_empty(on_both_empty) {
+        if (wildcards.empty()) {
+            return;
+        }
+        std::string name;
+        const char wc_pattern[3] = { '*', question_mark, '\0' };
+        for (butil::StringMultiSplitter sp(wildcards.c_str(), ",;");
+             sp != NULL; ++sp) {
+            name.assign(sp.field(), sp.length());
+            if (name.find_first_of(wc_pattern) != std::string::npos) {
+                if (_wcs.empty()) {
+                    _wcs.reserve(8);
+                }
+                _wcs.push_back(name);
+            } else {
+                _exact.insert(name);
+            }
+        }
+    }
+    
+    bool match(const std::string& name) const {
+        if (!_exact.empty()) {
+            if (_exact.find(name) != _exact.end()) {
+                return true;
+            }
+        } else if (_wcs.empty()) {
+            return _on_both_empty;
+        }
+        for (size_t i = 0; i < _wcs.size(); ++i) {
+            if (wildcmp(_wcs[i].c_str(), name.c_str(), _question_mark)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const std::vector<std::string>& wildcards() const { return _wcs; }
+    const std::set<std::string>& exact_names() const { return _exact; }
+
+private:
+    char _question_mark;
+    bool _on_both_empty;
+    std::vector<std::string> _wcs;
+    std::set<std::string> _exact;
+};
+
+}  // namespace detail
+}  // namespace bvar
+
+#endif  // BVAR_DETAIL_WILDCARD_MATCHER_H
@@ -23,7 +23,7 @@ namespace detail {
 
 typedef PercentileSamples<1022> CombinedPercentileSamples;
 
-CDF::CDF(PercentileWindow* w) : _w(w) {}
+CDF::CDF(const LatencyRecorderBase* owner) : _owner(owner) {}
 
 CDF::~CDF() {
     hide();
@@ -35,35 +35,36 @@ void CDF::describe(std::ostream& os, bool) const {
 
 int CDF::describe_series(
     std::ostream& os, const SeriesOptions& options) const {
-    if (_w == NULL) {
+    if (_owner == NULL) {
         return 1;
     }
     if (options.test_only) {
         return 0;
     }
-    std::unique_ptr<CombinedPercentileSamples> cb(new CombinedPercentileSamples);
-    std::vector<GlobalPercentileSamples> buckets;
-    _w->get_samples(&buckets);
-    for (size_t i = 0; i < buckets.size(); ++i) {
-        cb->combine_of(buckets.begin(), buckets.end());
-    }
-    std::pair<int, int> values[20];
+    int labels[20];
+    double ratios[20];
     size_t n = 0;
     for (int i = 1; i < 10; ++i) {
-        values[n++] = std::make_pair(i*10, cb->get_number(i * 0.1));
+        labels[n] = i * 10;
+        ratios[n++] = i * 0.1;
     }
     for (int i = 91; i < 100; ++i) {
-        values[n++] = std::make_pair(i, cb->get_number(i * 0.01));
+        labels[n] = i;
+        ratios[n++] = i * 0.01;
     }
-    values[n++] = std::make_pair(100, cb->get_number(0.999));
-    values[n++] = std::make_pair(101, cb->get_number(0.9999));
-    CHECK_EQ(n, arraysize(values));
+    labels[n] = 100;
+    ratios[n++] = 0.999;
+    labels[n] = 101;
+    ratios[n++] = 0.9999;
+    CHECK_EQ(n, arraysize(ratios));
+    int64_t values[20];
+    _owner->get_percentiles(ratios, n, values);
     os << "{\"label\":\"cdf\",\"data\":[";
     for (size_t i = 0; i < n; ++i) {
         if (i) {
             os << ',';
         }
-        os << '[' << values[i].first << ',' << values[i].second << ']';
+        os << '[' << labels[i] << ',' << values[i] << ']';
     }
     os << "]}";
     return 0;
@@ -99,16 +100,17 @@ int64_t get_percetile(void* arg) {
 }
 
 static Vector<int64_t, 4> get_latencies(void *arg) {
-    std::unique_ptr<CombinedPercentileSamples> cb(
-        combine((PercentileWindow*)arg));
     // NOTE: We don't show 99.99% since it's often significantly larger than
     // other values and make other curves on the plotted graph small and
     // hard to read.
+    const double ratios[4] = { 0.5, 0.90, 0.99, 0.999 };
+    int64_t values[4];
+    static_cast<LatencyRecorderBase*>(arg)->get_percentiles(
+        ratios, arraysize(ratios), values);
     Vector<int64_t, 4> result;
-    result[0] = cb->get_number(0.5);
-    result[1] = cb->get_number(0.90);
-    result[2] = cb->get_number(0.99);
-    result[3] = cb->get_number(0.999);
+    for (size_t i = 0; i < arraysize(values); ++i) {
+        result[i] = values[i];
+    }
     return result;
 }
 
@@ -124,16 +126,61 @@ LatencyRecorderBase::LatencyRecorderBase(time_t window_size)
     , _latency_99(get_percetile<99, 100>, this)
     , _latency_999(get_percetile<999, 1000>, this)
     , _latency_9999(get_percetile<9999, 10000>, this)
-    , _latency_cdf(&_latency_percentile_window)
-    , _latency_percentiles(get_latencies, &_latency_percentile_window)
+    , _latency_cdf(this)
+    , _latency_percentiles(get_latencies, this)
 {}
 
+void LatencyRecorderBase::get_percentiles(
+    const double* ratios, size_t n, int64_t* out) const {
+    if (_latency_histogram_window != NULL) {
+        const GlobalHistogram h = _latency_histogram_window->get_value();
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = h.get_number(ratios[i]);
+        }
+        return;
+    }
+    // const_cast here is just to adapt parameter type and safe.
+    std::unique_ptr<CombinedPercentileSamples> cb(
+        combine(const_cast<PercentileWindow*>(&_latency_percentile_window)));
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = cb->get_number(ratios[i]);
+    }
+}
+
 }  // namespace detail
 
 Vector<int64_t, 4> LatencyRecorder::latency_percentiles() const {
     // const_cast here is just to adapt parameter type and safe.
-    return detail::get_latencies(
-        const_cast<detail::PercentileWindow*>(&_latency_percentile_window));
+    return detail::get_latencies(const_cast<LatencyRecorder*>(this));
+}
+
+int LatencyRecorder::enable_histogram_percentile() {
+    if (_latency_histogram != NULL) {
+        return 0;
+    }
+    if (count() != 0) {
+        LOG(ERROR) << "Can't enable histogram percentile after recording";
+        return -1;
+    }
+    if (!latency_name().empty()) {
+        // Exposed vars may be read by other threads.
+        LOG(ERROR) << "Can't enable histogram percentile after exposing";
+        return -1;
+    }
+    _latency_histogram.reset(new detail::HistogramPercentile);
+    // The window uses the sampler owned by the histogram and is destroyed
+    // before the histogram, see declaration order of the members.
+    _latency_histogram_window.reset(new detail::HistogramWindow(
+        _latency_histogram.get(), window_size()));
+    return 0;
+}
+
+int LatencyRecorder::latency_histogram(LatencyHistogram* out) const {
+    if (_latency_histogram_window == NULL) {
+        return -1;
+    }
+    *out = _latency_histogram_window->get_value();
+    return 0;
 }
 
 int64_t LatencyRecorder::qps(time_t window_size) const {
@@ -173,6 +220,9 @@ int LatencyRecorder::expose(const butil::StringPiece& prefix1,
     // set debug names for printing helpful error log.
     _latency.set_debug_name(prefix);
     _latency_percentile.set_debug_name(prefix);
+    if (_latency_histogram) {
+        _latency_histogram->set_debug_name(prefix);
+    }
 
     if (_latency_window.expose_as(prefix, "latency") != 0) {
         return -1;
@@ -212,9 +262,9 @@ int LatencyRecorder::expose(const butil::StringPiece& prefix1,
 }
 
 int64_t LatencyRecorder::latency_percentile(double ratio) const {
-    std::unique_ptr<detail::CombinedPercentileSamples> cb(
-        combine((detail::PercentileWindow*)&_latency_percentile_window));
-    return cb->get_number(ratio);
+    int64_t value = 0;
+    get_percentiles(&ratio, 1, &value);
+    return value;
 }
 
 void LatencyRecorder::hide() {
@@ -227,12 +277,18 @@ void LatencyRecorder::hide() {
     _latency_99.hide();
     _latency_999.hide();
     _latency_9999.hide();
+    _latency_cdf.hide();
+    _latency_percentiles.hide();
 }
 
 LatencyRecorder& LatencyRecorder::operator<<(int64_t latency) {
     _latency << latency;
     _max_latency << latency;
-    _latency_percentile << latency;
+    if (_latency_histogram) {
+        *_latency_histogram << latency;
+    } else {
+        _latency_percentile << latency;
+    }
     return *this;
 }
 
@@ -18,10 +18,12 @@
 #ifndef  BVAR_LATENCY_RECORDER_H
 #define  BVAR_LATENCY_RECORDER_H
 
+#include <memory>                          // std::unique_ptr
 #include "bvar/recorder.h"
 #include "bvar/reducer.h"
 #include "bvar/passive_status.h"
 #include "bvar/detail/percentile.h"
+#include "bvar/detail/histogram.h"
 
 namespace bvar {
 namespace detail {
@@ -30,17 +32,20 @@ class Percentile;
 typedef Window<IntRecorder, SERIES_IN_SECOND> RecorderWindow;
 typedef Window<Maxer<int64_t>, SERIES_IN_SECOND> MaxWindow;
 typedef Window<Percentile, SERIES_IN_SECOND> PercentileWindow;
+typedef Window<HistogramPercentile, SERIES_IN_SECOND> HistogramWindow;
 
 // NOTE: Always use int64_t in the interfaces no matter what the impl. is.
 
+class LatencyRecorderBase;
+
 class CDF : public Variable {
 public:
-    explicit CDF(PercentileWindow* w);
+    explicit CDF(const LatencyRecorderBase* owner);
     ~CDF();
     void describe(std::ostream& os, bool quote_string) const;
     int describe_series(std::ostream& os, const SeriesOptions& options) const;
 private:
-    PercentileWindow* _w; 
+    const LatencyRecorderBase* _owner;
 };
 
 // For mimic constructor inheritance.
@@ -48,6 +53,10 @@ class LatencyRecorderBase {
 public:
     explicit LatencyRecorderBase(time_t window_size);
     time_t window_size() const { return _latency_window.window_size(); }
+
+    // Get |ratios[i]|-ile latencies in recent window_size-to-ctor seconds
+    // into out[i], samples of the window are combined only once.
+    void get_percentiles(const double* ratios, size_t n, int64_t* out) const;
 protected:
     IntRecorder _latency;
     Maxer<int64_t> _max_latency;
@@ -58,6 +67,11 @@ protected:
     PassiveStatus<int64_t> _count;
     PassiveStatus<int64_t> _qps;
     PercentileWindow _latency_percentile_window;
+    // Replace _latency_percentile when histogram percentile is enabled.
+    // Declared before the vars reading them (including the series sampler
+    // of _latency_percentiles) so that they're destroyed after the readers.
+    std::unique_ptr<HistogramPercentile> _latency_histogram;
+    std::unique_ptr<HistogramWindow> _latency_histogram_window;
     PassiveStatus<int64_t> _latency_50;
     PassiveStatus<int64_t> _latency_90;
     PassiveStatus<int64_t> _latency_99;
@@ -68,6 +82,9 @@ protected:
 };
 } // namespace detail
 
+// Counts of latencies in log-scaled buckets, see bvar/detail/histogram.h
+typedef detail::GlobalHistogram LatencyHistogram;
+
 // Specialized structure to record latency.
 // It's not a Variable, but it contains multiple bvar inside.
 class LatencyRecorder : public detail::LatencyRecorderBase {
@@ -96,6 +113,23 @@ public:
 
     // Record the latency.
     LatencyRecorder& operator<<(int64_t latency);
+
+    // Compute percentiles with log-scaled histograms rather than random
+    // samples. Relative errors of all percentiles (including 99.99%) are
+    // bounded and histograms of different windows, recorders or processes
+    // can be merged exactly, at the cost of 3.5KB memory per thread that
+    // records latencies.
+    // This method is not thread-safe and must be called before recording,
+    // exposing or reading the recorder.
+    // Returns 0 on success, -1 if latencies were recorded or the recorder
+    // was exposed.
+    int enable_histogram_percentile();
+    bool histogram_percentile_enabled() const
+    { return _latency_histogram != NULL; }
+
+    // Get histogram of latencies in recent window_size-to-ctor seconds.
+    // Returns 0 on success, -1 if histogram percentile is not enabled.
+    int latency_histogram(LatencyHistogram* out) const;
         
     // Expose all internal variables using `prefix' as prefix.
     // Returns 0 on success, -1 otherwise.
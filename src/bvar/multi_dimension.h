@@ -0,0 +1,125 @@
+// Copyright (c) 2014 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BVAR_MULTI_DIMENSION_H
+#define  BVAR_MULTI_DIMENSION_H
+
+#include <pthread.h>
+#include <list>
+#include <string>
+#include <vector>
+#include <gflags/gflags_declare.h>
+#include "butil/macros.h"                          // DISALLOW_COPY_AND_ASSIGN
+#include "butil/containers/flat_map.h"             // butil::FlatMap
+#include "butil/containers/doubly_buffered_data.h" // butil::DoublyBufferedData
+#include "bvar/mvariable.h"
+
+namespace bvar {
+
+DECLARE_int32(bvar_max_multi_dimension_stats_count);
+
+// A family of stats sharing one name, each of them is identified by values
+// of the labels given at construction.
+//   T is a reducer (Adder, Maxer, Miner, IntRecorder ...) or LatencyRecorder.
+//
+// Example:
+//   bvar::MultiDimension<bvar::Adder<int> > g_request_count(
+//       "request_count", {"method", "peer"});
+//   ...
+//   std::list<std::string> labels = {"Echo", "127.0.0.1"};
+//   bvar::Adder<int>* count = g_request_count.get_stats(labels);
+//   if (count) {
+//       *count << 1;
+//   }
+//
+// Stats are dumped as request_count{method="Echo",peer="127.0.0.1"} : 1
+//
+// Looking up existing stats is almost lock-free (DoublyBufferedData), only
+// creating or deleting stats takes the lock of this MultiDimension. Number
+// of stats is limited by -bvar_max_multi_dimension_stats_count to bound the
+// memory consumed by labels with unexpectedly many values (e.g. user ids).
+// Pointers returned by get_stats() are valid until they're deleted by
+// delete_stats() or clear_stats(), users are responsible for not using the
+// pointers after that.
+template <typename T>
+class MultiDimension : public MVariable {
+public:
+    typedef std::list<std::string> key_type;
+    typedef T value_type;
+
+    struct KeyHash {
+        size_t operator()(const key_type& key) const {
+            size_t hash = 0;
+            butil::DefaultHasher<std::string> hasher;
+            for (key_type::const_iterator
+                     it = key.begin(); it != key.end(); ++it) {
+                hash = hash * 31 + hasher(*it);
+            }
+            return hash;
+        }
+    };
+    typedef butil::FlatMap<key_type, T*, KeyHash> StatsMap;
+
+    explicit MultiDimension(const key_type& labels);
+    MultiDimension(const butil::StringPiece& name, const key_type& labels);
+    MultiDimension(const butil::StringPiece& prefix,
+                   const butil::StringPiece& name,
+                   const key_type& labels);
+    ~MultiDimension();
+
+    // Get stats of `label_values' which must have as many values as
+    // labels(), create the stats if it does not exist.
+    // Returns NULL when number of values mismatches or there're already
+    // -bvar_max_multi_dimension_stats_count stats.
+    T* get_stats(const key_type& label_values);
+
+    bool has_stats(const key_type& label_values);
+
+    // Delete stats of `label_values'. Stats returned by get_stats() before
+    // become invalid.
+    void delete_stats(const key_type& label_values);
+
+    // Delete all stats.
+    void clear_stats();
+
+    // Put values of labels of all stats into `label_values'.
+    void list_stats(std::vector<key_type>* label_values);
+
+    // Implement MVariable
+    size_t count_stats();
+    void describe(std::ostream& os);
+    int dump(Dumper* dumper, const DumpOptions* options);
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(MultiDimension);
+
+    void init();
+    T* find_stats(const key_type& label_values);
+
+    static size_t init_flatmap(StatsMap& m);
+    static size_t insert_stats(StatsMap& m, const key_type& label_values,
+                               T* const& stats);
+    static size_t erase_stats(StatsMap& m, const key_type& label_values);
+    static size_t clear_flatmap(StatsMap& m);
+
+    // Serialize creations and deletions of stats.
+    pthread_mutex_t _mutex;
+    butil::DoublyBufferedData<StatsMap> _stats;
+};
+
+}  // namespace bvar
+
+#include "bvar/multi_dimension_inl.h"
+
+#endif  // BVAR_MULTI_DIMENSION_H
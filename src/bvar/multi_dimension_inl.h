@@ -0,0 +1,329 @@
+// Copyright (c) 2014 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BVAR_MULTI_DIMENSION_INL_H
+#define  BVAR_MULTI_DIMENSION_INL_H
+
+#include <stdio.h>                          // snprintf
+#include <algorithm>                        // std::sort
+#include <sstream>                          // std::ostringstream
+#include "butil/logging.h"
+#include "butil/scoped_lock.h"              // BAIDU_SCOPED_LOCK
+#include "bvar/latency_recorder.h"
+
+namespace bvar {
+namespace detail {
+
+// Append {label1="value1",label2="value2"} to `out', values are escaped.
+inline void append_labels(std::string* out,
+                          const std::list<std::string>& labels,
+                          const std::list<std::string>& values) {
+    out->push_back('{');
+    std::list<std::string>::const_iterator it_label = labels.begin();
+    std::list<std::string>::const_iterator it_value = values.begin();
+    for (; it_label != labels.end() && it_value != values.end();
+         ++it_label, ++it_value) {
+        if (it_label != labels.begin()) {
+            out->push_back(',');
+        }
+        out->append(*it_label);
+        out->append("=\"");
+        append_escaped_label_value(out, *it_value);
+        out->push_back('"');
+    }
+    out->push_back('}');
+}
+
+// Dump `stats' whose labels are the first of the pairs.
+// Returns number of dumped stats, -1 on error.
+template <typename T>
+int dump_labeled_stats(Dumper* dumper, const DumpOptions& options,
+                       const std::string& name,
+                       const std::vector<std::pair<std::string, T*> >& stats) {
+    std::ostringstream os;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        os.str("");
+        stats[i].second->describe(os, options.quote_string);
+        if (!dumper->dump(name + stats[i].first, os.str())) {
+            return -1;
+        }
+    }
+    return (int)stats.size();
+}
+
+// LatencyRecorder is a group of bvars, dump the ones commonly monitored.
+// Values of one item are dumped together so that dumpers (e.g. the
+// prometheus one) see all labels of a metric contiguously. The quantiles
+// are followed by the count, which makes up a summary together with them.
+inline int dump_labeled_stats(
+    Dumper* dumper, const DumpOptions&, const std::string& name,
+    const std::vector<std::pair<std::string, LatencyRecorder*> >& stats) {
+    static const char* const suffixes[] = {
+        "_latency_99", "_latency_999", "_count",
+        "_latency", "_max_latency", "_qps"
+    };
+    std::string full_name;
+    for (size_t i = 0; i < arraysize(suffixes); ++i) {
+        for (size_t j = 0; j < stats.size(); ++j) {
+            const LatencyRecorder* rec = stats[j].second;
+            int64_t value = 0;
+            switch (i) {
+            case 0: value = rec->latency_percentile(0.99); break;
+            case 1: value = rec->latency_percentile(0.999); break;
+            case 2: value = rec->count(); break;
+            case 3: value = rec->latency(); break;
+            case 4: value = rec->max_latency(); break;
+            case 5: value = rec->qps(); break;
+            }
+            full_name = name;
+            full_name.append(suffixes[i]);
+            full_name.append(stats[j].first);
+            char buf[32];
+            const int len = snprintf(buf, sizeof(buf), "%lld",
+                                     (long long)value);
+            if (!dumper->dump(full_name, butil::StringPiece(buf, len))) {
+                return -1;
+            }
+        }
+    }
+    return (int)(arraysize(suffixes) * stats.size());
+}
+
+template <typename K, typename V>
+struct FirstLess {
+    bool operator()(const std::pair<K, V>& a,
+                    const std::pair<K, V>& b) const {
+        return a.first < b.first;
+    }
+};
+
+}  // namespace detail
+
+template <typename T>
+MultiDimension<T>::MultiDimension(const key_type& labels)
+    : MVariable(labels) {
+    init();
+}
+
+template <typename T>
+MultiDimension<T>::MultiDimension(const butil::StringPiece& name,
+                                  const key_type& labels)
+    : MVariable(labels) {
+    init();
+    this->expose(name);
+}
+
+template <typename T>
+MultiDimension<T>::MultiDimension(const butil::StringPiece& prefix,
+                                  const butil::StringPiece& name,
+                                  const key_type& labels)
+    : MVariable(labels) {
+    init();
+    this->expose_as(prefix, name);
+}
+
+template <typename T>
+MultiDimension<T>::~MultiDimension() {
+    hide();
+    clear_stats();
+    pthread_mutex_destroy(&_mutex);
+}
+
+template <typename T>
+void MultiDimension<T>::init() {
+    pthread_mutex_init(&_mutex, NULL);
+    _stats.Modify(init_flatmap);
+}
+
+template <typename T>
+size_t MultiDimension<T>::init_flatmap(StatsMap& m) {
+    // Buckets are small, a few labels should not trigger resizing.
+    CHECK_EQ(0, m.init(32));
+    return 1;
+}
+
+template <typename T>
+size_t MultiDimension<T>::insert_stats(StatsMap& m,
+                                       const key_type& label_values,
+                                       T* const& stats) {
+    m[label_values] = stats;
+    return 1;
+}
+
+template <typename T>
+size_t MultiDimension<T>::erase_stats(StatsMap& m,
+                                      const key_type& label_values) {
+    return m.erase(label_values);
+}
+
+template <typename T>
+size_t MultiDimension<T>::clear_flatmap(StatsMap& m) {
+    const size_t n = m.size();
+    m.clear();
+    return n;
+}
+
+template <typename T>
+T* MultiDimension<T>::find_stats(const key_type& label_values) {
+    typename butil::DoublyBufferedData<StatsMap>::ScopedPtr ptr;
+    if (_stats.Read(&ptr) != 0) {
+        return NULL;
+    }
+    T** stats = ptr->seek(label_values);
+    return stats ? *stats : NULL;
+}
+
+template <typename T>
+T* MultiDimension<T>::get_stats(const key_type& label_values) {
+    if (label_values.size() != count_labels()) {
+        LOG_EVERY_SECOND(ERROR) << "Number of label values="
+                                << label_values.size()
+                                << " mismatches number of labels="
+                                << count_labels() << " of `" << name() << '\'';
+        return NULL;
+    }
+    T* stats = find_stats(label_values);
+    if (stats) {
+        return stats;
+    }
+    BAIDU_SCOPED_LOCK(_mutex);
+    stats = find_stats(label_values);
+    if (stats) {
+        return stats;
+    }
+    if (count_stats() >= (size_t)FLAGS_bvar_max_multi_dimension_stats_count) {
+        LOG_EVERY_SECOND(ERROR) << "Too many stats in `" << name()
+                                << "', max="
+                                << FLAGS_bvar_max_multi_dimension_stats_count;
+        return NULL;
+    }
+    stats = new T;
+    _stats.Modify(insert_stats, label_values, stats);
+    return stats;
+}
+
+template <typename T>
+bool MultiDimension<T>::has_stats(const key_type& label_values) {
+    return find_stats(label_values) != NULL;
+}
+
+template <typename T>
+void MultiDimension<T>::delete_stats(const key_type& label_values) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    T* stats = find_stats(label_values);
+    if (stats == NULL) {
+        return;
+    }
+    // Modify() returns after all readers left the old map, nobody can find
+    // the stats after that.
+    _stats.Modify(erase_stats, label_values);
+    delete stats;
+}
+
+template <typename T>
+void MultiDimension<T>::clear_stats() {
+    BAIDU_SCOPED_LOCK(_mutex);
+    std::vector<T*> all_stats;
+    {
+        typename butil::DoublyBufferedData<StatsMap>::ScopedPtr ptr;
+        if (_stats.Read(&ptr) != 0) {
+            return;
+        }
+        all_stats.reserve(ptr->size());
+        for (typename StatsMap::const_iterator
+                 it = ptr->begin(); it != ptr->end(); ++it) {
+            all_stats.push_back(it->second);
+        }
+    }
+    _stats.Modify(clear_flatmap);
+    for (size_t i = 0; i < all_stats.size(); ++i) {
+        delete all_stats[i];
+    }
+}
+
+template <typename T>
+size_t MultiDimension<T>::count_stats() {
+    typename butil::DoublyBufferedData<StatsMap>::ScopedPtr ptr;
+    if (_stats.Read(&ptr) != 0) {
+        return 0;
+    }
+    return ptr->size();
+}
+
+template <typename T>
+void MultiDimension<T>::list_stats(std::vector<key_type>* label_values) {
+    if (label_values == NULL) {
+        return;
+    }
+    label_values->clear();
+    typename butil::DoublyBufferedData<StatsMap>::ScopedPtr ptr;
+    if (_stats.Read(&ptr) != 0) {
+        return;
+    }
+    label_values->reserve(ptr->size());
+    for (typename StatsMap::const_iterator
+             it = ptr->begin(); it != ptr->end(); ++it) {
+        label_values->push_back(it->first);
+    }
+}
+
+template <typename T>
+void MultiDimension<T>::describe(std::ostream& os) {
+    os << "{\"name\" : \"" << name() << "\", \"labels\" : [";
+    for (key_type::const_iterator
+             it = labels().begin(); it != labels().end(); ++it) {
+        if (it != labels().begin()) {
+            os << ", ";
+        }
+        os << '"' << *it << '"';
+    }
+    os << "], \"stats_count\" : " << count_stats() << '}';
+}
+
+template <typename T>
+int MultiDimension<T>::dump(Dumper* dumper, const DumpOptions* options) {
+    DumpOptions opt;
+    if (options) {
+        opt = *options;
+    }
+    // Holding _mutex prevents the stats from being deleted during dumping
+    // while get_stats() on existing stats is not blocked.
+    BAIDU_SCOPED_LOCK(_mutex);
+    std::vector<std::pair<key_type, T*> > all_stats;
+    {
+        typename butil::DoublyBufferedData<StatsMap>::ScopedPtr ptr;
+        if (_stats.Read(&ptr) != 0) {
+            return 0;
+        }
+        all_stats.reserve(ptr->size());
+        for (typename StatsMap::const_iterator
+                 it = ptr->begin(); it != ptr->end(); ++it) {
+            all_stats.push_back(std::make_pair(it->first, it->second));
+        }
+    }
+    std::sort(all_stats.begin(), all_stats.end(),
+              detail::FirstLess<key_type, T*>());
+    std::vector<std::pair<std::string, T*> > labeled_stats;
+    labeled_stats.resize(all_stats.size());
+    for (size_t i = 0; i < all_stats.size(); ++i) {
+        detail::append_labels(&labeled_stats[i].first, labels(),
+                              all_stats[i].first);
+        labeled_stats[i].second = all_stats[i].second;
+    }
+    return detail::dump_labeled_stats(dumper, opt, name(), labeled_stats);
+}
+
+}  // namespace bvar
+
+#endif  // BVAR_MULTI_DIMENSION_INL_H
@@ -0,0 +1,162 @@
+// Copyright (c) 2014 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <pthread.h>
+#include <map>
+#include <gflags/gflags.h>
+#include "butil/logging.h"
+#include "butil/scoped_lock.h"                   // BAIDU_SCOPED_LOCK
+#include "bvar/mvariable.h"
+#include "bvar/detail/wildcard_matcher.h"
+
+namespace bvar {
+
+DEFINE_int32(bvar_max_multi_dimension_stats_count, 20000,
+             "Max number of different label values of a multi-dimensional "
+             "bvar, stats of more label values are not created");
+
+// The registry is only touched when exposing, hiding or dumping.
+static pthread_mutex_t s_mvar_map_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, MVariable*>* s_mvar_map = NULL;
+
+MVariable::MVariable(const std::list<std::string>& labels)
+    : _labels(labels) {
+}
+
+MVariable::~MVariable() {
+    CHECK(!hide()) << "Subclass of MVariable MUST call hide() manually in their"
+        " dtors to avoid dumping a variable that is just destructing";
+}
+
+int MVariable::expose_impl(const butil::StringPiece& prefix,
+                           const butil::StringPiece& name) {
+    if (name.empty()) {
+        LOG(ERROR) << "Parameter[name] is empty";
+        return -1;
+    }
+    hide();
+
+    // Build the name.
+    _name.clear();
+    _name.reserve((prefix.size() + name.size()) * 5 / 4);
+    if (!prefix.empty()) {
+        to_underscored_name(&_name, prefix);
+        if (!_name.empty() && butil::back_char(_name) != '_') {
+            _name.push_back('_');
+        }
+    }
+    to_underscored_name(&_name, name);
+
+    BAIDU_SCOPED_LOCK(s_mvar_map_mutex);
+    if (s_mvar_map == NULL) {
+        s_mvar_map = new std::map<std::string, MVariable*>;
+    }
+    MVariable*& mvar = (*s_mvar_map)[_name];
+    if (mvar == NULL) {
+        mvar = this;
+        return 0;
+    }
+    LOG(ERROR) << "Already exposed multi-dimensional bvar `" << _name << '\'';
+    _name.clear();
+    return -1;
+}
+
+bool MVariable::hide() {
+    if (_name.empty()) {
+        return false;
+    }
+    BAIDU_SCOPED_LOCK(s_mvar_map_mutex);
+    CHECK(s_mvar_map != NULL && s_mvar_map->erase(_name) == 1UL)
+        << "`" << _name << "' must exist";
+    _name.clear();
+    return true;
+}
+
+size_t MVariable::count_exposed() {
+    BAIDU_SCOPED_LOCK(s_mvar_map_mutex);
+    return s_mvar_map ? s_mvar_map->size() : 0;
+}
+
+void MVariable::list_exposed(std::vector<std::string>* names) {
+    if (names == NULL) {
+        return;
+    }
+    names->clear();
+    BAIDU_SCOPED_LOCK(s_mvar_map_mutex);
+    if (s_mvar_map == NULL) {
+        return;
+    }
+    names->reserve(s_mvar_map->size());
+    for (std::map<std::string, MVariable*>::const_iterator
+             it = s_mvar_map->begin(); it != s_mvar_map->end(); ++it) {
+        names->push_back(it->first);
+    }
+}
+
+int MVariable::dump_exposed(Dumper* dumper, const DumpOptions* poptions) {
+    if (NULL == dumper) {
+        LOG(ERROR) << "Parameter[dumper] is NULL";
+        return -1;
+    }
+    DumpOptions opt;
+    if (poptions) {
+        opt = *poptions;
+    }
+    detail::WildcardMatcher black_matcher(opt.black_wildcards,
+                                          opt.question_mark, false);
+    detail::WildcardMatcher white_matcher(opt.white_wildcards,
+                                          opt.question_mark, true);
+    int count = 0;
+    // Dump with the registry locked so that the MVariables are not
+    // destructed during dumping.
+    BAIDU_SCOPED_LOCK(s_mvar_map_mutex);
+    if (s_mvar_map == NULL) {
+        return 0;
+    }
+    for (std::map<std::string, MVariable*>::const_iterator
+             it = s_mvar_map->begin(); it != s_mvar_map->end(); ++it) {
+        if (!white_matcher.match(it->first) || black_matcher.match(it->first)) {
+            continue;
+        }
+        const int rc = it->second->dump(dumper, &opt);
+        if (rc < 0) {
+            return -1;
+        }
+        count += rc;
+    }
+    return count;
+}
+
+void append_escaped_label_value(std::string* out,
+                                const butil::StringPiece& value) {
+    for (size_t i = 0; i < value.size(); ++i) {
+        const char c = value[i];
+        switch (c) {
+        case '\\':
+            out->append("\\\\");
+            break;
+        case '"':
+            out->append("\\\"");
+            break;
+        case '\n':
+            out->append("\\n");
+            break;
+        default:
+            out->push_back(c);
+            break;
+        }
+    }
+}
+
+}  // namespace bvar
@@ -0,0 +1,107 @@
+// Copyright (c) 2014 Baidu, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef  BVAR_MVARIABLE_H
+#define  BVAR_MVARIABLE_H
+
+#include <ostream>                      // std::ostream
+#include <list>
+#include <string>
+#include <vector>
+#include "butil/macros.h"               // DISALLOW_COPY_AND_ASSIGN
+#include "butil/strings/string_piece.h" // butil::StringPiece
+#include "bvar/variable.h"              // Dumper, DumpOptions
+
+namespace bvar {
+
+// Base class of multi-dimensional bvars, namely a family of stats sharing a
+// name and distinguished by values of labels, e.g. latencies of different
+// methods called from different peers. See bvar/multi_dimension.h
+//
+// MVariables are exposed in a namespace separated from Variables. Exposing
+// or hiding takes a global lock, while updating stats does not.
+class MVariable {
+public:
+    explicit MVariable(const std::list<std::string>& labels);
+    virtual ~MVariable();
+
+    // Describe stats of all label values into `os'.
+    virtual void describe(std::ostream& os) = 0;
+
+    // Send stats of all label values to `dumper', names of the stats are
+    // name(){label1="value1",label2="value2"}.
+    // Returns number of dumped stats, -1 when dumper->dump() failed.
+    virtual int dump(Dumper* dumper, const DumpOptions* options) = 0;
+
+    // Number of different label values having stats.
+    virtual size_t count_stats() = 0;
+
+    const std::list<std::string>& labels() const { return _labels; }
+    size_t count_labels() const { return _labels.size(); }
+
+    // Get exposed name. If this variable is not exposed, the name is empty.
+    const std::string& name() const { return _name; }
+
+    // Expose this variable globally so that it's counted in *_exposed()
+    // functions. Names are normalized like Variable::expose().
+    // Returns 0 on success, -1 otherwise.
+    int expose(const butil::StringPiece& name) {
+        return expose_impl(butil::StringPiece(), name);
+    }
+    int expose_as(const butil::StringPiece& prefix,
+                  const butil::StringPiece& name) {
+        return expose_impl(prefix, name);
+    }
+
+    // Hide this variable so that it's not counted in *_exposed functions.
+    // Returns false if this variable is already hidden.
+    // Subclasses must call hide() in their dtors.
+    bool hide();
+
+    // ====================================================================
+
+    static size_t count_exposed();
+
+    // Put names of all exposed MVariables into `names'.
+    static void list_exposed(std::vector<std::string>* names);
+
+    // Find all exposed MVariables whose names match `white_wildcards' but
+    // `black_wildcards' of `options' and send their stats to `dumper'.
+    // MVariables are dumped in the order of names, and stats of one
+    // MVariable are dumped in the order of label values, so that stats of
+    // a name are grouped together.
+    // Use default options when `options' is NULL.
+    // Return number of dumped stats, -1 on error.
+    static int dump_exposed(Dumper* dumper, const DumpOptions* options);
+
+protected:
+    int expose_impl(const butil::StringPiece& prefix,
+                    const butil::StringPiece& name);
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(MVariable);
+
+    std::string _name;
+    std::list<std::string> _labels;
+};
+
+// Append `value' to `out' with backslash, double-quote and line feed escaped
+// as \\, \" and \n, which is how label values are written in names of
+// multi-dimensional bvars and in the prometheus text format.
+void append_escaped_label_value(std::string* out,
+                                const butil::StringPiece& value);
+
+}  // namespace bvar
+
+#endif  // BVAR_MVARIABLE_H
@@ -29,6 +29,7 @@
 #include "brpc/builtin/connections_service.h"  // ConnectionsService
 #include "brpc/builtin/flags_service.h"        // FlagsService
 #include "brpc/builtin/vars_service.h"         // VarsService
+#include "brpc/builtin/prometheus_metrics_service.h"
 #include "brpc/builtin/rpcz_service.h"         // RpczService
 #include "brpc/builtin/dir_service.h"          // DirService
 #include "brpc/builtin/pprof_service.h"        // PProfService
@@ -622,6 +623,72 @@ TEST_F(BuiltinServiceTest, vars) {
     }
 }
 
+TEST_F(BuiltinServiceTest, prometheus_metrics) {
+    bvar::Adder<int64_t> myvar("prom_myvar");
+    myvar << 9;
+    bvar::Status<std::string> mystr("prom_mystr", "not a number");
+    bvar::LatencyRecorder rec("prom_rec");
+    rec << 10 << 20;
+    std::list<std::string> labels;
+    labels.push_back("method");
+    bvar::MultiDimension<bvar::Adder<int> > md("prom_md", labels);
+    std::list<std::string> values;
+    values.push_back("Echo");
+    *md.get_stats(values) << 3;
+    values.front() = "Search";
+    *md.get_stats(values) << 4;
+    values.front() = "x\"y\nz";
+    *md.get_stats(values) << 5;
+    bvar::MultiDimension<bvar::LatencyRecorder> md_rec("prom_md_rec", labels);
+    values.front() = "Echo";
+    *md_rec.get_stats(values) << 10 << 20;
+    // Same name as a Variable.
+    bvar::Adder<int64_t> dup("prom_dup");
+    dup << 1;
+    bvar::MultiDimension<bvar::Adder<int> > md_dup("prom_dup", labels);
+    *md_dup.get_stats(values) << 2;
+
+    brpc::PrometheusMetricsService service;
+    brpc::MetricsRequest req;
+    brpc::MetricsResponse res;
+    ClosureChecker done;
+    brpc::Controller cntl;
+    service.default_method(&cntl, &req, &res, &done);
+    EXPECT_FALSE(cntl.Failed());
+    const std::string content = cntl.response_attachment().to_string();
+    EXPECT_NE(std::string::npos, content.find(
+                  "# TYPE prom_myvar gauge\nprom_myvar 9\n"));
+    EXPECT_EQ(std::string::npos, content.find("prom_mystr"));
+    EXPECT_NE(std::string::npos, content.find(
+                  "# TYPE prom_rec_latency summary\n"
+                  "prom_rec_latency_count 2\n"
+                  "prom_rec_latency{quantile=\"0.5\"} "));
+    EXPECT_NE(std::string::npos, content.find(
+                  "prom_rec_latency{quantile=\"0.99\"} "));
+    // The average latency is not written with the name of the summary.
+    EXPECT_EQ(std::string::npos, content.find("\nprom_rec_latency "));
+    EXPECT_EQ(std::string::npos, content.find("\nprom_rec_count "));
+    EXPECT_NE(std::string::npos, content.find(
+                  "# TYPE prom_md_rec_latency summary\n"
+                  "prom_md_rec_latency{method=\"Echo\",quantile=\"0.99\"} "));
+    EXPECT_NE(std::string::npos, content.find(
+                  "prom_md_rec_latency_count{method=\"Echo\"} 2\n"
+                  "# HELP prom_md_rec_max_latency\n"));
+    // Only one TYPE line for a name.
+    EXPECT_NE(std::string::npos, content.find("# TYPE prom_dup gauge\nprom_dup 1\n"));
+    EXPECT_EQ(content.find("# TYPE prom_dup "), content.rfind("# TYPE prom_dup "));
+    EXPECT_EQ(std::string::npos, content.find("prom_dup{"));
+    EXPECT_NE(std::string::npos, content.find("# TYPE prom_rec_qps gauge\n"));
+    // Labeled samples share one TYPE line.
+    EXPECT_NE(std::string::npos, content.find(
+                  "# TYPE prom_md gauge\n"
+                  "prom_md{method=\"Echo\"} 3\n"
+                  "prom_md{method=\"Search\"} 4\n"));
+    // Label values are escaped.
+    EXPECT_NE(std::string::npos, content.find(
+                  "prom_md{method=\"x\\\"y\\nz\"} 5\n"));
+}
+
 TEST_F(BuiltinServiceTest, rpcz) {
     for (int i = 0; i <= 1; ++i) {  // enable rpcz
         for (int j = 0; j <= 1; ++j) {  // hex log id
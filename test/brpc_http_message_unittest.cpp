@@ -6,6 +6,7 @@
 #include <gtest/gtest.h>
 #include <google/protobuf/descriptor.h>
 
+#include "butil/time.h"
 #include "brpc/server.h"
 #include "brpc/details/http_message.h"
 #include "brpc/policy/http_rpc_protocol.h"
@@ -212,6 +213,34 @@ TEST(HttpMessageTest, parse_from_iobuf) {
     ASSERT_EQ("text/plain", http_message.header().content_type());
 }
 
+TEST(HttpMessageTest, parse_headers_perf) {
+    const char* http_request =
+        "GET /service/method?key1=value1&key2=value2&key3=value3 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+        "(KHTML, like Gecko) Chrome/61.0.3163.100 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+        "image/webp,image/apng,*/*;q=0.8\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8,zh;q=0.7\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef; "
+        "user=someone; theme=light; tracking=ABCDEFGHIJKLMNOPQRSTUVWXYZ\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n";
+    const size_t len = strlen(http_request);
+    const size_t nheader = 8;
+    const int N = 100000;
+    butil::Timer tm;
+    tm.start();
+    for (int i = 0; i < N; ++i) {
+        brpc::HttpMessage http_message;
+        ASSERT_EQ((ssize_t)len, http_message.ParseFromArray(http_request, len));
+    }
+    tm.stop();
+    LOG(INFO) << "Parsed " << N * nheader * 1000000L / tm.u_elapsed()
+              << " headers/s, " << tm.n_elapsed() / N << "ns per request";
+}
+
 TEST(HttpMessageTest, find_method_property_by_uri) {
     brpc::Server server;
     ASSERT_EQ(0, server.AddService(new test::EchoService(),
@@ -367,6 +396,53 @@ TEST(HttpMessageTest, serialize_http_request) {
     ASSERT_EQ("GET / HTTP/1.1\r\naccePT: blahblah\r\nuser-AGENT: myUA\r\nauthorization: myAuthString\r\nFoo: Bar\r\nHost: MyHost: 4321\r\n\r\n", request);
 }
 
+TEST(HttpMessageTest, serialize_chunked_http_request) {
+    brpc::HttpHeader header;
+    header.SetHeader("Transfer-Encoding", "chunked");
+    header.SetHeader("Host", "MyHost");
+    header.SetHeader("Accept", "*/*");
+    header.SetHeader("User-Agent", "myUA");
+    header.set_method(brpc::HTTP_METHOD_POST);
+    butil::EndPoint ep;
+    butil::IOBuf request;
+    butil::IOBuf content;
+    content.append("data");
+    SerializeHttpRequest(&request, &header, ep, &content);
+    const std::string head = request.to_string().substr(
+        0, request.to_string().find("\r\n\r\n") + 4);
+    ASSERT_EQ(std::string::npos, head.find("Content-Length"));
+    ASSERT_NE(std::string::npos, head.find("Transfer-Encoding: chunked\r\n"));
+    ASSERT_EQ(head + "4\r\ndata\r\n0\r\n\r\n", request.to_string());
+
+    // empty content is sent as the last chunk only.
+    content.clear();
+    SerializeHttpRequest(&request, &header, ep, &content);
+    ASSERT_EQ(head + "0\r\n\r\n", request.to_string());
+
+    // null content means that the body is written separately.
+    SerializeHttpRequest(&request, &header, ep, NULL);
+    ASSERT_EQ(head, request.to_string());
+}
+
+TEST(HttpMessageTest, append_http_chunk) {
+    butil::IOBuf data;
+    data.append(std::string(300, 'x'));
+    butil::IOBuf buf;
+    brpc::AppendHttpChunk(&buf, data);
+    brpc::AppendHttpChunk(&buf, "abc", 3);
+    brpc::AppendLastHttpChunk(&buf);
+    ASSERT_EQ("12C\r\n" + std::string(300, 'x') + "\r\n3\r\nabc\r\n0\r\n\r\n",
+              buf.to_string());
+    // The data is referenced rather than copied.
+    bool shared = false;
+    for (size_t i = 0; i < buf.backing_block_num(); ++i) {
+        if (buf.backing_block(i).data() == data.backing_block(0).data()) {
+            shared = true;
+        }
+    }
+    ASSERT_TRUE(shared);
+}
+
 TEST(HttpMessageTest, serialize_http_response) {
     brpc::HttpHeader header;
     header.SetHeader("Foo", "Bar");
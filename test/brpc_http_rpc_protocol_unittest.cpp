@@ -12,6 +12,9 @@
 #include "butil/time.h"
 #include "butil/macros.h"
 #include "butil/files/scoped_file.h"
+#include "butil/fd_guard.h"
+#include "butil/string_printf.h"
+#include "bthread/bthread.h"
 #include "brpc/socket.h"
 #include "brpc/acceptor.h"
 #include "brpc/server.h"
@@ -20,6 +23,7 @@
 #include "brpc/controller.h"
 #include "echo.pb.h"
 #include "brpc/policy/http_rpc_protocol.h"
+#include "brpc/http_response_cache.h"
 #include "json2pb/pb_to_json.h"
 #include "json2pb/json_to_pb.h"
 #include "brpc/details/method_status.h"
@@ -921,4 +925,563 @@ TEST_F(HttpTest, broken_socket_stops_progressive_reading) {
     ASSERT_TRUE(reader->destroyed());
     ASSERT_EQ(ECONNRESET, reader->destroying_status().error_code());
 }
+
+struct FakeHttpServer {
+    int listen_fd;
+    int nrequest;
+    const char* response;
+};
+
+// Accept one connection, wait for all `nrequest' GETs pipelined on it and
+// respond them in order with their paths as the bodies.
+static void* RunFakeHttpServer(void* arg) {
+    const FakeHttpServer* fs = (const FakeHttpServer*)arg;
+    butil::fd_guard fd(accept(fs->listen_fd, NULL, NULL));
+    EXPECT_GE(fd, 0);
+    std::string input;
+    std::vector<std::string> paths;
+    while ((int)paths.size() < fs->nrequest) {
+        const size_t pos = input.find("\r\n\r\n");
+        if (pos != std::string::npos) {
+            const size_t path_begin = input.find(' ') + 1;
+            paths.push_back(input.substr(
+                    path_begin, input.find(' ', path_begin) - path_begin));
+            input.erase(0, pos + 4);
+            continue;
+        }
+        char buf[1024];
+        const ssize_t nr = read(fd, buf, sizeof(buf));
+        if (nr <= 0) {
+            return NULL;
+        }
+        input.append(buf, nr);
+    }
+    std::string output;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        butil::string_appendf(&output, "HTTP/1.1 200 OK\r\nContent-Length: %lu"
+                              "\r\n\r\n%s", (unsigned long)paths[i].size(),
+                              paths[i].c_str());
+    }
+    EXPECT_EQ((ssize_t)output.size(), write(fd, output.data(), output.size()));
+    return NULL;
+}
+
+struct CallArgs {
+    brpc::Channel* channel;
+    std::string path;
+    bool ok;
+};
+
+static void* CallFakeHttpServer(void* void_args) {
+    CallArgs* args = (CallArgs*)void_args;
+    brpc::Controller cntl;
+    cntl.http_request().uri() = args->path;
+    args->channel->CallMethod(NULL, &cntl, NULL, NULL, NULL);
+    args->ok = !cntl.Failed() && cntl.response_attachment() == args->path;
+    return NULL;
+}
+
+TEST_F(HttpTest, pipelined_calls_on_single_connection) {
+    const int N = 10;
+    butil::fd_guard listen_fd(butil::tcp_listen(butil::EndPoint(butil::my_ip(), 8924), false));
+    ASSERT_GE(listen_fd, 0);
+    FakeHttpServer fs = { listen_fd, N };
+    pthread_t server_th;
+    ASSERT_EQ(0, pthread_create(&server_th, NULL, RunFakeHttpServer, &fs));
+
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+    options.timeout_ms = 2000;
+    options.max_retry = 0;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), 8924), &options));
+    CallArgs args[N];
+    bthread_t th[N];
+    for (int i = 0; i < N; ++i) {
+        args[i].channel = &channel;
+        args[i].path = butil::string_printf("/path%d", i);
+        args[i].ok = false;
+        ASSERT_EQ(0, bthread_start_background(&th[i], NULL,
+                                              CallFakeHttpServer, &args[i]));
+    }
+    for (int i = 0; i < N; ++i) {
+        bthread_join(th[i], NULL);
+        ASSERT_TRUE(args[i].ok) << "i=" << i;
+    }
+    pthread_join(server_th, NULL);
+}
+
+// Respond one request on each of the first `nrequest' connections with
+// `response' and close the connection right after, like HTTP/1.0 servers or
+// servers responding "Connection: close".
+static void* RunFakeShortHttpServer(void* arg) {
+    const FakeHttpServer* fs = (const FakeHttpServer*)arg;
+    for (int i = 0; i < fs->nrequest; ++i) {
+        butil::fd_guard fd(accept(fs->listen_fd, NULL, NULL));
+        EXPECT_GE(fd, 0);
+        if (fd < 0) {
+            break;
+        }
+        std::string input;
+        while (input.find("\r\n\r\n") == std::string::npos) {
+            char buf[1024];
+            const ssize_t nr = read(fd, buf, sizeof(buf));
+            if (nr <= 0) {
+                break;
+            }
+            input.append(buf, nr);
+        }
+        const ssize_t len = strlen(fs->response);
+        EXPECT_EQ(len, write(fd, fs->response, len));
+    }
+    return NULL;
+}
+
+TEST_F(HttpTest, fallback_to_pooled_without_failing_server) {
+    butil::fd_guard listen_fd(butil::tcp_listen(butil::EndPoint(butil::my_ip(), 8922), false));
+    ASSERT_GE(listen_fd, 0);
+    FakeHttpServer fs = { listen_fd, 3,
+                          "HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok" };
+    pthread_t server_th;
+    ASSERT_EQ(0, pthread_create(&server_th, NULL, RunFakeShortHttpServer, &fs));
+
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+    options.timeout_ms = 2000;
+    options.max_retry = 1;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), 8922), &options));
+    brpc::Controller cntl;
+    cntl.http_request().uri() = "/";
+    channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+    // The HTTP/1.0 response fails the first try, the retry goes through a
+    // pooled connection of the same server.
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    ASSERT_EQ(1, cntl.retried_count());
+    ASSERT_EQ(brpc::CONNECTION_TYPE_POOLED, cntl.connection_type());
+    ASSERT_EQ("ok", cntl.response_attachment().to_string());
+
+    // Closing connections by the server does not mark it as broken, the
+    // next RPC is sent through a pooled connection directly.
+    bthread_usleep(100000);
+    cntl.Reset();
+    cntl.http_request().uri() = "/";
+    channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    ASSERT_EQ(0, cntl.retried_count());
+    ASSERT_EQ(brpc::CONNECTION_TYPE_POOLED, cntl.connection_type());
+    ASSERT_EQ("ok", cntl.response_attachment().to_string());
+    pthread_join(server_th, NULL);
+}
+
+TEST_F(HttpTest, pipelined_connection_closed_by_server) {
+    const int N = 3;
+    butil::fd_guard listen_fd(butil::tcp_listen(butil::EndPoint(butil::my_ip(), 8921), false));
+    ASSERT_GE(listen_fd, 0);
+    FakeHttpServer fs = { listen_fd, N,
+                          "HTTP/1.1 200 OK\r\nConnection: close\r\n"
+                          "Content-Length: 2\r\n\r\nok" };
+    pthread_t server_th;
+    ASSERT_EQ(0, pthread_create(&server_th, NULL, RunFakeShortHttpServer, &fs));
+
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+    options.timeout_ms = 2000;
+    options.max_retry = 0;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), 8921), &options));
+    for (int i = 0; i < N; ++i) {
+        // Each RPC is pipelined on a new connection replacing the one
+        // closed by the server, which is not marked as broken.
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/";
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_FALSE(cntl.Failed()) << "i=" << i << " " << cntl.ErrorText();
+        ASSERT_EQ(brpc::CONNECTION_TYPE_SINGLE, cntl.connection_type());
+        ASSERT_EQ("ok", cntl.response_attachment().to_string());
+        bthread_usleep(100000);
+    }
+    pthread_join(server_th, NULL);
+}
+
+TEST_F(HttpTest, read_progressively_on_single_connection) {
+    // The RPC uses a pooled connection instead of the single one.
+    const int port = 8923;
+    brpc::Server server;
+    DownloadServiceImpl svc;
+    EXPECT_EQ(0, server.AddService(&svc, brpc::SERVER_DOESNT_OWN_SERVICE));
+    EXPECT_EQ(0, server.Start(port, NULL));
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+    brpc::Controller cntl;
+    cntl.response_will_be_read_progressively();
+    cntl.http_request().uri() = "/DownloadService/Download";
+    channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    ASSERT_EQ(brpc::CONNECTION_TYPE_POOLED, cntl.connection_type());
+}
+
+// Count bytes of the request body and respond the count at the end.
+class CountBody : public brpc::ProgressiveReader {
+public:
+    CountBody(brpc::Controller* cntl, google::protobuf::Closure* done)
+        : _nread(0), _cntl(cntl), _done(done) {}
+
+    // @ProgressiveReader
+    butil::Status OnReadOnePart(const void* data, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            if (((const char*)data)[i] != (char)('a' + (_nread + i) % 26)) {
+                return butil::Status(EINVAL, "Unexpected data at %lu",
+                                    (unsigned long)(_nread + i));
+            }
+        }
+        _nread += length;
+        return butil::Status::OK();
+    }
+    void OnEndOfMessage(const butil::Status& st) {
+        brpc::ClosureGuard done_guard(_done);
+        if (!st.ok()) {
+            _cntl->SetFailed(st.error_code(), "%s", st.error_cstr());
+        } else {
+            _cntl->response_attachment().append(
+                butil::string_printf("%lu", (unsigned long)_nread));
+        }
+        delete this;
+    }
+
+private:
+    size_t _nread;
+    brpc::Controller* _cntl;
+    google::protobuf::Closure* _done;
+};
+
+class UploadServiceImpl : public ::test::UploadService {
+public:
+    void Upload(::google::protobuf::RpcController* cntl_base,
+                const ::test::HttpRequest*,
+                ::test::HttpResponse*,
+                ::google::protobuf::Closure* done) {
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        ASSERT_TRUE(cntl->is_request_read_progressively());
+        ASSERT_TRUE(cntl->request_attachment().empty());
+        cntl->ReadProgressiveAttachmentBy(new CountBody(cntl, done));
+    }
+    void UploadIgnored(::google::protobuf::RpcController* cntl_base,
+                       const ::test::HttpRequest*,
+                       ::test::HttpResponse*,
+                       ::google::protobuf::Closure* done) {
+        // The body is dropped when cntl is destroyed.
+        brpc::ClosureGuard done_guard(done);
+    }
+};
+
+TEST_F(HttpTest, read_request_progressively) {
+    const int port = 8923;
+    brpc::Server server;
+    UploadServiceImpl svc;
+    brpc::ServiceOptions svc_opt;
+    svc_opt.ownership = brpc::SERVER_DOESNT_OWN_SERVICE;
+    svc_opt.enable_progressive_read = true;
+    EXPECT_EQ(0, server.AddService(&svc, svc_opt));
+    EXPECT_EQ(0, server.Start(port, NULL));
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    options.timeout_ms = 10000;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+    // Larger than a single read of the server.
+    const size_t body_size = 4 * 1024 * 1024 + 17;
+    std::string body;
+    body.reserve(body_size);
+    for (size_t i = 0; i < body_size; ++i) {
+        body.push_back('a' + i % 26);
+    }
+    for (int i = 0; i < 2; ++i) {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/UploadService/Upload";
+        cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
+        cntl.request_attachment().append(body);
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(butil::string_printf("%lu", (unsigned long)body_size),
+                  cntl.response_attachment().to_string());
+    }
+    for (int i = 0; i < 2; ++i) {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/UploadService/UploadIgnored";
+        cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
+        cntl.request_attachment().append(body);
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    }
+    {
+        // Bodies without data are complete along with the headers.
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/UploadService/Upload";
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ("0", cntl.response_attachment().to_string());
+    }
+}
+
+struct WriteBodyArgs {
+    butil::intrusive_ptr<brpc::ProgressiveAttachment> pa;
+    size_t offset;
+    size_t body_size;
+};
+
+// Write the remaining body in pieces and end it by releasing the attachment.
+void* WriteBody(void* void_args) {
+    WriteBodyArgs* args = (WriteBodyArgs*)void_args;
+    char buf[4096];
+    size_t offset = args->offset;
+    while (offset < args->body_size) {
+        const size_t n = std::min(sizeof(buf), args->body_size - offset);
+        for (size_t i = 0; i < n; ++i) {
+            buf[i] = 'a' + (offset + i) % 26;
+        }
+        if (args->pa->Write(buf, n) != 0) {
+            EXPECT_EQ(brpc::EOVERCROWDED, errno);
+            bthread_usleep(1000);
+            continue;
+        }
+        offset += n;
+    }
+    args->pa.reset(NULL);
+    return NULL;
+}
+
+TEST_F(HttpTest, write_request_progressively) {
+    const int port = 8923;
+    brpc::Server server;
+    UploadServiceImpl svc;
+    brpc::ServiceOptions svc_opt;
+    svc_opt.ownership = brpc::SERVER_DOESNT_OWN_SERVICE;
+    svc_opt.enable_progressive_read = true;
+    EXPECT_EQ(0, server.AddService(&svc, svc_opt));
+    EXPECT_EQ(0, server.Start(port, NULL));
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    options.timeout_ms = 10000;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+    // Much larger than -socket_max_unwritten_bytes.
+    const size_t body_size = 72 * 1024 * 1024 + 17;
+    for (int i = 0; i < 2; ++i) {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/UploadService/Upload";
+        cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
+        // Sent as the first chunk.
+        const size_t first_size = (i == 0 ? 26 : 0);
+        for (size_t j = 0; j < first_size; ++j) {
+            cntl.request_attachment().push_back('a' + j % 26);
+        }
+        WriteBodyArgs args;
+        args.pa.reset(cntl.CreateProgressiveRequestAttachment());
+        ASSERT_TRUE(args.pa != NULL);
+        ASSERT_TRUE(cntl.is_request_written_progressively());
+        ASSERT_TRUE(cntl.CreateProgressiveRequestAttachment() == NULL);
+        args.offset = first_size;
+        args.body_size = body_size;
+        bthread_t th;
+        ASSERT_EQ(0, bthread_start_background(&th, NULL, WriteBody, &args));
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        bthread_join(th, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(butil::string_printf("%lu", (unsigned long)body_size),
+                  cntl.response_attachment().to_string());
+        ASSERT_EQ(brpc::CONNECTION_TYPE_SHORT, cntl.connection_type());
+    }
+    {
+        // Writes fail after the request fails to be sent.
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/UploadService/Upload";
+        butil::intrusive_ptr<brpc::ProgressiveAttachment> pa(
+            cntl.CreateProgressiveRequestAttachment());
+        ASSERT_EQ(0, pa->Write("abc", 3));
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_EQ(brpc::EREQUEST, cntl.ErrorCode()) << cntl.ErrorText();
+        ASSERT_EQ(-1, pa->Write("abc", 3));
+        ASSERT_EQ(ECANCELED, errno);
+    }
+}
+
+class CacheServiceImpl : public ::test::CacheService {
+public:
+    CacheServiceImpl() : ncalled(0) {}
+    void Get(::google::protobuf::RpcController* cntl_base,
+             const ::test::HttpRequest*,
+             ::test::HttpResponse*,
+             ::google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        const int n = ncalled.fetch_add(1) + 1;
+        const std::string* sleep_ms = cntl->http_request().uri().GetQuery("sleep_ms");
+        if (sleep_ms) {
+            bthread_usleep(strtol(sleep_ms->c_str(), NULL, 10) * 1000L);
+        }
+        if (cntl->http_request().uri().GetQuery("fail")) {
+            cntl->SetFailed(brpc::EINTERNAL, "intended failure");
+            return;
+        }
+        cntl->http_response().set_content_type("text/plain");
+        cntl->response_attachment().append(butil::string_printf("%d", n));
+    }
+    butil::atomic<int> ncalled;
+};
+
+struct CacheCallArgs {
+    brpc::Channel* channel;
+    std::string uri;
+    std::string body;
+};
+
+static void* GetCached(void* void_args) {
+    CacheCallArgs* args = (CacheCallArgs*)void_args;
+    brpc::Controller cntl;
+    cntl.http_request().uri() = args->uri;
+    args->channel->CallMethod(NULL, &cntl, NULL, NULL, NULL);
+    EXPECT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    args->body = cntl.response_attachment().to_string();
+    return NULL;
+}
+
+TEST_F(HttpTest, response_cache) {
+    const int port = 8923;
+    brpc::HttpResponseCache cache;
+    brpc::HttpResponseCacheOptions cache_opt;
+    cache_opt.ttl_ms = 300;
+    ASSERT_EQ(0, cache.Init(&cache_opt));
+    brpc::Server server;
+    CacheServiceImpl svc;
+    brpc::ServiceOptions svc_opt;
+    svc_opt.ownership = brpc::SERVER_DOESNT_OWN_SERVICE;
+    svc_opt.http_response_cache = &cache;
+    EXPECT_EQ(0, server.AddService(&svc, svc_opt));
+    EXPECT_EQ(0, server.Start(port, NULL));
+    brpc::Channel channel;
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_HTTP;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), port), &options));
+
+    // Concurrent misses are coalesced into one call.
+    const int N = 8;
+    CacheCallArgs args[N];
+    bthread_t th[N];
+    for (int i = 0; i < N; ++i) {
+        args[i].channel = &channel;
+        args[i].uri = "/CacheService/Get?sleep_ms=50";
+        ASSERT_EQ(0, bthread_start_background(&th[i], NULL, GetCached, &args[i]));
+    }
+    for (int i = 0; i < N; ++i) {
+        bthread_join(th[i], NULL);
+        ASSERT_EQ("1", args[i].body);
+    }
+    ASSERT_EQ(1, svc.ncalled.load());
+    ASSERT_EQ(1u, cache.count());
+
+    std::string etag;
+    {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/CacheService/Get?sleep_ms=50";
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ("1", cntl.response_attachment().to_string());
+        ASSERT_EQ("text/plain", cntl.http_response().content_type());
+        const std::string* etag_ptr = cntl.http_response().GetHeader("ETag");
+        ASSERT_TRUE(etag_ptr != NULL);
+        etag = *etag_ptr;
+        // Generated ETags are weak.
+        ASSERT_EQ(0, etag.compare(0, 2, "W/"));
+    }
+    {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/CacheService/Get?sleep_ms=50";
+        cntl.http_request().SetHeader("If-None-Match", "\"other\", " + etag);
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        // brpc clients treat status codes other than 2xx as errors.
+        ASSERT_EQ(brpc::EHTTP, cntl.ErrorCode());
+        ASSERT_EQ(brpc::HTTP_STATUS_NOT_MODIFIED, cntl.http_response().status_code());
+        ASSERT_TRUE(cntl.response_attachment().empty());
+    }
+    ASSERT_EQ(1, svc.ncalled.load());
+
+    // Different queries, failed responses and non-GET requests are not
+    // answered by the cache.
+    CacheCallArgs args2 = { &channel, "/CacheService/Get", "" };
+    GetCached(&args2);
+    ASSERT_EQ("2", args2.body);
+    for (int i = 0; i < 2; ++i) {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/CacheService/Get?fail=1";
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_TRUE(cntl.Failed());
+    }
+    ASSERT_EQ(4, svc.ncalled.load());
+    {
+        brpc::Controller cntl;
+        cntl.http_request().uri() = "/CacheService/Get";
+        cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
+        channel.CallMethod(NULL, &cntl, NULL, NULL, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ("5", cntl.response_attachment().to_string());
+    }
+
+    // Expired after ttl.
+    bthread_usleep(cache_opt.ttl_ms * 1000L + 100000);
+    args2.body.clear();
+    GetCached(&args2);
+    ASSERT_EQ("6", args2.body);
+    cache.Clear();
+    ASSERT_EQ(0u, cache.count());
+    ASSERT_EQ(0u, cache.size_in_bytes());
+}
+
+TEST_F(HttpTest, resolve_method_once_for_progressive_read) {
+    const char* upload =
+        "POST /UploadService/Upload HTTP/1.1\r\nContent-Length: 3\r\n\r\n";
+    {
+        // No service reads progressively, uri is matched in
+        // ProcessHttpRequest() only.
+        brpc::policy::HttpContext* ctx =
+            new brpc::policy::HttpContext(false, &_server);
+        ASSERT_GT(ctx->ParseFromArray(upload, strlen(upload)), 0);
+        ASSERT_FALSE(ctx->method_resolved());
+        ASSERT_FALSE(ctx->read_body_progressively());
+        ctx->Destroy();
+    }
+    brpc::Server server;
+    UploadServiceImpl svc;
+    brpc::ServiceOptions svc_opt;
+    svc_opt.ownership = brpc::SERVER_DOESNT_OWN_SERVICE;
+    svc_opt.enable_progressive_read = true;
+    ASSERT_EQ(0, server.AddService(&svc, svc_opt));
+    {
+        brpc::policy::HttpContext* ctx =
+            new brpc::policy::HttpContext(false, &server);
+        ASSERT_GT(ctx->ParseFromArray(upload, strlen(upload)), 0);
+        ASSERT_TRUE(ctx->method_resolved());
+        ASSERT_TRUE(ctx->read_body_progressively());
+        ASSERT_TRUE(ctx->method_property() != NULL);
+        ASSERT_EQ("Upload", ctx->method_property()->method->name());
+        ctx->Destroy();
+    }
+    {
+        const char* unknown =
+            "POST /NO_SUCH_METHOD HTTP/1.1\r\nContent-Length: 3\r\n\r\n";
+        brpc::policy::HttpContext* ctx =
+            new brpc::policy::HttpContext(false, &server);
+        ASSERT_GT(ctx->ParseFromArray(unknown, strlen(unknown)), 0);
+        ASSERT_TRUE(ctx->method_resolved());
+        ASSERT_TRUE(ctx->method_property() == NULL);
+        ASSERT_FALSE(ctx->read_body_progressively());
+        ctx->Destroy();
+    }
+}
 } //namespace
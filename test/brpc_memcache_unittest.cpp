@@ -1,13 +1,18 @@
 // Copyright (c) 2014 Baidu, Inc.
 // Date: Thu Jun 11 14:30:07 CST 2015
 
-#ifdef BAIDU_INTERNAL
-
+#include <algorithm>
 #include <iostream>
 #include "butil/time.h"
 #include "butil/logging.h"
+#include "butil/sys_byteorder.h"
+#include "butil/string_printf.h"
 #include <brpc/memcache.h>
 #include <brpc/channel.h>
+#include <brpc/socket.h>
+#include <brpc/policy/memcache_binary_header.h>
+#include <brpc/policy/hasher.h>
+#include <brpc/policy/consistent_hashing_load_balancer.h>
 #include <gtest/gtest.h>
 
 namespace brpc {
@@ -20,6 +25,206 @@ int main(int argc, char* argv[]) {
     return RUN_ALL_TESTS();
 }
 
+namespace {
+// Append a response as it's put into MemcacheResponse by the protocol:
+// the header in host byte order followed by the body.
+static void AppendResponse(butil::IOBuf* buf, uint8_t command, uint16_t status,
+                           const std::string& key, const std::string& value,
+                           uint32_t flags) {
+    const bool has_flags = (command == brpc::policy::MC_BINARY_GETKQ &&
+                            status == brpc::MemcacheResponse::STATUS_SUCCESS);
+    const uint8_t extras_length = (has_flags ? 4 : 0);
+    const brpc::policy::MemcacheResponseHeader header = {
+        brpc::policy::MC_MAGIC_RESPONSE, command, (uint16_t)key.size(),
+        extras_length, brpc::policy::MC_BINARY_RAW_BYTES, status,
+        (uint32_t)(extras_length + key.size() + value.size()), 0, 1 };
+    buf->append(&header, sizeof(header));
+    if (has_flags) {
+        const uint32_t raw_flags = butil::HostToNet32(flags);
+        buf->append(&raw_flags, sizeof(raw_flags));
+    }
+    buf->append(key);
+    buf->append(value);
+}
+
+static void AppendHit(butil::IOBuf* buf, const std::string& key,
+                      const std::string& value, uint32_t flags) {
+    AppendResponse(buf, brpc::policy::MC_BINARY_GETKQ,
+                   brpc::MemcacheResponse::STATUS_SUCCESS, key, value, flags);
+}
+
+static void AppendNoop(butil::IOBuf* buf) {
+    AppendResponse(buf, brpc::policy::MC_BINARY_NOOP,
+                   brpc::MemcacheResponse::STATUS_SUCCESS, "", "", 0);
+}
+
+TEST(MemcacheMultiGetTest, pop_multi_get) {
+    brpc::MemcacheResponse response;
+    AppendHit(&response.raw_buffer(), "k1", "v1", 1);
+    AppendResponse(&response.raw_buffer(), brpc::policy::MC_BINARY_GETKQ,
+                   brpc::MemcacheResponse::STATUS_E2BIG, "", "Too large", 0);
+    AppendHit(&response.raw_buffer(), "k3", "", 3);
+    AppendNoop(&response.raw_buffer());
+    AppendNoop(&response.raw_buffer());
+
+    brpc::MemcacheHitMap hits;
+    ASSERT_TRUE(response.PopMultiGet(&hits));
+    ASSERT_EQ(2u, hits.size());
+    ASSERT_EQ("Too large", response.LastError());
+    ASSERT_EQ("v1", hits["k1"].value.to_string());
+    ASSERT_EQ(1u, hits["k1"].flags);
+    ASSERT_EQ(1u, hits["k1"].cas_value);
+    ASSERT_TRUE(hits["k3"].value.empty());
+    ASSERT_EQ(3u, hits["k3"].flags);
+
+    // A batch of misses only has the NOOP.
+    hits.clear();
+    ASSERT_TRUE(response.PopMultiGet(&hits));
+    ASSERT_TRUE(hits.empty());
+    ASSERT_TRUE(response.LastError().empty());
+    ASSERT_TRUE(response.raw_buffer().empty());
+
+    // Not terminated by NOOP.
+    AppendHit(&response.raw_buffer(), "k1", "v1", 1);
+    ASSERT_FALSE(response.PopMultiGet(&hits));
+}
+
+TEST(MemcacheMultiGetTest, map_and_merge) {
+    const int N = 3;
+    std::vector<std::string> keys;
+    for (int i = 0; i < 20; ++i) {
+        keys.push_back(butil::string_printf("key_%d", i));
+    }
+    brpc::MemcacheRequest request;
+    ASSERT_TRUE(request.MultiGet(keys));
+    ASSERT_EQ(1, request.pipelined_count());
+
+    brpc::MemcacheResponse response;
+    brpc::MemcacheMultiGetMerger merger;
+    size_t nkey = 0;
+    for (int i = 0; i < N; ++i) {
+        brpc::MemcacheMultiGetMapper mapper(i, N);
+        brpc::SubCall sub = mapper.Map(i, NULL, &request, &response);
+        ASSERT_FALSE(sub.is_bad());
+        ASSERT_FALSE(sub.is_skip());
+        ASSERT_EQ(brpc::DELETE_REQUEST | brpc::DELETE_RESPONSE, sub.flags);
+        const brpc::MemcacheRequest* sub_request =
+            static_cast<const brpc::MemcacheRequest*>(sub.request);
+        ASSERT_EQ(1, sub_request->pipelined_count());
+
+        // Respond hits of keys in this shard as the values.
+        brpc::MemcacheResponse* sub_response =
+            static_cast<brpc::MemcacheResponse*>(sub.response);
+        for (size_t j = 0; j < keys.size(); ++j) {
+            if (brpc::MemcacheMultiGetMapper::GetShard(keys[j], N) == i) {
+                ++nkey;
+                AppendHit(&sub_response->raw_buffer(), keys[j], keys[j], i);
+            }
+        }
+        AppendNoop(&sub_response->raw_buffer());
+        ASSERT_EQ(brpc::ResponseMerger::MERGED,
+                  merger.Merge(&response, sub_response));
+        delete sub.request;
+        delete sub.response;
+    }
+    ASSERT_EQ(keys.size(), nkey);
+
+    brpc::MemcacheHitMap hits;
+    ASSERT_TRUE(response.PopMultiGet(&hits));
+    ASSERT_TRUE(response.raw_buffer().empty());
+    ASSERT_EQ(keys.size(), hits.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        brpc::MemcacheHit* hit = hits.seek(keys[i]);
+        ASSERT_TRUE(hit != NULL);
+        ASSERT_EQ(keys[i], hit->value.to_string());
+        ASSERT_EQ((uint32_t)brpc::MemcacheMultiGetMapper::GetShard(keys[i], N),
+                  hit->flags);
+    }
+
+    // Shards without keys are skipped.
+    brpc::MemcacheRequest single;
+    ASSERT_TRUE(single.MultiGet(std::vector<std::string>(1, "key_0")));
+    const int shard = brpc::MemcacheMultiGetMapper::GetShard("key_0", N);
+    brpc::MemcacheMultiGetMapper other((shard + 1) % N, N);
+    ASSERT_TRUE(other.Map(0, NULL, &single, &response).is_skip());
+
+    // Only a single MultiGet() is sharded.
+    single.Get("key_1");
+    brpc::MemcacheMultiGetMapper mapper(shard, N);
+    ASSERT_TRUE(mapper.Map(0, NULL, &single, &response).is_bad());
+}
+
+TEST(MemcacheMultiGetTest, consistent_hash_sharding) {
+    const int N = 4;
+    std::vector<butil::EndPoint> servers;
+    std::vector<brpc::SocketId> ids;
+    brpc::policy::ConsistentHashingLoadBalancer chlb(
+        brpc::policy::MurmurHash32);
+    for (int i = 0; i < N; ++i) {
+        butil::EndPoint point(butil::my_ip(), 11311 + i);
+        brpc::SocketOptions options;
+        options.remote_side = point;
+        brpc::ServerId id(0);
+        ASSERT_EQ(0, brpc::Socket::Create(options, &id.id));
+        ASSERT_TRUE(chlb.AddServer(id));
+        servers.push_back(point);
+        ids.push_back(id.id);
+    }
+    butil::intrusive_ptr<brpc::MemcacheConsistentHashSharding> sharding(
+        new brpc::MemcacheConsistentHashSharding(
+            servers, brpc::policy::MurmurHash32));
+
+    // Keys are got from the servers that a c_murmurhash channel sets them
+    // to, with request_code being MurmurHash32 of the keys.
+    std::vector<std::string> keys;
+    std::vector<int> shards;
+    for (int i = 0; i < 100; ++i) {
+        keys.push_back(butil::string_printf("key_%d", i));
+        shards.push_back(sharding->GetShard(keys.back()));
+        brpc::SocketUniquePtr ptr;
+        const brpc::LoadBalancer::SelectIn in = {
+            0, true, brpc::policy::MurmurHash32(keys[i].data(), keys[i].size()),
+            NULL };
+        brpc::LoadBalancer::SelectOut out(&ptr);
+        ASSERT_EQ(0, chlb.SelectServer(in, &out));
+        ASSERT_EQ(servers[shards[i]], ptr->remote_side()) << keys[i];
+    }
+
+    brpc::MemcacheRequest request;
+    ASSERT_TRUE(request.MultiGet(keys));
+    brpc::MemcacheResponse response;
+    for (int i = 0; i < N; ++i) {
+        brpc::MemcacheMultiGetMapper mapper(i, sharding.get());
+        brpc::SubCall sub = mapper.Map(i, NULL, &request, &response);
+        size_t expected_size = 0;
+        for (size_t j = 0; j < keys.size(); ++j) {
+            if (shards[j] == i) {
+                expected_size += sizeof(brpc::policy::MemcacheRequestHeader) +
+                    keys[j].size();
+            }
+        }
+        if (expected_size == 0) {
+            ASSERT_TRUE(sub.is_skip());
+            continue;
+        }
+        ASSERT_FALSE(sub.is_bad());
+        ASSERT_FALSE(sub.is_skip());
+        // GETKQ of the keys in this shard followed by a NOOP.
+        const brpc::MemcacheRequest* sub_request =
+            static_cast<const brpc::MemcacheRequest*>(sub.request);
+        ASSERT_EQ(expected_size + sizeof(brpc::policy::MemcacheRequestHeader),
+                  sub_request->raw_buffer().size());
+        delete sub.request;
+        delete sub.response;
+    }
+    for (int i = 0; i < N; ++i) {
+        brpc::Socket::SetFailed(ids[i]);
+    }
+}
+} //namespace
+
+#ifdef BAIDU_INTERNAL
+
 namespace {
 static pthread_once_t download_memcached_once = PTHREAD_ONCE_INIT;
 
@@ -164,6 +369,38 @@ TEST_F(MemcacheTest, version) {
     ASSERT_TRUE(response.PopVersion(&version)) << response.LastError();
     std::cout << "version=" << version << std::endl;
 }
+
+TEST_F(MemcacheTest, multi_get) {
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_MEMCACHE;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("0.0.0.0:11211", &options));
+    brpc::MemcacheRequest request;
+    brpc::MemcacheResponse response;
+    brpc::Controller cntl;
+    ASSERT_TRUE(request.Set("k1", "v1", 0xdeadbeef, 10, 0));
+    ASSERT_TRUE(request.Set("k3", "v3", 0, 10, 0));
+    std::vector<std::string> keys;
+    keys.push_back("k1");
+    keys.push_back("k2");
+    keys.push_back("k3");
+    ASSERT_TRUE(request.MultiGet(keys));
+    ASSERT_TRUE(request.Get("k3"));
+    channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    ASSERT_TRUE(response.PopSet(NULL));
+    ASSERT_TRUE(response.PopSet(NULL));
+    brpc::MemcacheHitMap hits;
+    ASSERT_TRUE(response.PopMultiGet(&hits)) << response.LastError();
+    ASSERT_EQ(2u, hits.size());
+    ASSERT_EQ("v1", hits["k1"].value.to_string());
+    ASSERT_EQ(0xdeadbeef, hits["k1"].flags);
+    ASSERT_EQ("v3", hits["k3"].value.to_string());
+    ASSERT_TRUE(hits.seek("k2") == NULL);
+    std::string value;
+    ASSERT_TRUE(response.PopGet(&value, NULL, NULL));
+    ASSERT_EQ("v3", value);
+}
 } //namespace
 
 #endif // BAIDU_INTERNAL
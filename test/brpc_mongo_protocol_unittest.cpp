@@ -11,6 +11,9 @@
 #include <google/protobuf/descriptor.h>
 #include "butil/time.h"
 #include "butil/macros.h"
+#include "butil/crc32c.h"
+#include "butil/fd_guard.h"
+#include "bthread/bthread.h"
 #include "brpc/socket.h"
 #include "brpc/acceptor.h"
 #include "brpc/server.h"
@@ -19,6 +22,8 @@
 #include "brpc/controller.h"
 #include "brpc/mongo_head.h"
 #include "brpc/mongo_service_adaptor.h"
+#include "brpc/mongo_message.h"
+#include "brpc/channel.h"
 #include "brpc/policy/mongo.pb.h"
 
 int main(int argc, char* argv[]) {
@@ -216,4 +221,173 @@ TEST_F(MongoTest, complete_flow) {
     ASSERT_FALSE(cntl.Failed());
     ASSERT_STREQ(EXP_RESPONSE.c_str(), msg_buf);
 }
+
+// A minimal BSON document: {"k": <value>}
+static butil::IOBuf MakeDocument(int32_t value) {
+    butil::IOBuf doc;
+    const int32_t size = 4 + 1 + 2 + 4 + 1;
+    doc.append(&size, sizeof(size));
+    doc.push_back(0x10);  // int32
+    doc.append("k", 2);
+    doc.append(&value, sizeof(value));
+    doc.push_back(0);
+    return doc;
+}
+
+static int32_t GetDocumentValue(const butil::IOBuf& doc) {
+    int32_t value = -1;
+    doc.copy_to(&value, sizeof(value), 7);
+    return value;
+}
+
+TEST(MongoMessageTest, sections) {
+    brpc::MongoMessage msg;
+    butil::IOBuf body;
+    ASSERT_FALSE(msg.GetBody(&body));
+    butil::IOBuf docs[2] = { MakeDocument(1), MakeDocument(2) };
+    msg.AppendDocumentSequence("documents", docs, 2);
+    ASSERT_FALSE(msg.GetBody(&body));
+    msg.AppendBody(MakeDocument(3));
+    ASSERT_EQ(1 + (4 + 10 + 2 * 12) + 1 + 12, msg.ByteSize() - 4);
+    ASSERT_TRUE(msg.GetBody(&body));
+    ASSERT_EQ(MakeDocument(3), body);
+    ASSERT_EQ(3, GetDocumentValue(body));
+
+    // Truncated sections.
+    msg.sections.pop_back(1);
+    ASSERT_FALSE(msg.GetBody(&body));
+}
+
+static bool ReadFully(int fd, void* buf, size_t n) {
+    for (size_t nr = 0; nr < n; ) {
+        const ssize_t rc = read(fd, (char*)buf + nr, n - nr);
+        if (rc <= 0) {
+            return false;
+        }
+        nr += rc;
+    }
+    return true;
+}
+
+struct FakeMongod {
+    int listen_fd;
+    int max_requests;
+};
+
+// Accept one connection and respond `max_requests' OP_MSG requests on it in
+// order with the same sections, checksums are verified and added if
+// requested.
+static void* RunFakeMongod(void* arg) {
+    const FakeMongod* mongod = (const FakeMongod*)arg;
+    butil::fd_guard fd(accept(mongod->listen_fd, NULL, NULL));
+    EXPECT_GE(fd, 0);
+    brpc::mongo_head_t header;
+    for (int i = 0; i < mongod->max_requests &&
+             ReadFully(fd, &header, sizeof(header)); ++i) {
+        EXPECT_EQ(brpc::MONGO_OPCODE_OP_MSG, header.op_code);
+        std::string body(header.message_length - sizeof(header), '\0');
+        EXPECT_TRUE(ReadFully(fd, &body[0], body.size()));
+        uint32_t flag_bits = 0;
+        memcpy(&flag_bits, body.data(), sizeof(flag_bits));
+        const bool has_checksum = (flag_bits & brpc::MONGO_MSG_CHECKSUM_PRESENT);
+        if (has_checksum) {
+            uint32_t checksum = 0;
+            memcpy(&checksum, body.data() + body.size() - 4, 4);
+            body.resize(body.size() - 4);
+            uint32_t crc = butil::crc32c::Value((const char*)&header, sizeof(header));
+            crc = butil::crc32c::Extend(crc, body.data(), body.size());
+            EXPECT_EQ(crc, checksum);
+        }
+        brpc::mongo_head_t res_header = {
+            (int32_t)(sizeof(header) + body.size() + (has_checksum ? 4 : 0)),
+            header.request_id + 1, header.request_id, brpc::MONGO_OPCODE_OP_MSG };
+        butil::IOBuf res;
+        res.append(&res_header, sizeof(res_header));
+        res.append(body);
+        if (has_checksum) {
+            const uint32_t checksum = butil::crc32c::Value(res);
+            res.append(&checksum, sizeof(checksum));
+        }
+        while (!res.empty()) {
+            if (res.cut_into_file_descriptor(fd) < 0) {
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+struct CallArgs {
+    brpc::Channel* channel;
+    int value;
+    bool checksum;
+};
+
+static void* CallFakeMongod(void* void_args) {
+    CallArgs* args = (CallArgs*)void_args;
+    brpc::MongoMessage request;
+    brpc::MongoMessage response;
+    brpc::Controller cntl;
+    if (args->checksum) {
+        request.flag_bits = brpc::MONGO_MSG_CHECKSUM_PRESENT;
+    }
+    request.AppendBody(MakeDocument(args->value));
+    args->channel->CallMethod(NULL, &cntl, &request, &response, NULL);
+    EXPECT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    EXPECT_EQ(request.flag_bits, response.flag_bits);
+    butil::IOBuf body;
+    EXPECT_TRUE(response.GetBody(&body));
+    EXPECT_EQ(args->value, GetDocumentValue(body));
+    return NULL;
+}
+
+TEST(MongoClientTest, pipelined_calls) {
+    butil::fd_guard listen_fd(butil::tcp_listen(
+        butil::EndPoint(butil::IP_ANY, 0), true));
+    ASSERT_GE(listen_fd, 0);
+    butil::EndPoint server_ep;
+    ASSERT_EQ(0, butil::get_local_side(listen_fd, &server_ep));
+    const int N = 32;
+    FakeMongod mongod = { listen_fd, N };
+    pthread_t server_tid;
+    ASSERT_EQ(0, pthread_create(&server_tid, NULL, RunFakeMongod, &mongod));
+
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_MONGO;
+    options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(butil::EndPoint(butil::my_ip(), server_ep.port),
+                              &options));
+
+    // Bad requests.
+    brpc::MongoMessage request;
+    brpc::MongoMessage response;
+    brpc::Controller cntl;
+    channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+    ASSERT_EQ(brpc::EREQUEST, cntl.ErrorCode());
+    request.AppendBody(MakeDocument(0));
+    request.flag_bits = brpc::MONGO_MSG_MORE_TO_COME;
+    cntl.Reset();
+    channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+    ASSERT_EQ(brpc::EREQUEST, cntl.ErrorCode());
+    request.flag_bits = brpc::MONGO_MSG_EXHAUST_ALLOWED;
+    cntl.Reset();
+    channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+    ASSERT_EQ(brpc::EREQUEST, cntl.ErrorCode());
+
+    // Concurrent calls share the only connection.
+    CallArgs args[N];
+    bthread_t tids[N];
+    for (int i = 0; i < N; ++i) {
+        args[i].channel = &channel;
+        args[i].value = i;
+        args[i].checksum = (i % 2 == 0);
+        ASSERT_EQ(0, bthread_start_background(&tids[i], NULL, CallFakeMongod,
+                                              &args[i]));
+    }
+    for (int i = 0; i < N; ++i) {
+        bthread_join(tids[i], NULL);
+    }
+    pthread_join(server_tid, NULL);
+}
 } //namespace
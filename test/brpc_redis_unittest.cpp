@@ -1,17 +1,22 @@
 // Copyright (c) 2014 Baidu, Inc.
 // Date: Thu Jun 11 14:30:07 CST 2015
 
-#ifdef BAIDU_INTERNAL
-
 #include <iostream>
 #include "butil/time.h"
+#include "butil/string_printf.h"
 #include "butil/logging.h"
 #include <brpc/redis.h>
 #include <brpc/channel.h>
+#include <brpc/server.h>
+#include <brpc/redis_cluster_channel.h>
+#include <map>
+#include <strings.h>
+#include "butil/synchronization/lock.h"
 #include <gtest/gtest.h>
 
 namespace brpc {
 DECLARE_int32(idle_timeout_second);
+DECLARE_int32(redis_reply_min_referenced_size);
 }
 
 int main(int argc, char* argv[]) {
@@ -21,6 +26,7 @@ int main(int argc, char* argv[]) {
 }
 
 namespace {
+#ifdef BAIDU_INTERNAL
 static pthread_once_t download_redis_server_once = PTHREAD_ONCE_INIT;
 
 static pid_t redis_pid = -1; 
@@ -297,5 +303,536 @@ TEST_F(RedisTest, by_components) {
     response2.MergeFrom(response);
     AssertResponseEqual(response2, response, 2);
 }
-} //namespace
 #endif // BAIDU_INTERNAL
+
+TEST(RedisReplyTest, set_and_serialize) {
+    butil::Arena arena;
+    brpc::RedisReply r;
+    ASSERT_TRUE(r.SetArray(6, &arena));
+    r[0].SetString("short", &arena);
+    r[1].SetString("a string longer than sso", &arena);
+    r[2].SetStatus("OK", &arena);
+    r[3].SetError("ERR wrong", &arena);
+    r[4].SetInteger(-42);
+    r[5].SetNil();
+    butil::IOBufAppender appender;
+    r.SerializeTo(&appender);
+    butil::IOBuf buf;
+    appender.move_to(buf);
+    ASSERT_EQ("*6\r\n$5\r\nshort\r\n$24\r\na string longer than sso\r\n"
+              "+OK\r\n-ERR wrong\r\n:-42\r\n$-1\r\n", buf.to_string());
+
+    butil::Arena arena2;
+    brpc::RedisReply r2;
+    ASSERT_TRUE(r2.ConsumePartialIOBuf(buf, &arena2));
+    ASSERT_TRUE(buf.empty());
+    ASSERT_EQ(6UL, r2.size());
+    ASSERT_EQ("a string longer than sso", r2[1].data());
+    ASSERT_STREQ("ERR wrong", r2[3].error_message());
+    ASSERT_EQ(-42, r2[4].integer());
+    ASSERT_TRUE(r2[5].is_nil());
+}
+
+TEST(RedisReplyTest, index_non_array) {
+    butil::Arena arena;
+    brpc::RedisReply r;
+    r.SetInteger(1);
+    const brpc::RedisReply& cr = r;
+    ASSERT_TRUE(cr[0].is_nil());
+    ASSERT_TRUE(r.SetArray(1, &arena));
+    ASSERT_TRUE(cr[1].is_nil());
+    // Modifying sub replies does not affect the nil returned above.
+    r[0].SetStatus("a status longer than sso", &arena);
+    ASSERT_STREQ("a status longer than sso", cr[0].c_str());
+    ASSERT_TRUE(cr[1].is_nil());
+}
+
+TEST(RedisReplyTest, status_and_error_span_one_line) {
+    butil::Arena arena;
+    brpc::RedisReply r;
+    ASSERT_TRUE(r.SetArray(2, &arena));
+    r[0].SetStatus("OK\r\n+injected", &arena);
+    r[1].SetError("ERR unknown command 'x\r\n:1'", &arena);
+    butil::IOBufAppender appender;
+    r.SerializeTo(&appender);
+    ASSERT_EQ("*2\r\n+OK  +injected\r\n-ERR unknown command 'x  :1'\r\n",
+              appender.buf().to_string());
+}
+
+TEST(RedisReplyTest, consume_partial_command) {
+    struct {
+        const char* data;
+        brpc::ParseError expected;
+    } cases[] = {
+        { "*100000000\r\n", brpc::PARSE_ERROR_TOO_BIG_DATA },
+        { "*1\r\n$100\r\n", brpc::PARSE_ERROR_TOO_BIG_DATA },
+        { "*1\r\n+01234567890123456789", brpc::PARSE_ERROR_TOO_BIG_DATA },
+        { "*1\r\n*1\r\n$1\r\na\r\n", brpc::PARSE_ERROR_ABSOLUTELY_WRONG },
+        { "*1\r\n:abc\r\n", brpc::PARSE_ERROR_ABSOLUTELY_WRONG },
+        { "*1\r\n:0123456789012345678901234567890123456789",
+          brpc::PARSE_ERROR_ABSOLUTELY_WRONG },
+        { "*1\r\n!\r\n", brpc::PARSE_ERROR_ABSOLUTELY_WRONG },
+        { "*2\r\n$1\r\na\r\n$1\r\n", brpc::PARSE_ERROR_NOT_ENOUGH_DATA },
+        { "*2\r\n$1\r\na\r\n$1\r\nb\r\n", brpc::PARSE_OK },
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(cases); ++i) {
+        butil::Arena arena;
+        brpc::RedisReply r;
+        butil::IOBuf buf;
+        buf.append(cases[i].data);
+        ASSERT_EQ(cases[i].expected,
+                  r.ConsumePartialCommand(buf, &arena, 1024, 10)) << i;
+    }
+    // Continue parsing a partial command.
+    butil::Arena arena;
+    brpc::RedisReply r;
+    butil::IOBuf buf;
+    buf.append("*2\r\n$1\r\na\r\n$10");
+    ASSERT_EQ(brpc::PARSE_ERROR_NOT_ENOUGH_DATA,
+              r.ConsumePartialCommand(buf, &arena, 1024, 10));
+    buf.append("\r\n0123456789\r\n");
+    ASSERT_EQ(brpc::PARSE_OK, r.ConsumePartialCommand(buf, &arena, 1024, 10));
+    ASSERT_TRUE(buf.empty());
+    ASSERT_EQ(2UL, r.size());
+    ASSERT_EQ("0123456789", r[1].data());
+}
+
+TEST(RedisReplyTest, referenced_string) {
+    const int32_t saved = brpc::FLAGS_redis_reply_min_referenced_size;
+    brpc::FLAGS_redis_reply_min_referenced_size = 1024;
+    std::string value;
+    for (int i = 0; value.size() < 100000; ++i) {
+        butil::string_appendf(&value, "%d,", i);
+    }
+    // Spread the value over multiple blocks.
+    butil::IOBuf buf;
+    buf.append(butil::string_printf("*3\r\n$%lu\r\n", value.size()));
+    for (size_t i = 0; i < value.size(); i += 3000) {
+        buf.append(value.data() + i, std::min((size_t)3000, value.size() - i));
+    }
+    buf.append("\r\n$2000\r\n");
+    buf.append(std::string(2000, 'x'));
+    buf.append("\r\n$3\r\nabc\r\n");
+    const std::string serialized = buf.to_string();
+
+    butil::Arena arena;
+    brpc::RedisReply r;
+    ASSERT_TRUE(r.ConsumePartialIOBuf(buf, &arena));
+    ASSERT_TRUE(buf.empty());
+    ASSERT_EQ(3UL, r.size());
+    butil::IOBuf out;
+    r[0].AppendDataTo(&out);
+    ASSERT_EQ(value, out.to_string());
+    ASSERT_EQ(value, r[0].data());
+    ASSERT_EQ(value, r[0].c_str());
+    ASSERT_EQ(std::string(2000, 'x'), r[1].data());
+    ASSERT_STREQ("abc", r[2].c_str());
+
+    // Copied replies share the referenced blocks.
+    butil::Arena arena2;
+    brpc::RedisReply r2;
+    r2.CopyFromDifferentArena(r, &arena2);
+    arena.clear();
+    ASSERT_EQ(3UL, r2.size());
+    ASSERT_EQ(value, r2[0].data());
+    butil::IOBufAppender appender;
+    r2.SerializeTo(&appender);
+    ASSERT_EQ(serialized, appender.buf().to_string());
+    brpc::FLAGS_redis_reply_min_referenced_size = saved;
+}
+
+class SetCommandHandler : public brpc::RedisCommandHandler {
+public:
+    void Run(const std::vector<butil::StringPiece>& args,
+             brpc::RedisReply* output, butil::Arena* arena) {
+        if (args.size() != 3) {
+            output->SetError("ERR wrong number of arguments", arena);
+            return;
+        }
+        BAIDU_SCOPED_LOCK(_mutex);
+        _m[args[1].as_string()] = args[2].as_string();
+        output->SetStatus("OK", arena);
+    }
+    std::string Get(const std::string& key) {
+        BAIDU_SCOPED_LOCK(_mutex);
+        return _m[key];
+    }
+private:
+    butil::Mutex _mutex;
+    std::map<std::string, std::string> _m;
+};
+
+class GetCommandHandler : public brpc::RedisCommandHandler {
+public:
+    explicit GetCommandHandler(SetCommandHandler* set) : _set(set) {}
+    void Run(const std::vector<butil::StringPiece>& args,
+             brpc::RedisReply* output, butil::Arena* arena) {
+        if (args.size() != 2) {
+            output->SetError("ERR wrong number of arguments", arena);
+            return;
+        }
+        const std::string value = _set->Get(args[1].as_string());
+        if (value.empty()) {
+            output->SetNil();
+        } else {
+            output->SetString(value, arena);
+        }
+    }
+private:
+    SetCommandHandler* _set;
+};
+
+TEST(RedisServerTest, pipelined_commands) {
+    SetCommandHandler set_handler;
+    GetCommandHandler get_handler(&set_handler);
+    brpc::RedisService* service = new brpc::RedisService;
+    ASSERT_TRUE(service->AddCommandHandler("set", &set_handler));
+    ASSERT_TRUE(service->AddCommandHandler("get", &get_handler));
+    ASSERT_FALSE(service->AddCommandHandler("GET", &get_handler));
+    brpc::Server server;
+    brpc::ServerOptions server_options;
+    server_options.redis_service = service;
+    ASSERT_EQ(0, server.Start(8976, &server_options));
+
+    brpc::ChannelOptions options;
+    options.protocol = brpc::PROTOCOL_REDIS;
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8976", &options));
+    brpc::RedisRequest request;
+    brpc::RedisResponse response;
+    brpc::Controller cntl;
+    ASSERT_TRUE(request.AddCommand("SET k1 v1"));
+    ASSERT_TRUE(request.AddCommand("set k2 %s", "a value longer than sso"));
+    ASSERT_TRUE(request.AddCommand("get k1"));
+    ASSERT_TRUE(request.AddCommand("get k2"));
+    ASSERT_TRUE(request.AddCommand("get k3"));
+    ASSERT_TRUE(request.AddCommand("set k3"));
+    ASSERT_TRUE(request.AddCommand("incr k1"));
+    // CRLF in the unknown command can't break the reply.
+    const butil::StringPiece bad_command[] = { "x\r\n+OK" };
+    ASSERT_TRUE(request.AddCommandByComponents(bad_command, 1));
+    ASSERT_TRUE(request.AddCommand("get k1"));
+    channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    ASSERT_EQ(9, response.reply_size());
+    ASSERT_STREQ("OK", response.reply(0).c_str());
+    ASSERT_STREQ("OK", response.reply(1).c_str());
+    ASSERT_STREQ("v1", response.reply(2).c_str());
+    ASSERT_STREQ("a value longer than sso", response.reply(3).c_str());
+    ASSERT_TRUE(response.reply(4).is_nil());
+    ASSERT_STREQ("ERR wrong number of arguments",
+                 response.reply(5).error_message());
+    ASSERT_STREQ("ERR unknown command 'incr'",
+                 response.reply(6).error_message());
+    ASSERT_STREQ("ERR unknown command 'x  +OK'",
+                 response.reply(7).error_message());
+    ASSERT_STREQ("v1", response.reply(8).c_str());
+    server.Stop(0);
+    server.Join();
+}
+
+TEST(RedisClusterTest, key_slot) {
+    // Examples in the redis cluster specification.
+    ASSERT_EQ(12739, brpc::RedisClusterChannel::GetKeySlot("123456789"));
+    ASSERT_EQ(brpc::RedisClusterChannel::GetKeySlot("user1000"),
+              brpc::RedisClusterChannel::GetKeySlot("{user1000}.following"));
+    ASSERT_EQ(brpc::RedisClusterChannel::GetKeySlot("{user1000}.following"),
+              brpc::RedisClusterChannel::GetKeySlot("{user1000}.followers"));
+    ASSERT_EQ(brpc::RedisClusterChannel::GetKeySlot("{bar"),
+              brpc::RedisClusterChannel::GetKeySlot("foo{{bar}}zap"));
+    ASSERT_NE(brpc::RedisClusterChannel::GetKeySlot("bar"),
+              brpc::RedisClusterChannel::GetKeySlot("foo{}{bar}"));
+}
+
+// Slots and migrations shared by nodes of FakeClusterNode.
+struct FakeCluster {
+    FakeCluster()
+        : migrating_slot(-1), migrating_to(-1), bouncing_slot(-1)
+        , delay_us(0), nmoved(0), nasking(0) {
+        // Node 0 serves [0, 8192), node 1 serves the rest.
+        owners.assign(brpc::RedisClusterChannel::SLOT_COUNT, 0);
+        std::fill(owners.begin() + 8192, owners.end(), 1);
+        ports[0] = 8977;
+        ports[1] = 8978;
+    }
+    butil::Mutex mutex;
+    std::vector<int> owners;
+    int ports[2];
+    // Keys of `migrating_slot' not existing in the owner are redirected to
+    // node `migrating_to' with ASK.
+    int migrating_slot;
+    int migrating_to;
+    // Keys of `bouncing_slot' are always MOVED to the other node.
+    int bouncing_slot;
+    // Every command is delayed for so many microseconds.
+    int64_t delay_us;
+    int nmoved;
+    int nasking;
+};
+
+static bool CommandIs(const butil::StringPiece& cmd, const char* name) {
+    return cmd.size() == strlen(name) &&
+        strncasecmp(cmd.data(), name, cmd.size()) == 0;
+}
+
+// A node of redis cluster supporting GET, SET, CLUSTER SLOTS and ASKING.
+class FakeClusterNode : public brpc::RedisCommandHandler {
+public:
+    FakeClusterNode(FakeCluster* cluster, int index)
+        : _cluster(cluster), _index(index) {}
+
+    void Run(const std::vector<butil::StringPiece>& args,
+             brpc::RedisReply* output, butil::Arena* arena) {
+        int64_t delay_us = 0;
+        {
+            BAIDU_SCOPED_LOCK(_cluster->mutex);
+            delay_us = _cluster->delay_us;
+        }
+        if (delay_us > 0) {
+            bthread_usleep(delay_us);
+        }
+        BAIDU_SCOPED_LOCK(_cluster->mutex);
+        if (CommandIs(args[0], "cluster")) {
+            DescribeSlots(output, arena);
+            return;
+        }
+        if (CommandIs(args[0], "asking")) {
+            ++_cluster->nasking;
+            output->SetStatus("OK", arena);
+            return;
+        }
+        if (args.size() < 2) {
+            output->SetError("ERR wrong number of arguments", arena);
+            return;
+        }
+        const std::string key = args[1].as_string();
+        const int slot = brpc::RedisClusterChannel::GetKeySlot(key);
+        const int owner = _cluster->owners[slot];
+        char buf[64];
+        if (slot == _cluster->bouncing_slot) {
+            ++_cluster->nmoved;
+            snprintf(buf, sizeof(buf), "MOVED %d 127.0.0.1:%d",
+                     slot, _cluster->ports[1 - _index]);
+            output->SetError(buf, arena);
+            return;
+        }
+        if (owner != _index) {
+            if (slot != _cluster->migrating_slot ||
+                _cluster->migrating_to != _index) {
+                ++_cluster->nmoved;
+                snprintf(buf, sizeof(buf), "MOVED %d 127.0.0.1:%d",
+                         slot, _cluster->ports[owner]);
+                output->SetError(buf, arena);
+                return;
+            }
+        } else if (slot == _cluster->migrating_slot && !_data.count(key)) {
+            snprintf(buf, sizeof(buf), "ASK %d 127.0.0.1:%d", slot,
+                     _cluster->ports[_cluster->migrating_to]);
+            output->SetError(buf, arena);
+            return;
+        }
+        if (CommandIs(args[0], "set") && args.size() == 3) {
+            _data[key] = args[2].as_string();
+            output->SetStatus("OK", arena);
+        } else if (CommandIs(args[0], "get")) {
+            std::map<std::string, std::string>::const_iterator
+                it = _data.find(key);
+            if (it == _data.end()) {
+                output->SetNil();
+            } else {
+                output->SetString(it->second, arena);
+            }
+        } else {
+            output->SetError("ERR unsupported", arena);
+        }
+    }
+
+    size_t size() {
+        BAIDU_SCOPED_LOCK(_cluster->mutex);
+        return _data.size();
+    }
+
+private:
+    void DescribeSlots(brpc::RedisReply* output, butil::Arena* arena) {
+        std::vector<std::pair<int, int> > ranges;
+        for (size_t i = 0; i < _cluster->owners.size(); ++i) {
+            if (i == 0 || _cluster->owners[i] != _cluster->owners[i - 1]) {
+                ranges.push_back(std::make_pair((int)i, (int)i));
+            } else {
+                ranges.back().second = i;
+            }
+        }
+        output->SetArray(ranges.size(), arena);
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            brpc::RedisReply& r = (*output)[i];
+            r.SetArray(3, arena);
+            r[0].SetInteger(ranges[i].first);
+            r[1].SetInteger(ranges[i].second);
+            r[2].SetArray(2, arena);
+            r[2][0].SetString("127.0.0.1", arena);
+            r[2][1].SetInteger(
+                _cluster->ports[_cluster->owners[ranges[i].first]]);
+        }
+    }
+
+    FakeCluster* _cluster;
+    int _index;
+    std::map<std::string, std::string> _data;
+};
+
+TEST(RedisClusterTest, slot_routing_and_redirections) {
+    FakeCluster cluster;
+    FakeClusterNode node0(&cluster, 0);
+    FakeClusterNode node1(&cluster, 1);
+    FakeClusterNode* nodes[2] = { &node0, &node1 };
+    brpc::Server servers[2];
+    for (int i = 0; i < 2; ++i) {
+        brpc::RedisService* service = new brpc::RedisService;
+        ASSERT_TRUE(service->AddCommandHandler("get", nodes[i]));
+        ASSERT_TRUE(service->AddCommandHandler("set", nodes[i]));
+        ASSERT_TRUE(service->AddCommandHandler("cluster", nodes[i]));
+        ASSERT_TRUE(service->AddCommandHandler("asking", nodes[i]));
+        brpc::ServerOptions server_options;
+        server_options.redis_service = service;
+        ASSERT_EQ(0, servers[i].Start(cluster.ports[i], &server_options));
+    }
+
+    brpc::RedisClusterChannel channel;
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8977", NULL));
+    ASSERT_EQ(0, channel.CheckHealth());
+
+    // One pipeline is split between the two nodes.
+    const int N = 32;
+    {
+        brpc::RedisRequest request;
+        brpc::RedisResponse response;
+        brpc::Controller cntl;
+        for (int i = 0; i < N; ++i) {
+            ASSERT_TRUE(request.AddCommand("set key%d value%d", i, i));
+        }
+        for (int i = 0; i < N; ++i) {
+            ASSERT_TRUE(request.AddCommand("get key%d", i));
+        }
+        channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(2 * N, response.reply_size());
+        for (int i = 0; i < N; ++i) {
+            ASSERT_STREQ("OK", response.reply(i).c_str());
+            ASSERT_EQ(butil::string_printf("value%d", i),
+                      response.reply(N + i).c_str());
+        }
+        ASSERT_EQ((size_t)N, node0.size() + node1.size());
+        ASSERT_LT(0UL, node0.size());
+        ASSERT_LT(0UL, node1.size());
+        ASSERT_EQ(0, cluster.nmoved);
+    }
+
+    // The slot of "foo" is moved to the other node.
+    const int foo_slot = brpc::RedisClusterChannel::GetKeySlot("foo");
+    {
+        BAIDU_SCOPED_LOCK(cluster.mutex);
+        cluster.owners[foo_slot] = 1 - cluster.owners[foo_slot];
+    }
+    for (int i = 0; i < 2; ++i) {
+        brpc::RedisRequest request;
+        brpc::RedisResponse response;
+        brpc::Controller cntl;
+        ASSERT_TRUE(request.AddCommand("set foo bar"));
+        ASSERT_TRUE(request.AddCommand("get foo"));
+        channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(2, response.reply_size());
+        ASSERT_STREQ("OK", response.reply(0).c_str());
+        ASSERT_STREQ("bar", response.reply(1).c_str());
+        // Only the first call is redirected.
+        ASSERT_EQ(1, cluster.nmoved);
+    }
+
+    // The slot of "{tag}" is being migrated, new keys are created in the
+    // importing node with ASKING.
+    const int tag_slot = brpc::RedisClusterChannel::GetKeySlot("{tag}");
+    const int importing = 1 - cluster.owners[tag_slot];
+    const size_t old_size = nodes[importing]->size();
+    {
+        BAIDU_SCOPED_LOCK(cluster.mutex);
+        cluster.migrating_slot = tag_slot;
+        cluster.migrating_to = importing;
+    }
+    {
+        brpc::RedisRequest request;
+        brpc::RedisResponse response;
+        brpc::Controller cntl;
+        ASSERT_TRUE(request.AddCommand("set {tag}new v"));
+        channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_STREQ("OK", response.reply(0).c_str());
+        ASSERT_EQ(1, cluster.nasking);
+        ASSERT_EQ(old_size + 1, nodes[importing]->size());
+        ASSERT_EQ(1, cluster.nmoved);
+    }
+
+    // Asynchronous call.
+    {
+        brpc::RedisRequest request;
+        brpc::RedisResponse response;
+        brpc::Controller cntl;
+        ASSERT_TRUE(request.AddCommand("get key0"));
+        ASSERT_TRUE(request.AddCommand("get key1"));
+        channel.CallMethod(NULL, &cntl, &request, &response,
+                           brpc::DoNothing());
+        brpc::Join(cntl.call_id());
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_LT(0, cntl.latency_us());
+        ASSERT_EQ(2, response.reply_size());
+        ASSERT_STREQ("value0", response.reply(0).c_str());
+        ASSERT_STREQ("value1", response.reply(1).c_str());
+    }
+
+    // Redirections share the timeout of the whole call.
+    {
+        BAIDU_SCOPED_LOCK(cluster.mutex);
+        cluster.bouncing_slot = brpc::RedisClusterChannel::GetKeySlot("bounce");
+        cluster.delay_us = 60000;
+    }
+    {
+        brpc::RedisRequest request;
+        brpc::RedisResponse response;
+        brpc::Controller cntl;
+        cntl.set_timeout_ms(100);
+        ASSERT_TRUE(request.AddCommand("get bounce"));
+        const int64_t start_us = butil::gettimeofday_us();
+        channel.CallMethod(NULL, &cntl, &request, &response, NULL);
+        ASSERT_EQ(brpc::ERPCTIMEDOUT, cntl.ErrorCode()) << cntl.ErrorText();
+        ASSERT_LT(butil::gettimeofday_us() - start_us, 200000);
+    }
+    {
+        BAIDU_SCOPED_LOCK(cluster.mutex);
+        cluster.bouncing_slot = -1;
+        cluster.delay_us = 500000;
+    }
+
+    // Canceling an asynchronous call stops the commands in-flight.
+    {
+        brpc::RedisRequest request;
+        brpc::RedisResponse response;
+        brpc::Controller cntl;
+        ASSERT_TRUE(request.AddCommand("get key0"));
+        const int64_t start_us = butil::gettimeofday_us();
+        channel.CallMethod(NULL, &cntl, &request, &response,
+                           brpc::DoNothing());
+        bthread_usleep(50000);
+        brpc::StartCancel(cntl.call_id());
+        brpc::Join(cntl.call_id());
+        ASSERT_EQ(ECANCELED, cntl.ErrorCode()) << cntl.ErrorText();
+        ASSERT_LT(butil::gettimeofday_us() - start_us, 400000);
+    }
+    {
+        BAIDU_SCOPED_LOCK(cluster.mutex);
+        cluster.delay_us = 0;
+    }
+    for (int i = 0; i < 2; ++i) {
+        servers[i].Stop(0);
+        servers[i].Join();
+    }
+}
+} //namespace
@@ -49,6 +49,9 @@ int main(int argc, char* argv[]) {
 namespace brpc {
 DECLARE_bool(enable_threads_service);
 DECLARE_bool(enable_dir_service);
+namespace policy {
+DECLARE_bool(baidu_protocol_payload_checksum);
+}
 }
 
 namespace {
@@ -1148,6 +1151,36 @@ TEST_F(ServerTest, serving_requests) {
     ASSERT_EQ(0, server.Join());
 }
 
+TEST_F(ServerTest, baidu_std_payload_checksum) {
+    EchoServiceImpl echo_svc;
+    brpc::Server server;
+    ASSERT_EQ(0, server.AddService(&echo_svc,
+                                   brpc::SERVER_DOESNT_OWN_SERVICE));
+    butil::EndPoint ep;
+    ASSERT_EQ(0, str2endpoint("127.0.0.1:8613", &ep));
+    ASSERT_EQ(0, server.Start(ep, NULL));
+    brpc::Channel channel;
+    ASSERT_EQ(0, channel.Init(ep, NULL));
+    test::EchoService_Stub stub(&channel);
+
+    brpc::policy::FLAGS_baidu_protocol_payload_checksum = true;
+    for (int i = 0; i < 3; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message(EXP_REQUEST);
+        // Payload spanning multiple blocks.
+        cntl.request_attachment().append(std::string(i * 100000, 'a'));
+        stub.Echo(&cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(EXP_RESPONSE, res.message());
+    }
+    brpc::policy::FLAGS_baidu_protocol_payload_checksum = false;
+    ASSERT_EQ(3, echo_svc.count.load());
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
 TEST_F(ServerTest, create_pid_file) {
     {
         brpc::Server server;
@@ -27,6 +27,10 @@ namespace bthread {
 extern TaskControl* g_task_control;
 }
 
+namespace brpc {
+DECLARE_int64(socket_zerocopy_min_bytes);
+}
+
 void EchoProcessHuluRequest(brpc::InputMessageBase* msg_base);
 
 int main(int argc, char* argv[]) {
@@ -900,3 +904,77 @@ TEST_F(SocketTest, multi_threaded_write_perf) {
     ASSERT_EQ((brpc::Socket*)NULL, global_sock);
     close(fds[0]);
 }
+
+static butil::atomic<int> g_nzerocopy_released(0);
+
+static void ReleaseZeroCopyData(void* data) {
+    free(data);
+    g_nzerocopy_released.fetch_add(1);
+}
+
+static void IgnoreInputEvents(brpc::Socket* s) {
+    // Nothing is sent by the peer, only EPOLLERR of completions comes.
+    int progress = brpc::Socket::PROGRESS_INIT;
+    while (s->MoreReadEvents(&progress));
+}
+
+TEST_F(SocketTest, zerocopy_write_releases_data_after_completions) {
+    GFLAGS_NS::FlagSaver flag_saver;
+    brpc::FLAGS_socket_zerocopy_min_bytes = 1;
+
+    butil::EndPoint point(butil::IP_ANY, 7879);
+    const int listening_fd = tcp_listen(point, false);
+    ASSERT_TRUE(listening_fd > 0);
+    const int client_fd = butil::tcp_connect(
+        butil::EndPoint(butil::my_ip(), point.port), NULL);
+    ASSERT_TRUE(client_fd > 0);
+    const int server_fd = accept(listening_fd, NULL, NULL);
+    ASSERT_TRUE(server_fd > 0);
+    close(listening_fd);
+    butil::make_non_blocking(client_fd);
+
+    brpc::SocketId id;
+    brpc::SocketOptions options;
+    options.fd = client_fd;
+    options.on_edge_triggered_events = IgnoreInputEvents;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+    s->_ssl_state = brpc::SSL_OFF;
+
+    const size_t len = 64 * 1024;
+    char* data = (char*)malloc(len);
+    memset(data, 'z', len);
+    butil::IOBuf src;
+    ASSERT_EQ(0, src.append_user_data(data, len, ReleaseZeroCopyData));
+    ASSERT_EQ(0, s->Write(&src));
+    ASSERT_TRUE(src.empty());
+
+    char buf[4096];
+    size_t nr = 0;
+    while (nr < len) {
+        const ssize_t n = read(server_fd, buf, sizeof(buf));
+        ASSERT_GT(n, 0);
+        nr += n;
+    }
+    if (s->_zerocopy_state < 0) {
+        LOG(WARNING) << "SO_ZEROCOPY is not supported, skip the test";
+    } else {
+        // No more writes on the socket, completions must be reaped by the
+        // dispatcher.
+        const int64_t start_time = butil::gettimeofday_us();
+        while (g_nzerocopy_released.load() == 0) {
+            ASSERT_LT(butil::gettimeofday_us(), start_time + 1000000L)
+                << "Zero-copy data is not released";
+            bthread_usleep(1000);
+        }
+        BAIDU_SCOPED_LOCK(s->_zerocopy_mutex);
+        ASSERT_TRUE(s->_zerocopy_bufs->empty());
+        ASSERT_EQ(0, s->_zerocopy_pinned_bytes);
+        // Reaped by the timer scheduled on EPOLLERR.
+        ASSERT_FALSE(s->_zerocopy_reap_scheduled);
+    }
+    ASSERT_EQ(0, s->SetFailed());
+    s.reset();
+    close(server_fd);
+}
@@ -0,0 +1,257 @@
+// Copyright (c) 2018 Baidu, Inc.
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/time.h"
+#include "butil/string_printf.h"
+#include "butil/sys_byteorder.h"
+#include "bthread/bthread.h"
+#include "brpc/server.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/thrift_message.h"
+#include "brpc/thrift_service.h"
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+const int PORT = 8613;
+
+// Encode a struct in TBinaryProtocol: { 0: string value }, which is the
+// result struct of `string Echo(1: string value)'.
+void EncodeStruct(butil::IOBuf* buf, int16_t id, const std::string& value) {
+    const uint16_t net_id = butil::HostToNet16(id);
+    const uint32_t net_len = butil::HostToNet32(value.size());
+    buf->push_back(11);  // T_STRING
+    buf->append(&net_id, sizeof(net_id));
+    buf->append(&net_len, sizeof(net_len));
+    buf->append(value);
+    buf->push_back(0);   // T_STOP
+}
+
+bool DecodeStruct(const butil::IOBuf& buf, std::string* value) {
+    const size_t header_size = 1 + sizeof(uint16_t) + sizeof(uint32_t);
+    char header[header_size];
+    if (buf.copy_to(header, header_size) != header_size || header[0] != 11) {
+        return false;
+    }
+    uint32_t len = 0;
+    memcpy(&len, header + 1 + sizeof(uint16_t), sizeof(len));
+    len = butil::NetToHost32(len);
+    if (buf.size() != header_size + len + 1) {
+        return false;
+    }
+    value->clear();
+    buf.append_to(value, len, header_size);
+    return true;
+}
+
+class EchoThriftService : public brpc::ThriftService {
+public:
+    void ProcessThriftFramedRequest(const brpc::Server&,
+                                    brpc::Controller* cntl,
+                                    const brpc::ThriftFramedMessage& req,
+                                    brpc::ThriftFramedMessage* res,
+                                    brpc::ThriftClosure* done) {
+        brpc::ClosureGuard done_guard(done);
+        std::string value;
+        if (!DecodeStruct(req.body, &value)) {
+            cntl->SetFailed(brpc::EREQUEST, "Fail to decode args");
+            return;
+        }
+        if (req.method_name == "Echo") {
+            EncodeStruct(&res->body, 0, value);
+        } else if (req.method_name == "SleepEcho") {
+            // Sleep for milliseconds in the value, making responses on the
+            // same connection out of order.
+            bthread_usleep(strtol(value.c_str(), NULL, 10) * 1000L);
+            EncodeStruct(&res->body, 0, value);
+        } else if (req.method_name == "Fail") {
+            cntl->SetFailed(brpc::EINTERNAL, "%s", value.c_str());
+        } else {
+            cntl->SetFailed(brpc::ENOMETHOD, "Unknown method=%s",
+                            req.method_name.c_str());
+        }
+    }
+};
+
+class ThriftTest : public ::testing::Test {
+protected:
+    ThriftTest() {
+        brpc::ServerOptions options;
+        options.thrift_service = new EchoThriftService;
+        EXPECT_EQ(0, _server.Start(PORT, &options));
+        brpc::ChannelOptions chan_options;
+        chan_options.protocol = brpc::PROTOCOL_THRIFT;
+        chan_options.connection_type = brpc::CONNECTION_TYPE_SINGLE;
+        EXPECT_EQ(0, _channel.Init("127.0.0.1", PORT, &chan_options));
+    }
+    ~ThriftTest() {
+        _server.Stop(0);
+        _server.Join();
+    }
+
+    brpc::Server _server;
+    brpc::Channel _channel;
+};
+
+TEST_F(ThriftTest, echo) {
+    brpc::ThriftFramedMessage req;
+    brpc::ThriftFramedMessage res;
+    brpc::Controller cntl;
+    req.method_name = "Echo";
+    EncodeStruct(&req.body, 1, "hello thrift");
+    _channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    ASSERT_EQ("Echo", res.method_name);
+    ASSERT_EQ(brpc::THRIFT_REPLY, res.message_type);
+    std::string value;
+    ASSERT_TRUE(DecodeStruct(res.body, &value));
+    ASSERT_EQ("hello thrift", value);
+}
+
+TEST_F(ThriftTest, connection_types) {
+    brpc::ChannelOptions chan_options;
+    chan_options.protocol = brpc::PROTOCOL_THRIFT;
+    // seqids are allocated from the context of the connection, which can't
+    // be returned to the pool.
+    chan_options.connection_type = brpc::CONNECTION_TYPE_POOLED;
+    brpc::Channel pooled_channel;
+    ASSERT_EQ(-1, pooled_channel.Init("127.0.0.1", PORT, &chan_options));
+
+    chan_options.connection_type = brpc::CONNECTION_TYPE_SHORT;
+    brpc::Channel short_channel;
+    ASSERT_EQ(0, short_channel.Init("127.0.0.1", PORT, &chan_options));
+    for (int i = 0; i < 3; ++i) {
+        brpc::ThriftFramedMessage req;
+        brpc::ThriftFramedMessage res;
+        brpc::Controller cntl;
+        req.method_name = "Echo";
+        const std::string sent = butil::string_printf("short%d", i);
+        EncodeStruct(&req.body, 1, sent);
+        short_channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        std::string value;
+        ASSERT_TRUE(DecodeStruct(res.body, &value));
+        ASSERT_EQ(sent, value);
+    }
+}
+
+struct CallArgs {
+    brpc::Channel* channel;
+    int sleep_ms;
+    bool ok;
+};
+
+void* CallSleepEcho(void* void_args) {
+    CallArgs* args = (CallArgs*)void_args;
+    brpc::ThriftFramedMessage req;
+    brpc::ThriftFramedMessage res;
+    brpc::Controller cntl;
+    const std::string sent = butil::string_printf("%d", args->sleep_ms);
+    req.method_name = "SleepEcho";
+    EncodeStruct(&req.body, 1, sent);
+    args->channel->CallMethod(NULL, &cntl, &req, &res, NULL);
+    std::string value;
+    args->ok = (!cntl.Failed() && DecodeStruct(res.body, &value) &&
+                value == sent);
+    return NULL;
+}
+
+TEST_F(ThriftTest, multiplexed_calls) {
+    // Earlier calls sleep longer so that responses come back in reversed
+    // order on the single connection and are matched by seqid.
+    const int N = 8;
+    CallArgs args[N];
+    bthread_t th[N];
+    for (int i = 0; i < N; ++i) {
+        args[i].channel = &_channel;
+        args[i].sleep_ms = (N - i) * 20;
+        args[i].ok = false;
+        ASSERT_EQ(0, bthread_start_background(&th[i], NULL,
+                                              CallSleepEcho, &args[i]));
+    }
+    for (int i = 0; i < N; ++i) {
+        bthread_join(th[i], NULL);
+        ASSERT_TRUE(args[i].ok) << "i=" << i;
+    }
+}
+
+TEST_F(ThriftTest, timedout_calls) {
+    for (int i = 0; i < 3; ++i) {
+        brpc::ThriftFramedMessage req;
+        brpc::ThriftFramedMessage res;
+        brpc::Controller cntl;
+        cntl.set_timeout_ms(20);
+        cntl.set_max_retry(0);
+        req.method_name = "SleepEcho";
+        EncodeStruct(&req.body, 1, "100");
+        _channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+        ASSERT_EQ(brpc::ERPCTIMEDOUT, cntl.ErrorCode()) << cntl.ErrorText();
+    }
+    // Late responses of the calls above are dropped and don't confuse
+    // following calls on the connection.
+    bthread_usleep(150 * 1000);
+    brpc::ThriftFramedMessage req;
+    brpc::ThriftFramedMessage res;
+    brpc::Controller cntl;
+    req.method_name = "Echo";
+    EncodeStruct(&req.body, 1, "after timeout");
+    _channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    std::string value;
+    ASSERT_TRUE(DecodeStruct(res.body, &value));
+    ASSERT_EQ("after timeout", value);
+}
+
+TEST_F(ThriftTest, exceptions) {
+    {
+        brpc::ThriftFramedMessage req;
+        brpc::ThriftFramedMessage res;
+        brpc::Controller cntl;
+        req.method_name = "Fail";
+        EncodeStruct(&req.body, 1, "something wrong");
+        _channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+        ASSERT_TRUE(cntl.Failed());
+        ASSERT_EQ(brpc::EINTERNAL, cntl.ErrorCode());
+        ASSERT_NE(std::string::npos, cntl.ErrorText().find("something wrong"))
+            << cntl.ErrorText();
+    }
+    {
+        brpc::ThriftFramedMessage req;
+        brpc::ThriftFramedMessage res;
+        brpc::Controller cntl;
+        req.method_name = "NoSuchMethod";
+        EncodeStruct(&req.body, 1, "");
+        _channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+        ASSERT_EQ(brpc::ENOMETHOD, cntl.ErrorCode()) << cntl.ErrorText();
+    }
+}
+
+TEST_F(ThriftTest, bad_requests) {
+    {
+        brpc::ThriftFramedMessage req;
+        brpc::ThriftFramedMessage res;
+        brpc::Controller cntl;
+        EncodeStruct(&req.body, 1, "no name");
+        _channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+        ASSERT_EQ(brpc::EREQUEST, cntl.ErrorCode());
+    }
+    {
+        brpc::ThriftFramedMessage req;
+        brpc::ThriftFramedMessage res;
+        brpc::Controller cntl;
+        req.method_name = "Echo";
+        req.message_type = brpc::THRIFT_ONEWAY;
+        EncodeStruct(&req.body, 1, "oneway");
+        _channel.CallMethod(NULL, &cntl, &req, &res, NULL);
+        ASSERT_EQ(brpc::EREQUEST, cntl.ErrorCode());
+    }
+}
+
+} //namespace
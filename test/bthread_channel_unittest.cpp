@@ -0,0 +1,300 @@
+// Copyright (c) 2017 Baidu, Inc.
+
+#include <deque>
+#include <gtest/gtest.h>
+#include "butil/atomicops.h"
+#include "butil/time.h"
+#include "bthread/bthread.h"
+#include "bthread/channel.h"
+#include "bthread/condition_variable.h"
+#include "bthread/mutex.h"
+
+namespace {
+
+TEST(ChannelTest, sanity) {
+    bthread::Channel<int> ch(2);
+    ASSERT_EQ(2u, ch.capacity());
+    ASSERT_EQ(0, ch.try_send(1));
+    ASSERT_EQ(0, ch.send(2));
+    ASSERT_EQ(EAGAIN, ch.try_send(3));
+    timespec abstime = butil::milliseconds_from_now(10);
+    ASSERT_EQ(ETIMEDOUT, ch.send(3, &abstime));
+    ASSERT_EQ(2u, ch.size());
+    int v = 0;
+    ASSERT_EQ(0, ch.recv(&v));
+    ASSERT_EQ(1, v);
+    ASSERT_EQ(0, ch.try_recv(&v));
+    ASSERT_EQ(2, v);
+    ASSERT_EQ(EAGAIN, ch.try_recv(&v));
+    abstime = butil::milliseconds_from_now(10);
+    ASSERT_EQ(ETIMEDOUT, ch.recv(&v, &abstime));
+
+    ASSERT_EQ(0, ch.send(3));
+    ch.close();
+    ASSERT_TRUE(ch.closed());
+    ASSERT_EQ(EPIPE, ch.send(4));
+    ASSERT_EQ(0, ch.recv(&v));
+    ASSERT_EQ(3, v);
+    ASSERT_EQ(EPIPE, ch.recv(&v));
+}
+
+const int NITEMS_PER_PRODUCER = 100000;
+
+void* produce(void* arg) {
+    bthread::Channel<int>* ch = static_cast<bthread::Channel<int>*>(arg);
+    for (int i = 1; i <= NITEMS_PER_PRODUCER; ++i) {
+        EXPECT_EQ(0, ch->send(i));
+    }
+    return NULL;
+}
+
+struct ConsumerArg {
+    bthread::Channel<int>* ch;
+    bool batch;
+    int64_t sum;
+};
+
+void* consume(void* void_arg) {
+    ConsumerArg* arg = static_cast<ConsumerArg*>(void_arg);
+    std::vector<int> items;
+    while (true) {
+        items.clear();
+        int rc = 0;
+        if (arg->batch) {
+            rc = arg->ch->recv_batch(&items, 64);
+        } else {
+            items.resize(1);
+            rc = arg->ch->recv(&items[0]);
+        }
+        if (rc == EPIPE) {
+            break;
+        }
+        EXPECT_EQ(0, rc);
+        for (size_t i = 0; i < items.size(); ++i) {
+            arg->sum += items[i];
+        }
+    }
+    return NULL;
+}
+
+void run_producers_and_consumers(bool batch) {
+    const int NPRODUCER = 4;
+    const int NCONSUMER = 4;
+    bthread::Channel<int> ch(128);
+    bthread_t producers[NPRODUCER];
+    bthread_t consumers[NCONSUMER];
+    ConsumerArg args[NCONSUMER];
+    butil::Timer tm;
+    tm.start();
+    for (int i = 0; i < NCONSUMER; ++i) {
+        args[i].ch = &ch;
+        args[i].batch = batch;
+        args[i].sum = 0;
+        ASSERT_EQ(0, bthread_start_background(&consumers[i], NULL,
+                                              consume, &args[i]));
+    }
+    for (int i = 0; i < NPRODUCER; ++i) {
+        ASSERT_EQ(0, bthread_start_background(&producers[i], NULL,
+                                              produce, &ch));
+    }
+    for (int i = 0; i < NPRODUCER; ++i) {
+        ASSERT_EQ(0, bthread_join(producers[i], NULL));
+    }
+    ch.close();
+    int64_t sum = 0;
+    for (int i = 0; i < NCONSUMER; ++i) {
+        ASSERT_EQ(0, bthread_join(consumers[i], NULL));
+        sum += args[i].sum;
+    }
+    tm.stop();
+    ASSERT_EQ((int64_t)NPRODUCER * NITEMS_PER_PRODUCER *
+              (NITEMS_PER_PRODUCER + 1) / 2, sum);
+    LOG(INFO) << "Channel" << (batch ? " with recv_batch: " : ": ")
+              << tm.n_elapsed() / (NPRODUCER * NITEMS_PER_PRODUCER)
+              << "ns/item";
+}
+
+TEST(ChannelTest, producers_and_consumers) {
+    run_producers_and_consumers(false);
+}
+
+TEST(ChannelTest, producers_and_consumers_with_recv_batch) {
+    run_producers_and_consumers(true);
+}
+
+// The hand-rolled bounded queue that Channel replaces.
+class MutexCondQueue {
+public:
+    explicit MutexCondQueue(size_t cap) : _cap(cap), _closed(false) {}
+    void send(int v) {
+        std::unique_lock<bthread::Mutex> lck(_mutex);
+        while (_q.size() >= _cap) {
+            _not_full.wait(lck);
+        }
+        _q.push_back(v);
+        _not_empty.notify_one();
+    }
+    bool recv(int* v) {
+        std::unique_lock<bthread::Mutex> lck(_mutex);
+        while (_q.empty()) {
+            if (_closed) {
+                return false;
+            }
+            _not_empty.wait(lck);
+        }
+        *v = _q.front();
+        _q.pop_front();
+        _not_full.notify_one();
+        return true;
+    }
+    void close() {
+        BAIDU_SCOPED_LOCK(_mutex);
+        _closed = true;
+        _not_empty.notify_all();
+    }
+private:
+    bthread::Mutex _mutex;
+    bthread::ConditionVariable _not_empty;
+    bthread::ConditionVariable _not_full;
+    std::deque<int> _q;
+    size_t _cap;
+    bool _closed;
+};
+
+void* produce_to_mutex_cond_queue(void* arg) {
+    MutexCondQueue* q = static_cast<MutexCondQueue*>(arg);
+    for (int i = 1; i <= NITEMS_PER_PRODUCER; ++i) {
+        q->send(i);
+    }
+    return NULL;
+}
+
+struct MutexCondConsumerArg {
+    MutexCondQueue* q;
+    int64_t sum;
+};
+
+void* consume_from_mutex_cond_queue(void* void_arg) {
+    MutexCondConsumerArg* arg = static_cast<MutexCondConsumerArg*>(void_arg);
+    int v = 0;
+    while (arg->q->recv(&v)) {
+        arg->sum += v;
+    }
+    return NULL;
+}
+
+TEST(ChannelTest, producers_and_consumers_with_mutex_and_cond) {
+    const int NPRODUCER = 4;
+    const int NCONSUMER = 4;
+    MutexCondQueue q(128);
+    bthread_t producers[NPRODUCER];
+    bthread_t consumers[NCONSUMER];
+    MutexCondConsumerArg args[NCONSUMER];
+    butil::Timer tm;
+    tm.start();
+    for (int i = 0; i < NCONSUMER; ++i) {
+        args[i].q = &q;
+        args[i].sum = 0;
+        ASSERT_EQ(0, bthread_start_background(
+                      &consumers[i], NULL, consume_from_mutex_cond_queue, &args[i]));
+    }
+    for (int i = 0; i < NPRODUCER; ++i) {
+        ASSERT_EQ(0, bthread_start_background(
+                      &producers[i], NULL, produce_to_mutex_cond_queue, &q));
+    }
+    for (int i = 0; i < NPRODUCER; ++i) {
+        ASSERT_EQ(0, bthread_join(producers[i], NULL));
+    }
+    q.close();
+    int64_t sum = 0;
+    for (int i = 0; i < NCONSUMER; ++i) {
+        ASSERT_EQ(0, bthread_join(consumers[i], NULL));
+        sum += args[i].sum;
+    }
+    tm.stop();
+    ASSERT_EQ((int64_t)NPRODUCER * NITEMS_PER_PRODUCER *
+              (NITEMS_PER_PRODUCER + 1) / 2, sum);
+    LOG(INFO) << "mutex+cond queue: "
+              << tm.n_elapsed() / (NPRODUCER * NITEMS_PER_PRODUCER)
+              << "ns/item";
+}
+
+struct SelectArg {
+    bthread::Channel<int>** chans;
+    size_t n;
+    int64_t sum;
+    int count[3];
+};
+
+void* select_all(void* void_arg) {
+    SelectArg* arg = static_cast<SelectArg*>(void_arg);
+    int v = 0;
+    size_t index = 0;
+    int rc = 0;
+    while ((rc = bthread::channel_select(arg->chans, arg->n, &v, &index)) == 0) {
+        arg->sum += v;
+        ++arg->count[index];
+    }
+    EXPECT_EQ(EPIPE, rc);
+    return NULL;
+}
+
+TEST(ChannelTest, select) {
+    bthread::Channel<int> ch1(4);
+    bthread::Channel<int> ch2(4);
+    bthread::Channel<int> ch3(4);
+    bthread::Channel<int>* chans[] = { &ch1, &ch2, &ch3 };
+    int v = 0;
+    const timespec abstime = butil::milliseconds_from_now(10);
+    ASSERT_EQ(ETIMEDOUT, bthread::channel_select(chans, 3, &v, NULL, &abstime));
+
+    SelectArg arg = { chans, 3, 0, { 0, 0, 0 } };
+    bthread_t selector;
+    ASSERT_EQ(0, bthread_start_background(&selector, NULL, select_all, &arg));
+    bthread_t producers[3];
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(0, bthread_start_background(&producers[i], NULL,
+                                              produce, chans[i]));
+    }
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(0, bthread_join(producers[i], NULL));
+        chans[i]->close();
+    }
+    ASSERT_EQ(0, bthread_join(selector, NULL));
+    ASSERT_EQ((int64_t)3 * NITEMS_PER_PRODUCER *
+              (NITEMS_PER_PRODUCER + 1) / 2, arg.sum);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(NITEMS_PER_PRODUCER, arg.count[i]);
+    }
+}
+
+struct RecvArg {
+    bthread::Channel<int>* ch;
+    int rc;
+};
+
+void* recv_one(void* void_arg) {
+    RecvArg* arg = static_cast<RecvArg*>(void_arg);
+    int v = 0;
+    arg->rc = arg->ch->recv(&v);
+    return NULL;
+}
+
+TEST(ChannelTest, close_wakes_up_receivers) {
+    bthread::Channel<int> ch(1);
+    bthread_t th[4];
+    RecvArg args[4];
+    for (int i = 0; i < 4; ++i) {
+        args[i].ch = &ch;
+        args[i].rc = -1;
+        ASSERT_EQ(0, bthread_start_background(&th[i], NULL, recv_one, &args[i]));
+    }
+    bthread_usleep(10000);
+    ch.close();
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], NULL));
+        ASSERT_EQ(EPIPE, args[i].rc);
+    }
+}
+
+} // namespace
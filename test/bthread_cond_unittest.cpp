@@ -4,6 +4,7 @@
 
 #include <map>
 #include <gtest/gtest.h>
+#include <gflags/gflags.h>
 #include "butil/atomicops.h"
 #include "butil/time.h"
 #include "butil/macros.h"
@@ -13,6 +14,10 @@
 #include "bthread/condition_variable.h"
 #include "bthread/stack.h"
 
+namespace bthread {
+DECLARE_int32(bthread_mutex_starvation_us);
+}
+
 namespace {
 struct Arg {
     bthread_mutex_t m;
@@ -450,4 +455,90 @@ TEST(CondTest, too_many_bthreads_from_bthread) {
     ASSERT_EQ(0, bthread_start_urgent(&th, NULL, run_launch_many_bthreads, NULL));
     bthread_join(th, NULL);
 }
+
+struct HandoffArg {
+    bthread::Mutex m;
+    bthread::ConditionVariable c;
+    int64_t generation;
+    butil::atomic<bool> stopped;
+    butil::atomic<int64_t> nwoken;
+};
+
+void* handoff_waiter(void* void_arg) {
+    HandoffArg* a = (HandoffArg*)void_arg;
+    std::unique_lock<bthread::Mutex> lck(a->m);
+    while (!a->stopped.load(butil::memory_order_relaxed)) {
+        const int64_t generation = a->generation;
+        while (generation == a->generation &&
+               !a->stopped.load(butil::memory_order_relaxed)) {
+            a->c.wait(lck);
+        }
+        a->nwoken.fetch_add(1, butil::memory_order_relaxed);
+    }
+    return NULL;
+}
+
+void* handoff_locker(void* void_arg) {
+    HandoffArg* a = (HandoffArg*)void_arg;
+    while (!a->stopped.load(butil::memory_order_relaxed)) {
+        BAIDU_SCOPED_LOCK(a->m);
+        bthread_usleep(10);
+    }
+    return NULL;
+}
+
+void* handoff_broadcaster(void* void_arg) {
+    HandoffArg* a = (HandoffArg*)void_arg;
+    while (!a->stopped.load(butil::memory_order_relaxed)) {
+        {
+            BAIDU_SCOPED_LOCK(a->m);
+            ++a->generation;
+        }
+        a->c.notify_all();
+        bthread_usleep(100);
+    }
+    return NULL;
+}
+
+TEST(CondTest, broadcast_with_mutex_handoff) {
+    // Waiters requeued onto the mutex by broadcasting must be able to take
+    // the mutex handed off by unlock, otherwise they sleep forever.
+    GFLAGS_NS::FlagSaver flag_saver;
+    bthread::FLAGS_bthread_mutex_starvation_us = 1;
+    HandoffArg a;
+    a.generation = 0;
+    a.stopped = false;
+    a.nwoken = 0;
+    const int N = 8;
+    bthread_t waiters[N];
+    bthread_t lockers[N];
+    bthread_t bth;
+    for (int i = 0; i < N; ++i) {
+        ASSERT_EQ(0, bthread_start_background(
+                      &waiters[i], NULL, handoff_waiter, &a));
+        ASSERT_EQ(0, bthread_start_background(
+                      &lockers[i], NULL, handoff_locker, &a));
+    }
+    ASSERT_EQ(0, bthread_start_background(&bth, NULL, handoff_broadcaster, &a));
+    int64_t last_nwoken = 0;
+    for (int i = 0; i < 10; ++i) {
+        usleep(200 * 1000);
+        const int64_t nwoken = a.nwoken.load(butil::memory_order_relaxed);
+        // Broadcasts keep waking up waiters.
+        ASSERT_GT(nwoken, last_nwoken) << "i=" << i;
+        last_nwoken = nwoken;
+    }
+    a.stopped = true;
+    bthread_join(bth, NULL);
+    {
+        BAIDU_SCOPED_LOCK(a.m);
+        ++a.generation;
+    }
+    a.c.notify_all();
+    for (int i = 0; i < N; ++i) {
+        bthread_join(waiters[i], NULL);
+        bthread_join(lockers[i], NULL);
+    }
+    LOG(INFO) << "nwoken=" << a.nwoken.load();
+}
 } // namespace
@@ -0,0 +1,73 @@
+// Copyright (c) 2017 Baidu, Inc.
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include "butil/fd_guard.h"
+#include "butil/files/temp_file.h"
+#include "butil/logging.h"
+#include "bthread/bthread.h"
+#include "bthread/unstable.h"
+
+namespace {
+
+struct FileIOArgs {
+    int fd;
+    int index;
+};
+
+static void* write_and_read_back(void* void_arg) {
+    FileIOArgs* arg = static_cast<FileIOArgs*>(void_arg);
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "%08d", arg->index);
+    const off_t offset = arg->index * len;
+    EXPECT_EQ(len, bthread_file_pwrite(arg->fd, buf, len, offset));
+    char buf2[32];
+    EXPECT_EQ(len, bthread_file_pread(arg->fd, buf2, len, offset));
+    EXPECT_EQ(0, memcmp(buf, buf2, len));
+    return NULL;
+}
+
+TEST(FileIOTest, pread_pwrite_in_bthreads) {
+    butil::TempFile tmp;
+    butil::fd_guard fd(open(tmp.fname(), O_RDWR));
+    ASSERT_GE(fd, 0);
+    const int N = 100;
+    FileIOArgs args[N];
+    bthread_t th[N];
+    for (int i = 0; i < N; ++i) {
+        args[i].fd = fd;
+        args[i].index = i;
+        ASSERT_EQ(0, bthread_start_background(
+                      &th[i], NULL, write_and_read_back, &args[i]));
+    }
+    for (int i = 0; i < N; ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], NULL));
+    }
+    ASSERT_EQ(0, bthread_file_fsync(fd));
+    // Check the content from pthread.
+    char buf[16];
+    for (int i = 0; i < N; ++i) {
+        ASSERT_EQ(8, bthread_file_pread(fd, buf, 8, i * 8));
+        ASSERT_EQ(i, atoi(std::string(buf, 8).c_str()));
+    }
+}
+
+static void* read_invalid_fd(void*) {
+    char buf[8];
+    EXPECT_EQ(-1, bthread_file_read(-1, buf, sizeof(buf)));
+    EXPECT_EQ(EBADF, errno);
+    EXPECT_EQ(-1, bthread_file_write(-1, buf, sizeof(buf)));
+    EXPECT_EQ(EBADF, errno);
+    EXPECT_EQ(-1, bthread_file_fsync(-1));
+    EXPECT_EQ(EBADF, errno);
+    return NULL;
+}
+
+TEST(FileIOTest, errno_is_set) {
+    read_invalid_fd(NULL);
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(&th, NULL, read_invalid_fd, NULL));
+    ASSERT_EQ(0, bthread_join(th, NULL));
+}
+
+} // namespace
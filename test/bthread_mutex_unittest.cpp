@@ -3,6 +3,7 @@
 // Date: Sun Jul 13 15:04:18 CST 2014
 
 #include <gtest/gtest.h>
+#include <gflags/gflags.h>
 #include "butil/time.h"
 #include "butil/macros.h"
 #include "butil/string_printf.h"
@@ -13,6 +14,11 @@
 #include "bthread/mutex.h"
 #include "butil/gperftools_profiler.h"
 
+namespace bthread {
+DECLARE_int32(bthread_mutex_max_spin);
+DECLARE_int32(bthread_mutex_starvation_us);
+}
+
 namespace {
 inline unsigned* get_butex(bthread_mutex_t & m) {
     return m.butex;
@@ -252,4 +258,75 @@ TEST(MutexTest, mix_thread_types) {
         pthread_join(pthreads[i], NULL);
     }
 }
+
+struct FairnessArg {
+    bthread::Mutex* m;
+    int64_t* shared_counter;
+    int64_t nlocked;
+    int64_t ntimedout;
+};
+
+void* lock_until_stopped(void* void_arg) {
+    FairnessArg* arg = (FairnessArg*)void_arg;
+    while (!g_stopped) {
+        timespec abstime = butil::milliseconds_from_now(2);
+        const int rc = bthread_mutex_timedlock(arg->m->native_handler(), &abstime);
+        if (rc == ETIMEDOUT) {
+            ++arg->ntimedout;
+            continue;
+        }
+        EXPECT_EQ(0, rc);
+        // Not atomic, broken if two threads are inside the lock together.
+        const int64_t c = *arg->shared_counter;
+        bthread_usleep(10);
+        *arg->shared_counter = c + 1;
+        ++arg->nlocked;
+        arg->m->unlock();
+    }
+    return NULL;
+}
+
+TEST(MutexTest, spin_and_handoff) {
+    // Restore the flags even if an assertion fails.
+    GFLAGS_NS::FlagSaver flag_saver;
+    bthread::FLAGS_bthread_mutex_max_spin = 100;
+    bthread::FLAGS_bthread_mutex_starvation_us = 100;
+    g_stopped = false;
+    const int N = 8;
+    bthread::Mutex m;
+    int64_t shared_counter = 0;
+    FairnessArg args[N * 2];
+    pthread_t pthreads[N];
+    bthread_t bthreads[N];
+    for (int i = 0; i < N * 2; ++i) {
+        args[i].m = &m;
+        args[i].shared_counter = &shared_counter;
+        args[i].nlocked = 0;
+        args[i].ntimedout = 0;
+    }
+    for (int i = 0; i < N; ++i) {
+        ASSERT_EQ(0, pthread_create(&pthreads[i], NULL, lock_until_stopped, &args[i]));
+        ASSERT_EQ(0, bthread_start_background(
+                      &bthreads[i], NULL, lock_until_stopped, &args[N + i]));
+    }
+    usleep(500 * 1000);
+    g_stopped = true;
+    for (int i = 0; i < N; ++i) {
+        pthread_join(pthreads[i], NULL);
+        bthread_join(bthreads[i], NULL);
+    }
+    int64_t total = 0;
+    int64_t ntimedout = 0;
+    for (int i = 0; i < N * 2; ++i) {
+        // Every thread got the lock.
+        ASSERT_GT(args[i].nlocked, 0) << "i=" << i;
+        total += args[i].nlocked;
+        ntimedout += args[i].ntimedout;
+    }
+    ASSERT_EQ(total, shared_counter);
+    LOG(INFO) << "nlocked=" << total << " ntimedout=" << ntimedout;
+    // The mutex is still usable after handoffs and timeouts.
+    ASSERT_TRUE(m.try_lock());
+    m.unlock();
+}
 } // namespace
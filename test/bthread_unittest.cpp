@@ -4,6 +4,7 @@
 
 #include <execinfo.h>
 #include <gtest/gtest.h>
+#include <gflags/gflags.h>
 #include "butil/time.h"
 #include "butil/macros.h"
 #include "butil/logging.h"
@@ -12,6 +13,16 @@
 #include "bthread/bthread.h"
 #include "bthread/unstable.h"
 #include "bthread/task_meta.h"
+#include "bthread/task_control.h"
+
+namespace bthread {
+DECLARE_int32(task_group_max_spin_us);
+DECLARE_int32(task_group_spin_cpu_percent);
+extern butil::atomic<TaskControl*> g_task_control;
+inline TaskControl* get_task_control() {
+    return g_task_control.load(butil::memory_order_consume);
+}
+}
 
 namespace {
 class BthreadTest : public ::testing::Test{
@@ -392,6 +403,102 @@ TEST_F(BthreadTest, start_latency_when_high_idle) {
               << elp2 / REP << "ns";
 }
 
+TEST_F(BthreadTest, start_latency_with_spinning_workers) {
+    const int32_t saved_max_spin_us = bthread::FLAGS_task_group_max_spin_us;
+    const int32_t saved_spin_cpu_percent =
+        bthread::FLAGS_task_group_spin_cpu_percent;
+    bthread::FLAGS_task_group_max_spin_us = 100;
+    bthread::FLAGS_task_group_spin_cpu_percent = 10;
+    bthread::TaskControl* c = bthread::get_task_control();
+    ASSERT_TRUE(c);
+    const double spin_time0 = c->get_cumulated_spin_time();
+    const int64_t spin_found0 = c->get_cumulated_spin_found_count();
+    butil::Timer wall;
+    wall.start();
+    long elp = 0;
+    int REP = 0;
+    for (int i = 0; i < 10000; ++i) {
+        butil::Timer tm;
+        tm.start();
+        bthread_t th;
+        ASSERT_EQ(0, bthread_start_background(&th, NULL, log_start_latency, &tm));
+        ASSERT_EQ(0, bthread_join(th, NULL));
+        if (i >= 100) {
+            ++REP;
+            elp += tm.n_elapsed();
+        }
+    }
+    wall.stop();
+    const double spin_time = c->get_cumulated_spin_time() - spin_time0;
+    const int64_t spin_found = c->get_cumulated_spin_found_count() - spin_found0;
+    bthread::FLAGS_task_group_max_spin_us = saved_max_spin_us;
+    bthread::FLAGS_task_group_spin_cpu_percent = saved_spin_cpu_percent;
+    LOG(INFO) << "start_background=" << elp / REP << "ns with spinning"
+              << " spin_time=" << spin_time << "s spin_found=" << spin_found;
+    // Workers are woken up by tasks started at short intervals, some of the
+    // tasks must be caught by spinning.
+    ASSERT_GT(spin_found, 0);
+    // Each worker starts with at most max_spin_us of budget and is refilled
+    // with spin_cpu_percent of the elapsed time. Double the bound to tolerate
+    // spins that overrun the deadline.
+    const double max_spin_time = c->concurrency() *
+        (100 / 1000000.0 + wall.n_elapsed() / 1000000000.0 * 10 / 100.0) * 2;
+    ASSERT_LE(spin_time, max_spin_time);
+}
+
+static void* add_one(void* arg) {
+    static_cast<butil::atomic<int>*>(arg)->fetch_add(1);
+    return NULL;
+}
+
+static void* start_batch_and_join(void* arg) {
+    const size_t N = 100;
+    butil::atomic<int>* counter = static_cast<butil::atomic<int>*>(arg);
+    bthread_t tids[N];
+    void* args[N];
+    for (size_t i = 0; i < N; ++i) {
+        args[i] = counter;
+    }
+    EXPECT_EQ(0, bthread_start_batch(tids, N, NULL, add_one, args));
+    for (size_t i = 0; i < N; ++i) {
+        EXPECT_NE(INVALID_BTHREAD, tids[i]);
+        EXPECT_EQ(0, bthread_join(tids[i], NULL));
+    }
+    return NULL;
+}
+
+TEST_F(BthreadTest, start_batch) {
+    butil::atomic<int> counter(0);
+    bthread_t tids[1];
+    ASSERT_EQ(0, bthread_start_batch(tids, 0, NULL, add_one, NULL));
+    ASSERT_EQ(EINVAL, bthread_start_batch(tids, 1, NULL, NULL, NULL));
+
+    // from non-worker
+    start_batch_and_join(&counter);
+    ASSERT_EQ(100, counter.load());
+
+    // from worker
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_urgent(&th, NULL, start_batch_and_join, &counter));
+    ASSERT_EQ(0, bthread_join(th, NULL));
+    ASSERT_EQ(200, counter.load());
+
+    // nosignal
+    const size_t N = 10;
+    void* args[N];
+    for (size_t i = 0; i < N; ++i) {
+        args[i] = &counter;
+    }
+    bthread_t tids2[N];
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL | BTHREAD_NOSIGNAL;
+    ASSERT_EQ(0, bthread_start_batch(tids2, N, &attr, add_one, args));
+    bthread_flush();
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_EQ(0, bthread_join(tids2[i], NULL));
+    }
+    ASSERT_EQ(210, counter.load());
+}
+
 void* sleep_for_awhile_with_sleep(void* arg) {
     bthread_usleep((intptr_t)arg);
     return NULL;
@@ -0,0 +1,176 @@
+// Copyright (c) 2014 Baidu, Inc.
+
+#include <pthread.h>
+#include <map>
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/logging.h"
+#include "bvar/bvar.h"
+
+namespace {
+
+std::list<std::string> make_list(const char* a, const char* b) {
+    std::list<std::string> l;
+    l.push_back(a);
+    l.push_back(b);
+    return l;
+}
+
+class MapDumper : public bvar::Dumper {
+public:
+    bool dump(const std::string& name, const butil::StringPiece& desc) {
+        _names.push_back(name);
+        _values[name] = desc.as_string();
+        return true;
+    }
+    std::vector<std::string> _names;
+    std::map<std::string, std::string> _values;
+};
+
+class MultiDimensionTest : public testing::Test {
+protected:
+    void SetUp() {}
+    void TearDown() {}
+};
+
+TEST_F(MultiDimensionTest, get_and_delete_stats) {
+    bvar::MultiDimension<bvar::Adder<int> > md(make_list("method", "peer"));
+    ASSERT_EQ(2UL, md.count_labels());
+    ASSERT_EQ(0UL, md.count_stats());
+
+    std::list<std::string> one_value;
+    one_value.push_back("Echo");
+    ASSERT_TRUE(md.get_stats(one_value) == NULL);
+
+    const std::list<std::string> k1 = make_list("Echo", "127.0.0.1");
+    const std::list<std::string> k2 = make_list("Echo", "127.0.0.2");
+    ASSERT_FALSE(md.has_stats(k1));
+    bvar::Adder<int>* s1 = md.get_stats(k1);
+    ASSERT_TRUE(s1 != NULL);
+    ASSERT_EQ(s1, md.get_stats(k1));
+    *s1 << 2 << 3;
+    bvar::Adder<int>* s2 = md.get_stats(k2);
+    ASSERT_TRUE(s2 != NULL);
+    ASSERT_NE(s1, s2);
+    ASSERT_EQ(2UL, md.count_stats());
+    ASSERT_EQ(5, md.get_stats(k1)->get_value());
+
+    std::vector<std::list<std::string> > keys;
+    md.list_stats(&keys);
+    ASSERT_EQ(2UL, keys.size());
+
+    md.delete_stats(k1);
+    ASSERT_FALSE(md.has_stats(k1));
+    ASSERT_TRUE(md.has_stats(k2));
+    ASSERT_EQ(1UL, md.count_stats());
+    md.clear_stats();
+    ASSERT_EQ(0UL, md.count_stats());
+}
+
+TEST_F(MultiDimensionTest, max_stats_count) {
+    const int saved = bvar::FLAGS_bvar_max_multi_dimension_stats_count;
+    bvar::FLAGS_bvar_max_multi_dimension_stats_count = 3;
+    bvar::MultiDimension<bvar::Maxer<int> > md(make_list("a", "b"));
+    ASSERT_TRUE(md.get_stats(make_list("1", "1")));
+    ASSERT_TRUE(md.get_stats(make_list("1", "2")));
+    ASSERT_TRUE(md.get_stats(make_list("1", "3")));
+    ASSERT_TRUE(md.get_stats(make_list("1", "4")) == NULL);
+    // Existing stats are still available.
+    ASSERT_TRUE(md.get_stats(make_list("1", "2")));
+    bvar::FLAGS_bvar_max_multi_dimension_stats_count = saved;
+}
+
+TEST_F(MultiDimensionTest, expose_and_dump) {
+    const size_t old_count = bvar::MVariable::count_exposed();
+    bvar::MultiDimension<bvar::Adder<int> > md(
+        "md_test_request_count", make_list("method", "peer"));
+    ASSERT_EQ("md_test_request_count", md.name());
+    ASSERT_EQ(old_count + 1, bvar::MVariable::count_exposed());
+    bvar::MultiDimension<bvar::Adder<int> > dup(
+        "md_test_request_count", make_list("method", "peer"));
+    ASSERT_TRUE(dup.name().empty());
+
+    *md.get_stats(make_list("Search", "b")) << 1;
+    *md.get_stats(make_list("Echo", "b")) << 2;
+    *md.get_stats(make_list("Echo", "a")) << 3;
+
+    MapDumper dumper;
+    bvar::DumpOptions opt;
+    opt.white_wildcards = "md_test_*";
+    ASSERT_EQ(3, bvar::MVariable::dump_exposed(&dumper, &opt));
+    ASSERT_EQ(3UL, dumper._names.size());
+    // Sorted by label values.
+    ASSERT_EQ("md_test_request_count{method=\"Echo\",peer=\"a\"}",
+              dumper._names[0]);
+    ASSERT_EQ("md_test_request_count{method=\"Echo\",peer=\"b\"}",
+              dumper._names[1]);
+    ASSERT_EQ("md_test_request_count{method=\"Search\",peer=\"b\"}",
+              dumper._names[2]);
+    ASSERT_EQ("3", dumper._values[dumper._names[0]]);
+
+    MapDumper dumper2;
+    opt.black_wildcards = "md_test_request_count";
+    ASSERT_EQ(0, bvar::MVariable::dump_exposed(&dumper2, &opt));
+
+    ASSERT_TRUE(md.hide());
+    ASSERT_EQ(old_count, bvar::MVariable::count_exposed());
+}
+
+TEST_F(MultiDimensionTest, escape_label_values) {
+    bvar::MultiDimension<bvar::Adder<int> > md(
+        "md_test_escape_count", make_list("path", "peer"));
+    *md.get_stats(make_list("C:\\dir \"x\"", "a\nb")) << 1;
+
+    MapDumper dumper;
+    bvar::DumpOptions opt;
+    opt.white_wildcards = "md_test_escape_count";
+    ASSERT_EQ(1, bvar::MVariable::dump_exposed(&dumper, &opt));
+    ASSERT_EQ("md_test_escape_count{path=\"C:\\\\dir \\\"x\\\"\","
+              "peer=\"a\\nb\"}", dumper._names[0]);
+}
+
+TEST_F(MultiDimensionTest, latency_recorder) {
+    bvar::MultiDimension<bvar::LatencyRecorder> md(
+        "md_test", "latency", make_list("method", "peer"));
+    bvar::LatencyRecorder* rec = md.get_stats(make_list("Echo", "a"));
+    ASSERT_TRUE(rec != NULL);
+    *rec << 10 << 20;
+    MapDumper dumper;
+    ASSERT_EQ(6, md.dump(&dumper, NULL));
+    ASSERT_EQ(1UL, dumper._values.count(
+                  "md_test_latency_count{method=\"Echo\",peer=\"a\"}"));
+    ASSERT_EQ(1UL, dumper._values.count(
+                  "md_test_latency_latency_99{method=\"Echo\",peer=\"a\"}"));
+}
+
+static void* get_stats_thread(void* arg) {
+    bvar::MultiDimension<bvar::Adder<int> >* md =
+        (bvar::MultiDimension<bvar::Adder<int> >*)arg;
+    char buf[16];
+    for (int i = 0; i < 10000; ++i) {
+        snprintf(buf, sizeof(buf), "%d", i % 16);
+        *md->get_stats(make_list("x", buf)) << 1;
+    }
+    return NULL;
+}
+
+TEST_F(MultiDimensionTest, multi_threaded) {
+    bvar::MultiDimension<bvar::Adder<int> > md(make_list("a", "b"));
+    pthread_t th[8];
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, pthread_create(&th[i], NULL, get_stats_thread, &md));
+    }
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        pthread_join(th[i], NULL);
+    }
+    ASSERT_EQ(16UL, md.count_stats());
+    int sum = 0;
+    std::vector<std::list<std::string> > keys;
+    md.list_stats(&keys);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        sum += md.get_stats(keys[i])->get_value();
+    }
+    ASSERT_EQ(80000, sum);
+}
+
+}  // namespace
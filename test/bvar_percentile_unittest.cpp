@@ -4,6 +4,8 @@
 // Date: 2015/09/15 15:42:55
 
 #include "bvar/detail/percentile.h"
+#include "bvar/detail/histogram.h"
+#include "bvar/latency_recorder.h"
 #include "butil/logging.h"
 #include <gtest/gtest.h>
 #include <fstream>
@@ -172,3 +174,88 @@ TEST_F(PercentileTest, combine_of) {
                   
     }
 }
+
+TEST_F(PercentileTest, histogram_buckets) {
+    using namespace bvar::detail;
+    size_t last_index = 0;
+    for (uint64_t v = 0; v <= std::numeric_limits<uint32_t>::max();
+         v = (v < 100000 ? v + 1 : v * 1.01)) {
+        const size_t index = histogram_bucket_index(v);
+        ASSERT_LT(index, HISTOGRAM_NUM_BUCKETS);
+        ASSERT_GE(index, last_index);
+        ASSERT_LE(histogram_bucket_lower(index), v);
+        ASSERT_GT(histogram_bucket_lower(index) +
+                  histogram_bucket_width(index), v);
+        // Bounded relative error.
+        ASSERT_LE(histogram_bucket_width(index) * HISTOGRAM_SUB_BUCKETS,
+                  std::max(v, (uint64_t)HISTOGRAM_SUB_BUCKETS));
+        last_index = index;
+    }
+    ASSERT_EQ(HISTOGRAM_NUM_BUCKETS - 1,
+              histogram_bucket_index(std::numeric_limits<uint32_t>::max()));
+}
+
+TEST_F(PercentileTest, histogram_add_and_merge) {
+    bvar::detail::HistogramPercentile p;
+    bvar::detail::GlobalHistogram merged;
+    for (int j = 0; j < 10; ++j) {
+        for (int i = 0; i < 100000; ++i) {
+            p << (i + 1);
+        }
+        bvar::detail::GlobalHistogram h = p.reset();
+        ASSERT_EQ(100000u, h.added_count());
+        for (int k = 1; k <= 10000; ++k) {
+            const double expected = k * 10;
+            const double value = h.get_number(k / 10000.0);
+            ASSERT_LE(fabs(value - expected) / expected,
+                      1.0 / (2 * bvar::detail::HISTOGRAM_SUB_BUCKETS))
+                << "k=" << k;
+        }
+        merged.merge(h);
+    }
+    ASSERT_EQ(1000000u, merged.added_count());
+    bvar::detail::GlobalHistogram h;
+    for (int i = 0; i < 100000; ++i) {
+        h.add(i + 1);
+    }
+    // Merging is exact.
+    for (size_t i = 0; i < bvar::detail::HISTOGRAM_NUM_BUCKETS; ++i) {
+        ASSERT_EQ(h.count_at(i) * 10, merged.count_at(i));
+    }
+    ASSERT_EQ(h.get_number(0.9999), merged.get_number(0.9999));
+}
+
+TEST_F(PercentileTest, latency_recorder_with_histogram) {
+    bvar::LatencyRecorder rec;
+    ASSERT_FALSE(rec.histogram_percentile_enabled());
+    bvar::LatencyHistogram h;
+    ASSERT_EQ(-1, rec.latency_histogram(&h));
+    ASSERT_EQ(0, rec.enable_histogram_percentile());
+    ASSERT_TRUE(rec.histogram_percentile_enabled());
+    ASSERT_EQ(0, rec.expose("histogram_test"));
+    for (int i = 0; i < 10000; ++i) {
+        rec << (i + 1);
+    }
+    usleep(1100000);
+    ASSERT_EQ(0, rec.latency_histogram(&h));
+    ASSERT_EQ(10000u, h.added_count());
+    const int64_t p99 = rec.latency_percentile(0.99);
+    ASSERT_LE(std::abs(p99 - 9900), 9900 / 64) << p99;
+    ASSERT_EQ(p99, rec.latency_percentiles()[2]);
+
+    bvar::LatencyRecorder rec2;
+    rec2 << 1;
+    ASSERT_EQ(-1, rec2.enable_histogram_percentile());
+
+    bvar::LatencyRecorder rec3("histogram_test3");
+    ASSERT_EQ(-1, rec3.enable_histogram_percentile());
+
+    // The cdf and percentiles reading the histogram are hidden along with
+    // other vars.
+    const std::string cdf_name = rec.latency_cdf_name();
+    const std::string percentiles_name = rec.latency_percentiles_name();
+    ASSERT_FALSE(bvar::Variable::describe_exposed(cdf_name).empty());
+    rec.hide();
+    ASSERT_TRUE(bvar::Variable::describe_exposed(cdf_name).empty());
+    ASSERT_TRUE(bvar::Variable::describe_exposed(percentiles_name).empty());
+}
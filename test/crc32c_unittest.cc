@@ -9,6 +9,9 @@
 
 #include <gtest/gtest.h>
 #include "butil/crc32c.h"
+#include "butil/iobuf.h"
+#include "butil/fast_rand.h"
+#include "butil/time.h"
 
 namespace butil {
 namespace crc32c {
@@ -61,6 +64,58 @@ TEST_F(CRC, Extend) {
             Extend(Value("hello ", 6), "world", 5));
 }
 
+TEST_F(CRC, LargeBuffers) {
+  std::string data(200000, '\0');
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (char)butil::fast_rand();
+  }
+  // Large buffers are computed by multiple streams in parallel, the result
+  // must be same with extending small pieces one by one.
+  const size_t sizes[] = { 767, 768, 769, 8192 * 3 - 1, 8192 * 3,
+                           8192 * 3 + 7, 100000, 200000 - 3 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    for (size_t offset = 0; offset < 3; ++offset) {
+      const char* p = data.data() + offset;
+      uint32_t expected = 0;
+      for (size_t j = 0; j < sizes[i]; j += 100) {
+        expected = Extend(expected, p + j, std::min((size_t)100, sizes[i] - j));
+      }
+      ASSERT_EQ(expected, Value(p, sizes[i])) << sizes[i] << " " << offset;
+    }
+  }
+}
+
+TEST_F(CRC, IOBuf) {
+  std::string data;
+  butil::IOBuf buf;
+  for (int i = 0; i < 100; ++i) {
+    std::string s(butil::fast_rand_less_than(20000), 'a' + i % 26);
+    data.append(s);
+    buf.append(s);
+    // Break the continuity of blocks.
+    butil::IOBuf gap;
+    gap.append("-");
+  }
+  ASSERT_GT(buf.backing_block_num(), 1u);
+  ASSERT_EQ(Value(data.data(), data.size()), Value(buf));
+  ASSERT_EQ(Extend(123, data.data(), data.size()), Extend(123, buf));
+  ASSERT_EQ(0u, Value(butil::IOBuf()));
+}
+
+TEST_F(CRC, perf) {
+  std::string data(1024 * 1024, 'x');
+  butil::Timer t;
+  t.start();
+  uint32_t crc = 0;
+  for (int i = 0; i < 100; ++i) {
+    crc = Extend(crc, data.data(), data.size());
+  }
+  t.stop();
+  std::cout << "crc32c of 1MB takes " << t.u_elapsed() / 100 << "us, "
+            << data.size() * 100 * 1000.0 / t.n_elapsed() << "MB/s"
+            << std::endl;
+}
+
 TEST_F(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
@@ -13,6 +13,8 @@
 #include <butil/time.h>                 // Timer
 #include <butil/fd_utility.h>           // make_non_blocking
 #include <butil/iobuf.h>
+#include <butil/iobuf_slab_allocator.h>
+#include <butil/iobuf_profiler.h>
 #include <butil/logging.h>
 #include <butil/fd_guard.h>
 #include <butil/errno.h>
@@ -819,6 +821,89 @@ TEST_F(IOBufTest, cut_into_fd_a_lot_of_data) {
     close(fds[1]);
 }
 
+TEST_F(IOBufTest, find_and_count) {
+    butil::IOBuf b;
+    std::string expected;
+    // Make the content spread over blocks of different sizes.
+    for (int i = 0; i < 200; ++i) {
+        butil::IOBuf piece;
+        std::string s(butil::fast_rand_less_than(100) + 1, 'a' + i % 26);
+        s.append(i % 3 == 0 ? "\r\n" : "\n");
+        piece.append(s);
+        b.append(piece);
+        expected.append(s);
+        // Make next piece not adjacent with this one in the block.
+        butil::IOBuf gap;
+        gap.append("#");
+    }
+    ASSERT_GT(b.backing_block_num(), 100u);
+    ASSERT_EQ(expected, b.to_string());
+    ASSERT_EQ((size_t)std::count(expected.begin(), expected.end(), '\n'),
+              b.count('\n'));
+    ASSERT_EQ(0u, b.count('#'));
+    for (size_t pos = 0; pos < expected.size(); pos += 7) {
+        ASSERT_EQ(expected.find('\n', pos), b.find('\n', pos));
+        ASSERT_EQ(expected.find("\r\n", pos), b.find("\r\n", pos));
+        ASSERT_EQ(expected.find("\nbbb", pos), b.find("\nbbb", pos));
+    }
+    ASSERT_EQ(butil::IOBuf::npos, b.find('#'));
+    ASSERT_EQ(butil::IOBuf::npos, b.find(""));
+    ASSERT_EQ(butil::IOBuf::npos, b.find('\n', expected.size()));
+    ASSERT_EQ(butil::IOBuf::npos, b.find("\n\n"));
+
+    // Delimiters crossing blocks and longer than 8 bytes.
+    butil::IOBuf b2;
+    b2.append(std::string("hello wo"));
+    b2.append(butil::IOBuf(b2));  // share the block
+    butil::IOBuf tail;
+    tail.append(std::string("rld, bye"));
+    b2.append(tail);
+    ASSERT_EQ("hello wohello world, bye", b2.to_string());
+    ASSERT_EQ(8u, b2.find("hello world"));
+    butil::IOBuf out;
+    ASSERT_EQ(0, b2.cut_until(&out, "hello world"));
+    ASSERT_EQ("hello wo", out.to_string());
+    ASSERT_EQ(", bye", b2.to_string());
+}
+
+TEST_F(IOBufTest, find_perf) {
+    std::string line(200, 'x');
+    line.append("\r\n");
+    butil::IOBuf b;
+    for (int i = 0; i < 2000; ++i) {
+        b.append(line);
+    }
+    // Scan all bytes byte by byte as a baseline.
+    butil::Timer t;
+    t.start();
+    size_t nlf = 0;
+    for (size_t i = 0; i < b.backing_block_num(); ++i) {
+        const butil::StringPiece blk = b.backing_block(i);
+        for (size_t j = 0; j < blk.size(); ++j) {
+            nlf += (blk[j] == '\n');
+        }
+    }
+    t.stop();
+    ASSERT_EQ(2000u, nlf);
+    LOG(INFO) << "Scanning bytes one by one: "
+              << b.size() * 1000.0 / t.n_elapsed() << "MB/s";
+    t.start();
+    ASSERT_EQ(butil::IOBuf::npos, b.find("\r\n\r\n"));
+    t.stop();
+    LOG(INFO) << "IOBuf::find(char*): "
+              << b.size() * 1000.0 / t.n_elapsed() << "MB/s";
+    t.start();
+    ASSERT_EQ(butil::IOBuf::npos, b.find('#'));
+    t.stop();
+    LOG(INFO) << "IOBuf::find(char): "
+              << b.size() * 1000.0 / t.n_elapsed() << "MB/s";
+    t.start();
+    ASSERT_EQ(2000u, b.count('\n'));
+    t.stop();
+    LOG(INFO) << "IOBuf::count: "
+              << b.size() * 1000.0 / t.n_elapsed() << "MB/s";
+}
+
 TEST_F(IOBufTest, cut_by_delim_perf) {
     butil::iobuf::reset_blockmem_allocate_and_deallocate();
     
@@ -1551,4 +1636,181 @@ TEST_F(IOBufTest, copy_to_string_from_iterator) {
     }
     ASSERT_EQ(nc, b0.length());
 }
+static int s_user_data_deleted = 0;
+static void delete_user_data(void* data) {
+    ++s_user_data_deleted;
+    delete [] static_cast<char*>(data);
+}
+
+TEST_F(IOBufTest, append_user_data) {
+    const size_t N = 1024 * 1024;
+    char* data = new char[N];
+    for (size_t i = 0; i < N; ++i) {
+        data[i] = 'a' + i % 26;
+    }
+    const std::string expected(data, N);
+    s_user_data_deleted = 0;
+    {
+        butil::IOBuf buf;
+        buf.append("head");
+        ASSERT_EQ(0, buf.append_user_data(data, N, delete_user_data));
+        buf.append("tail");
+        ASSERT_EQ(N + 8, buf.length());
+        ASSERT_EQ("head" + expected + "tail", buf.to_string());
+
+        // Cut in the middle of the user data and append elsewhere.
+        butil::IOBuf front;
+        buf.cutn(&front, 4 + N / 2);
+        butil::IOBuf copy;
+        copy.append(front);
+        ASSERT_EQ("head" + expected.substr(0, N / 2), copy.to_string());
+        ASSERT_EQ(expected.substr(N / 2) + "tail", buf.to_string());
+        front.clear();
+        copy.clear();
+        ASSERT_EQ(0, s_user_data_deleted);
+
+        // Write the remaining into a file.
+        butil::TempFile tmp;
+        butil::fd_guard fd(open(tmp.fname(), O_RDWR));
+        ASSERT_GE(fd, 0);
+        off_t offset = 0;
+        while (!buf.empty()) {
+            const ssize_t nw = buf.pcut_into_file_descriptor(fd, offset);
+            ASSERT_GT(nw, 0);
+            offset += nw;
+        }
+        ASSERT_EQ(1, s_user_data_deleted);
+        ASSERT_EQ((off_t)(N - N / 2 + 4), offset);
+        butil::IOPortal portal;
+        while (portal.length() < (size_t)offset) {
+            ASSERT_GT(portal.pappend_from_file_descriptor(
+                          fd, portal.length(), offset), 0);
+        }
+        ASSERT_EQ(expected.substr(N / 2) + "tail", portal.to_string());
+    }
+
+    // Zero-length data is released immediately.
+    ASSERT_EQ(0, butil::IOBuf().append_user_data(
+                  new char[1], 0, delete_user_data));
+    ASSERT_EQ(2, s_user_data_deleted);
+}
+
+TEST_F(IOBufTest, compact_portal) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    const std::string data(50, 'x');
+    ASSERT_EQ((ssize_t)data.size(), write(fds[1], data.data(), data.size()));
+    butil::IOPortal p;
+    ASSERT_EQ((ssize_t)data.size(), p.append_from_file_descriptor(fds[0], 4096));
+    ASSERT_TRUE(p._block != NULL);
+    ASSERT_FALSE(p.compact(data.size() - 1));
+    ASSERT_TRUE(p._block != NULL);
+    ASSERT_TRUE(p.compact(data.size()));
+    ASSERT_TRUE(p._block == NULL);
+    ASSERT_EQ(data, p.to_string());
+    // Reading again after compaction.
+    ASSERT_EQ(4, write(fds[1], "tail", 4));
+    ASSERT_EQ(4, p.append_from_file_descriptor(fds[0], 4096));
+    ASSERT_EQ(data + "tail", p.to_string());
+    p.clear();
+    ASSERT_FALSE(p.compact(100));
+    ASSERT_EQ(0, close(fds[0]));
+    ASSERT_EQ(0, close(fds[1]));
+}
+
+TEST_F(IOBufTest, slab_allocator) {
+    void* (*saved_allocate)(size_t) = butil::iobuf::blockmem_allocate;
+    void (*saved_deallocate)(void*) = butil::iobuf::blockmem_deallocate;
+    butil::iobuf::remove_tls_block_chain();
+
+    // Blocks allocated by malloc before installation.
+    butil::iobuf::reset_blockmem_allocate_and_deallocate();
+    butil::IOBuf before;
+    before.append(std::string(100000, 'b'));
+
+    ASSERT_EQ(0, butil::iobuf::install_slab_allocator(64 * 1024 * 1024));
+    ASSERT_EQ((void*)butil::iobuf::slab_allocate,
+              (void*)butil::iobuf::blockmem_allocate);
+    std::string expected;
+    std::vector<butil::IOBuf> bufs(100);
+    for (size_t i = 0; i < bufs.size(); ++i) {
+        std::string s(butil::fast_rand_less_than(50000) + 1, 'a' + i % 26);
+        bufs[i].append(s);
+        expected.append(s);
+    }
+    ASSERT_GT(butil::iobuf::slab_block_count(1), 0u);
+    ASSERT_GT(butil::iobuf::slab_memory(), 0u);
+    butil::IOBuf all;
+    for (size_t i = 0; i < bufs.size(); ++i) {
+        all.append(bufs[i]);
+    }
+    ASSERT_EQ(expected, all.to_string());
+
+    // Blocks of other sizes.
+    ASSERT_EQ(0, butil::iobuf::set_default_block_size(butil::IOBuf::MAX_BLOCK_SIZE));
+    butil::iobuf::remove_tls_block_chain();
+    butil::IOBuf big;
+    big.append(expected);
+    ASSERT_GT(butil::iobuf::slab_block_count(2), 0u);
+    ASSERT_EQ(expected, big.to_string());
+    ASSERT_EQ(0, butil::iobuf::set_default_block_size(butil::IOBuf::DEFAULT_BLOCK_SIZE));
+    ASSERT_EQ(-1, butil::iobuf::set_default_block_size(butil::IOBuf::MAX_BLOCK_SIZE + 1));
+
+    before.clear();
+    bufs.clear();
+    all.clear();
+    big.clear();
+    butil::iobuf::remove_tls_block_chain();
+    butil::iobuf::uninstall_slab_allocator();
+    ASSERT_EQ((void*)::malloc, (void*)butil::iobuf::blockmem_allocate);
+    // Blocks allocated from slabs are still freed by the deallocator.
+    ASSERT_EQ((void*)butil::iobuf::slab_deallocate,
+              (void*)butil::iobuf::blockmem_deallocate);
+    butil::iobuf::blockmem_allocate = saved_allocate;
+    butil::iobuf::blockmem_deallocate = saved_deallocate;
+}
+
+TEST_F(IOBufTest, block_profiler) {
+    butil::iobuf::remove_tls_block_chain();
+    ASSERT_EQ(0u, butil::iobuf::block_sampling_rate());
+    ASSERT_EQ(0u, butil::iobuf::sampled_block_count());
+    butil::iobuf::set_block_sampling_rate(1);
+    butil::IOBuf buf;
+    buf.append(std::string(100000, 'a'));
+    butil::iobuf::remove_tls_block_chain();
+    const size_t nsampled = butil::iobuf::sampled_block_count();
+    ASSERT_GE(nsampled, buf.backing_block_num());
+
+    std::string prof;
+    butil::iobuf::dump_block_profile(&prof);
+    std::ostringstream expected_header;
+    expected_header << "heap profile: " << nsampled << ": "
+                    << nsampled * butil::iobuf::default_block_size();
+    ASSERT_EQ(0u, prof.find(expected_header.str())) << prof.substr(0, 100);
+    ASSERT_NE(std::string::npos, prof.find("\nMAPPED_LIBRARIES:\n"));
+
+    // Freed blocks are not tracked anymore even if sampling is off.
+    butil::iobuf::set_block_sampling_rate(0);
+    buf.clear();
+    ASSERT_EQ(0u, butil::iobuf::sampled_block_count());
+    buf.append(std::string(100000, 'b'));
+    ASSERT_EQ(0u, butil::iobuf::sampled_block_count());
+
+    // One in every 4 blocks are sampled.
+    butil::iobuf::set_block_sampling_rate(4);
+    std::vector<butil::IOBuf> bufs(40);
+    for (size_t i = 0; i < bufs.size(); ++i) {
+        bufs[i].append(std::string(butil::iobuf::default_block_size(), 'c'));
+    }
+    ASSERT_GE(butil::iobuf::sampled_block_count(), 10u);
+    ASSERT_LE(butil::iobuf::sampled_block_count(), 21u);
+    prof.clear();
+    butil::iobuf::dump_block_profile(&prof);
+    ASSERT_EQ(0u, prof.find("heap profile: ")) << prof.substr(0, 100);
+    butil::iobuf::set_block_sampling_rate(0);
+    bufs.clear();
+    buf.clear();
+    butil::iobuf::remove_tls_block_chain();
+    ASSERT_EQ(0u, butil::iobuf::sampled_block_count());
+}
 } // namespace